@@ -1,3 +1,4 @@
+# Superseded by PiecewiseLinearRewriter in cxx/, which learns its model from the data at Init.
 import numpy as np
 import sys
 import scipy.stats as stats
@@ -1,24 +1,112 @@
 /*
  * Benchmark for sorting algorithms on partially sorted data (e.g. merging multiple sorted lists
- * together)
+ * together), and for the key sorts used to build clustered indexes.
  */
 
 #include <vector>
 #include <algorithm>
+#include <parallel/algorithm>
 #include <random>
 #include <chrono>
+#include <string>
 
 #include "timsort.hpp"
 #include "merge_utils.h"
+#include "radix_sort.h"
+#include "types.h"
 
+// Generates n keys from the named distribution.
+std::vector<Scalar> generate_keys(size_t n, const std::string& distribution) {
+    std::default_random_engine gen(1);
+    std::vector<Scalar> keys(n);
+    if (distribution == "uniform") {
+        std::uniform_int_distribution<Scalar> dist(std::numeric_limits<Scalar>::lowest(),
+                std::numeric_limits<Scalar>::max());
+        for (auto& k : keys) {
+            k = dist(gen);
+        }
+    } else if (distribution == "small_domain") {
+        std::uniform_int_distribution<Scalar> dist(0, 1000);
+        for (auto& k : keys) {
+            k = dist(gen);
+        }
+    } else if (distribution == "skewed") {
+        std::exponential_distribution<double> dist(1e-6);
+        for (auto& k : keys) {
+            k = (Scalar)dist(gen);
+        }
+    } else if (distribution == "almost_sorted") {
+        std::uniform_int_distribution<size_t> dist(0, n - 1);
+        for (size_t i = 0; i < n; i++) {
+            keys[i] = i;
+        }
+        for (size_t i = 0; i < n / 100; i++) {
+            std::swap(keys[dist(gen)], keys[dist(gen)]);
+        }
+    }
+    return keys;
+}
 
-int main() {
+// Compares the ways of sorting (key, position) pairs when building a clustered index.
+void benchmark_key_sorts() {
+    std::vector<size_t> sizes = {100000, 1000000, 10000000};
+    std::vector<std::string> distributions = {"uniform", "small_domain", "skewed", "almost_sorted"};
+    for (size_t n : sizes) {
+        for (const std::string& distribution : distributions) {
+            std::vector<Scalar> keys = generate_keys(n, distribution);
+            std::vector<std::pair<Scalar, size_t>> pairs(n);
+            for (size_t i = 0; i < n; i++) {
+                pairs[i] = std::make_pair(keys[i], i);
+            }
+            auto pair_cmp = [](const std::pair<Scalar, size_t>& a, const std::pair<Scalar, size_t>& b) {
+                return a.first < b.first;
+            };
+
+            auto pairs1 = pairs;
+            auto start = std::chrono::high_resolution_clock::now();
+            // The sequential tag keeps std::stable_sort sequential even with _GLIBCXX_PARALLEL.
+            __gnu_parallel::stable_sort(pairs1.begin(), pairs1.end(), pair_cmp,
+                    __gnu_parallel::sequential_tag());
+            auto end = std::chrono::high_resolution_clock::now();
+            auto t_std = std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count();
+
+            auto pairs2 = pairs;
+            start = std::chrono::high_resolution_clock::now();
+            __gnu_parallel::stable_sort(pairs2.begin(), pairs2.end(), pair_cmp);
+            end = std::chrono::high_resolution_clock::now();
+            auto t_gnu = std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count();
+
+            std::vector<Scalar> radix_keys = keys;
+            std::vector<size_t> order(n);
+            for (size_t i = 0; i < n; i++) {
+                order[i] = i;
+            }
+            start = std::chrono::high_resolution_clock::now();
+            RadixSort::Sort(radix_keys, order);
+            end = std::chrono::high_resolution_clock::now();
+            auto t_radix = std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count();
+
+            for (size_t i = 0; i < n; i++) {
+                if (order[i] != pairs1[i].second || order[i] != pairs2[i].second) {
+                    std::cout << "Sort results differ at position " << i << std::endl;
+                    break;
+                }
+            }
+            std::cout << "n = " << n << ", keys = " << distribution
+                << ": std::stable_sort " << t_std / 1e3 << "us"
+                << ", __gnu_parallel::stable_sort " << t_gnu / 1e3 << "us"
+                << ", RadixSort " << t_radix / 1e3 << "us" << std::endl;
+        }
+    }
+}
+
+void benchmark_partially_sorted() {
     const size_t NVECS = 50;
     
     std::default_random_engine gen;
     std::uniform_int_distribution<size_t> dist(1,1<<30);
     
-    std::vector<std::vector<size_t> *> vecs;
+    std::vector<const std::vector<size_t> *> vecs;
     for (size_t i = 0; i < NVECS; i++) {
         auto v = new std::vector<size_t>();
         v->reserve(200000);
@@ -60,7 +148,11 @@ int main() {
     std::cout << merge_vec[merge_vec.size()/2] << std::endl;
     tt = std::chrono::duration_cast<std::chrono::nanoseconds>(end_merge-start_merge).count();
     std::cout << "std::sort time: " << tt / 1e3 << "us" << std::endl;
+}
 
+int main() {
+    benchmark_partially_sorted();
+    benchmark_key_sorts();
     return 0;
 }
 
@@ -0,0 +1,57 @@
+/*
+ * Builds the mapping, target bucket and outlier artifacts for a MappedCorrelationIndex from a
+ * dataset that is already sorted by the primary index. See correlation_map_builder.h.
+ */
+
+#include <iostream>
+#include <chrono>
+#include <sysexits.h>
+#include <vector>
+
+#include "types.h"
+#include "flags.h"
+#include "correlation_map_builder.h"
+#include "mapping_artifacts.h"
+#include "utils.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    if (argc < 6) {
+        std::cerr << "Expected arguments: --dataset --mapped-column --targets --output "
+            << "--storage-factor [--bucket-width | --num-buckets]" << std::endl;
+        return EX_USAGE;
+    }
+    auto flags = ParseFlags(argc, argv);
+
+    cout << "Dimension is " << DIM << endl;
+    std::string dataset_file = GetRequired(flags, "dataset");
+    std::vector<Point<DIM>> data = load_binary_file< Point<DIM> >(dataset_file);
+    size_t mapped_column = std::stoi(GetRequired(flags, "mapped-column"));
+    AssertWithMessage(mapped_column < DIM, "Mapped column out of range");
+    TargetBucketsArtifact targets(GetRequired(flags, "targets"));
+    float storage_factor = std::stof(GetRequired(flags, "storage-factor"));
+    cout << "Loaded " << data.size() << " points and " << targets.View().num_buckets
+        << " target buckets" << endl;
+
+    CorrelationMapBuilder<DIM> builder(mapped_column, storage_factor);
+    std::string num_buckets = GetWithDefault(flags, "num-buckets", "");
+    if (!num_buckets.empty()) {
+        builder.SetNumBuckets(std::stoul(num_buckets));
+    } else {
+        builder.SetBucketWidth(std::stoll(GetRequired(flags, "bucket-width")));
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    builder.Build(data.cbegin(), data.cend(), targets.View());
+    auto end = std::chrono::high_resolution_clock::now();
+    cout << "Built correlation map in "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms"
+        << endl;
+
+    std::string prefix = GetRequired(flags, "output");
+    builder.Write(prefix);
+    cout << "Wrote " << prefix << ".mapping, " << prefix << ".targets and " << prefix
+        << ".outliers" << endl;
+    return 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * Converts the text mapping and target bucket files, and raw outlier lists, written by the
+ * correlation scripts into the binary artifact format (see mapping_artifacts.h), which the
+ * indexes can mmap instead of parsing.
+ */
+
+#include <iostream>
+#include <chrono>
+#include <sysexits.h>
+
+#include "types.h"
+#include "flags.h"
+#include "mapping_artifacts.h"
+#include "utils.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "Expected arguments: --kind=<mapping|target-buckets|outliers> "
+            << "--input --output" << std::endl;
+        return EX_USAGE;
+    }
+    auto flags = ParseFlags(argc, argv);
+    std::string kind = GetRequired(flags, "kind");
+    std::string input = GetRequired(flags, "input");
+    std::string output = GetRequired(flags, "output");
+
+    auto start = std::chrono::high_resolution_clock::now();
+    if (kind == "mapping") {
+        MappingArtifact mapping(input);
+        const MappingView& view = mapping.View();
+        MappingArtifacts::WriteMapping(view, output);
+        cout << "Wrote " << view.num_buckets << " mapped buckets and " << view.num_mappings
+            << " mappings" << endl;
+    } else if (kind == "target-buckets") {
+        TargetBucketsArtifact targets(input);
+        MappingArtifacts::WriteTargetBuckets(targets.View(), output);
+        cout << "Wrote " << targets.View().num_buckets << " target buckets" << endl;
+    } else if (kind == "outliers") {
+        IndexList rows = MappingArtifacts::LoadOutliers(input);
+        MappingArtifacts::WriteOutliers(rows, output);
+        cout << "Wrote " << rows.size() << " outliers" << endl;
+    } else {
+        std::cerr << "Unrecognized artifact kind " << kind << std::endl;
+        return EX_USAGE;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    cout << "Converted " << input << " to " << output << " in "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms"
+        << endl;
+    return 0;
+}
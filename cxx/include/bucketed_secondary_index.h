@@ -5,9 +5,21 @@
 #include <string>
 #include <fstream>
 
+#include "cpp-btree/btree_map.h"
 #include "secondary_indexer.h"
 #include "types.h"
+#include "row_ids.h"
 
+/*
+ * Secondary index that groups the indexed points into buckets by value. Each bucket keeps its rows
+ * in increasing order, so they're naturally partitioned into blocks of 2^BLOCK_BITS rows, and the
+ * blocks of each bucket are recorded explicitly.
+ *
+ * Matches unions the buckets overlapping the query block by block: a block that only one bucket
+ * contributes to is copied as is, and blocks shared by several buckets are merged through a small
+ * bitmap. When the result is too sparse for that to pay off, the buckets are merged row by row with
+ * a loser tree instead. Buckets that only partially overlap the query are filtered by value first.
+ */
 template <size_t D>
 class BucketedSecondaryIndex : public SecondaryIndexer<D> {
   public:
@@ -22,20 +34,15 @@ class BucketedSecondaryIndex : public SecondaryIndexer<D> {
 
     void Init(ConstPointIterator<D> start, ConstPointIterator<D> end) override;
 
-    IndexList Matches(const Query<D>& q) const override; 
+    MatchResult Matches(const Query<D>& q) const override; 
 
     void SetBucketFile(const std::string& filename);
     void SetBucketWidth(Scalar width);
     
     size_t Size() const override {
-        size_t s = 0;
-        size_t keys = 0;
-        for (auto it = buckets_.begin(); it != buckets_.end(); it++) {
-            s += it->second.size() * sizeof(PhysicalIndex) + sizeof(std::vector<PhysicalIndex>);
-            keys++;
-        }
-        s += keys * 10; // 10 bytes of overhead on a random insertion benchmark (~2 * 4.9 for 64-bit)
-        return s;
+        return bucket_keys_.size() * (3 * sizeof(Scalar) + 2 * sizeof(size_t))
+            + rows_.Bytes() + values_.size() * sizeof(Scalar)
+            + block_ids_.size() * (sizeof(uint64_t) + sizeof(size_t));
     }
 
     void WriteStats(std::ofstream& statsfile) override {
@@ -43,8 +50,28 @@ class BucketedSecondaryIndex : public SecondaryIndexer<D> {
     }
 
   private:
+    // A sorted list of rows together with its blocks. Block i holds the rows from
+    // block_starts[i] up to block_starts[i+1].
+    template <typename R>
+    struct BlockedList {
+        const R* rows;
+        const uint64_t* block_ids;
+        const size_t* block_starts;
+        size_t num_blocks;
+    };
+
     // Add to the buckets_ map, but don't order this value with the other existing ones.
     void InsertUnsorted(PhysicalIndex index, Scalar v);
+
+    // Matches against the stored rows, which are of type R.
+    template <typename R>
+    MatchResult MatchesWithRows(const std::vector<R>& rows, const QueryFilter& filter) const;
+    // Unions the lists block by block into out.
+    template <typename R>
+    void MergeBlocks(const std::vector<BlockedList<R>>& lists, std::vector<R>* out) const;
+    // Unions the lists row by row into out.
+    template <typename R>
+    void MergeRows(const std::vector<BlockedList<R>>& lists, std::vector<R>* out) const;
     
     BucketingStrategy bucket_strat_;
     size_t data_size_;
@@ -56,8 +83,31 @@ class BucketedSecondaryIndex : public SecondaryIndexer<D> {
     // Whether to use the custom index_subset_
     bool use_subset_;
     IndexList index_subset_;
-    // For each map bucket (key is the start value of the map bucket range), 
+    // For each map bucket (key is the start value of the map bucket range), the rows that fall
+    // into it. Only used while building; Init flattens this into the arrays below.
     btree::btree_map<Scalar, IndexList> buckets_;
+
+    // Start value of each non-empty bucket, in increasing order, and the smallest and largest
+    // value actually in the bucket.
+    std::vector<Scalar> bucket_keys_;
+    std::vector<Scalar> bucket_mins_;
+    std::vector<Scalar> bucket_maxs_;
+    // Rows of each bucket, in increasing order, and their values. Bucket b holds the entries from
+    // bucket_offsets_[b] up to bucket_offsets_[b+1].
+    std::vector<size_t> bucket_offsets_;
+    RowIds rows_;
+    std::vector<Scalar> values_;
+    // The blocks of every bucket, one after the other: the block number and the offset of its
+    // first row in rows_, followed by a final rows_.size(). Bucket b owns the blocks from
+    // bucket_blocks_[b] up to bucket_blocks_[b+1].
+    std::vector<size_t> bucket_blocks_;
+    std::vector<uint64_t> block_ids_;
+    std::vector<size_t> block_starts_;
+
+    static const size_t BLOCK_BITS = 12;
+    static const size_t BLOCK_WORDS = (1 << BLOCK_BITS) / 64;
+    // Below this many rows per block, on average, rows are merged directly.
+    static const size_t MIN_ROWS_PER_BLOCK = 8;
 };
 
 #include "../src/bucketed_secondary_index.hpp"
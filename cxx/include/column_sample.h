@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "types.h"
+
+/*
+ * A sorted, evenly strided sample of one column, used to estimate the fraction of rows a filter
+ * matches. Values are assumed to be independent of their position, so the stride doesn't bias
+ * the sample.
+ */
+class ColumnSample {
+  public:
+    ColumnSample() : values_() {}
+
+    template <typename It>
+    ColumnSample(It start, It end, size_t column, size_t max_size) : values_() {
+        size_t n = std::distance(start, end);
+        size_t stride = std::max<size_t>(1, n / std::max<size_t>(1, max_size));
+        values_.reserve(n / stride + 1);
+        for (size_t i = 0; i < n; i += stride) {
+            values_.push_back((*(start + i))[column]);
+        }
+        std::sort(values_.begin(), values_.end());
+    }
+
+    // Estimated fraction of rows matching the filter. Never 0, since a filter that matches no
+    // sampled value can still match rows outside the sample.
+    double Selectivity(const QueryFilter& qf) const {
+        if (!qf.present || values_.empty()) {
+            return 1.0;
+        }
+        size_t matches = 0;
+        if (qf.is_range) {
+            for (const ScalarRange& r : qf.ranges) {
+                matches += std::upper_bound(values_.begin(), values_.end(), r.second)
+                    - std::lower_bound(values_.begin(), values_.end(), r.first);
+            }
+        } else {
+            for (Scalar v : qf.values) {
+                auto range = std::equal_range(values_.begin(), values_.end(), v);
+                matches += range.second - range.first;
+            }
+        }
+        return std::min(1.0, std::max(0.5, (double)matches) / values_.size());
+    }
+
+    size_t Size() const { return values_.size() * sizeof(Scalar); }
+
+  private:
+    std::vector<Scalar> values_;
+};
@@ -54,7 +54,7 @@ class CombinedCorrelationIndex : public CorrelationIndexer<D> {
         std::cout << "## forcing time: " << mapped_ranges.ranges.size() << std::endl;
         PhysicalIndexSet ret;
         if (outlier_index_) {
-            IndexList lst = outlier_index_->Matches(q);
+            IndexList lst = outlier_index_->Matches(q).ToList();
             std::cout << "## forcing time: " << (lst.empty() || lst[0] > 1000) << std::endl;
             mid2 = std::chrono::high_resolution_clock::now();
             ret = MergeUtils::Union(mapped_ranges.ranges, lst);
@@ -1,18 +1,26 @@
 #pragma once
 
 #include <vector>
+#include <map>
 #include <memory>
 #include <fstream>
+#include <string>
+#include <unordered_map>
 
 #include "types.h"
+#include "column_sample.h"
 #include "primary_indexer.h"
 #include "secondary_indexer.h"
 #include "correlation_indexer.h"
 #include "rewriter.h"
 
 /*
- * An index that combines other indexes together. It allows at most one primary index and multiple
- * secondary indexes.
+ * An index that combines other indexes together. It allows at most one primary index, and any mix
+ * of secondary indexes, correlation indexes and rewriters.
+ *
+ * A query runs as a pipeline: the rewriters widen the filters on their target columns, the primary
+ * index looks up the rewritten query (plus the rewriters' auxiliary rows), and the correlation and
+ * secondary indexes the plan picks are intersected in, most selective first.
  */
 template <size_t D>
 class CompositeIndex : public PrimaryIndexer<D> {
@@ -30,6 +38,11 @@ class CompositeIndex : public PrimaryIndexer<D> {
     virtual void Init(PointIterator<D> start, PointIterator<D> end) override;
 
     PhysicalIndexSet Ranges(Query<D>& q) override; 
+    RoaringSet RangesBitmap(Query<D>& q) override;
+
+    bool MovesRowsOnQuery() const override {
+        return primary_index_ != NULL && primary_index_->MovesRowsOnQuery();
+    }
     
     size_t Size() const override {
         size_t s = 0;
@@ -63,7 +76,40 @@ class CompositeIndex : public PrimaryIndexer<D> {
     // Public for testing.
     std::vector<size_t> Intersect(const std::vector<size_t>&, const std::vector<size_t>&) const;
 
+    // A sub-index that can narrow down the primary index's result. Costs are in rows scanned
+    // sequentially.
+    struct Candidate {
+        std::string name;
+        // Estimated fraction of the rows it returns.
+        double selectivity;
+        double lookup_cost;
+        // True if it returns a list of rows, which are scanned at random.
+        bool is_list;
+    };
+    // Picks the candidates worth intersecting with a result of the given number of rows, in the
+    // order to apply them: most selective first, as long as each one lowers the estimated cost of
+    // the lookups plus the final scan.
+    // Public for testing.
+    std::vector<size_t> ChoosePlan(size_t rows, bool is_list,
+            const std::vector<Candidate>& candidates) const;
+
+    // Pins the sub-indexes that queries look up, by candidate name (e.g. "secondary_3"), in the
+    // order to apply them, instead of letting ChoosePlan pick. Named sub-indexes that don't filter
+    // a query are skipped. An empty list goes back to the cost-based plan.
+    void ForcePlan(const std::vector<std::string>& names) { forced_plan_ = names; }
+
+    // The sub-indexes used for the last query, in the order they were applied, e.g.
+    // "primary+secondary_3". Rewriter queries that fall back to a full scan use "full_scan".
+    const std::string& LastPlan() const { return last_plan_; }
+
     void WriteStats(std::ofstream& statsfile) override {
+        statsfile << "primary_build_time_ns: " << primary_build_time_ns_ << std::endl;
+        for (size_t i = 0; i < build_names_.size(); i++) {
+            statsfile << "build_time_ns_" << build_names_[i] << ": " << build_times_ns_[i] << std::endl;
+        }
+        for (const auto& p : plan_counts_) {
+            statsfile << "plan_" << p.first << ": " << p.second << std::endl;
+        }
         if (primary_index_) {
             primary_index_->WriteStats(statsfile);
         }
@@ -77,12 +123,31 @@ class CompositeIndex : public PrimaryIndexer<D> {
 
   private:
     PhysicalIndexSet RangesWithPrimary(Query<D>& q);
-    PhysicalIndexSet RangesWithRewriter(Query<D>& q);
-    PhysicalIndexSet RangesWithSecondary(Query<D>& q);
-    PhysicalIndexSet RangesWithCorrelation(Query<D>& q);
+    // Runs the rewriters, which widen the query's filters on their target columns, then the
+    // primary index on the rewritten query. Sets plan to the steps taken.
+    PhysicalIndexSet RangesWithRewriters(Query<D>& q, std::string* plan);
+    // Number of sub-index builds to run at once, so that their combined working memory fits in
+    // what is currently available.
+    size_t MaxConcurrentBuilds(size_t num_builds) const;
+
+    // The correlation and secondary indexes that filter the query, as plan candidates. Candidates
+    // [0, correlations->size()) are the correlation indexes and the rest are secondary.
+    std::vector<Candidate> PlanCandidates(const Query<D>& q,
+            std::vector<CorrelationIndexer<D>*>* correlations,
+            std::vector<SecondaryIndexer<D>*>* secondaries) const;
+    // Estimated fraction of rows matching the query on all the given columns, assuming they're
+    // independent.
+    double Selectivity(const std::vector<size_t>& columns, const Query<D>& q) const;
+    // The forced plan if there is one, or else ChoosePlan's.
+    std::vector<size_t> PlanFor(size_t rows, bool is_list,
+            const std::vector<Candidate>& candidates) const;
+    // Turns runs of the list whose gaps are within the gap threshold into ranges.
+    PhysicalIndexSet MergeGaps(const PhysicalIndexSet& s) const;
+    void RecordPlan(const std::string& plan);
+    static size_t NumRows(const PhysicalIndexSet& s);
     
     // If consecutive matching indexes are at or below this gap threshold, includes them in a single
-    // range. Otherwise, truncates the old range and starts a new one.
+    // range. Otherwise, truncates the old range and starts a new one. At 0, matches stay a list.
     size_t gap_threshold_;
     // Number of points indexed. 
     size_t data_size_;
@@ -93,6 +158,30 @@ class CompositeIndex : public PrimaryIndexer<D> {
     std::vector<std::unique_ptr<SecondaryIndexer<D>>> secondary_indexes_;
     std::vector<std::unique_ptr<CorrelationIndexer<D>>> correlation_indexes_;
     std::vector<std::unique_ptr<Rewriter<D>>> rewriters_;
+
+    // Build time of the primary index, and of each other sub-index (named by type and column).
+    long primary_build_time_ns_;
+    std::vector<std::string> build_names_;
+    std::vector<long> build_times_ns_;
+
+    // Samples of the columns with a secondary or correlation index, for the plan's estimates.
+    std::unordered_map<size_t, ColumnSample> column_samples_;
+    std::vector<std::string> forced_plan_;
+    std::string last_plan_;
+    // Number of queries that used each plan.
+    std::map<std::string, size_t> plan_counts_;
+
+    // Maximum number of values sampled from each column.
+    static const size_t SAMPLE_SIZE = 1 << 14;
+    // Cost of scanning a row from a list, of producing a row from a secondary index and of
+    // producing a row from a correlation index, relative to scanning a row in a range.
+    static constexpr double LIST_ROW_COST = 4.0;
+    static constexpr double MATCH_ROW_COST = 1.0;
+    static constexpr double CORRELATION_ROW_COST = 0.05;
+
+    // Assumed peak working memory of a single sub-index build, per indexed point. This covers a
+    // sort of (key, position) pairs plus the output structure.
+    static const size_t BUILD_BYTES_PER_POINT = 64;
 };
 
 #include "../src/composite_index.hpp"
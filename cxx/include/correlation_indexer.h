@@ -7,6 +7,7 @@
 #include "types.h"
 #include "dataset.h"
 #include "indexer.h"
+#include "roaring_set.h"
 
 template <size_t D>
 using ConstPointIterator = typename std::vector<Point<D>>::const_iterator;
@@ -23,6 +24,11 @@ class CorrelationIndexer : public Indexer<D> {
     // ranges of VirtualIndices to check.
     virtual PhysicalIndexSet Ranges(const Query<D>& query) const = 0;
 
+    // The same indexes as Ranges, as a compressed bitmap.
+    virtual RoaringSet RangesBitmap(const Query<D>& query) const {
+        return RoaringSet::FromIndexSet(Ranges(query));
+    }
+
     virtual void Init(ConstPointIterator<D> start, ConstPointIterator<D> end) = 0;
 
     // Size of the indexer in bytes
@@ -30,6 +36,19 @@ class CorrelationIndexer : public Indexer<D> {
 
     virtual size_t GetMappedColumn() const { return column_; }    
 
+    // Every column the index maps from. Most indexes only have one.
+    virtual std::vector<size_t> GetMappedColumns() const { return {GetMappedColumn()}; }
+
+    // True if the query filters any of the mapped columns.
+    bool Filters(const Query<D>& query) const {
+        for (size_t c : GetMappedColumns()) {
+            if (query.filters[c].present) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     IndexerType Type() const override { return IndexerType::Correlation; }
 
     protected:
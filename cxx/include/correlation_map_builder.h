@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "mapping_artifacts.h"
+#include "stash_utils.h"
+#include "types.h"
+
+/*
+ * Builds the artifacts used by MappedCorrelationIndex and its outlier index directly from a
+ * dataset, replacing the offline stashing scripts. The dataset must already be sorted by the
+ * primary index, so that every target bucket is a contiguous range of physical indexes.
+ *
+ * The mapped column is split into buckets, either of constant width or holding roughly the same
+ * number of points. Each target bucket then decides on its own which of the mapped buckets it
+ * intersects are cheaper to stash as outliers, using StashUtils, so target buckets are processed
+ * in parallel.
+ */
+template <size_t D>
+class CorrelationMapBuilder {
+  public:
+    // storage_factor is the alpha of TargetBucket: the cost of an outlier relative to scanning one
+    // extra point.
+    CorrelationMapBuilder(size_t mapped_column, float storage_factor)
+        : mapped_column_(mapped_column), storage_factor_(storage_factor), strategy_(CONST_WIDTH),
+          bucket_width_(1), num_buckets_(0), bounds_(), bucket_ids_(), bucket_starts_(),
+          bucket_ends_(), mapping_ids_(), mapping_offsets_(), mapping_targets_(), target_ids_(),
+          target_starts_(), target_ends_(), outliers_() {}
+
+    void SetBucketWidth(Scalar width) {
+        AssertWithMessage(width > 0, "Bucket width must be positive");
+        bucket_width_ = width;
+        strategy_ = CONST_WIDTH;
+    }
+
+    // Equi-depth buckets on the mapped column.
+    void SetNumBuckets(size_t num_buckets) {
+        AssertWithMessage(num_buckets > 0, "Need at least one mapped bucket");
+        num_buckets_ = num_buckets;
+        strategy_ = EQUI_DEPTH;
+    }
+
+    // targets gives the physical range of each target bucket, in increasing order.
+    void Build(ConstPointIterator<D> start, ConstPointIterator<D> end,
+            const TargetBucketsView& targets);
+
+    // Views over the built artifacts, valid until the next call to Build.
+    MappingView Mapping() const;
+    TargetBucketsView TargetBuckets() const;
+    const IndexList& Outliers() const { return outliers_; }
+
+    // Writes <prefix>.mapping, <prefix>.targets and <prefix>.outliers as binary artifacts.
+    void Write(const std::string& prefix) const;
+
+  private:
+    enum BucketStrategy { CONST_WIDTH, EQUI_DEPTH };
+
+    // Decisions made by a single target bucket, with the outliers as physical indexes.
+    typedef StashUtils::StashResult<Scalar> TargetResult;
+
+    // Key of the mapped bucket containing v: floor(v / width) for constant width buckets, and the
+    // bucket's position otherwise.
+    Scalar BucketKey(Scalar v) const;
+    ScalarRange BucketRange(Scalar key) const;
+    TargetResult StashTarget(ConstPointIterator<D> start, PhysicalIndexRange range) const;
+
+    size_t mapped_column_;
+    float storage_factor_;
+    BucketStrategy strategy_;
+    Scalar bucket_width_;
+    size_t num_buckets_;
+    // Left bounds of the equi-depth buckets, followed by one past the largest value.
+    std::vector<Scalar> bounds_;
+
+    // Artifact contents, in the layout of MappingView and TargetBucketsView.
+    std::vector<uint64_t> bucket_ids_;
+    std::vector<Scalar> bucket_starts_;
+    std::vector<Scalar> bucket_ends_;
+    std::vector<uint64_t> mapping_ids_;
+    std::vector<uint64_t> mapping_offsets_;
+    std::vector<int32_t> mapping_targets_;
+    std::vector<uint64_t> target_ids_;
+    std::vector<uint64_t> target_starts_;
+    std::vector<uint64_t> target_ends_;
+    IndexList outliers_;
+};
+
+#include "../src/correlation_map_builder.hpp"
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <random>
+
+#include "types.h"
+#include "utils.h"
+#include "primary_indexer.h"
+
+/**
+ * Adaptive index that cracks the data as queries arrive instead of sorting it up front. Init
+ * leaves the rows where they are and only remembers them, so the first query can run right away.
+ *
+ * Each query partitions the rows of the pieces that contain its bounds on the indexed column, and
+ * the cracker index records where every piece starts. The rows matching a range on the column are
+ * then one contiguous piece, which comes back as a range to scan. Pieces larger than
+ * STOCHASTIC_PIECE_SIZE are first cracked at randomly chosen values from the piece (stochastic
+ * cracking), so that sequential or otherwise skewed query patterns can't keep re-scanning one
+ * large piece. Over time the rows converge to sorted order on the queried ranges.
+ *
+ * Since queries move rows, the data given to Init has to outlive the index and be what the query
+ * engine scans (see RowOrderDatasetView), and no other index can keep row ids into it.
+ */
+template <size_t D>
+class CrackingIndex : public PrimaryIndexer<D> {
+    public:
+        explicit CrackingIndex(size_t dim);
+
+        void Init(PointIterator<D> start, PointIterator<D> end) override;
+        PhysicalIndexSet Ranges(Query<D>&) override;
+
+        bool MovesRowsOnQuery() const override { return true; }
+
+        size_t Size() const override {
+            return cracker_index_.size() * (sizeof(Scalar) + sizeof(size_t));
+        }
+
+        // Number of pieces the rows are cracked into.
+        size_t NumPieces() const {
+            return cracker_index_.size() + 1;
+        }
+
+        void WriteStats(std::ofstream& statsfile) override {
+            statsfile << "primary_index_type: cracking_" << dim_ << std::endl
+                << "cracking_pieces: " << NumPieces() << std::endl;
+        }
+
+    private:
+        // Returns the position of the first row with value >= val, cracking the piece containing
+        // val if needed.
+        size_t CrackAt(Scalar val);
+        // Partitions rows [start, end) around val, and records the boundary.
+        size_t Partition(size_t start, size_t end, Scalar val);
+
+        size_t dim_;
+        PointIterator<D> data_;
+        size_t data_size_;
+        // Maps a value v to the position p such that every row before p is smaller than v on the
+        // indexed column and every row from p onwards is at least v.
+        std::map<Scalar, size_t> cracker_index_;
+        std::mt19937_64 gen_;
+
+        // Pieces larger than this are cracked at random values before cracking at a query bound.
+        static const size_t STOCHASTIC_PIECE_SIZE = 1 << 14;
+};
+
+#include "../src/cracking_index.hpp"
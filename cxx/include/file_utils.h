@@ -23,13 +23,12 @@ class FileUtils {
         return arr;
     }
 
-    // Gets the next non-empty line as an array.
+    // Gets the next non-empty line as an array, or an empty array at the end of the file.
     template <typename T>
     static std::vector<T> NextArray(std::ifstream& f) {
         std::string line;
         std::vector<T> arr;
-        while (arr.size() == 0) {
-            std::getline(f, line);
+        while (arr.size() == 0 && std::getline(f, line)) {
             std::istringstream iss(line);
             T val;
             while (iss >> val) {
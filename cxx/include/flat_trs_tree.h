@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+
+#include "types.h"
+#include "trs_node.h"
+
+/*
+ * Read-only, compiled form of a TRS tree, used to answer lookups once the tree is built.
+ *
+ * Only the leaves are kept, in increasing order of their bounds on the mapped column. The
+ * children of a TRSNode partition its slice of the sorted mapped values, so the leaves don't
+ * overlap. A query is then a binary search for the first leaf it reaches, followed by a scan
+ * over consecutive leaves. Internal nodes add nothing to that search, so they are dropped.
+ * Each leaf keeps only what the lookup reads: its bounds and its model.
+ */
+class FlatTRSTree {
+  public:
+    FlatTRSTree() : leaf_lows_(), leaf_highs_(), leaves_() {}
+    explicit FlatTRSTree(const TRSNode& root) : FlatTRSTree() { Compile(root); }
+
+    // Replaces the contents of this tree with the leaves of root.
+    void Compile(const TRSNode& root);
+
+    // Writes the target ranges matching query_range into *ranges, sorted and coalesced. The
+    // previous contents of *ranges are discarded, but its capacity is reused.
+    void Lookup(ScalarRange query_range, std::vector<ScalarRange>* ranges) const;
+
+    size_t NumLeaves() const { return leaves_.size(); }
+    size_t Size() const;
+
+  private:
+    struct Leaf {
+        double slope;
+        double intercept;
+        double tolerance;
+    };
+
+    void AddLeaves(const TRSNode& node);
+
+    // Bounds of each leaf on the mapped column, split into two arrays so the binary search only
+    // touches the upper bounds.
+    std::vector<Scalar> leaf_lows_;
+    std::vector<Scalar> leaf_highs_;
+    std::vector<Leaf> leaves_;
+};
+
+#include "../src/flat_trs_tree.hpp"
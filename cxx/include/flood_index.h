@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "types.h"
+#include "utils.h"
+#include "primary_indexer.h"
+
+/**
+ * Learned grid index in the style of Flood. The data is laid out in a grid over the grid
+ * dimensions and sorted by the sort dimension within each cell. Each grid dimension is split into
+ * columns of roughly equal size using a piecewise linear model of its CDF, fit on a sample of the
+ * data. The number of columns per dimension is tuned on a sample query workload to minimize the
+ * estimated number of points scanned plus a fixed overhead per visited cell.
+ */
+template <size_t D>
+class FloodIndex : public PrimaryIndexer<D> {
+    public:
+        // If workload_file is empty, the grid is split evenly across the grid dimensions instead
+        // of being tuned.
+        FloodIndex(std::vector<size_t>& grid_dims, size_t sort_dim, const std::string& workload_file);
+
+        void Init(PointIterator<D> start, PointIterator<D> end) override;
+        PhysicalIndexSet Ranges(Query<D>&) override;
+
+        size_t Size() const override {
+            size_t knots = 0;
+            for (const auto& k : cdf_knots_) {
+                knots += k.size();
+            }
+            return sizeof(Scalar) * (knots + sort_fences_.size())
+                + sizeof(size_t) * (cell_offsets_.size() + columns_per_dim_.size());
+        }
+
+        std::unordered_set<size_t> GetColumns() const override {
+            std::unordered_set<size_t> cols(grid_dims_.cbegin(), grid_dims_.cend());
+            cols.insert(sort_dim_);
+            return cols;
+        }
+
+        // Number of columns chosen for each grid dimension. Only valid after Init.
+        const std::vector<size_t>& ColumnsPerDim() const {
+            return columns_per_dim_;
+        }
+
+        void WriteStats(std::ofstream& statsfile) override {
+            statsfile << "primary_index_type: flood_";
+            for (size_t d : grid_dims_) {
+                statsfile << d << "_";
+            }
+            statsfile << "s" << sort_dim_ << std::endl;
+            statsfile << "flood_columns_per_dim:";
+            for (size_t c : columns_per_dim_) {
+                statsfile << " " << c;
+            }
+            statsfile << std::endl;
+        }
+
+    private:
+        // A query reduced to a box over the grid dimensions and a range on the sort dimension.
+        struct QueryBounds {
+            std::vector<Scalar> lo;
+            std::vector<Scalar> hi;
+            bool sort_present;
+            Scalar sort_lo;
+            Scalar sort_hi;
+        };
+
+        // Fits the CDF model of each grid dimension on the given sample of rows.
+        void FitCDFs(PointIterator<D> start, const std::vector<size_t>& sample);
+        // Model estimate of the fraction of points below val in grid dimension i.
+        double CDF(size_t i, Scalar val) const;
+        // Column of the value in grid dimension i, for the given number of columns.
+        size_t ColumnFor(size_t i, Scalar val, size_t num_columns) const {
+            return std::min(num_columns - 1, (size_t)(CDF(i, val) * num_columns));
+        }
+        // Converts a query to its bounds. Returns false if no point can match.
+        bool GetBounds(const Query<D>& query, QueryBounds* bounds) const;
+        // Picks the number of columns in each grid dimension from the workload.
+        void TuneColumns(PointIterator<D> start, const std::vector<size_t>& sample);
+        // Estimated cost of the workload, in points scanned, for the given grid on the sample.
+        double EstimateCost(const std::vector<size_t>& columns,
+                const std::vector<std::vector<double>>& sample_cdfs,
+                const std::vector<Scalar>& sample_sort_vals,
+                const std::vector<QueryBounds>& workload) const;
+
+        std::vector<size_t> grid_dims_;
+        size_t sort_dim_;
+        std::string workload_file_;
+        size_t data_size_;
+        std::vector<size_t> columns_per_dim_;
+        // For each grid dimension, the values at evenly spaced quantiles of the sample.
+        std::vector<std::vector<Scalar>> cdf_knots_;
+        // Start row of each cell, followed by the number of rows.
+        std::vector<size_t> cell_offsets_;
+        // Sort dimension value of every FENCE_SPACING-th row.
+        std::vector<Scalar> sort_fences_;
+
+        static const size_t NUM_CDF_KNOTS = 256;
+        static const size_t SAMPLE_SIZE = 1 << 14;
+        static const size_t MAX_TUNING_QUERIES = 256;
+        // Tuning never makes cells smaller than this on average.
+        static const size_t MIN_POINTS_PER_CELL = 64;
+        // Average cell size when no workload is given.
+        static const size_t DEFAULT_POINTS_PER_CELL = 4096;
+        static const size_t FENCE_SPACING = 64;
+        // Overhead of visiting a cell, in equivalent points scanned.
+        static constexpr double CELL_COST = 16.0;
+};
+
+#include "../src/flood_index.hpp"
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+
+#include "correlation_indexer.h"
+#include "types.h"
+
+/*
+ * Correlation index keyed on a grid over two or more mapped columns, for joint correlations such
+ * as (pickup_zone, hour) -> fare. Each mapped column is split into equi-depth buckets, and a grid
+ * cell is one bucket from every mapped column.
+ *
+ * Built at Init over data already sorted by the host index, which is cut into target buckets of
+ * target_bucket_size consecutive rows. As in CorrelationMapBuilder, each target bucket decides
+ * with StashUtils which of its cells are cheaper to keep as outliers. Every cell
+ * then maps to the target buckets it's an inlier of and to its outlier rows, so a query returns
+ * the target buckets of the cells it overlaps plus their outliers, like CombinedCorrelationIndex.
+ */
+template <size_t D>
+class GridCorrelationIndex : public CorrelationIndexer<D> {
+  public:
+    GridCorrelationIndex(const std::vector<size_t>& mapped_columns, size_t buckets_per_column,
+            size_t target_bucket_size, float storage_factor);
+
+    void Init(ConstPointIterator<D> start, ConstPointIterator<D> end) override;
+
+    PhysicalIndexSet Ranges(const Query<D>& q) const override;
+
+    size_t Size() const override {
+        size_t s = (cells_.size() + cell_offsets_.size() + outlier_offsets_.size()) * sizeof(uint64_t)
+            + cell_targets_.size() * sizeof(uint32_t) + outlier_rows_.size() * sizeof(size_t);
+        for (const auto& b : bounds_) {
+            s += b.size() * sizeof(Scalar);
+        }
+        return s;
+    }
+
+    std::vector<size_t> GetMappedColumns() const override { return mapped_columns_; }
+
+    size_t NumOutliers() const { return outlier_rows_.size(); }
+
+  private:
+    // Cell of a row, with the last mapped column varying fastest.
+    uint64_t CellOf(const Point<D>& p) const;
+    // Bucket of v in mapped column c, clamped to the existing buckets.
+    size_t BucketOf(size_t c, Scalar v) const;
+    // Buckets of mapped column c that can hold rows matching the query. Returns false if none.
+    bool BucketsMatching(size_t c, const Query<D>& q, size_t* lo, size_t* hi) const;
+
+    std::vector<size_t> mapped_columns_;
+    size_t buckets_per_column_;
+    size_t target_bucket_size_;
+    float storage_factor_;
+    size_t data_size_;
+
+    // Left bounds of the buckets of each mapped column, followed by one past its largest value.
+    std::vector<std::vector<Scalar>> bounds_;
+    // Number of buckets in each mapped column, and the stride of each in a cell id.
+    std::vector<uint64_t> num_buckets_;
+    std::vector<uint64_t> strides_;
+
+    // Non-empty cells in increasing order. Cell i maps to target buckets
+    // cell_targets_[cell_offsets_[i]:cell_offsets_[i+1]] and to outlier rows
+    // outlier_rows_[outlier_offsets_[i]:outlier_offsets_[i+1]], both in increasing order.
+    std::vector<uint64_t> cells_;
+    std::vector<uint64_t> cell_offsets_;
+    std::vector<uint32_t> cell_targets_;
+    std::vector<uint64_t> outlier_offsets_;
+    IndexList outlier_rows_;
+};
+
+#include "../src/grid_correlation_index.hpp"
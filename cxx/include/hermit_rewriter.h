@@ -1,5 +1,12 @@
 /*
- * Dispatches to multiple linear rewriters on different columns.
+ * Hermit-style rewriter over several mapped -> target column pairs sharing one host index. Each
+ * pair keeps its own TRS tree and outlier index. A query with filters on several mapped columns
+ * gets the intersection of all their target ranges, so correlated filters narrow each other down
+ * before the primary lookup.
+ *
+ * A row matching the query is either an inlier of every pair whose mapped column is filtered, in
+ * which case its target value lies in the intersection, or an outlier of at least one of them, in
+ * which case that pair's outlier index returns it.
  */
 
 #pragma once
@@ -9,45 +16,38 @@
 
 #include "types.h"
 #include "rewriter.h"
-#include "secondary_indexer.h"
+#include "trs_tree_rewriter.h"
+#include "secondary_btree_index.h"
 
 template <size_t D>
 class HermitRewriter : public Rewriter<D> {
   public:
-    // Loads the one-to-one rewriter from a file.
-    HermitRewriter(const std::string& filename);
+    HermitRewriter() : pairs_(), target_ranges_(), target_present_() {}
 
-    void SetAuxiliaryIndex(std::unique_ptr<SecondaryBTreeIndex<D>> index) {
-        outlier_index_ = std::move(index);
-    }
+    // Adds a TRS tree from the mapped to the target column, whose outliers are indexed by
+    // outlier_index on the mapped column.
+    void AddPair(size_t mapped, size_t target,
+            std::unique_ptr<SecondaryBTreeIndex<D>> outlier_index);
+
+    size_t NumPairs() const { return pairs_.size(); }
 
     void Init(ConstPointIterator<D> start, ConstPointIterator<D> end) override;
 
     IndexList Rewrite(Query<D>& q) override;
 
     size_t Size() const override {
-        return 3*sizeof(double) + 2*sizeof(size_t);
+        size_t s = 0;
+        for (const auto& p : pairs_) {
+            s += p->Size();
+        }
+        return s;
     }    
 
-  protected:
-    void Load(const std::string& filename);
-
-    // Return the target range for this value. Range bounds are inclusive.
-    ScalarRange RangeFor(Scalar val);
-
   private:
-    // The width around the line that's considered inlier territory. Everything outside of this
-    // offset is an outlier.
-    // For inliers:
-    // target_dim is within linear_coeffs.[1, mapped_dim] +/- model_offset
-    double model_offset_;
-    // Coefficients of the linear map. The ith coefficient corresponds to the ith-degree term.
-    std::pair<double, double> linear_coeffs_;
-    // The rewriter maps values in mapped_dim_ to values in target_dim_ and adds those target_dim_
-    // values to the query.
-    size_t mapped_dim_;
-    size_t target_dim_;
-    std::unique_ptr<SecondaryBTreeIndex<D>> outlier_index_;
+    std::vector<std::unique_ptr<TRSTreeRewriter<D>>> pairs_;
+    // Intersected target ranges of the current query, per target column.
+    std::array<std::vector<ScalarRange>, D> target_ranges_;
+    std::array<bool, D> target_present_;
 };
 
-#include "../src/linear_model_rewriter.hpp"
+#include "../src/hermit_rewriter.hpp"
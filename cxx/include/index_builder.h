@@ -13,16 +13,25 @@
 #include "secondary_indexer.h"
 #include "primary_indexer.h"
 #include "secondary_btree_index.h"
+#include "posting_list_secondary_index.h"
 #include "binary_search_index.h"
 #include "primary_btree_index.h"
 #include "combined_correlation_index.h"
 #include "mapped_correlation_index.h"
+#include "grid_correlation_index.h"
 #include "outlier_index.h"
 #include "bucketed_secondary_index.h"
+#include "mapping_artifacts.h"
 #include "octree_index.h"
+#include "z_order_index.h"
+#include "flood_index.h"
+#include "cracking_index.h"
 #include "rewriter.h"
+#include "single_column_rewriter.h"
 #include "linear_model_rewriter.h"
 #include "trs_tree_rewriter.h"
+#include "hermit_rewriter.h"
+#include "piecewise_linear_rewriter.h"
 #include "measure_beta_index.h"
 
 /*
@@ -43,15 +52,23 @@ class IndexBuilder {
     std::unique_ptr<JustSortIndex<D>> BuildJustSortIndex(std::ifstream& spec);
     std::unique_ptr<DummyIndex<D>> BuildDummyIndex(std::ifstream& spec);
     std::unique_ptr<CompositeIndex<D>> BuildCompositeIndex(std::ifstream& spec);
+    std::unique_ptr<GridCorrelationIndex<D>> BuildGridCorrelationIndex(std::ifstream& spec);
     std::unique_ptr<CombinedCorrelationIndex<D>> BuildCombinedCorrelationIndex(std::ifstream& spec);
     std::unique_ptr<MappedCorrelationIndex<D>> BuildMappedCorrelationIndex(std::ifstream& spec);
     std::unique_ptr<SecondaryBTreeIndex<D>> BuildSecondaryBTreeIndex(std::ifstream& spec);
+    std::unique_ptr<PostingListSecondaryIndex<D>> BuildPostingListSecondaryIndex(std::ifstream& spec);
     std::unique_ptr<BinarySearchIndex<D>> BuildBinarySearchIndex(std::ifstream& spec);
     std::unique_ptr<PrimaryBTreeIndex<D>> BuildPrimaryBTreeIndex(std::ifstream& spec);
     std::unique_ptr<OctreeIndex<D>> BuildOctreeIndex(std::ifstream& spec);
+    std::unique_ptr<ZOrderIndex<D>> BuildZOrderIndex(std::ifstream& spec);
+    std::unique_ptr<FloodIndex<D>> BuildFloodIndex(std::ifstream& spec);
+    std::unique_ptr<CrackingIndex<D>> BuildCrackingIndex(std::ifstream& spec);
     std::unique_ptr<BucketedSecondaryIndex<D>> BuildBucketedSecondaryIndex(std::ifstream& spec);
+    std::unique_ptr<SingleColumnRewriter<D>> BuildSingleColumnRewriter(std::ifstream& spec);
     std::unique_ptr<LinearModelRewriter<D>> BuildLinearModelRewriter(std::ifstream& spec);
     std::unique_ptr<TRSTreeRewriter<D>> BuildTRSTreeRewriter(std::ifstream& spec);
+    std::unique_ptr<HermitRewriter<D>> BuildHermitRewriter(std::ifstream& spec);
+    std::unique_ptr<PiecewiseLinearRewriter<D>> BuildPiecewiseLinearRewriter(std::ifstream& spec);
     std::unique_ptr<MeasureBetaIndex<D>> BuildMeasureBetaIndex(std::ifstream& spec);
 };
 
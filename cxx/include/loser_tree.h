@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <limits>
+
+/*
+ * Tournament tree of losers for k-way merging. Each of the k leaves holds the current key of one
+ * input sequence. The winner is the smallest key (ties go to the lower index), and replacing it
+ * replays a single leaf-to-root path, so each step of the merge costs log(k) comparisons.
+ */
+class LoserTree {
+  public:
+    // Key of an exhausted sequence.
+    static const uint64_t DONE = std::numeric_limits<uint64_t>::max();
+
+    explicit LoserTree(const std::vector<uint64_t>& keys)
+        : k_(keys.size()), keys_(keys), losers_(keys.size(), 0), winner_(0) {
+        std::vector<size_t> winners(2 * k_);
+        for (size_t i = 0; i < k_; i++) {
+            winners[k_ + i] = i;
+        }
+        for (size_t n = k_ - 1; n >= 1 && n < k_; n--) {
+            size_t a = winners[2 * n], b = winners[2 * n + 1];
+            bool a_wins = Beats(a, b);
+            winners[n] = a_wins ? a : b;
+            losers_[n] = a_wins ? b : a;
+        }
+        winner_ = k_ > 1 ? winners[1] : 0;
+    }
+
+    // Index of the sequence with the smallest current key.
+    size_t Top() const { return winner_; }
+    uint64_t TopKey() const { return keys_[winner_]; }
+
+    // Sets the key of the winning sequence and finds the new winner.
+    void Replace(uint64_t key) {
+        keys_[winner_] = key;
+        size_t cur = winner_;
+        for (size_t n = (winner_ + k_) / 2; n >= 1; n /= 2) {
+            if (Beats(losers_[n], cur)) {
+                std::swap(losers_[n], cur);
+            }
+        }
+        winner_ = cur;
+    }
+
+  private:
+    bool Beats(size_t a, size_t b) const {
+        return keys_[a] < keys_[b] || (keys_[a] == keys_[b] && a < b);
+    }
+
+    size_t k_;
+    std::vector<uint64_t> keys_;
+    // losers_[n] is the sequence that lost the match at internal node n (1 <= n < k).
+    std::vector<size_t> losers_;
+    size_t winner_;
+};
@@ -6,6 +6,7 @@
 #include <unordered_map>
 
 #include "correlation_indexer.h"
+#include "roaring_set.h"
 #include "types.h"
 
 template <size_t D>
@@ -21,13 +22,12 @@ class MappedCorrelationIndex : public CorrelationIndexer<D> {
     PhysicalIndexSet Ranges(const Query<D>& q) const override; 
     
     size_t Size() const override {
-        size_t s = 0;
-        for (auto it = mapping_.begin(); it != mapping_.end(); it++) {
-            s += it->second.size() * sizeof(PhysicalIndexRange);
-            s += sizeof(ScalarRange);
+        size_t s = mapped_ends_.size() * sizeof(Scalar)
+            + target_buckets_.size() * sizeof(std::pair<int32_t, PhysicalIndexRange>);
+        for (const RoaringSet& node : tree_) {
+            s += node.Size();
         }
-        // BTree overhead (5 bytes per entry)
-        return mapping_.size() * 10 + s;
+        return s;
     }
 
     // This is ONLY for use in special cases. Usually the column is automatically set from the
@@ -40,18 +40,27 @@ class MappedCorrelationIndex : public CorrelationIndexer<D> {
     // Load the contents of the files specified in the constructor, used to construct a mapping we
     // can use.
     void Load(const std::string&, const std::string&);
-    
+
+    // Builds the segment tree over the target bucket sets of the mapped buckets, which must be
+    // given in the order of mapped_ends_. Entries are positions in target_buckets_.
+    void BuildTree(std::vector<RoaringSet>&& leaves);
+
+    // Union of the target bucket sets of mapped buckets [first, last).
+    RoaringSet TargetsBetween(size_t first, size_t last) const;
+
     // Number of data points
     size_t data_size_;
     
     // True when the index has been initialized.
     bool ready_;
     
-    // Mapping from mapped dimension bucket value (left bound) to range of indices it corresponds to.
-    // TODO: use a CPP B-Tree here (https://code.google.com/archive/p/cpp-btree/) for
-    // memory-efficient and fast accesses.
-    btree::btree_map<ScalarRange, IndexRangeList, ScalarRangeComp> mapping_; 
-    btree::btree_map<ScalarRange, std::vector<int32_t>, ScalarRangeComp> mapping_lst_;
+    // Exclusive ends of the mapped buckets that have a mapping, in increasing order.
+    std::vector<Scalar> mapped_ends_;
+    // Segment tree over the mapped buckets: leaf i (at mapped_ends_.size() + i) holds the target
+    // buckets of mapped bucket i, and every internal node holds the union of its two children.
+    // Any run of mapped buckets is covered by O(log n) nodes.
+    std::vector<RoaringSet> tree_;
+    // Target bucket ids in increasing order, with the range of rows each one holds.
     std::vector<std::pair<int32_t, PhysicalIndexRange>> target_buckets_;
 };
 
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+/*
+ * Binary format for the artifacts produced by the correlation scripts: mapping files, target
+ * bucket files and outlier lists. The text formats need a stream extraction per value, which
+ * dominates cold-start time for large mappings. A binary artifact is a fixed header followed by
+ * 8-byte aligned arrays, so it can be mmapped and read in place.
+ *
+ * Every artifact starts with an ArtifactHeader. The arrays that follow depend on the kind:
+ *  - MAPPING, counts = {buckets, mappings, targets}:
+ *      bucket_ids[buckets], bucket_starts[buckets], bucket_ends[buckets],
+ *      mapping_ids[mappings], mapping_offsets[mappings + 1], targets[targets] (int32, padded).
+ *    Buckets and mappings are sorted by id. The target buckets of mapping i are
+ *    targets[mapping_offsets[i]:mapping_offsets[i+1]], in increasing order.
+ *  - TARGET_BUCKETS, counts = {buckets}: ids[buckets], starts[buckets], ends[buckets].
+ *    Buckets are sorted by id.
+ *  - OUTLIERS, counts = {rows}: rows[rows].
+ *
+ * Loaders accept both formats, so the text files keep working and can be converted with
+ * convert_artifacts.
+ */
+enum ArtifactKind : uint32_t { MAPPING = 1, TARGET_BUCKETS = 2, OUTLIERS = 3 };
+
+struct ArtifactHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;
+    // Source column of a mapping, unused by the other kinds.
+    uint64_t column;
+    uint64_t counts[3];
+};
+
+// Read-only view of a mapping file, whether it was parsed or mmapped.
+struct MappingView {
+    size_t column;
+    size_t num_buckets;
+    const uint64_t* bucket_ids;
+    const Scalar* bucket_starts;
+    const Scalar* bucket_ends;
+    size_t num_mappings;
+    const uint64_t* mapping_ids;
+    const uint64_t* mapping_offsets;
+    const int32_t* targets;
+};
+
+// Read-only view of a target bucket file. Bucket i covers physical indexes [starts[i], ends[i]).
+struct TargetBucketsView {
+    size_t num_buckets;
+    const uint64_t* ids;
+    const uint64_t* starts;
+    const uint64_t* ends;
+};
+
+// Read-only memory mapping of a whole file. Unmapped when destroyed.
+class MappedFile {
+  public:
+    MappedFile() : data_(NULL), size_(0) {}
+    explicit MappedFile(const std::string& filename) : data_(NULL), size_(0) { Open(filename); }
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    void Open(const std::string& filename);
+
+    const char* Data() const { return data_; }
+    size_t Size() const { return size_; }
+
+  private:
+    const char* data_;
+    size_t size_;
+};
+
+// A mapping file loaded in either format. The view stays valid as long as the artifact exists.
+class MappingArtifact {
+  public:
+    explicit MappingArtifact(const std::string& filename);
+    MappingArtifact(const MappingArtifact&) = delete;
+    MappingArtifact& operator=(const MappingArtifact&) = delete;
+
+    const MappingView& View() const { return view_; }
+    bool IsBinary() const { return file_.Data() != NULL; }
+
+  private:
+    void ParseText(const std::string& filename);
+
+    MappedFile file_;
+    // Storage for the parsed text format.
+    std::vector<uint64_t> bucket_ids_;
+    std::vector<Scalar> bucket_starts_;
+    std::vector<Scalar> bucket_ends_;
+    std::vector<uint64_t> mapping_ids_;
+    std::vector<uint64_t> mapping_offsets_;
+    std::vector<int32_t> targets_;
+    MappingView view_;
+};
+
+// A target bucket file loaded in either format.
+class TargetBucketsArtifact {
+  public:
+    explicit TargetBucketsArtifact(const std::string& filename);
+    TargetBucketsArtifact(const TargetBucketsArtifact&) = delete;
+    TargetBucketsArtifact& operator=(const TargetBucketsArtifact&) = delete;
+
+    const TargetBucketsView& View() const { return view_; }
+    bool IsBinary() const { return file_.Data() != NULL; }
+
+  private:
+    void ParseText(const std::string& filename);
+
+    MappedFile file_;
+    std::vector<uint64_t> ids_;
+    std::vector<uint64_t> starts_;
+    std::vector<uint64_t> ends_;
+    TargetBucketsView view_;
+};
+
+class MappingArtifacts {
+  public:
+    static const uint32_t VERSION = 1;
+
+    // True if the file starts with the header of a binary artifact.
+    static bool IsBinary(const std::string& filename);
+
+    // Loads an outlier list, either a binary artifact or a raw array of size_t.
+    static IndexList LoadOutliers(const std::string& filename);
+
+    static void WriteMapping(const MappingView& mapping, const std::string& filename);
+    static void WriteTargetBuckets(const TargetBucketsView& targets, const std::string& filename);
+    static void WriteOutliers(const IndexList& rows, const std::string& filename);
+
+    // Checks the header of an mmapped artifact and returns its array section.
+    static const char* CheckHeader(const MappedFile& file, ArtifactKind kind,
+            const ArtifactHeader** header);
+    // Arrays are padded to a multiple of 8 bytes.
+    static size_t PaddedBytes(size_t bytes) { return (bytes + 7) / 8 * 8; }
+    // Returns the array of n Ts at *pos and advances *pos past it.
+    template <typename T>
+    static const T* NextSection(const char** pos, size_t n);
+
+  private:
+    MappingArtifacts() {}
+
+    static void WriteHeader(std::ofstream& file, ArtifactKind kind, uint64_t column,
+            uint64_t c0, uint64_t c1, uint64_t c2);
+    template <typename T>
+    static void WriteArray(std::ofstream& file, const T* data, size_t n);
+
+    static const char MAGIC[8];
+};
+
+#include "../src/mapping_artifacts.hpp"
@@ -13,21 +13,32 @@ class LinearModel {
     LinearModel() {}
 
   public:
+    // Least squares fit in a single pass over the points. Values are taken relative to the first
+    // point so the sums don't lose precision on large coordinates.
     template <class ForwardIterator>
     static std::pair<double, double> Fit(ForwardIterator xbegin, ForwardIterator xend, ForwardIterator ybegin) {
         size_t n = std::distance(xbegin, xend);
-        auto yend = ybegin + n;
-        double c_x = std::accumulate(xbegin, xend, 0.0);
-        double c_y = std::accumulate(ybegin, yend, 0.0);
-        double c_xx = std::inner_product(xbegin, xend, xbegin, 0.0);
-        double c_xy = std::inner_product(xbegin, xend, ybegin, 0.0);
-        double c_yy = std::inner_product(ybegin, yend, ybegin, 0.0);
+        auto x0 = *xbegin;
+        auto y0 = *ybegin;
+        double c_x = 0, c_y = 0, c_xx = 0, c_xy = 0;
+        auto y = ybegin;
+        for (auto x = xbegin; x != xend; x++, y++) {
+            double dx = *x - x0, dy = *y - y0;
+            c_x += dx;
+            c_y += dy;
+            c_xx += dx * dx;
+            c_xy += dx * dy;
+        }
+        return FromSums(n, c_x, c_y, c_xx, c_xy, x0, y0);
+    }
 
-        double ssy = c_yy - c_y * c_y / n;
+    // Fit from the sums of n points taken relative to (x0, y0).
+    static std::pair<double, double> FromSums(size_t n, double c_x, double c_y, double c_xx,
+            double c_xy, double x0, double y0) {
         double ssx = c_xx - c_x * c_x / n;
         double sxy = c_xy - c_x * c_y / n;
         double slope = sxy / ssx;
-        double intercept = (c_y - slope * c_x) / n;
+        double intercept = (c_y - slope * c_x) / n + y0 - slope * x0;
         return std::make_pair(slope, intercept);
     }
 };
@@ -49,7 +49,7 @@ class MeasureBetaIndex : public PrimaryIndexer<D> {
        
         // We don't care about accuracy here.
         return PhysicalIndexSet({{range_start, std::min(data_size_, range_start + range_size)}},
-                                secondary_->Matches(q));
+                                secondary_->Matches(q).ToList());
     } 
 
     size_t Size() const override {
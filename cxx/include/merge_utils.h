@@ -14,10 +14,17 @@ class MergeUtils {
     static IndexRangeList Intersect(const IndexRangeList&, const IndexRangeList&);
     static std::vector<ScalarRange> Intersect(const std::vector<ScalarRange>&, const std::vector<ScalarRange>&);
 
-    static IndexList Intersect(const IndexList&, const IndexList&);
+    // Sorted lists of row ids at either width. The result has the width of the first list.
+    template <typename Id1, typename Id2>
+    static std::vector<Id1> Intersect(const std::vector<Id1>&, const std::vector<Id2>&);
 
     static PhysicalIndexSet Intersect(const PhysicalIndexSet&, const PhysicalIndexSet&);
 
+    // Universe and empty inputs are handled without touching the other side. Unsorted lists are
+    // sorted first. Lists stay at the width the indexes produced them in.
+    static MatchResult Intersect(const MatchResult&, const MatchResult&);
+    static PhysicalIndexSet Intersect(const PhysicalIndexSet&, const MatchResult&);
+
     static IndexRangeList Union(const IndexRangeList&, const IndexRangeList&);
 
     static PhysicalIndexSet Union(const IndexRangeList&, const IndexList&);
@@ -25,7 +32,9 @@ class MergeUtils {
     // Note: this does NOT deduplicate.
     static IndexList Union(const std::vector<const IndexList *> ix_lists);
 
-    static IndexList Merge(const IndexRangeList&, const IndexList&);
+    // The ids of a sorted list that fall in one of the ranges.
+    template <typename Id>
+    static std::vector<Id> Merge(const IndexRangeList&, const std::vector<Id>&);
 
     // Scalar ranges must be sorted.
     template <class ForwardIterator>
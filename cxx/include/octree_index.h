@@ -8,7 +8,9 @@
 #include "primary_indexer.h"
 
 /**
- * Splits space into eighths until each leaf node contains less than the page size number of points
+ * Splits space into eighths until each leaf node contains less than the page size number of points.
+ * Nodes are partitioned in place, and subtrees above a minimum size are built as parallel OpenMP
+ * tasks.
  */
 template <size_t D>
 class OctreeIndex : public PrimaryIndexer<D> {
@@ -48,6 +50,12 @@ class OctreeIndex : public PrimaryIndexer<D> {
             return std::unordered_set<size_t>(index_dims_.cbegin(), index_dims_.cend());
         }
 
+        // If set before Init, writes the sorted data and the leaf offsets to
+        // octree_sorted_data.bin / octree_sorted_buckets.dat once the tree is built.
+        void SetDumpSortedData(bool dump) {
+            dump_sorted_data_ = dump;
+        }
+
         void WriteStats(std::ofstream& statsfile) override {
             statsfile << "primary_index_type: octree_";
             for (size_t d : index_dims_) {
@@ -63,21 +71,35 @@ class OctreeIndex : public PrimaryIndexer<D> {
         bool sort_leaf_;
         size_t sort_dim_;
         size_t data_size_;
-        int32_t next_id_;
 
         std::vector<Scalar> mins_;
         std::vector<Scalar> maxs_;
+        int32_t next_id_;
+        bool dump_sorted_data_;
 
-        int get_octant_containing_point(Point<D>& point, std::vector<Scalar>& center) const;
+        int get_octant_containing_point(const Point<D>& point, const std::vector<Scalar>& center) const;
+        // Reorders [start, end) so that points are grouped by octant, in octant order. `next` holds
+        // the first offset of each octant and is advanced as points are placed.
+        void partition_by_octant(PointIterator<D> start, PointIterator<D> end,
+                const std::vector<Scalar>& center, std::vector<size_t>& next) const;
         bool divide_node(std::shared_ptr<Node> node, PointIterator<D> start, PointIterator<D> end, int depth);
+        // Numbers the children of every node in turn, depth first, once the tree is built. Subtrees
+        // are built concurrently, so ids can't be handed out during the build without depending on
+        // the task schedule.
+        void assign_ids(Node* node);
+        void write_sorted_data(PointIterator<D> start) const;
         bool should_keep_dividing(std::shared_ptr<Node> node, int depth) const;
-        bool is_relevant_node(std::shared_ptr<Node> node, const Query<D>& query) const;
+        bool is_relevant_node(const Node* node, const Query<D>& query) const;
+        // True if every point in the node's bounding box satisfies the query on the indexed
+        // dimensions, so the whole node can be returned without descending further.
+        bool is_contained_node(const Node* node, const Query<D>& query) const;
         size_t num_partitions_;
 
         static const size_t DEFAULT_PAGE_SIZE = 10000;
         static const int DEFAULT_MAX_DEPTH = 100;
-        std::ofstream sorted_data_points_;
-        std::ofstream sorted_data_buckets_; 
+        // Nodes with fewer points than this are built on the spawning thread rather than as a new
+        // task, since the task overhead would dominate.
+        static const size_t MIN_POINTS_PER_TASK = 1 << 16;
 };
 
 #include "../src/octree_index.hpp"
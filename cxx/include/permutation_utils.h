@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "types.h"
+
+/*
+ * Applies a permutation to a random access range in place, following its cycles and tracking
+ * visited positions in a bitmap. Used by the clustered indexes to reorder the data after sorting
+ * without making a full copy of it.
+ */
+class PermutationUtils {
+  private:
+    PermutationUtils() {}
+
+  public:
+    // Reorders data in place so that position i ends up with the element previously at order[i].
+    // order must be a permutation of [0, order.size()).
+    template <typename RandomIt>
+    static void Apply(RandomIt data, const std::vector<size_t>& order);
+
+    // Same as Apply, but moves cycles in parallel. Cycles longer than BLOCK_SIZE are split into
+    // blocks that are moved independently, so one long cycle doesn't serialize the work. Uses
+    // two bits per element plus a small amount of memory per block.
+    template <typename RandomIt>
+    static void ApplyParallel(RandomIt data, const std::vector<size_t>& order);
+
+  private:
+    static const size_t BLOCK_SIZE = 1 << 12;
+    // Below this many elements, ApplyParallel just calls Apply.
+    static const size_t MIN_PARALLEL_SIZE = 1 << 16;
+};
+
+#include "../src/permutation_utils.hpp"
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "types.h"
+
+// A line over the mapped values [x_start, x_end]: y = slope * (x - x_start) + intercept.
+struct PLASegment {
+    Scalar x_start;
+    Scalar x_end;
+    double slope;
+    double intercept;
+
+    double At(Scalar x) const { return slope * double(x - x_start) + intercept; }
+};
+
+/*
+ * Piecewise-linear approximation of y as a function of x with a fixed error bound eps: every
+ * covered point lies within eps of its segment.
+ *
+ * Segments are grown greedily over the points in increasing x with the optimal PLA algorithm
+ * (O'Rourke): the set of lines that stay within eps of all points so far is a convex polygon in
+ * (slope, intercept) space, and each point clips it with two half-planes. A segment ends when the
+ * polygon would become empty, which gives the fewest segments for the bound.
+ *
+ * Points sharing an x value can't be separated by segments, so each group of them keeps the
+ * densest window of width 2 * eps and leaves the rest uncovered. An isolated spike, a group that
+ * no line can join to the two groups after it while those two fit a line, is left uncovered
+ * instead of ending a segment. Uncovered points are outliers; Covers tells them apart.
+ */
+class PiecewiseLinearModel {
+  public:
+    // Fits the points [index_start, index_end), sorted by x, and appends the segments.
+    static void Fit(const std::vector<Scalar>& xs, const std::vector<Scalar>& ys,
+            size_t index_start, size_t index_end, double eps, std::vector<PLASegment>* segments);
+
+    // Same as Fit, but splits the points into one slice per thread and fits them concurrently.
+    // Costs at most one extra segment per slice.
+    static std::vector<PLASegment> ParallelFit(const std::vector<Scalar>& xs,
+            const std::vector<Scalar>& ys, double eps);
+
+    // Clip keeps lines that miss an interval by this much relative to its bounds, so Covers
+    // allows the same slack.
+    static constexpr double CLIP_TOLERANCE = 1e-9;
+
+    static bool Covers(const PLASegment& s, double eps, Scalar x, Scalar y) {
+        double line = s.At(x);
+        double tol = CLIP_TOLERANCE * (fabs(line) + eps + 1);
+        return line - eps - tol <= y && y <= line + eps + tol;
+    }
+
+    // Inputs with fewer points than this are fit on a single thread.
+    static const size_t MIN_PARALLEL_SIZE = 1 << 16;
+
+  private:
+    PiecewiseLinearModel() {}
+
+    // The lines a*(x - x0) + b that pass through every interval added so far, as a convex polygon
+    // of (a, b) vertices.
+    class Region {
+      public:
+        // Starts a region with a single interval at x0. Slopes are limited to
+        // [-max_slope, max_slope].
+        void Reset(Scalar x0, double lo, double hi, double max_slope);
+        // Clips the region so the lines pass through [lo, hi] at x. Returns false and leaves
+        // the region untouched if no line does.
+        bool Add(Scalar x, double lo, double hi);
+        // A line inside the region, as (slope, intercept) relative to x.
+        std::pair<double, double> Line(Scalar x) const;
+
+      private:
+        // Clips poly to the half-plane a*dx + b >= c (sign = 1) or <= c (sign = -1).
+        static void Clip(const std::vector<std::pair<double, double>>& poly, double dx, double c,
+                double sign, std::vector<std::pair<double, double>>* out);
+
+        Scalar x0_;
+        std::vector<std::pair<double, double>> poly_;
+        std::vector<std::pair<double, double>> clipped_lo_;
+        std::vector<std::pair<double, double>> clipped_;
+    };
+
+    // The points at x == xs[start], which end at end, and the interval [lo, hi] a line has to
+    // pass through at x to keep their densest window within eps.
+    struct Group {
+        size_t start;
+        size_t end;
+        Scalar x;
+        double lo;
+        double hi;
+    };
+
+    static Group NextGroup(const std::vector<Scalar>& xs, const std::vector<Scalar>& ys,
+            size_t start, size_t index_end, double eps);
+
+    // True if g is an isolated spike ahead of the two groups after it: no line through g reaches
+    // both of them, but one line goes through both.
+    static bool IsSpike(const Group& g, const Group& next, const Group& after, double max_slope);
+};
+
+#include "../src/piecewise_linear_model.hpp"
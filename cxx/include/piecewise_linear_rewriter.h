@@ -0,0 +1,82 @@
+/*
+ * Rewrites a range filter on the mapped column into target ranges with a piecewise-linear model
+ * learned from the data at Init, instead of the single line fit offline by
+ * continuous/gen_linear_map.py. Every segment keeps its points within the same error bound eps;
+ * points outside their segment's band are outliers, served by an auxiliary index on the mapped
+ * column.
+ *
+ * Unless it is fixed, eps is picked among powers of two by fitting a sample of the data and
+ * minimizing
+ *     sum over segments of (rows per target value) * (target span of the segment + 2 * eps)
+ *         + storage_factor * outliers,
+ * that is the rows scanned if every segment is queried once plus the size of the outlier index,
+ * with an outlier costing storage_factor scanned rows as in TargetBucket.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "rewriter.h"
+#include "piecewise_linear_model.h"
+#include "secondary_btree_index.h"
+
+template <size_t D>
+class PiecewiseLinearRewriter : public Rewriter<D> {
+  public:
+    PiecewiseLinearRewriter(size_t mapped, size_t target, double storage_factor);
+
+    void SetAuxiliaryIndex(std::unique_ptr<SecondaryBTreeIndex<D>> index) {
+        outlier_index_ = std::move(index);
+    }
+
+    // Uses this error bound instead of searching for one.
+    void SetErrorBound(double eps) {
+        AssertWithMessage(eps >= 0, "Error bound must be non-negative");
+        eps_ = eps;
+        fixed_eps_ = true;
+    }
+
+    void Init(ConstPointIterator<D> start, ConstPointIterator<D> end) override;
+
+    IndexList Rewrite(Query<D>& q) override;
+
+    size_t Size() const override {
+        size_t s = segments_.size() * sizeof(PLASegment) + sizeof(double);
+        if (outlier_index_ != nullptr) {
+            s += outlier_index_->Size();
+        }
+        return s;
+    }
+
+    double ErrorBound() const { return eps_; }
+    const std::vector<PLASegment>& Segments() const { return segments_; }
+    size_t GetMappedColumn() const { return mapped_dim_; }
+    size_t GetTargetColumn() const { return target_dim_; }
+
+    // Samples used to pick the error bound.
+    static const size_t SAMPLE_SIZE = 1 << 20;
+
+  private:
+    double ChooseErrorBound(const std::vector<Scalar>& xs, const std::vector<Scalar>& ys) const;
+
+    // Positions of the points, sorted by x, that their segment doesn't cover.
+    static IndexList Uncovered(const std::vector<PLASegment>& segments, double eps,
+            const std::vector<Scalar>& xs, const std::vector<Scalar>& ys);
+
+    size_t mapped_dim_;
+    size_t target_dim_;
+    double storage_factor_;
+    double eps_;
+    bool fixed_eps_;
+    // Ordered by x, without overlaps.
+    std::vector<PLASegment> segments_;
+    std::vector<Scalar> segment_ends_;
+    // Reused across queries.
+    std::vector<ScalarRange> bands_;
+    std::unique_ptr<SecondaryBTreeIndex<D>> outlier_index_;
+};
+
+#include "../src/piecewise_linear_rewriter.hpp"
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "secondary_indexer.h"
+#include "types.h"
+#include "row_ids.h"
+
+/*
+ * Secondary index that keeps, for every distinct value of the column, the sorted list of rows with
+ * that value. A value with a single row stores it inline in the key directory. The longer lists are
+ * concatenated into one stream, in key order, which is cut into blocks of BLOCK_SIZE rows shared by
+ * consecutive lists. A block stores its first row, followed by the difference of every row from the
+ * one before it modulo the number of rows, bit-packed at the smallest width that fits the largest.
+ * Within a list these are the gaps between rows; the first row of a list is a wide step from the
+ * end of the previous list, which only widens the block it lands in.
+ *
+ * Matches decodes the lists for the matching values and merges them, so the result is always
+ * sorted. It is 32-bit when the table has at most 2^32 rows.
+ */
+template <size_t D>
+class PostingListSecondaryIndex : public SecondaryIndexer<D> {
+  public:
+    PostingListSecondaryIndex(size_t dim);
+
+    void SetIndexList(IndexList list) {
+        index_subset_ = list;
+        use_index_subset_ = true;
+    }
+
+    void Init(ConstPointIterator<D> start, ConstPointIterator<D> end) override;
+
+    MatchResult Matches(const Query<D>& q) const override;
+
+    size_t Size() const override {
+        return keys_.size() * sizeof(Scalar) + key_refs_.Bytes() + list_offsets_.Bytes()
+            + block_first_.Bytes() + block_offsets_.size() * sizeof(uint32_t)
+            + block_bits_.size() * sizeof(uint8_t) + packed_.size() * sizeof(uint64_t);
+    }
+
+    void WriteStats(std::ofstream& statsfile) override {
+        statsfile << "posting_list_col_" << this->column_ << "_keys: " << keys_.size() << std::endl
+            << "posting_list_col_" << this->column_ << "_bytes: " << Size() << std::endl;
+    }
+
+  private:
+    // Decodes every row of block b into out.
+    void DecodeBlock(size_t b, PhysicalIndex* out) const;
+    // Decodes the rows at positions [begin, end) of the stream into out.
+    template <typename Id>
+    void DecodeSlice(size_t begin, size_t end, Id* out) const;
+    // Number of rows with key k.
+    size_t ListSize(size_t k) const {
+        PhysicalIndex ref = key_refs_[k];
+        return ref < data_size_ ? 1 : list_offsets_[ref - data_size_ + 1] - list_offsets_[ref - data_size_];
+    }
+    // Appends the rows of the posting list for key k to out.
+    template <typename Id>
+    void DecodeList(size_t k, std::vector<Id>* out) const;
+    // Merges the posting lists for the given keys into out, in increasing order.
+    template <typename Id>
+    void MergeLists(const std::vector<size_t>& key_ixs, size_t total, std::vector<Id>* out) const;
+
+    size_t data_size_;
+    bool use_index_subset_;
+    IndexList index_subset_;
+
+    // Distinct values of the column in increasing order.
+    std::vector<Scalar> keys_;
+    // For each key, its row if it has a single one, or else data_size_ plus the index of its list.
+    RowIds key_refs_;
+    // Position of each list in the stream, followed by the length of the stream.
+    RowIds list_offsets_;
+    size_t stream_size_;
+    // Per block: the first row, the offset of its packed differences in packed_, and their width.
+    RowIds block_first_;
+    std::vector<uint32_t> block_offsets_;
+    std::vector<uint8_t> block_bits_;
+    std::vector<uint64_t> packed_;
+
+    static const size_t BLOCK_SIZE = 128;
+    // Up to this many lists are merged with a heap. Beyond that, they are decoded together and
+    // either sorted or collected in a bitmap over all rows.
+    static const size_t MAX_HEAP_MERGE_LISTS = 16;
+};
+
+#include "../src/posting_list_secondary_index.hpp"
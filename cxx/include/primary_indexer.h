@@ -7,6 +7,7 @@
 #include "types.h"
 #include "dataset.h"
 #include "indexer.h"
+#include "roaring_set.h"
 
 
 template <size_t D>
@@ -21,8 +22,17 @@ class PrimaryIndexer : public Indexer<D> {
     // ranges of VirtualIndices to check.
     virtual PhysicalIndexSet Ranges(Query<D>& query) = 0;
 
+    // The same indexes as Ranges, as a compressed bitmap the query engine can scan word by word.
+    virtual RoaringSet RangesBitmap(Query<D>& query) {
+        return RoaringSet::FromIndexSet(Ranges(query));
+    }
+
     virtual void Init(PointIterator<D> start, PointIterator<D> end) = 0;
 
+    // True if Ranges moves rows of the data given to Init, as cracking does. The query engine then
+    // has to scan that data in place instead of a copy made after Init.
+    virtual bool MovesRowsOnQuery() const { return false; }
+
     // Size of the indexer in bytes
     virtual size_t Size() const override = 0;
     
@@ -13,6 +13,7 @@
 #include "rewriter.h"
 #include "dataset.h"
 #include "visitor.h"
+#include "roaring_set.h"
 
 template <size_t D>
 class QueryEngine {
@@ -22,6 +23,12 @@ class QueryEngine {
     
     void Execute(Query<D>& q, Visitor<D>& visitor);
 
+    // If set, the indexer's output is requested as a bitmap and scanned one 64-row word at a time,
+    // instead of as ranges and a list.
+    void SetBitmapScan(bool bitmap_scan) {
+        bitmap_scan_ = bitmap_scan;
+    }
+
     long ScannedPoints() const {
         return scanned_range_points_ + scanned_list_points_;
     }
@@ -55,6 +62,16 @@ class QueryEngine {
     }
 
   private:
+    // Scans the rows of the indexer's bitmap. Returns the time spent scanning in ns.
+    long ExecuteBitmap(Query<D>& q, Visitor<D>& visitor, const std::vector<size_t>& categorical_dims,
+            const std::vector<std::unordered_set<Scalar>>& value_sets,
+            const std::vector<size_t>& range_dims);
+    // Clears the bits in valids for rows in [start, end) that don't pass the query's filters.
+    uint64_t FilterWord(Query<D>& q, size_t start, size_t end, uint64_t valids,
+            const std::vector<size_t>& categorical_dims,
+            const std::vector<std::unordered_set<Scalar>>& value_sets,
+            const std::vector<size_t>& range_dims) const;
+
     std::shared_ptr<Dataset<D>> dataset_;
     std::shared_ptr<PrimaryIndexer<D>> indexer_;
     // The columns that are indexed by this indexer, saved for faster access.
@@ -66,6 +83,7 @@ class QueryEngine {
     long indexing_time_;
     long list_scan_time_;
     size_t num_queries_;
+    bool bitmap_scan_;
 };
 
 #include "../src/query_engine.hpp"
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
+#include "types.h"
+
+/*
+ * Parallel, stable LSD radix sort on 64-bit keys, carrying a payload (usually the original
+ * position of each key) alongside. Keys can be signed (e.g. Scalar) or unsigned. Passes whose
+ * digit is the same for every key are skipped.
+ */
+class RadixSort {
+  private:
+    RadixSort() {}
+
+  public:
+    // Sorts keys in increasing order and applies the same permutation to payload.
+    template <typename K, typename P>
+    static void Sort(std::vector<K>& keys, std::vector<P>& payload);
+
+  private:
+    // Maps a key to bits that sort in the same order as unsigned integers.
+    template <typename K>
+    static uint64_t KeyBits(K key) {
+        static_assert(std::is_integral<K>::value && sizeof(K) == sizeof(uint64_t),
+                "RadixSort only supports 64-bit integer keys");
+        return std::is_signed<K>::value ? (uint64_t)key ^ (1ULL << 63) : (uint64_t)key;
+    }
+
+    static const size_t RADIX_BITS = 8;
+    static const size_t NUM_BUCKETS = 1 << RADIX_BITS;
+    static const size_t NUM_PASSES = 64 / RADIX_BITS;
+    // Below this many keys, a single thread does all the work.
+    static const size_t MIN_PARALLEL_SIZE = 1 << 16;
+};
+
+#include "../src/radix_sort.hpp"
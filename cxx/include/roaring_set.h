@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "types.h"
+
+/*
+ * Compressed set of physical indexes, in the style of a Roaring bitmap. Indexes are split on their
+ * high bits into chunks of 2^16 rows, and each non-empty chunk is stored in whichever container
+ * suits it:
+ *  - an array of sorted 16-bit offsets, when the chunk holds few rows,
+ *  - a bitmap of 1024 words, when it holds many,
+ *  - a list of runs, for the contiguous ranges returned by clustered indexes.
+ *
+ * Bitmap words are MSB-first: the most significant bit of a word is the first of its 64 rows. This
+ * is the same layout as the valids masks in the query engine, so words can be handed to the scan
+ * without any conversion.
+ */
+class RoaringSet {
+  public:
+    RoaringSet() : keys_(), containers_() {}
+
+    // Ranges must be sorted and must not overlap.
+    static RoaringSet FromRanges(const IndexRangeList& ranges);
+    // The list doesn't need to be sorted, but sorted lists are cheaper to convert.
+    template <typename Id>
+    static RoaringSet FromList(const std::vector<Id>& list);
+    static RoaringSet FromIndexSet(const PhysicalIndexSet& set);
+
+    static RoaringSet Intersect(const RoaringSet& first, const RoaringSet& second);
+    static RoaringSet Union(const RoaringSet& first, const RoaringSet& second);
+
+    size_t Cardinality() const;
+    bool Empty() const { return containers_.empty(); }
+    bool Contains(PhysicalIndex ix) const;
+
+    // Indexes in increasing order.
+    IndexList ToList() const;
+    // Maximal contiguous ranges, in increasing order.
+    IndexRangeList ToRanges() const;
+
+    // Calls f(start, word) on every aligned group of 64 rows that has at least one index in the
+    // set, in increasing order. The most significant bit of word is row start.
+    template <typename F>
+    void ForEachWord(F f) const;
+
+    size_t Size() const;
+
+  private:
+    // Inclusive range of offsets within a chunk.
+    struct Run {
+        uint16_t start;
+        uint16_t last;
+    };
+
+    enum ContainerType : uint8_t { ARRAY, BITMAP, RUN };
+
+    struct Container {
+        Container(ContainerType t, uint32_t card) : type(t), cardinality(card), array(), bitmap(), runs() {}
+
+        ContainerType type;
+        uint32_t cardinality;
+        std::vector<uint16_t> array;
+        std::vector<uint64_t> bitmap;
+        std::vector<Run> runs;
+    };
+
+    static Container ArrayContainer(std::vector<uint16_t>&& values);
+    static Container BitmapContainer(std::vector<uint64_t>&& words, uint32_t cardinality);
+    // Converts between arrays and bitmaps depending on the cardinality.
+    static Container Normalize(Container c);
+    // The container's contents as BITMAP_WORDS words.
+    static std::vector<uint64_t> ToWords(const Container& c);
+    static bool ContainsOffset(const Container& c, uint16_t offset);
+
+    static Container IntersectContainers(const Container& a, const Container& b);
+    static Container UnionContainers(const Container& a, const Container& b);
+
+    // Bitwise and/or of two full bitmaps into out. Returns the number of bits set in out.
+    static uint32_t AndWords(const uint64_t* a, const uint64_t* b, uint64_t* out);
+    static uint32_t OrWords(const uint64_t* a, const uint64_t* b, uint64_t* out);
+
+    // Mask for the offsets first to last (inclusive) within a single word.
+    static uint64_t WordMask(size_t first, size_t last) {
+        return (~0ULL >> first) & (~0ULL << (63 - last));
+    }
+
+    // High bits of the indexes in each container, in increasing order.
+    std::vector<uint64_t> keys_;
+    std::vector<Container> containers_;
+
+    static const size_t CHUNK_BITS = 16;
+    static const size_t CHUNK_SIZE = 1 << CHUNK_BITS;
+    static const size_t BITMAP_WORDS = CHUNK_SIZE / 64;
+    static_assert(BITMAP_WORDS % 4 == 0, "Bitmap containers must be a whole number of AVX2 vectors");
+    // Arrays with more entries than this are larger than a bitmap.
+    static const size_t ARRAY_MAX = 4096;
+};
+
+#include "../src/roaring_set.hpp"
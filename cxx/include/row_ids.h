@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+/*
+ * A list of row ids stored at the narrowest width that can address the table: 32 bits when it has
+ * at most 2^32 rows, 64 bits otherwise. The width is picked once, when the owning index is
+ * built. Callers go through Visit, which hands them the underlying vector, so loops over the ids
+ * are compiled separately for each width instead of branching on every access.
+ */
+class RowIds {
+  public:
+    RowIds() : narrow_(true), narrow_rows_(), wide_rows_() {}
+    // Takes over ids that were already collected at either width.
+    explicit RowIds(std::vector<uint32_t> ids) : narrow_(true), narrow_rows_(std::move(ids)), wide_rows_() {}
+    explicit RowIds(std::vector<uint64_t> ids) : narrow_(false), narrow_rows_(), wide_rows_(std::move(ids)) {}
+
+    // Clears the ids and picks the width for a table with num_rows rows.
+    void Reset(size_t num_rows) {
+        narrow_ = num_rows <= (size_t)std::numeric_limits<uint32_t>::max() + 1;
+        narrow_rows_.clear();
+        wide_rows_.clear();
+    }
+
+    bool IsNarrow() const { return narrow_; }
+
+    // Calls f with the std::vector of ids at the chosen width and returns its result.
+    template <typename F>
+    auto Visit(F f) {
+        return narrow_ ? f(narrow_rows_) : f(wide_rows_);
+    }
+
+    template <typename F>
+    auto Visit(F f) const {
+        return narrow_ ? f(narrow_rows_) : f(wide_rows_);
+    }
+
+    size_t size() const {
+        return narrow_ ? narrow_rows_.size() : wide_rows_.size();
+    }
+
+    bool empty() const { return size() == 0; }
+
+    uint64_t operator[](size_t i) const {
+        return narrow_ ? narrow_rows_[i] : wide_rows_[i];
+    }
+
+    // The ids widened to 64 bits.
+    std::vector<uint64_t> ToWide() const {
+        return narrow_ ? std::vector<uint64_t>(narrow_rows_.begin(), narrow_rows_.end()) : wide_rows_;
+    }
+
+    size_t Bytes() const {
+        return narrow_rows_.size() * sizeof(uint32_t) + wide_rows_.size() * sizeof(uint64_t);
+    }
+
+  private:
+    bool narrow_;
+    std::vector<uint32_t> narrow_rows_;
+    std::vector<uint64_t> wide_rows_;
+};
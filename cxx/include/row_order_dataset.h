@@ -41,3 +41,38 @@ class RowOrderDataset : public Dataset<D> {
     std::vector<Point<D>> data_;
 };
 
+
+/**
+ * A row-ordered dataset over points owned by someone else, so that it sees rows moved after it is
+ * built, e.g. by a CrackingIndex. The points have to outlive it.
+ */
+template <size_t D>
+class RowOrderDatasetView : public Dataset<D> {
+  public:
+    RowOrderDatasetView(ConstPointIterator<D> start, ConstPointIterator<D> end)
+        : start_(start), size_(std::distance(start, end)) {}
+
+    Point<D> Get(size_t id) const override {
+        return *(start_ + id);
+    }
+
+    Scalar GetCoord(size_t id, size_t dim) const override {
+        return (*(start_ + id))[dim];
+    }
+
+    size_t Size() const override {
+        return size_;
+    }
+
+    size_t NumDims() const override {
+        return D;
+    }
+
+    size_t SizeInBytes() const override {
+        return size_ * sizeof(Point<D>);
+    }
+
+  private:
+    ConstPointIterator<D> start_;
+    size_t size_;
+};
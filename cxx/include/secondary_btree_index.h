@@ -3,10 +3,15 @@
 #include <vector>
 #include <map>
 
-#include "cpp-btree/btree_map.h"
 #include "secondary_indexer.h"
 #include "types.h"
+#include "row_ids.h"
 
+/*
+ * Secondary index on a single column. The (key, row) pairs are bulk loaded: they are radix sorted
+ * once in Init and stored as two packed arrays ordered by key, which are then binary searched. Rows
+ * are stored as 32-bit ids unless the table is too large for them.
+ */
 template <size_t D>
 class SecondaryBTreeIndex : public SecondaryIndexer<D> {
   public:
@@ -19,23 +24,18 @@ class SecondaryBTreeIndex : public SecondaryIndexer<D> {
 
     void Init(ConstPointIterator<D> start, ConstPointIterator<D> end) override;
 
-    IndexList Matches(const Query<D>& q) const override; 
+    MatchResult Matches(const Query<D>& q) const override; 
     
     size_t Size() const override {
-        size_t unique_keys = 0;
-        size_t total_entries = btree_.size();
-        Scalar prev_key = std::numeric_limits<Scalar>::lowest();
-        for (auto it = btree_.begin(); it != btree_.end(); it++) {
-            assert (it->first >= prev_key);
-            if (it->first > prev_key) {
-                unique_keys++;
-                prev_key = it->first;
-            }
-        }
-        // Based on: https://code.google.com/archive/p/cpp-btree/
-        // Each key (in a random insertion benchmark) carries an overhead of 10 bytes (for 64-bit
-        // machines)
-        return unique_keys*10 + total_entries*sizeof(PhysicalIndex);
+        return keys_.size()*sizeof(Scalar) + rows_.Bytes();
+    }
+
+    size_t NumUniqueKeys() const {
+        return unique_keys_;
+    }
+
+    bool HasNarrowRowIds() const {
+        return rows_.IsNarrow();
     }
 
   private:
@@ -45,9 +45,11 @@ class SecondaryBTreeIndex : public SecondaryIndexer<D> {
     bool ready_;
     bool use_index_subset_;
     IndexList index_subset_;
-    // A map from dimension value to index range where points with that dimension value that are
-    // outliers can be found.
-    btree::btree_multimap<Scalar, PhysicalIndex> btree_;
+    // Indexed values in sorted order, and the row each one comes from.
+    std::vector<Scalar> keys_;
+    RowIds rows_;
+    // Number of distinct values in keys_, counted at load time.
+    size_t unique_keys_;
 };
 
 #include "../src/secondary_btree_index.hpp"
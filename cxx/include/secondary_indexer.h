@@ -7,6 +7,7 @@
 #include "indexer.h"
 #include "types.h"
 #include "dataset.h"
+#include "roaring_set.h"
    
 /*
  * Interface for a secondary index, which does not determine the layout of the data. Instead of
@@ -20,7 +21,17 @@ class SecondaryIndexer : public Indexer<D> {
     // Given a query bounding box, specified by the bottom left point p1 and
     // bottom-right point p2, initialize an iterator, which successively returns
     // ranges of VirtualIndices to check.
-    virtual IndexList Matches(const Query<D>& query) const = 0;
+    // If the query doesn't filter this column, the result is the universe.
+    virtual MatchResult Matches(const Query<D>& query) const = 0;
+
+    // The same indexes as Matches, as a compressed bitmap.
+    virtual RoaringSet MatchesBitmap(const Query<D>& query) const {
+        MatchResult m = Matches(query);
+        if (!m.IsList()) {
+            return RoaringSet::FromRanges(m.ranges);
+        }
+        return m.list.Visit([](const auto& ids) { return RoaringSet::FromList(ids); });
+    }
 
     virtual void Init(ConstPointIterator<D> start,
             ConstPointIterator<D> end) = 0;
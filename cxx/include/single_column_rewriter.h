@@ -10,6 +10,7 @@
 
 #include "types.h"
 #include "rewriter.h"
+#include <utility>
 #include <vector>
 
 template <size_t D>
@@ -27,19 +28,12 @@ class SingleColumnRewriter : public Rewriter<D> {
     }
 
     size_t Size() const override {
-        size_t s = 0;
-        if (cmap_categorical_.size() > 0) {
-            for (auto it = cmap_categorical_.cbegin(); it != cmap_categorical_.cend(); it++) {
-                s += sizeof(Scalar) + it->second.size() * sizeof(Scalar);
-            }
-        }
-        if (cmap_continuous_.size() > 0) {
-            for (auto it = cmap_continuous_.cbegin(); it != cmap_continuous_.cend(); it++) {
-                s += sizeof(Scalar) + it->second.size() * sizeof(ScalarRange);
-            }
-        }
-        s += 2 * sizeof(size_t);
-        return s;
+        return bucket_ends_.size() * sizeof(Scalar)
+            + (range_offsets_.size() + node_offsets_.size()) * sizeof(size_t)
+            + (ranges_.size() + node_ranges_.size()) * sizeof(ScalarRange)
+            + (values_.size() + value_targets_.size()) * sizeof(Scalar)
+            + value_offsets_.size() * sizeof(size_t)
+            + 2 * sizeof(size_t);
     }
 
     IndexList Rewrite(Query<D>& q) override;
@@ -63,15 +57,33 @@ class SingleColumnRewriter : public Rewriter<D> {
     QueryFilter RewriteRangeFilter(const QueryFilter& mapped, const QueryFilter& target) const;
     QueryFilter RewriteValueFilter(const QueryFilter& mapped, const QueryFilter& target) const;
 
-
+    // Writes the union of the target ranges of buckets [lo, hi] into *out, sorted and coalesced.
+    void BucketRanges(size_t lo, size_t hi, std::vector<ScalarRange>* out) const;
 
   private:
-    // For categorical variables, we map each value to a set of target values.
-    // Unioning is simple to do with a set. 
-    std::map<Scalar, std::vector<Scalar>> cmap_categorical_;
-    // For continuous variables, each value (marking the *end* of a column) is mapped to a sequence
-    // of target value ranges. Unioning is done by a linear merge algorithm.
-    std::map<Scalar, std::vector<ScalarRange>> cmap_continuous_;
+    // Builds the union tree over the continuous mapping.
+    void BuildTree();
+    // The target ranges held by a node of the union tree, as [begin, end).
+    std::pair<const ScalarRange*, const ScalarRange*> Node(size_t k) const;
+
+    // Continuous mappings, in CSR form. Bucket i ends at bucket_ends_[i] (the previous bucket's
+    // end is its start) and maps to ranges_[range_offsets_[i]:range_offsets_[i+1]], which are
+    // sorted and disjoint.
+    std::vector<Scalar> bucket_ends_;
+    std::vector<size_t> range_offsets_;
+    std::vector<ScalarRange> ranges_;
+    // Bottom-up segment tree over the buckets, caching the union of the ranges under each node.
+    // The leaves are the buckets themselves, as node n + i. Internal node k < n holds the union of
+    // nodes 2k and 2k+1 in node_ranges_[node_offsets_[k]:node_offsets_[k+1]].
+    std::vector<size_t> node_offsets_;
+    std::vector<ScalarRange> node_ranges_;
+
+    // Categorical mappings, in CSR form: values_[i] maps to the sorted, distinct targets
+    // value_targets_[value_offsets_[i]:value_offsets_[i+1]]. values_ is sorted.
+    std::vector<Scalar> values_;
+    std::vector<size_t> value_offsets_;
+    std::vector<Scalar> value_targets_;
+
     // The rewriter maps values in mapped_dim_ to values in target_dim_ and adds those target_dim_
     // values to the query.
     size_t mapped_dim_;
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "types.h"
+
+/*
+ * The bucketing and stashing steps shared by the builders of correlation maps. Mapped columns are
+ * cut into equi-depth buckets, and every target bucket decides on its own, with the cost model in
+ * TargetBucket::CostToStash, which of the mapped buckets (or grid cells) it holds are cheaper to
+ * keep as outliers.
+ */
+class StashUtils {
+  private:
+    StashUtils() {}
+
+  public:
+    // Decisions made by a single target bucket.
+    template <typename K>
+    struct StashResult {
+        // Keys of the mapped buckets it holds, in increasing order.
+        std::vector<K> keys;
+        // Whether each of them stays an inlier.
+        std::vector<bool> inlier;
+        // Positions of the rows in stashed buckets, in increasing order.
+        IndexList outliers;
+    };
+
+    // Left bounds of num_buckets equi-depth buckets on column col, followed by one past the
+    // largest value. Bounds shared by several buckets, when many points have the same value, are
+    // only kept once.
+    template <size_t D>
+    static std::vector<Scalar> EquiDepthBounds(ConstPointIterator<D> start,
+            ConstPointIterator<D> end, size_t col, size_t num_buckets);
+
+    // Stash decisions for a target bucket whose rows are in the mapped buckets row_keys[0:n].
+    template <typename K>
+    static StashResult<K> StashTarget(const K* row_keys, size_t n, float storage_factor);
+};
+
+#include "../src/stash_utils.hpp"
@@ -3,6 +3,9 @@
 #include <vector>
 #include <memory>
 #include <iostream>
+#include <algorithm>
+#include <array>
+#include <omp.h>
 
 #include "types.h"
 #include "math_utils.h"
@@ -10,56 +13,124 @@
 
 const Scalar NINF = -(1LL << 45);
 
+/*
+ * Running sums of x, y, x*x and x*y over the sorted points of a TRS tree under construction,
+ * taken relative to the first point. The regression statistics of a node are the difference of
+ * two entries, so every level of the tree shares one pass over the data instead of rereading its
+ * slice. The differences carry the rounding error of the whole prefix, so once a node's spread is
+ * small compared to the column's, Fit gives up and the node fits its own slice directly.
+ */
+struct TRSPrefixSums {
+    static constexpr size_t MIN_PARALLEL_SIZE = 1 << 16;
+    // Smallest ratio of a node's sum of squares to the running sum for which Fit is trusted.
+    static constexpr double MIN_RELATIVE_SPREAD = 1e-6;
+
+    size_t base;
+    Scalar x0, y0;
+    std::vector<double> x, y, xx, xy;
+
+    // Runs as OpenMP tasks, so it must be called from inside a parallel region.
+    void Build(const std::vector<Scalar>& xs, const std::vector<Scalar>& ys,
+            size_t index_start, size_t index_end) {
+        base = index_start;
+        x0 = xs[index_start];
+        y0 = ys[index_start];
+        size_t n = index_end - index_start;
+        x.assign(n + 1, 0);
+        y.assign(n + 1, 0);
+        xx.assign(n + 1, 0);
+        xy.assign(n + 1, 0);
+        // Scan each block in parallel, then shift every block by the totals of the ones before it.
+        size_t nblocks = n < MIN_PARALLEL_SIZE ? 1 : omp_get_num_threads();
+        size_t block_size = (n + nblocks - 1) / nblocks;
+        #pragma omp taskloop default(shared) grainsize(1)
+        for (size_t b = 0; b < nblocks; b++) {
+            size_t lo = std::min(n, b * block_size);
+            size_t hi = std::min(n, lo + block_size);
+            double sx = 0, sy = 0, sxx = 0, sxy = 0;
+            for (size_t i = lo; i < hi; i++) {
+                double dx = xs[base + i] - x0;
+                double dy = ys[base + i] - y0;
+                x[i+1] = sx += dx;
+                y[i+1] = sy += dy;
+                xx[i+1] = sxx += dx * dx;
+                xy[i+1] = sxy += dx * dy;
+            }
+        }
+        std::vector<std::array<double, 4>> carry(nblocks, {0, 0, 0, 0});
+        for (size_t b = 1; b < nblocks; b++) {
+            size_t last = std::min(n, b * block_size);
+            carry[b] = {carry[b-1][0] + x[last], carry[b-1][1] + y[last],
+                carry[b-1][2] + xx[last], carry[b-1][3] + xy[last]};
+        }
+        #pragma omp taskloop default(shared) grainsize(1)
+        for (size_t b = 1; b < nblocks; b++) {
+            size_t lo = std::min(n, b * block_size);
+            size_t hi = std::min(n, lo + block_size);
+            for (size_t i = lo + 1; i <= hi; i++) {
+                x[i] += carry[b][0];
+                y[i] += carry[b][1];
+                xx[i] += carry[b][2];
+                xy[i] += carry[b][3];
+            }
+        }
+    }
+
+    // Least squares fit of the points in [index_start, index_end). Returns false if the running
+    // sums are too imprecise for this range.
+    bool Fit(size_t index_start, size_t index_end, std::pair<double, double>* coeffs) const {
+        size_t s = index_start - base, e = index_end - base;
+        size_t n = e - s;
+        double c_x = x[e] - x[s];
+        double c_xx = xx[e] - xx[s];
+        if (!(c_xx - c_x * c_x / n > MIN_RELATIVE_SPREAD * xx[e])) {
+            return false;
+        }
+        *coeffs = LinearModel::FromSums(n, c_x, y[e] - y[s], c_xx, xy[e] - xy[s], x0, y0);
+        return true;
+    }
+};
+
 struct TRSNode {
+    // Nodes with fewer points than this are built on the spawning thread rather than as a new
+    // task, and scan their points in a single pass.
+    static constexpr size_t MIN_POINTS_PER_TASK = 1 << 16;
+
     std::vector<std::unique_ptr<TRSNode>> children;
     // The bounds on the mapped column this node is responsible for.
     ScalarRange bounds; 
     // tolerance is the same as \epsilon from the paper
     double slope, intercept, err_bound, outlier_ratio, tolerance;
     int fanout, depth, max_depth;
+    // Outliers of a leaf, held until Build gathers them.
+    std::vector<size_t> leaf_outliers;
 
     TRSNode(float err_bnd, float outlier_frac, int nchild, int d, int max_d) 
         : children(), slope(0), intercept(0), err_bound(err_bnd),
-            outlier_ratio(outlier_frac), fanout(nchild), depth(d), max_depth(max_d) {
+            outlier_ratio(outlier_frac), fanout(nchild), depth(d), max_depth(max_d),
+            leaf_outliers() {
     }
 
-    std::vector<size_t> Split(const std::vector<Scalar>& xs, const std::vector<Scalar>& ys, size_t index_start, size_t index_end) { 
-        Scalar xmin = xs[index_start];
-        Scalar xmax = xs[index_end-1];
-        double div = (xmax - xmin + 1) / (double)fanout;
-        double thresh = div + xmin;
-        size_t prev_ix = index_start;
-        children.reserve(fanout);
+    // x values must be sorted. index_end is exclusive. Returns the outliers in the order of the
+    // leaves, followed by the NULL values. Subtrees are built as OpenMP tasks, in the enclosing
+    // parallel region if there is one, so several trees can share one team of threads.
+    std::vector<size_t> Build(const std::vector<Scalar>& xs, const std::vector<Scalar>& ys,
+            size_t index_start, size_t index_end) {
         std::vector<size_t> outliers;
-        for (size_t ix = index_start; ix < index_end; ix++) {
-           if (xs[ix] >= thresh) {
-                while (thresh <= xs[ix]) {
-                    thresh += div;
-                }
-                std::unique_ptr<TRSNode> child = std::make_unique<TRSNode>(
-                        err_bound, outlier_ratio, fanout, depth+1, max_depth);
-                children.push_back(std::move(child));
-                auto out = children.back()->Build(xs, ys, prev_ix, ix);
-                outliers.insert(outliers.end(), out.begin(), out.end());
-                prev_ix = ix;
-           }
-        }
-        AssertWithMessage(children.size() < fanout, "Got " + std::to_string(children.size()) + 
-                " children but was expecting less than " + std::to_string(fanout) + ": " +
-                " xmin = " + std::to_string(xmin) + ", xmax = " + std::to_string(xmax) + 
-                ", div = " + std::to_string(div));
-        std::unique_ptr<TRSNode> child = std::make_unique<TRSNode>(
-                err_bound, outlier_ratio, fanout, depth+1, max_depth);
-        children.push_back(std::move(child));
-        auto out = children.back()->Build(xs, ys, prev_ix, index_end);
-        outliers.insert(outliers.end(), out.begin(), out.end());
-        return outliers; 
+        if (omp_in_parallel()) {
+            outliers = BuildTasks(xs, ys, index_start, index_end);
+        } else {
+            #pragma omp parallel
+            #pragma omp single
+            outliers = BuildTasks(xs, ys, index_start, index_end);
+        }
+        return outliers;
     }
 
-    // x values must be sorted. index_end is exclusive.
-    std::vector<size_t> Build(const std::vector<Scalar>& xs, const std::vector<Scalar>& ys,
+    // Body of Build, run by a single thread of a parallel region.
+    std::vector<size_t> BuildTasks(const std::vector<Scalar>& xs, const std::vector<Scalar>& ys,
             size_t index_start, size_t index_end) {
-        std::vector<size_t> outlier_indexes;
+        std::vector<size_t> null_indexes;
         if (depth == 0) {
             std::cout << "Building TRS Tree with err_bound = " << err_bound
                 << ", max_depth = " << max_depth
@@ -67,11 +138,40 @@ struct TRSNode {
                 << ", fanout = " << fanout << std::endl;
             AssertWithMessage(std::is_sorted(xs.begin(), xs.end()), "X values are not sorted");
             while(xs[index_start] < NINF) {
-                outlier_indexes.push_back(index_start);
+                null_indexes.push_back(index_start);
                 index_start++;
             }
             std::cout << "Found " << index_start << " NULL values" << std::endl;
         }
+        TRSPrefixSums sums;
+        sums.Build(xs, ys, index_start, index_end);
+        BuildNode(xs, ys, sums, index_start, index_end);
+
+        // Concatenate the leaves' outliers in order.
+        std::vector<TRSNode*> leaves;
+        CollectLeaves(&leaves);
+        std::vector<size_t> offsets(leaves.size() + 1, 0);
+        for (size_t i = 0; i < leaves.size(); i++) {
+            offsets[i+1] = offsets[i] + leaves[i]->leaf_outliers.size();
+        }
+        std::vector<size_t> outliers(offsets.back() + null_indexes.size());
+        #pragma omp taskloop default(shared)
+        for (size_t i = 0; i < leaves.size(); i++) {
+            std::copy(leaves[i]->leaf_outliers.begin(), leaves[i]->leaf_outliers.end(),
+                    outliers.begin() + offsets[i]);
+            std::vector<size_t>().swap(leaves[i]->leaf_outliers);
+        }
+        std::copy(null_indexes.begin(), null_indexes.end(), outliers.begin() + offsets.back());
+        return outliers;
+    }
+
+    bool IsOutlier(Scalar x, Scalar y) const {
+        double line = slope * x + intercept;
+        return line + tolerance < y || line - tolerance > y;
+    }
+
+    void BuildNode(const std::vector<Scalar>& xs, const std::vector<Scalar>& ys,
+            const TRSPrefixSums& sums, size_t index_start, size_t index_end) {
         Scalar xmin = xs[index_start];
         Scalar xmax = xs[index_end-1];
         size_t npts = index_end - index_start;
@@ -79,44 +179,115 @@ struct TRSNode {
         bounds = {xmin, xmax};
         if (xmin == xmax) {
             // Take all y values within 1 stdev of the mean.
-            double yavg = std::accumulate(ys.begin() + index_start, ys.begin() + index_end, 0.0);
+            double yavg = 0, y2 = 0;
+            for (size_t i = index_start; i < index_end; i++) {
+                yavg += ys[i];
+                y2 += (double)ys[i] * ys[i];
+            }
             yavg /= npts;
-            double y2 = std::inner_product(ys.begin() + index_start, ys.begin() + index_end,
-                    ys.begin() + index_start, 0.0);
             y2 /= npts;
             tolerance = sqrt(y2 - yavg*yavg);
             intercept = 0;
             slope = double(yavg) / xmin;
         } else {
-            auto coeffs = LinearModel::Fit(xs.begin() + index_start, xs.begin() + index_end, ys.begin() + index_start);
+            std::pair<double, double> coeffs;
+            if (!sums.Fit(index_start, index_end, &coeffs)) {
+                coeffs = LinearModel::Fit(xs.begin() + index_start, xs.begin() + index_end,
+                        ys.begin() + index_start);
+            }
             intercept = coeffs.second;
             slope = coeffs.first;
             tolerance = fabs(slope * (xmax - xmin) * err_bound / (2.*npts));
             size_t num_outliers = 0;
-            for (size_t i = index_start; i < index_end; i++) {
-                double line = slope* xs[i] + intercept;
-                num_outliers += (line + tolerance < ys[i] || line-tolerance > ys[i]); 
+            if (npts < 2 * MIN_POINTS_PER_TASK) {
+                for (size_t i = index_start; i < index_end; i++) {
+                    num_outliers += IsOutlier(xs[i], ys[i]);
+                }
+            } else {
+                #pragma omp taskloop default(shared) grainsize(MIN_POINTS_PER_TASK) \
+                    reduction(+:num_outliers)
+                for (size_t i = index_start; i < index_end; i++) {
+                    num_outliers += IsOutlier(xs[i], ys[i]);
+                }
             }
             if (num_outliers > npts * outlier_ratio && depth < max_depth) {
-                std::cout << "Splitting node: depth = " << depth << ", slope = " << slope
-                    << ", intercept = " << intercept
-                    << ", tolerance = " << tolerance
-                    << ", num_outliers = " << num_outliers << std::endl;
-                auto outliers = Split(xs, ys, index_start, index_end);
-                if (outlier_indexes.size() > 0) {
-                    outliers.insert(outliers.end(), outlier_indexes.begin(), outlier_indexes.end());
+                Split(xs, ys, sums, index_start, index_end);
+                return;
+            }
+        }
+        size_t nchunks = (npts + MIN_POINTS_PER_TASK - 1) / MIN_POINTS_PER_TASK;
+        if (nchunks == 1) {
+            for (size_t i = index_start; i < index_end; i++) {
+                if (IsOutlier(xs[i], ys[i])) {
+                    leaf_outliers.push_back(i);
+                }
+            }
+            return;
+        }
+        std::vector<std::vector<size_t>> chunk_outliers(nchunks);
+        #pragma omp taskloop default(shared) grainsize(1)
+        for (size_t c = 0; c < nchunks; c++) {
+            size_t lo = index_start + c * MIN_POINTS_PER_TASK;
+            size_t hi = std::min(index_end, lo + MIN_POINTS_PER_TASK);
+            for (size_t i = lo; i < hi; i++) {
+                if (IsOutlier(xs[i], ys[i])) {
+                    chunk_outliers[c].push_back(i);
                 }
-                return outliers;
             }
         }
-        outlier_indexes.reserve(outlier_ratio * xs.size() + outlier_indexes.size());
-        for (size_t i = index_start; i < index_end; i++) {
-            double line = slope * xs[i] + intercept;
-            if (line + tolerance < ys[i] || line-tolerance > ys[i]) {
-               outlier_indexes.push_back(i);
-            } 
+        for (const auto& out : chunk_outliers) {
+            leaf_outliers.insert(leaf_outliers.end(), out.begin(), out.end());
+        }
+    }
+
+    void Split(const std::vector<Scalar>& xs, const std::vector<Scalar>& ys,
+            const TRSPrefixSums& sums, size_t index_start, size_t index_end) { 
+        Scalar xmin = xs[index_start];
+        Scalar xmax = xs[index_end-1];
+        double div = (xmax - xmin + 1) / (double)fanout;
+        double thresh = div + xmin;
+        // Each child starts at the first point at or past the previous child's threshold.
+        std::vector<size_t> child_starts = {index_start};
+        auto it = xs.begin() + index_start;
+        auto end = xs.begin() + index_end;
+        while ((it = std::lower_bound(it, end, thresh,
+                        [](Scalar x, double t) { return x < t; })) != end) {
+            while (thresh <= *it) {
+                thresh += div;
+            }
+            child_starts.push_back(it - xs.begin());
+        }
+        AssertWithMessage(child_starts.size() <= (size_t)fanout, "Got " + std::to_string(child_starts.size()) + 
+                " children but was expecting at most " + std::to_string(fanout) + ": " +
+                " xmin = " + std::to_string(xmin) + ", xmax = " + std::to_string(xmax) + 
+                ", div = " + std::to_string(div));
+        child_starts.push_back(index_end);
+
+        // Children own disjoint slices of the points, so large ones are built concurrently.
+        children.reserve(child_starts.size() - 1);
+        for (size_t c = 0; c + 1 < child_starts.size(); c++) {
+            children.push_back(std::make_unique<TRSNode>(
+                        err_bound, outlier_ratio, fanout, depth+1, max_depth));
+            TRSNode* child = children.back().get();
+            size_t lo = child_starts[c], hi = child_starts[c+1];
+            if (hi - lo >= MIN_POINTS_PER_TASK) {
+                #pragma omp task default(shared) firstprivate(child, lo, hi)
+                child->BuildNode(xs, ys, sums, lo, hi);
+            } else {
+                child->BuildNode(xs, ys, sums, lo, hi);
+            }
+        }
+        #pragma omp taskwait
+    }
+
+    // Appends the leaves under this node in order.
+    void CollectLeaves(std::vector<TRSNode*>* leaves) {
+        if (children.empty()) {
+            leaves->push_back(this);
+        }
+        for (auto& c : children) {
+            c->CollectLeaves(leaves);
         }
-        return outlier_indexes;
     }
 
     void Lookup(ScalarRange query_range, std::vector<ScalarRange>* ranges) {
@@ -143,9 +314,7 @@ struct TRSNode {
         }
         // Otherwise, this is the root and we need to sort and merge them.
         std::sort(ranges->begin(), ranges->end(), ScalarRangeStartComp{});
-        std::cout << "Merge ranges begin" << std::endl;
         auto merged = MergeUtils::Coalesce(ranges->begin(), ranges->end());
-        std::cout << "Merge ranges end" << std::endl;
         ranges->assign(merged.begin(), merged.end());
     }
 
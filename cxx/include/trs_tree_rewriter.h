@@ -1,5 +1,6 @@
 /*
- * Dispatches to multiple linear rewriters on different columns.
+ * Rewrites a range filter on the mapped column into ranges on the target column, using a TRS tree
+ * fit to the data. Points the tree doesn't cover are returned from an auxiliary outlier index.
  */
 
 #pragma once
@@ -10,7 +11,8 @@
 #include "types.h"
 #include "rewriter.h"
 #include "trs_node.h"
-#include "secondary_indexer.h"
+#include "flat_trs_tree.h"
+#include "secondary_btree_index.h"
 
 template <size_t D>
 class TRSTreeRewriter : public Rewriter<D> {
@@ -25,10 +27,19 @@ class TRSTreeRewriter : public Rewriter<D> {
 
     IndexList Rewrite(Query<D>& q) override;
 
+    // Coalesced target ranges for the mapped range filter. The result is reused by the next call.
+    const std::vector<ScalarRange>& TargetRanges(const std::vector<ScalarRange>& mapped_ranges);
+
+    // Outliers whose mapped value matches the query.
+    IndexList Outliers(const Query<D>& q) const;
+
+    size_t GetMappedColumn() const { return mapped_dim_; }
+    size_t GetTargetColumn() const { return target_dim_; }
+
     void WriteOutliers(const IndexList& outliers);
 
     size_t Size() const override {
-        size_t s = trs_root_->Size();
+        size_t s = flat_trs_.Size();
         if (outlier_index_ != nullptr) {
             s += outlier_index_->Size();
         }
@@ -37,6 +48,11 @@ class TRSTreeRewriter : public Rewriter<D> {
 
   private:
     std::unique_ptr<TRSNode> trs_root_;
+    // Compiled from trs_root_ once it's built, and used for every lookup.
+    FlatTRSTree flat_trs_;
+    // Reused across queries to avoid reallocating the rewritten ranges.
+    std::vector<ScalarRange> trs_ranges_;
+    std::vector<ScalarRange> lookup_ranges_;
     // The rewriter maps values in mapped_dim_ to values in target_dim_ and adds those target_dim_
     // values to the query.
     size_t mapped_dim_;
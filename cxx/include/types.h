@@ -5,11 +5,15 @@
 #pragma once
 #include <vector>
 #include <array>
+#include <algorithm>
+#include <numeric>
 #include <cmath>
 #include <limits>
 #include <set>
 #include <memory>
 
+#include "row_ids.h"
+
 #ifndef DIM
 #define DIM 4
 #endif
@@ -171,6 +175,96 @@ struct PhysicalIndexSet {
     PhysicalIndexSet() : ranges(), list() {}
 };
 
+// The output of secondary indexes. Besides an explicit list of indexes, it can represent every row
+// or a list of ranges symbolically, so an index whose column isn't filtered costs nothing.
+struct MatchResult {
+    enum Kind { UNIVERSE, RANGES, SORTED_LIST, UNSORTED_LIST };
+
+    Kind kind;
+    // For UNIVERSE, the single range [0, n). For RANGES, sorted and non-overlapping ranges.
+    IndexRangeList ranges;
+    // For SORTED_LIST and UNSORTED_LIST, at the width the index that produced them stores its rows
+    // in. Lists are only widened when they are handed to the engine as a PhysicalIndexSet.
+    RowIds list;
+
+    MatchResult() : kind(SORTED_LIST), ranges(), list() {}
+
+    static MatchResult Universe(size_t n) {
+        MatchResult m;
+        m.kind = UNIVERSE;
+        if (n > 0) {
+            m.ranges.emplace_back(0, n);
+        }
+        return m;
+    }
+    static MatchResult FromRanges(IndexRangeList rgs) {
+        MatchResult m;
+        m.kind = RANGES;
+        m.ranges = std::move(rgs);
+        return m;
+    }
+    template <typename Id>
+    static MatchResult FromSortedList(std::vector<Id> lst) {
+        MatchResult m;
+        m.list = RowIds(std::move(lst));
+        return m;
+    }
+    static MatchResult FromSortedList(IndexList lst) {
+        return FromSortedList<PhysicalIndex>(std::move(lst));
+    }
+    template <typename Id>
+    static MatchResult FromList(std::vector<Id> lst) {
+        MatchResult m;
+        m.kind = UNSORTED_LIST;
+        m.list = RowIds(std::move(lst));
+        return m;
+    }
+    static MatchResult FromList(IndexList lst) {
+        return FromList<PhysicalIndex>(std::move(lst));
+    }
+
+    bool IsUniverse() const { return kind == UNIVERSE; }
+    bool IsList() const { return kind == SORTED_LIST || kind == UNSORTED_LIST; }
+    bool Empty() const { return IsList() ? list.empty() : ranges.empty(); }
+
+    // Number of indexes in the result.
+    size_t Size() const {
+        if (IsList()) {
+            return list.size();
+        }
+        size_t size = 0;
+        for (const auto& r : ranges) {
+            size += r.end - r.start;
+        }
+        return size;
+    }
+
+    void Sort() {
+        if (kind == UNSORTED_LIST) {
+            list.Visit([](auto& l) { std::sort(l.begin(), l.end()); });
+            kind = SORTED_LIST;
+        }
+    }
+
+    // Materializes the indexes. Ranges are expanded in order, while lists keep their order.
+    IndexList ToList() const {
+        if (IsList()) {
+            return list.ToWide();
+        }
+        IndexList lst(Size());
+        auto it = lst.begin();
+        for (const auto& r : ranges) {
+            std::iota(it, it + (r.end - r.start), r.start);
+            it += r.end - r.start;
+        }
+        return lst;
+    }
+
+    PhysicalIndexSet ToIndexSet() const {
+        return IsList() ? PhysicalIndexSet({}, list.ToWide()) : PhysicalIndexSet(ranges, {});
+    }
+};
+
 enum IndexerType { Primary, Secondary, Correlation, Rewriting };
 
 struct PrimaryIndexNode {
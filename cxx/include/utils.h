@@ -93,6 +93,20 @@ std::string QueryFilterToString(const QueryFilter& qf) {
     return buffer.str();
 }
 
+// Memory the OS reports as available for new allocations, in bytes, or 0 if it can't be read.
+size_t AvailableMemoryBytes() {
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    size_t kb;
+    std::string unit;
+    while (meminfo >> key >> kb >> unit) {
+        if (key == "MemAvailable:") {
+            return kb * 1024;
+        }
+    }
+    return 0;
+}
+
 template <typename K>
 std::vector<K> load_binary_file(const std::string &filename) {
     std::vector<K> result;
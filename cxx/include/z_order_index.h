@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "types.h"
+#include "utils.h"
+#include "primary_indexer.h"
+
+/**
+ * Clusters the data along a Z-order (Morton) curve over the indexed dimensions. Each indexed value
+ * is quantized to a fixed number of bits and the bits of all dimensions are interleaved into a
+ * 64-bit key, with the first indexed dimension in the most significant position.
+ *
+ * A query box is decomposed into intervals of Z-values by repeatedly splitting it at the most
+ * significant bit where its corners differ, which yields the LITMAX / BIGMIN pair of the split.
+ * Intervals are mapped to row ranges with a sparse directory holding the first key of every page.
+ */
+template <size_t D>
+class ZOrderIndex : public PrimaryIndexer<D> {
+    public:
+        ZOrderIndex(std::vector<size_t>& index_dims, size_t page_size);
+
+        void Init(PointIterator<D> start, PointIterator<D> end) override;
+        PhysicalIndexSet Ranges(Query<D>&) override;
+
+        size_t Size() const override {
+            return page_keys_.size() * sizeof(uint64_t)
+                + index_dims_.size() * (2 * sizeof(Scalar) + sizeof(uint64_t) + sizeof(uint32_t));
+        }
+
+        std::unordered_set<size_t> GetColumns() const override {
+            return std::unordered_set<size_t>(index_dims_.cbegin(), index_dims_.cend());
+        }
+
+        void WriteStats(std::ofstream& statsfile) override {
+            statsfile << "primary_index_type: zorder_";
+            for (size_t d : index_dims_) {
+                statsfile << d << "_";
+            }
+            statsfile << "p" << page_size_ << std::endl;
+        }
+
+        // Interleaves quantized cell coordinates (one per indexed dimension) into a Z-value.
+        // Public for testing.
+        uint64_t Encode(const std::vector<uint64_t>& cell) const;
+
+    private:
+        // A box of quantized cells, inclusive on both ends, per indexed dimension.
+        struct CellBox {
+            std::vector<uint64_t> lo;
+            std::vector<uint64_t> hi;
+        };
+
+        // Quantized cell of a value in the given indexed dimension.
+        uint64_t CellFor(size_t i, Scalar val) const;
+        // Converts the query to a box of cells. Returns false if no cell can match.
+        bool QueryBox(const Query<D>& query, CellBox* box) const;
+        // True if every Z-value between the box corners lies inside the box.
+        bool IsContiguous(const CellBox& box, uint64_t zlo, uint64_t zhi) const;
+        // Row range [start, end) that contains every key in [zlo, zhi].
+        PhysicalIndexRange RowsFor(uint64_t zlo, uint64_t zhi) const;
+
+        std::vector<size_t> index_dims_;
+        size_t page_size_;
+        size_t data_size_;
+        // Number of bits each dimension contributes to the key.
+        uint32_t bits_per_dim_;
+        std::vector<Scalar> mins_;
+        std::vector<Scalar> maxs_;
+        // Values are shifted right by this much after subtracting the minimum.
+        std::vector<uint32_t> shifts_;
+        // The key bits that belong to each indexed dimension.
+        std::vector<uint64_t> dim_masks_;
+        // First key of each page of page_size_ rows, followed by the last key in the data.
+        std::vector<uint64_t> page_keys_;
+
+        // Upper bound on the number of Z-intervals a single query is split into.
+        static const size_t MAX_INTERVALS = 4096;
+};
+
+#include "../src/z_order_index.hpp"
@@ -131,7 +131,7 @@ void run_workload(QueryEngine<DIM>& engine,
 int main(int argc, char** argv) {
     if (argc < 4) {
         std::cerr << "Expected arguments: --dataset --workload --visitor "
-            << "--indexer-spec --save [--base-cols]" << std::endl;
+            << "--indexer-spec --save [--base-cols] [--bitmap-scan]" << std::endl;
         return EX_USAGE;
     }
     auto flags = ParseFlags(argc, argv);
@@ -170,7 +170,13 @@ int main(int argc, char** argv) {
     std::cout << "Not using datacubes" << std::endl;
     bool use_datacubes = false;
 
-    auto dataset = std::make_shared<InMemoryColumnOrderDataset<DIM>>(data);
+    std::shared_ptr<Dataset<DIM>> dataset;
+    if (indexer->MovesRowsOnQuery()) {
+        // The indexer keeps reordering data, so scan it in place.
+        dataset = std::make_shared<RowOrderDatasetView<DIM>>(data.cbegin(), data.cend());
+    } else {
+        dataset = std::make_shared<InMemoryColumnOrderDataset<DIM>>(data);
+    }
     //auto dataset = std::make_shared<CompressedColumnOrderDataset<DIM>>(data);
     auto compression_finish = std::chrono::high_resolution_clock::now();
     auto compression_time = std::chrono::duration_cast<std::chrono::nanoseconds>(compression_finish-compression_start).count();
@@ -179,6 +185,7 @@ int main(int argc, char** argv) {
     std::cout << "Indexer sizei (B): " << indexer_size_bytes << std::endl;
 
     QueryEngine<DIM> engine(dataset, indexer);
+    engine.SetBitmapScan(GetWithDefault(flags, "bitmap-scan", "false") == "true");
     auto index_creation_finish = std::chrono::high_resolution_clock::now();
     auto index_creation_time = std::chrono::duration_cast<std::chrono::nanoseconds>(index_creation_finish-index_creation_start).count();
     std::cout << "Index creation time: " << index_creation_time / 1e9 << "s" << std::endl;
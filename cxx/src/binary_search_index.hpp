@@ -8,6 +8,8 @@
 
 #include "types.h"
 #include "utils.h"
+#include "radix_sort.h"
+#include "permutation_utils.h"
 
 template <size_t D>
 BinarySearchIndex<D>::BinarySearchIndex(size_t dim)
@@ -82,40 +84,23 @@ PhysicalIndexSet BinarySearchIndex<D>::Ranges(Query<D>& q) {
 template <size_t D>
 void BinarySearchIndex<D>::Init(PointIterator<D> start, PointIterator<D> end) {
     size_t s = std::distance(start, end);
-    std::vector<std::pair<Scalar, size_t>> indices(s);
-    size_t i = 0;
-    for (auto it = start; it != end; it++, i++) {
-        Scalar ix_val = (*it)[column_];
-        indices[i] = std::make_pair(ix_val, i);
+    std::vector<Scalar> keys(s);
+    std::vector<size_t> order(s);
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < s; i++) {
+        keys[i] = (*(start + i))[column_];
+        order[i] = i;
     }
 
     // Sort by this array instead, preserving the existing order as much as possible.
-    std::stable_sort(indices.begin(), indices.end(),
-        [](const std::pair<Scalar, size_t>& a, const std::pair<Scalar, size_t>& b) -> bool {
-            return a.first < b.first;
-        });
+    RadixSort::Sort(keys, order);
     bool data_modified = false;
-    for (size_t i = 0; i < indices.size(); i++) {
-        if (i != indices[i].second) {
-            std::cout << "Index " << indices[i].second << " sorted into position " << i << std::endl;
-            data_modified = true;
-        }
+    for (size_t i = 0; i < order.size() && !data_modified; i++) {
+        data_modified = (i != order[i]);
     }
 
-    sorted_data_ = std::vector<Scalar>(s);
-    std::vector<Point<D>> data_cpy(s);
-    const auto start_tmp = start;
-    std::transform(indices.begin(), indices.end(), data_cpy.begin(),
-            [start](const auto& ix_pair) -> Point<D> {
-                return *(start + ix_pair.second);
-                });
-
-    size_t col = column_;
-    std::transform(data_cpy.cbegin(), data_cpy.cend(), sorted_data_.begin(),
-            [col](const Point<D>& pt) -> Scalar {
-                return pt[col];
-                });
-    std::copy(data_cpy.cbegin(), data_cpy.cend(), start);
+    PermutationUtils::ApplyParallel(start, order);
+    sorted_data_ = std::move(keys);
     AssertWithMessage(std::is_sorted(sorted_data_.begin(), sorted_data_.end()),
             "BinarySearchIndex data was not sorted");
     if (data_modified) {
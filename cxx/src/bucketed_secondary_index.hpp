@@ -6,8 +6,9 @@
 #include <iostream>
 
 #include "merge_utils.h"
-#include "file_utils.h"
+#include "mapping_artifacts.h"
 #include "utils.h"
+#include "loser_tree.h"
 
 template <size_t D>
 BucketedSecondaryIndex<D>::BucketedSecondaryIndex(size_t dim)
@@ -47,36 +48,65 @@ void BucketedSecondaryIndex<D>::Init(ConstPointIterator<D> start, ConstPointIter
     std::cout << "Finished building map" << std::endl;
     size_t minsize = std::numeric_limits<size_t>::max();
     size_t maxsize = 0;
-    for (auto it = buckets_.begin(); it != buckets_.end(); it++) {
-        std::sort(it->second.begin(), it->second.end());
-        minsize = std::min(minsize, it->second.size());
-        maxsize = std::max(maxsize, it->second.size());
-    }
-    std::cout << "Finished creating BucketedSecondaryIndex with " << buckets_.size()
-        << " buckets, smallest = " << minsize << ", largest = " << maxsize << std::endl;
+    bucket_keys_.clear();
+    bucket_mins_.clear();
+    bucket_maxs_.clear();
+    bucket_offsets_.assign(1, 0);
+    values_.clear();
+    bucket_blocks_.assign(1, 0);
+    block_ids_.clear();
+    block_starts_.clear();
+    values_.reserve(indexed_size_);
+    rows_.Reset(data_size_);
+    rows_.Visit([&](auto& rows) {
+        rows.reserve(indexed_size_);
+        for (auto it = buckets_.begin(); it != buckets_.end(); it++) {
+            if (it->second.empty()) {
+                continue;
+            }
+            std::sort(it->second.begin(), it->second.end());
+            minsize = std::min(minsize, it->second.size());
+            maxsize = std::max(maxsize, it->second.size());
+            Scalar minval = std::numeric_limits<Scalar>::max();
+            Scalar maxval = std::numeric_limits<Scalar>::lowest();
+            for (PhysicalIndex ix : it->second) {
+                Scalar v = (*(start + ix))[this->column_];
+                minval = std::min(minval, v);
+                maxval = std::max(maxval, v);
+                uint64_t block = ix >> BLOCK_BITS;
+                if (rows.size() == bucket_offsets_.back() || block != block_ids_.back()) {
+                    block_ids_.push_back(block);
+                    block_starts_.push_back(rows.size());
+                }
+                rows.push_back(ix);
+                values_.push_back(v);
+            }
+            // The bucket's list isn't needed anymore.
+            IndexList().swap(it->second);
+            bucket_keys_.push_back(it->first);
+            bucket_mins_.push_back(minval);
+            bucket_maxs_.push_back(maxval);
+            bucket_offsets_.push_back(rows.size());
+            bucket_blocks_.push_back(block_ids_.size());
+        }
+    });
+    block_starts_.push_back(values_.size());
+    buckets_.clear();
+    std::cout << "Finished creating BucketedSecondaryIndex with " << bucket_keys_.size()
+        << " buckets, smallest = " << minsize << ", largest = " << maxsize
+        << ", blocks = " << block_ids_.size() << std::endl;
 }
 
 template <size_t D>
 void BucketedSecondaryIndex<D>::SetBucketFile(const std::string& filename) {
-    std::ifstream file(filename);
-    AssertWithMessage(file.is_open(), "Couldn't find file " + filename);
-    AssertWithMessage(FileUtils::NextLine(file) == "continuous-0", "Bad input " + filename);
-    
-    auto header = FileUtils::NextArray<std::string>(file, 3);
-    AssertWithMessage(header[0] == "source", "Bad input " + filename);
-    //AssertWithMessage(this->column_ == std::stoi(header[1]),
-    //        "Mapping file dimension does not match spec");
-    size_t s = std::stoi(header[2]);
-    // The last element is the rightmost bound on the data.
-    // Read everything as a double to be safe and then convert to scalar
-    
-    std::cout << "BucketedSecondaryIndex: reading " << s << " mapped buckets" << std::endl;
-    for (size_t i = 0; i < s; i++) {
-        auto arr = FileUtils::NextArray<double>(file, 3);
-        Scalar bucket_start = (Scalar)arr[1];
-        buckets_.insert(std::make_pair(bucket_start, IndexList{}));
+    // The column isn't checked against the mapping file's source column.
+    MappingArtifact mapping_file(filename);
+    const MappingView& mapping = mapping_file.View();
+    std::cout << "BucketedSecondaryIndex: reading " << mapping.num_buckets << " mapped buckets"
+        << std::endl;
+    for (size_t i = 0; i < mapping.num_buckets; i++) {
+        buckets_.insert(std::make_pair(mapping.bucket_starts[i], IndexList{}));
     }
-    file.close();
     bucket_strat_ = FROM_FILE;
 }
 
@@ -104,62 +134,187 @@ void BucketedSecondaryIndex<D>::InsertUnsorted(size_t index, Scalar v)  {
 }
 
 template <size_t D>
-IndexList BucketedSecondaryIndex<D>::Matches(const Query<D>& q) const {
+MatchResult BucketedSecondaryIndex<D>::Matches(const Query<D>& q) const {
     auto filter = q.filters[this->column_];
-    assert (filter.present && filter.is_range);
-    // Store a list of the index lists to merge all at once.
-    std::vector<const IndexList *> idx_lists;
-    size_t max_size = 0;
-    size_t smallest_vec = std::numeric_limits<size_t>::max();
-    size_t largest_vec = 0;
+    if (!filter.present) {
+        return MatchResult::Universe(data_size_);
+    }
+    assert (filter.is_range);
+    return rows_.Visit([&](const auto& rows) { return MatchesWithRows(rows, filter); });
+}
+
+template <size_t D>
+template <typename R>
+MatchResult BucketedSecondaryIndex<D>::MatchesWithRows(const std::vector<R>& rows,
+        const QueryFilter& filter) const {
+    // Buckets entirely inside one of the query ranges are used as is. The rest only overlap the
+    // query and have to be filtered by value.
+    std::vector<size_t> full_buckets, partial_buckets;
     for (ScalarRange r : filter.ranges) {
-        auto startit = buckets_.upper_bound(r.first);
-        if (startit != buckets_.begin()) {
-            startit--;
+        size_t lo = std::upper_bound(bucket_keys_.begin(), bucket_keys_.end(), r.first)
+            - bucket_keys_.begin();
+        lo = lo > 0 ? lo - 1 : 0;
+        size_t hi = std::upper_bound(bucket_keys_.begin(), bucket_keys_.end(), r.second)
+            - bucket_keys_.begin();
+        for (size_t b = lo; b < hi; b++) {
+            if (bucket_maxs_[b] < r.first || bucket_mins_[b] > r.second) {
+                continue;
+            }
+            if (bucket_mins_[b] >= r.first && bucket_maxs_[b] <= r.second) {
+                full_buckets.push_back(b);
+            } else {
+                partial_buckets.push_back(b);
+            }
+        }
+    }
+    std::sort(full_buckets.begin(), full_buckets.end());
+    full_buckets.erase(std::unique(full_buckets.begin(), full_buckets.end()), full_buckets.end());
+    std::sort(partial_buckets.begin(), partial_buckets.end());
+    partial_buckets.erase(std::unique(partial_buckets.begin(), partial_buckets.end()),
+            partial_buckets.end());
+
+    std::vector<BlockedList<R>> lists;
+    size_t max_size = 0;
+    size_t num_blocks = 0;
+    for (size_t b : full_buckets) {
+        lists.push_back({.rows = rows.data(),
+            .block_ids = block_ids_.data() + bucket_blocks_[b],
+            .block_starts = block_starts_.data() + bucket_blocks_[b],
+            .num_blocks = bucket_blocks_[b+1] - bucket_blocks_[b]});
+        max_size += bucket_offsets_[b+1] - bucket_offsets_[b];
+        num_blocks += lists.back().num_blocks;
+    }
+    // Filtered copies of the partial buckets, in the same layout as the full ones.
+    std::vector<R> partial_rows;
+    std::vector<uint64_t> partial_block_ids;
+    std::vector<size_t> partial_block_starts;
+    std::vector<size_t> partial_first_block;
+    for (size_t b : partial_buckets) {
+        if (std::binary_search(full_buckets.begin(), full_buckets.end(), b)) {
+            continue;
         }
-        auto endit = buckets_.upper_bound(r.second);
-        for (auto it = startit; it != endit; it++) {
-            if (it->second.size() == 0) {
+        partial_first_block.push_back(partial_block_ids.size());
+        for (size_t i = bucket_offsets_[b]; i < bucket_offsets_[b+1]; i++) {
+            bool match = false;
+            for (ScalarRange r : filter.ranges) {
+                match |= values_[i] >= r.first && values_[i] <= r.second;
+            }
+            if (!match) {
                 continue;
             }
-            idx_lists.push_back(&(it->second));
-            size_t s = it->second.size();
-            smallest_vec = std::min(s, smallest_vec);
-            largest_vec = std::max(s, largest_vec);
-            max_size += s;
+            uint64_t block = rows[i] >> BLOCK_BITS;
+            if (partial_block_ids.size() == partial_first_block.back()
+                    || block != partial_block_ids.back()) {
+                partial_block_ids.push_back(block);
+                partial_block_starts.push_back(partial_rows.size());
+            }
+            partial_rows.push_back(rows[i]);
         }
     }
-     std::cout << "Unioning " << idx_lists.size() << " index lists"
-         << " with " << max_size << " indexes. Smallest = " 
-         << smallest_vec << ", largest = " << largest_vec << std::endl;
-    // std::cout << "Bucket sizes: ";
-    // for (auto v : idx_lists) {
-    //     std::cout << v->size() << " ";
-    // }
-    // std::cout << std::endl;
+    partial_first_block.push_back(partial_block_ids.size());
+    partial_block_starts.push_back(partial_rows.size());
+    for (size_t i = 0; i + 1 < partial_first_block.size(); i++) {
+        size_t first = partial_first_block[i];
+        size_t count = partial_first_block[i+1] - first;
+        if (count > 0) {
+            lists.push_back({.rows = partial_rows.data(),
+                .block_ids = partial_block_ids.data() + first,
+                .block_starts = partial_block_starts.data() + first,
+                .num_blocks = count});
+            num_blocks += count;
+        }
+    }
+    max_size += partial_rows.size();
 
-    // Different merge solutions based on size. After a small number of lists, it's more efficient
-    // to just resort everything, since std::sort is so fast.
-    if (idx_lists.size() == 1) {
-        return *(idx_lists[0]);
+    std::vector<R> all_ixs;
+    if (lists.empty()) {
+        return MatchResult::FromSortedList(std::move(all_ixs));
     }
-    if (idx_lists.size() == 2) {
-        IndexList all_ixs;
-        all_ixs.reserve(max_size);
-        std::merge(idx_lists[0]->begin(), idx_lists[0]->end(),
-                idx_lists[1]->begin(), idx_lists[1]->end(),
-                std::back_inserter(all_ixs));
-        return all_ixs;
-    } 
-    if (idx_lists.size() <= 5) {
-        return MergeUtils::Union(idx_lists);
+    all_ixs.reserve(max_size);
+    if (lists.size() == 1) {
+        const BlockedList<R>& l = lists[0];
+        all_ixs.assign(l.rows + l.block_starts[0], l.rows + l.block_starts[l.num_blocks]);
+    } else if (max_size < num_blocks * MIN_ROWS_PER_BLOCK) {
+        MergeRows(lists, &all_ixs);
     } else {
-        IndexList all_ixs;
-        all_ixs.reserve(max_size);
-        for (const IndexList* ixl : idx_lists) {
-            all_ixs.insert(all_ixs.end(), ixl->begin(), ixl->end());
+        MergeBlocks(lists, &all_ixs);
+    }
+    return MatchResult::FromSortedList(std::move(all_ixs));
+}
+
+template <size_t D>
+template <typename R>
+void BucketedSecondaryIndex<D>::MergeBlocks(const std::vector<BlockedList<R>>& lists,
+        std::vector<R>* out) const {
+    std::vector<size_t> cursors(lists.size(), 0);
+    std::vector<uint64_t> keys(lists.size());
+    for (size_t i = 0; i < lists.size(); i++) {
+        keys[i] = lists[i].block_ids[0];
+    }
+    LoserTree tree(keys);
+    uint64_t words[BLOCK_WORDS] = {0};
+    while (tree.TopKey() != LoserTree::DONE) {
+        uint64_t block = tree.TopKey();
+        // Gather every list that has rows in this block.
+        size_t num_lists = 0;
+        const R* first_begin = NULL;
+        const R* first_end = NULL;
+        while (tree.TopKey() == block) {
+            size_t i = tree.Top();
+            const BlockedList<R>& l = lists[i];
+            const R* begin = l.rows + l.block_starts[cursors[i]];
+            const R* end = l.rows + l.block_starts[cursors[i] + 1];
+            if (num_lists == 0) {
+                first_begin = begin;
+                first_end = end;
+            } else {
+                if (num_lists == 1) {
+                    for (auto it = first_begin; it != first_end; it++) {
+                        words[(*it >> 6) & (BLOCK_WORDS - 1)] |= 1ULL << (*it & 63);
+                    }
+                }
+                for (auto it = begin; it != end; it++) {
+                    words[(*it >> 6) & (BLOCK_WORDS - 1)] |= 1ULL << (*it & 63);
+                }
+            }
+            num_lists++;
+            cursors[i]++;
+            tree.Replace(cursors[i] < l.num_blocks ? l.block_ids[cursors[i]] : LoserTree::DONE);
+        }
+        if (num_lists == 1) {
+            out->insert(out->end(), first_begin, first_end);
+            continue;
         }
-        std::sort(all_ixs.begin(), all_ixs.end());
-        return all_ixs;
+        PhysicalIndex base = block << BLOCK_BITS;
+        for (size_t w = 0; w < BLOCK_WORDS; w++) {
+            uint64_t word = words[w];
+            while (word) {
+                out->push_back(base + 64 * w + __builtin_ctzll(word));
+                word &= word - 1;
+            }
+            words[w] = 0;
+        }
+    }
+}
+
+template <size_t D>
+template <typename R>
+void BucketedSecondaryIndex<D>::MergeRows(const std::vector<BlockedList<R>>& lists,
+        std::vector<R>* out) const {
+    std::vector<const R*> cursors(lists.size());
+    std::vector<const R*> ends(lists.size());
+    std::vector<uint64_t> keys(lists.size());
+    for (size_t i = 0; i < lists.size(); i++) {
+        cursors[i] = lists[i].rows + lists[i].block_starts[0];
+        ends[i] = lists[i].rows + lists[i].block_starts[lists[i].num_blocks];
+        keys[i] = *cursors[i];
+    }
+    LoserTree tree(keys);
+    while (tree.TopKey() != LoserTree::DONE) {
+        size_t i = tree.Top();
+        // Buckets are disjoint, so there are no duplicates to skip.
+        out->push_back(tree.TopKey());
+        cursors[i]++;
+        tree.Replace(cursors[i] < ends[i] ? *cursors[i] : LoserTree::DONE);
     }
 }
@@ -1,15 +1,23 @@
 #include "composite_index.h"
 
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <vector>
 #include <cassert>
 #include <chrono>
+#include <functional>
+#include <numeric>
+#include <omp.h>
 
 #include "merge_utils.h"
+#include "utils.h"
 
 template <size_t D>
 CompositeIndex<D>::CompositeIndex(size_t gap)
-    : PrimaryIndexer<D>(), gap_threshold_(gap), secondary_indexes_() {}
+    : PrimaryIndexer<D>(), gap_threshold_(gap), secondary_indexes_(), primary_build_time_ns_(0),
+      build_names_(), build_times_ns_(), column_samples_(), forced_plan_(), last_plan_(),
+      plan_counts_() {}
 
 
 template <size_t D>
@@ -22,8 +30,6 @@ bool CompositeIndex<D>::SetPrimaryIndex(std::unique_ptr<PrimaryIndexer<D>> index
 template <size_t D>
 bool CompositeIndex<D>::AddSecondaryIndex(std::unique_ptr<SecondaryIndexer<D>> index) {
     AssertWithMessage(index != NULL, "Tried to add NULL secondary index");
-    AssertWithMessage(correlation_indexes_.empty(), "Cannot use secondary index with correlation index"); 
-    AssertWithMessage(rewriters_.empty(), "Cannot use secondary index with rewriters"); 
     secondary_indexes_.push_back(std::move(index));
     return true;
 }
@@ -31,8 +37,6 @@ bool CompositeIndex<D>::AddSecondaryIndex(std::unique_ptr<SecondaryIndexer<D>> i
 template <size_t D>
 bool CompositeIndex<D>::AddCorrelationIndex(std::unique_ptr<CorrelationIndexer<D>> index) {
     AssertWithMessage(index != NULL, "Tried to add NULL correlation index");
-    AssertWithMessage(secondary_indexes_.empty(), "Cannot use correlation index with secondary index"); 
-    AssertWithMessage(rewriters_.empty(), "Cannot use correlation index with rewriters");
     correlation_indexes_.push_back(std::move(index));
     return true;
 }
@@ -40,31 +44,198 @@ bool CompositeIndex<D>::AddCorrelationIndex(std::unique_ptr<CorrelationIndexer<D
 template <size_t D>
 bool CompositeIndex<D>::AddRewriter(std::unique_ptr<Rewriter<D>> rewriter) {
     AssertWithMessage(rewriter != NULL, "Tried to add NULL rewriter");
-    AssertWithMessage(secondary_indexes_.empty(), "Cannot use rewriters with secondary index"); 
-    AssertWithMessage(correlation_indexes_.empty(), "Cannot use rewriters with correlation index"); 
     rewriters_.push_back(std::move(rewriter));
     return true;
 }
 
+template <size_t D>
+size_t CompositeIndex<D>::MaxConcurrentBuilds(size_t num_builds) const {
+    size_t max_builds = std::min<size_t>(num_builds, omp_get_max_threads());
+    size_t available = AvailableMemoryBytes();
+    if (available > 0) {
+        size_t per_build = std::max<size_t>(1, data_size_ * BUILD_BYTES_PER_POINT);
+        max_builds = std::min(max_builds, available / per_build);
+    }
+    return std::max<size_t>(1, max_builds);
+}
+
 template <size_t D>
 void CompositeIndex<D>::Init(PointIterator<D> start, PointIterator<D> end) {
+    data_size_ = std::distance(start, end);
+    // Every other sub-index keeps row ids, which a primary index moving rows would invalidate.
+    AssertWithMessage(!MovesRowsOnQuery() || (correlation_indexes_.empty()
+                && secondary_indexes_.empty() && rewriters_.empty()),
+            "A primary index that moves rows on query can't be combined with other indexes");
+    auto primary_start = std::chrono::high_resolution_clock::now();
     if (primary_index_ != NULL) {
         primary_index_->Init(start, end);
         auto cols = primary_index_->GetColumns();
         this->columns_.insert(cols.begin(), cols.end());
     }
+    auto primary_end = std::chrono::high_resolution_clock::now();
+    primary_build_time_ns_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            primary_end - primary_start).count();
+
+    // The primary index is the only one that reorders the data. Everything else only reads it, so
+    // they can be built concurrently.
+    std::vector<std::function<void()>> builds;
+    build_names_.clear();
     for (auto& ci : correlation_indexes_) {
-        ci->Init(start, end);
-        this->columns_.insert(ci->GetMappedColumn());
+        builds.push_back([&ci, start, end]() { ci->Init(start, end); });
+        build_names_.push_back("correlation_" + std::to_string(ci->GetMappedColumn()));
+        for (size_t c : ci->GetMappedColumns()) {
+            this->columns_.insert(c);
+        }
     }
     for (auto& si : secondary_indexes_) {
-        si->Init(start, end);
+        builds.push_back([&si, start, end]() { si->Init(start, end); });
+        build_names_.push_back("secondary_" + std::to_string(si->GetColumn()));
         this->columns_.insert(si->GetColumn());
     }
-    for (auto& rw : rewriters_) {
-        rw->Init(start, end);
+    for (size_t i = 0; i < rewriters_.size(); i++) {
+        Rewriter<D>* rw = rewriters_[i].get();
+        builds.push_back([rw, start, end]() { rw->Init(start, end); });
+        build_names_.push_back("rewriter_" + std::to_string(i));
+    }
+    build_times_ns_.assign(builds.size(), 0);
+
+    auto build = [this, &builds](size_t i) {
+        auto build_start = std::chrono::high_resolution_clock::now();
+        builds[i]();
+        auto build_end = std::chrono::high_resolution_clock::now();
+        build_times_ns_[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                build_end - build_start).count();
+    };
+    size_t concurrency = MaxConcurrentBuilds(builds.size());
+    if (concurrency <= 1) {
+        // Run the builds one at a time, so each can use every thread for itself.
+        for (size_t i = 0; i < builds.size(); i++) {
+            build(i);
+        }
+    } else {
+        // Every build is a task of one team with a thread per concurrent build. Builds made of
+        // tasks, like the TRS trees, share that team. Builds that open a parallel region of their
+        // own get an even share of the threads through one more level of nesting.
+        size_t threads_per_build = std::max<size_t>(1, omp_get_max_threads() / concurrency);
+        int max_levels = omp_get_max_active_levels();
+        omp_set_max_active_levels(std::max(max_levels, 2));
+        #pragma omp parallel num_threads(concurrency)
+        #pragma omp single
+        for (size_t i = 0; i < builds.size(); i++) {
+            #pragma omp task default(shared) firstprivate(i)
+            {
+                omp_set_num_threads((int)threads_per_build);
+                build(i);
+            }
+        }
+        omp_set_max_active_levels(max_levels);
+    }
+
+    column_samples_.clear();
+    std::vector<size_t> sampled;
+    for (auto& ci : correlation_indexes_) {
+        auto cols = ci->GetMappedColumns();
+        sampled.insert(sampled.end(), cols.begin(), cols.end());
+    }
+    for (auto& si : secondary_indexes_) {
+        sampled.push_back(si->GetColumn());
+    }
+    for (size_t c : sampled) {
+        if (column_samples_.find(c) == column_samples_.end()) {
+            column_samples_.emplace(c, ColumnSample(start, end, c, SAMPLE_SIZE));
+        }
     }
-    data_size_ = std::distance(start, end);
+}
+
+template <size_t D>
+size_t CompositeIndex<D>::NumRows(const PhysicalIndexSet& s) {
+    size_t n = s.list.size();
+    for (const PhysicalIndexRange& r : s.ranges) {
+        n += r.end - r.start;
+    }
+    return n;
+}
+
+template <size_t D>
+double CompositeIndex<D>::Selectivity(const std::vector<size_t>& columns,
+        const Query<D>& q) const {
+    double selectivity = 1.0;
+    for (size_t c : columns) {
+        auto it = column_samples_.find(c);
+        if (it != column_samples_.end()) {
+            selectivity *= it->second.Selectivity(q.filters[c]);
+        }
+    }
+    return selectivity;
+}
+
+template <size_t D>
+std::vector<size_t> CompositeIndex<D>::ChoosePlan(size_t rows, bool is_list,
+        const std::vector<Candidate>& candidates) const {
+    std::vector<size_t> order(candidates.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&candidates](size_t a, size_t b) {
+                return candidates[a].selectivity < candidates[b].selectivity;
+            });
+    double est_rows = rows;
+    double lookup_cost = 0;
+    double cost = est_rows * (is_list ? LIST_ROW_COST : 1.0);
+    std::vector<size_t> plan;
+    for (size_t i : order) {
+        const Candidate& c = candidates[i];
+        // Rows are assumed to match each sub-index independently.
+        double next_rows = est_rows * c.selectivity;
+        bool next_list = is_list || c.is_list;
+        double next_cost = lookup_cost + c.lookup_cost
+            + next_rows * (next_list ? LIST_ROW_COST : 1.0);
+        if (next_cost < cost) {
+            plan.push_back(i);
+            est_rows = next_rows;
+            is_list = next_list;
+            lookup_cost += c.lookup_cost;
+            cost = next_cost;
+        }
+    }
+    return plan;
+}
+
+template <size_t D>
+std::vector<size_t> CompositeIndex<D>::PlanFor(size_t rows, bool is_list,
+        const std::vector<Candidate>& candidates) const {
+    if (forced_plan_.empty()) {
+        return ChoosePlan(rows, is_list, candidates);
+    }
+    std::vector<size_t> plan;
+    for (const std::string& name : forced_plan_) {
+        for (size_t c = 0; c < candidates.size(); c++) {
+            if (candidates[c].name == name) {
+                plan.push_back(c);
+            }
+        }
+    }
+    return plan;
+}
+
+template <size_t D>
+PhysicalIndexSet CompositeIndex<D>::MergeGaps(const PhysicalIndexSet& s) const {
+    if (gap_threshold_ == 0 || s.list.empty()) {
+        return s;
+    }
+    IndexRangeList ranges;
+    for (PhysicalIndex p : s.list) {
+        if (!ranges.empty() && p - (ranges.back().end - 1) <= gap_threshold_) {
+            ranges.back().end = p + 1;
+        } else {
+            ranges.emplace_back(p, p + 1);
+        }
+    }
+    return PhysicalIndexSet(MergeUtils::Union(s.ranges, ranges), {});
+}
+
+template <size_t D>
+void CompositeIndex<D>::RecordPlan(const std::string& plan) {
+    last_plan_ = plan;
+    plan_counts_[plan]++;
 }
 
 template <size_t D>
@@ -77,7 +248,11 @@ PhysicalIndexSet CompositeIndex<D>::RangesWithPrimary(Query<D>& q) {
 }
 
 template <size_t D>
-PhysicalIndexSet CompositeIndex<D>::RangesWithRewriter(Query<D>& q) {
+PhysicalIndexSet CompositeIndex<D>::RangesWithRewriters(Query<D>& q, std::string* plan) {
+    if (rewriters_.empty()) {
+        *plan = "primary";
+        return RangesWithPrimary(q);
+    }
     IndexList auxiliary_indexes;
     // Assumes all the indexes from rewriters are unsorted.
     for (auto& rw : rewriters_) {
@@ -90,92 +265,159 @@ PhysicalIndexSet CompositeIndex<D>::RangesWithRewriter(Query<D>& q) {
     }
 
     PhysicalIndexSet to_scan = RangesWithPrimary(q);
-    AssertWithMessage(to_scan.list.empty(), "Expected no secondary indexes");
     bool full_scan = to_scan.ranges.size() == 1 &&
         to_scan.ranges[0].end - to_scan.ranges[0].start == data_size_;
     if (full_scan) {
+        *plan = "primary";
         return to_scan;
     }
+    // The rewritten ranges only pay off if they and the auxiliary rows, scanned at random, cost
+    // less than scanning everything.
+    if (NumRows(to_scan) + auxiliary_indexes.size() * LIST_ROW_COST >= data_size_) {
+        *plan = "full_scan";
+        return PhysicalIndexSet({{0, data_size_}}, {});
+    }
+    *plan = "rewriter+primary";
     std::sort(auxiliary_indexes.begin(), auxiliary_indexes.end());
-    return MergeUtils::Union(to_scan.ranges, auxiliary_indexes);
+    auxiliary_indexes.erase(std::unique(auxiliary_indexes.begin(), auxiliary_indexes.end()),
+            auxiliary_indexes.end());
+    if (to_scan.list.empty()) {
+        return MergeUtils::Union(to_scan.ranges, auxiliary_indexes);
+    }
+    // The primary index returned a list of its own, so merge the two lists.
+    IndexList merged;
+    std::merge(to_scan.list.begin(), to_scan.list.end(), auxiliary_indexes.begin(),
+            auxiliary_indexes.end(), std::back_inserter(merged));
+    merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+    return MergeUtils::Union(to_scan.ranges, merged);
 }
 
 template <size_t D>
-PhysicalIndexSet CompositeIndex<D>::RangesWithCorrelation(Query<D>& q) {
-    PhysicalIndexSet to_scan = RangesWithPrimary(q);
-    bool full_scan = to_scan.ranges.size() == 1 &&
-        to_scan.ranges[0].end - to_scan.ranges[0].start == data_size_;
+std::vector<typename CompositeIndex<D>::Candidate> CompositeIndex<D>::PlanCandidates(
+        const Query<D>& q, std::vector<CorrelationIndexer<D>*>* correlations,
+        std::vector<SecondaryIndexer<D>*>* secondaries) const {
+    std::vector<Candidate> candidates;
     for (auto& ci : correlation_indexes_) {
-        if (!q.filters[ci->GetMappedColumn()].present) {
+        if (!ci->Filters(q)) {
             continue;
         }
-        PhysicalIndexSet ixs = ci->Ranges(q);
-        to_scan = full_scan ? std::move(ixs) : MergeUtils::Intersect(to_scan, ixs);
-        full_scan = false;
+        double selectivity = Selectivity(ci->GetMappedColumns(), q);
+        candidates.push_back({
+                .name = "correlation_" + std::to_string(ci->GetMappedColumn()),
+                .selectivity = selectivity,
+                .lookup_cost = selectivity * data_size_ * CORRELATION_ROW_COST,
+                .is_list = false,
+            });
+        correlations->push_back(ci.get());
     }
-    return to_scan;
+    for (auto& si : secondary_indexes_) {
+        if (!q.filters[si->GetColumn()].present) {
+            continue;
+        }
+        double selectivity = Selectivity({si->GetColumn()}, q);
+        candidates.push_back({
+                .name = "secondary_" + std::to_string(si->GetColumn()),
+                .selectivity = selectivity,
+                .lookup_cost = selectivity * data_size_ * MATCH_ROW_COST,
+                .is_list = true,
+            });
+        secondaries->push_back(si.get());
+    }
+    return candidates;
 }
 
 template <size_t D>
-PhysicalIndexSet CompositeIndex<D>::RangesWithSecondary(Query<D>& q) {
-    PhysicalIndexSet to_scan = RangesWithPrimary(q);
+PhysicalIndexSet CompositeIndex<D>::Ranges(Query<D>& q) {
+    // Rewriters narrow the filters on their target columns so that the primary index can use
+    // them. Their auxiliary rows only match the original filters, so the other sub-indexes look up
+    // the query as it was.
+    Query<D> original;
+    if (!rewriters_.empty()) {
+        original = q;
+    }
+    const Query<D>& lookup = rewriters_.empty() ? q : original;
+    std::string plan;
+    PhysicalIndexSet to_scan = RangesWithRewriters(q, &plan);
     bool full_scan = to_scan.ranges.size() == 1 &&
         to_scan.ranges[0].end - to_scan.ranges[0].start == data_size_;
 
-    // For each secondary index, merge the secondary index matches into it.
-    std::vector<size_t> matches;
-    // This is to make sure we sort the secondary index result only when we absolutely have to.
-    bool needs_sort = true;
-    for (auto& si : secondary_indexes_) {
-        if (!q.filters[si->GetColumn()].present) {
-            continue;
-        }
-        std::vector<size_t> next_matches = si->Matches(q);
-        if (matches.empty()) {
-            // Don't sort yet - wait until there other other matches or ranges that need
-            // intersecting.
-            matches = std::move(next_matches);
+    // Correlation and secondary indexes then narrow it down, in the order the plan picks.
+    std::vector<CorrelationIndexer<D>*> correlations;
+    std::vector<SecondaryIndexer<D>*> secondaries;
+    std::vector<Candidate> candidates = PlanCandidates(lookup, &correlations, &secondaries);
+    // Sub-indexes that would cost more to look up and scan than the rows they'd rule out are
+    // skipped, leaving their filter to the scan. Secondary matches are only sorted once there's
+    // something to intersect them with.
+    MatchResult matches = MatchResult::Universe(data_size_);
+    for (size_t c : PlanFor(NumRows(to_scan), !to_scan.list.empty(), candidates)) {
+        plan += "+" + candidates[c].name;
+        if (c < correlations.size()) {
+            PhysicalIndexSet ixs = correlations[c]->Ranges(lookup);
+            to_scan = full_scan ? std::move(ixs) : MergeUtils::Intersect(to_scan, ixs);
+            full_scan = false;
+            if (to_scan.ranges.empty() && to_scan.list.empty()) {
+                RecordPlan(plan);
+                return {};
+            }
         } else {
-            auto start = std::chrono::high_resolution_clock::now();
-            if (needs_sort) {
-                std::sort(matches.begin(), matches.end());
-                needs_sort = false;
+            matches = MergeUtils::Intersect(matches,
+                    secondaries[c - correlations.size()]->Matches(lookup));
+            if (matches.Empty()) {
+                RecordPlan(plan);
+                return {};
             }
-            auto mid = std::chrono::high_resolution_clock::now();
-            std::sort(next_matches.begin(), next_matches.end());
-            // Only sort if we absolutely have to
-            matches = MergeUtils::Intersect(matches, next_matches);
-            auto end = std::chrono::high_resolution_clock::now();
-            auto tt1 = std::chrono::duration_cast<std::chrono::nanoseconds>(mid - start).count();
-            auto tt2 = std::chrono::duration_cast<std::chrono::nanoseconds>(end - mid).count();
-            std::cout << "Sort time: " << tt1 << "ns, "
-                << "Intersect time: " << tt2 << "ns" << std::endl;
         }
     }
-    // This makes sure we don't sort the secondary index results unless there are non-trivial
-    // primary index results to merge with.
-    if (matches.size() == 0) {
+    RecordPlan(plan);
+    if (matches.IsUniverse()) {
         return to_scan;
     }
     if (full_scan) {
-        return {.ranges = IndexRangeList(), .list = matches};
-    }
-    if (needs_sort) {
-        std::sort(matches.begin(), matches.end());
+        // Gaps can only be merged between sorted rows.
+        if (gap_threshold_ > 0) {
+            matches.Sort();
+        }
+        return MergeGaps(matches.ToIndexSet());
     }
-    // Now merge the combined secondary indexes with the primary index range.
-    return MergeUtils::Intersect(to_scan, {{}, matches});
+    return MergeGaps(MergeUtils::Intersect(to_scan, matches));
 }
 
 template <size_t D>
-PhysicalIndexSet CompositeIndex<D>::Ranges(Query<D>& q) {
+RoaringSet CompositeIndex<D>::RangesBitmap(Query<D>& q) {
+    // Same pipeline and plan as Ranges, on bitmaps.
+    Query<D> original;
+    if (!rewriters_.empty()) {
+        original = q;
+    }
+    const Query<D>& lookup = rewriters_.empty() ? q : original;
+    std::string plan = "primary";
+    RoaringSet to_scan;
+    bool is_list = false;
     if (!rewriters_.empty()) {
-        return RangesWithRewriter(q);
-    } else if (!correlation_indexes_.empty()) {
-        return RangesWithCorrelation(q);
-    } else if (!secondary_indexes_.empty()) {
-        return RangesWithSecondary(q);
+        PhysicalIndexSet ixs = RangesWithRewriters(q, &plan);
+        is_list = !ixs.list.empty();
+        to_scan = RoaringSet::FromIndexSet(ixs);
+    } else if (primary_index_ != NULL) {
+        to_scan = primary_index_->RangesBitmap(q);
     } else {
-        return RangesWithPrimary(q);
+        to_scan = RoaringSet::FromRanges({{0, data_size_}});
+    }
+
+    std::vector<CorrelationIndexer<D>*> correlations;
+    std::vector<SecondaryIndexer<D>*> secondaries;
+    std::vector<Candidate> candidates = PlanCandidates(lookup, &correlations, &secondaries);
+    for (size_t c : PlanFor(to_scan.Cardinality(), is_list, candidates)) {
+        plan += "+" + candidates[c].name;
+        if (c < correlations.size()) {
+            to_scan = RoaringSet::Intersect(to_scan, correlations[c]->RangesBitmap(lookup));
+        } else {
+            to_scan = RoaringSet::Intersect(to_scan,
+                    secondaries[c - correlations.size()]->MatchesBitmap(lookup));
+        }
+        if (to_scan.Empty()) {
+            break;
+        }
     }
+    RecordPlan(plan);
+    return to_scan;
 }
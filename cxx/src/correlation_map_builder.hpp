@@ -0,0 +1,169 @@
+#include "correlation_map_builder.h"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+#include "utils.h"
+
+template <size_t D>
+Scalar CorrelationMapBuilder<D>::BucketKey(Scalar v) const {
+    if (strategy_ == CONST_WIDTH) {
+        Scalar key = v / bucket_width_;
+        // Round towards negative infinity.
+        if (v % bucket_width_ != 0 && v < 0) {
+            key--;
+        }
+        return key;
+    }
+    return std::upper_bound(bounds_.begin() + 1, bounds_.end(), v) - (bounds_.begin() + 1);
+}
+
+template <size_t D>
+ScalarRange CorrelationMapBuilder<D>::BucketRange(Scalar key) const {
+    if (strategy_ == CONST_WIDTH) {
+        return {key * bucket_width_, (key + 1) * bucket_width_};
+    }
+    return {bounds_[key], bounds_[key + 1]};
+}
+
+template <size_t D>
+typename CorrelationMapBuilder<D>::TargetResult CorrelationMapBuilder<D>::StashTarget(
+        ConstPointIterator<D> start, PhysicalIndexRange range) const {
+    size_t n = range.end - range.start;
+    std::vector<Scalar> row_keys(n);
+    for (size_t i = 0; i < n; i++) {
+        row_keys[i] = BucketKey((*(start + range.start + i))[mapped_column_]);
+    }
+    TargetResult result = StashUtils::StashTarget(row_keys.data(), n, storage_factor_);
+    for (size_t& row : result.outliers) {
+        row += range.start;
+    }
+    return result;
+}
+
+template <size_t D>
+void CorrelationMapBuilder<D>::Build(ConstPointIterator<D> start, ConstPointIterator<D> end,
+        const TargetBucketsView& targets) {
+    size_t data_size = std::distance(start, end);
+    AssertWithMessage(data_size > 0, "Can't build a correlation map on an empty dataset");
+    for (size_t t = 0; t < targets.num_buckets; t++) {
+        AssertWithMessage(targets.ends[t] <= data_size, "Target bucket beyond the dataset");
+        AssertWithMessage(t == 0 || (targets.ids[t] > targets.ids[t-1]
+                    && targets.starts[t] >= targets.ends[t-1]),
+                "Target buckets must be sorted by id and physical index");
+        AssertWithMessage(targets.ids[t] <= (uint64_t)std::numeric_limits<int32_t>::max(),
+                "Target bucket id doesn't fit in a mapping");
+    }
+    if (strategy_ == EQUI_DEPTH) {
+        bounds_ = StashUtils::EquiDepthBounds<D>(start, end, mapped_column_, num_buckets_);
+    }
+
+    // Every target bucket makes its stash decisions independently.
+    std::vector<TargetResult> results(targets.num_buckets);
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t t = 0; t < targets.num_buckets; t++) {
+        if (targets.ends[t] > targets.starts[t]) {
+            results[t] = StashTarget(start, {targets.starts[t], targets.ends[t]});
+        }
+    }
+
+    // The mapped buckets are every bucket that has at least one point, numbered in increasing
+    // order of their key.
+    std::vector<Scalar> keys;
+    for (const auto& r : results) {
+        keys.insert(keys.end(), r.keys.begin(), r.keys.end());
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    bucket_ids_.resize(keys.size());
+    bucket_starts_.resize(keys.size());
+    bucket_ends_.resize(keys.size());
+    for (size_t b = 0; b < keys.size(); b++) {
+        ScalarRange r = BucketRange(keys[b]);
+        bucket_ids_[b] = b;
+        bucket_starts_[b] = r.first;
+        bucket_ends_[b] = r.second;
+    }
+
+    // Each mapped bucket maps to the target buckets in which it stayed an inlier. Targets are
+    // visited in increasing order, so the lists come out sorted.
+    std::vector<std::vector<uint32_t>> cell_buckets(results.size());
+    std::vector<uint64_t> counts(keys.size(), 0);
+    for (size_t t = 0; t < results.size(); t++) {
+        const TargetResult& r = results[t];
+        cell_buckets[t].resize(r.keys.size());
+        for (size_t c = 0; c < r.keys.size(); c++) {
+            uint32_t b = std::lower_bound(keys.begin(), keys.end(), r.keys[c]) - keys.begin();
+            cell_buckets[t][c] = b;
+            counts[b] += r.inlier[c];
+        }
+    }
+    mapping_ids_.clear();
+    mapping_offsets_.assign(1, 0);
+    std::vector<uint64_t> next(keys.size(), 0);
+    for (size_t b = 0; b < keys.size(); b++) {
+        if (counts[b] > 0) {
+            next[b] = mapping_offsets_.back();
+            mapping_ids_.push_back(b);
+            mapping_offsets_.push_back(mapping_offsets_.back() + counts[b]);
+        }
+    }
+    mapping_targets_.resize(mapping_offsets_.back());
+    for (size_t t = 0; t < results.size(); t++) {
+        for (size_t c = 0; c < results[t].keys.size(); c++) {
+            if (results[t].inlier[c]) {
+                mapping_targets_[next[cell_buckets[t][c]]++] = (int32_t)targets.ids[t];
+            }
+        }
+    }
+
+    target_ids_.clear();
+    target_starts_.clear();
+    target_ends_.clear();
+    outliers_.clear();
+    for (size_t t = 0; t < targets.num_buckets; t++) {
+        if (targets.ends[t] > targets.starts[t]) {
+            target_ids_.push_back(targets.ids[t]);
+            target_starts_.push_back(targets.starts[t]);
+            target_ends_.push_back(targets.ends[t]);
+        }
+        // Target buckets are in physical order, so the outliers stay sorted.
+        outliers_.insert(outliers_.end(), results[t].outliers.begin(), results[t].outliers.end());
+    }
+    std::cout << "CorrelationMapBuilder: " << keys.size() << " mapped buckets, "
+        << target_ids_.size() << " target buckets, " << mapping_targets_.size()
+        << " inlier cells and " << outliers_.size() << " outliers" << std::endl;
+}
+
+template <size_t D>
+MappingView CorrelationMapBuilder<D>::Mapping() const {
+    return {
+        .column = mapped_column_,
+        .num_buckets = bucket_ids_.size(),
+        .bucket_ids = bucket_ids_.data(),
+        .bucket_starts = bucket_starts_.data(),
+        .bucket_ends = bucket_ends_.data(),
+        .num_mappings = mapping_ids_.size(),
+        .mapping_ids = mapping_ids_.data(),
+        .mapping_offsets = mapping_offsets_.data(),
+        .targets = mapping_targets_.data(),
+    };
+}
+
+template <size_t D>
+TargetBucketsView CorrelationMapBuilder<D>::TargetBuckets() const {
+    return {
+        .num_buckets = target_ids_.size(),
+        .ids = target_ids_.data(),
+        .starts = target_starts_.data(),
+        .ends = target_ends_.data(),
+    };
+}
+
+template <size_t D>
+void CorrelationMapBuilder<D>::Write(const std::string& prefix) const {
+    MappingArtifacts::WriteMapping(Mapping(), prefix + ".mapping");
+    MappingArtifacts::WriteTargetBuckets(TargetBuckets(), prefix + ".targets");
+    MappingArtifacts::WriteOutliers(outliers_, prefix + ".outliers");
+}
@@ -0,0 +1,109 @@
+#include "cracking_index.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+template <size_t D>
+CrackingIndex<D>::CrackingIndex(size_t dim) :
+        PrimaryIndexer<D>(dim),
+        dim_(dim),
+        data_(),
+        data_size_(0),
+        cracker_index_(),
+        gen_(42) {}
+
+template <size_t D>
+void CrackingIndex<D>::Init(PointIterator<D> start, PointIterator<D> end) {
+    data_ = start;
+    data_size_ = std::distance(start, end);
+    cracker_index_.clear();
+}
+
+template <size_t D>
+size_t CrackingIndex<D>::Partition(size_t start, size_t end, Scalar val) {
+    size_t dim = dim_;
+    auto mid = std::partition(data_ + start, data_ + end,
+            [dim, val](const Point<D>& p) { return p[dim] < val; });
+    size_t pos = mid - data_;
+    cracker_index_[val] = pos;
+    return pos;
+}
+
+template <size_t D>
+size_t CrackingIndex<D>::CrackAt(Scalar val) {
+    while (true) {
+        // Find the piece [piece_start, piece_end) that holds val.
+        auto next = cracker_index_.upper_bound(val);
+        size_t piece_end = next == cracker_index_.end() ? data_size_ : next->second;
+        size_t piece_start = 0;
+        if (next != cracker_index_.begin()) {
+            auto prev = std::prev(next);
+            if (prev->first == val) {
+                // Already cracked here.
+                return prev->second;
+            }
+            piece_start = prev->second;
+        }
+        if (piece_end - piece_start <= STOCHASTIC_PIECE_SIZE) {
+            return Partition(piece_start, piece_end, val);
+        }
+        // Crack at a random value from the piece, then look for val's (now smaller) piece again.
+        // Each random crack splits the piece in expectation, so this does linear work overall.
+        std::uniform_int_distribution<size_t> dist(piece_start, piece_end - 1);
+        Scalar pivot = (*(data_ + dist(gen_)))[dim_];
+        size_t pos = Partition(piece_start, piece_end, pivot);
+        if (pos == piece_start) {
+            // The pivot was the smallest value in the piece, so nothing moved. Split off the
+            // values equal to it instead.
+            if (pivot == std::numeric_limits<Scalar>::max()) {
+                return Partition(piece_start, piece_end, val);
+            }
+            if (Partition(piece_start, piece_end, pivot + 1) == piece_end) {
+                // Every value in the piece is the same.
+                return Partition(piece_start, piece_end, val);
+            }
+        }
+    }
+}
+
+template <size_t D>
+PhysicalIndexSet CrackingIndex<D>::Ranges(Query<D>& query) {
+    const QueryFilter& qf = query.filters[dim_];
+    if (!qf.present) {
+        return {{{0, data_size_}}, {}};
+    }
+    // Each range or value of the filter is a piece of its own.
+    std::vector<ScalarRange> bounds;
+    if (qf.is_range) {
+        bounds.assign(qf.ranges.begin(), qf.ranges.end());
+    } else {
+        for (Scalar v : qf.values) {
+            bounds.emplace_back(v, v);
+        }
+    }
+    IndexRangeList ranges;
+    for (const ScalarRange& r : bounds) {
+        if (r.first > r.second) {
+            continue;
+        }
+        size_t start = CrackAt(r.first);
+        size_t end = r.second == std::numeric_limits<Scalar>::max() ? data_size_ : CrackAt(r.second + 1);
+        if (start < end) {
+            ranges.emplace_back(start, end);
+        }
+    }
+    // Values or ranges may come in any order and overlap.
+    std::sort(ranges.begin(), ranges.end(),
+            [](const PhysicalIndexRange& a, const PhysicalIndexRange& b) { return a.start < b.start; });
+    size_t out = 0;
+    for (size_t i = 0; i < ranges.size(); i++) {
+        if (out > 0 && ranges[i].start <= ranges[out-1].end) {
+            ranges[out-1].end = std::max(ranges[out-1].end, ranges[i].end);
+        } else {
+            ranges[out++] = ranges[i];
+        }
+    }
+    ranges.resize(out);
+    return {ranges, {}};
+}
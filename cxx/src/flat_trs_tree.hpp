@@ -0,0 +1,69 @@
+#include "flat_trs_tree.h"
+
+#include <algorithm>
+
+#include "utils.h"
+
+void FlatTRSTree::Compile(const TRSNode& root) {
+    leaf_lows_.clear();
+    leaf_highs_.clear();
+    leaves_.clear();
+    AddLeaves(root);
+    for (size_t i = 1; i < leaves_.size(); i++) {
+        AssertWithMessage(leaf_lows_[i] > leaf_highs_[i-1], "TRS leaves overlap");
+    }
+}
+
+void FlatTRSTree::AddLeaves(const TRSNode& node) {
+    if (!node.children.empty()) {
+        for (const auto& c : node.children) {
+            AddLeaves(*c);
+        }
+        return;
+    }
+    leaf_lows_.push_back(node.bounds.first);
+    leaf_highs_.push_back(node.bounds.second);
+    leaves_.push_back({node.slope, node.intercept, node.tolerance});
+}
+
+void FlatTRSTree::Lookup(ScalarRange query_range, std::vector<ScalarRange>* ranges) const {
+    ranges->clear();
+    // First leaf whose upper bound reaches the query.
+    size_t i = std::lower_bound(leaf_highs_.begin(), leaf_highs_.end(), query_range.first)
+        - leaf_highs_.begin();
+    for (; i < leaves_.size() && leaf_lows_[i] <= query_range.second; i++) {
+        const Leaf& l = leaves_[i];
+        Scalar min_x = std::max(query_range.first, leaf_lows_[i]);
+        Scalar max_x = std::min(query_range.second, leaf_highs_[i]);
+        if (l.slope < 0) {
+            ranges->emplace_back(l.slope * max_x + l.intercept - l.tolerance,
+                    l.slope * min_x + l.intercept + l.tolerance + 1);
+        } else {
+            ranges->emplace_back(l.slope * min_x + l.intercept - l.tolerance,
+                    l.slope * max_x + l.intercept + l.tolerance + 1);
+        }
+    }
+    // Neighbouring leaves usually map to increasing targets, in which case there's nothing to
+    // sort.
+    if (!std::is_sorted(ranges->begin(), ranges->end(), ScalarRangeStartComp{})) {
+        std::sort(ranges->begin(), ranges->end(), ScalarRangeStartComp{});
+    }
+    // Coalesce in place.
+    size_t out = 0;
+    for (size_t j = 0; j < ranges->size(); j++) {
+        ScalarRange r = (*ranges)[j];
+        if (r.second <= r.first) {
+            continue;
+        }
+        if (out > 0 && r.first <= (*ranges)[out-1].second) {
+            (*ranges)[out-1].second = std::max((*ranges)[out-1].second, r.second);
+        } else {
+            (*ranges)[out++] = r;
+        }
+    }
+    ranges->resize(out);
+}
+
+size_t FlatTRSTree::Size() const {
+    return leaves_.size() * (2 * sizeof(Scalar) + sizeof(Leaf));
+}
@@ -0,0 +1,334 @@
+#include "flood_index.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+
+#include "permutation_utils.h"
+
+template <size_t D>
+FloodIndex<D>::FloodIndex(std::vector<size_t>& grid_dims, size_t sort_dim,
+        const std::string& workload_file) :
+        grid_dims_(grid_dims),
+        sort_dim_(sort_dim),
+        workload_file_(workload_file),
+        data_size_(0),
+        columns_per_dim_(grid_dims.size(), 1),
+        cdf_knots_(grid_dims.size()),
+        cell_offsets_(),
+        sort_fences_() {
+    AssertWithMessage(!grid_dims.empty(), "FloodIndex needs at least one grid dimension");
+    for (size_t d : grid_dims) {
+        AssertWithMessage(d != sort_dim, "FloodIndex sort dimension can't also be a grid dimension");
+    }
+}
+
+template <size_t D>
+void FloodIndex<D>::FitCDFs(PointIterator<D> start, const std::vector<size_t>& sample) {
+    std::vector<Scalar> vals(sample.size());
+    for (size_t i = 0; i < grid_dims_.size(); i++) {
+        for (size_t s = 0; s < sample.size(); s++) {
+            vals[s] = (*(start + sample[s]))[grid_dims_[i]];
+        }
+        std::sort(vals.begin(), vals.end());
+        cdf_knots_[i].resize(NUM_CDF_KNOTS + 1);
+        for (size_t k = 0; k <= NUM_CDF_KNOTS; k++) {
+            cdf_knots_[i][k] = vals[std::min(vals.size() - 1, k * vals.size() / NUM_CDF_KNOTS)];
+        }
+    }
+}
+
+template <size_t D>
+double FloodIndex<D>::CDF(size_t i, Scalar val) const {
+    const std::vector<Scalar>& knots = cdf_knots_[i];
+    if (val < knots.front()) {
+        return 0;
+    }
+    if (val >= knots.back()) {
+        return 1;
+    }
+    // knots[j] <= val < knots[j+1], so the segment is never empty.
+    size_t j = std::upper_bound(knots.begin(), knots.end(), val) - knots.begin() - 1;
+    double frac = (double)(val - knots[j]) / (double)(knots[j+1] - knots[j]);
+    return (j + frac) / NUM_CDF_KNOTS;
+}
+
+template <size_t D>
+bool FloodIndex<D>::GetBounds(const Query<D>& query, QueryBounds* bounds) const {
+    // Multiple ranges or values are covered by their hull.
+    auto hull = [](const QueryFilter& qf, Scalar* lo, Scalar* hi) {
+        if (qf.is_range) {
+            if (qf.ranges.empty()) {
+                return false;
+            }
+            *lo = qf.ranges[0].first;
+            *hi = qf.ranges[0].second;
+            for (const ScalarRange& r : qf.ranges) {
+                *lo = std::min(*lo, r.first);
+                *hi = std::max(*hi, r.second);
+            }
+        } else {
+            if (qf.values.empty()) {
+                return false;
+            }
+            *lo = qf.values.front();
+            *hi = qf.values.back();
+        }
+        return *lo <= *hi;
+    };
+    bounds->lo.resize(grid_dims_.size());
+    bounds->hi.resize(grid_dims_.size());
+    for (size_t i = 0; i < grid_dims_.size(); i++) {
+        const QueryFilter& qf = query.filters[grid_dims_[i]];
+        bounds->lo[i] = std::numeric_limits<Scalar>::lowest();
+        bounds->hi[i] = std::numeric_limits<Scalar>::max();
+        if (qf.present && !hull(qf, &bounds->lo[i], &bounds->hi[i])) {
+            return false;
+        }
+    }
+    const QueryFilter& sf = query.filters[sort_dim_];
+    bounds->sort_present = sf.present;
+    bounds->sort_lo = std::numeric_limits<Scalar>::lowest();
+    bounds->sort_hi = std::numeric_limits<Scalar>::max();
+    if (sf.present && !hull(sf, &bounds->sort_lo, &bounds->sort_hi)) {
+        return false;
+    }
+    return true;
+}
+
+template <size_t D>
+double FloodIndex<D>::EstimateCost(const std::vector<size_t>& columns,
+        const std::vector<std::vector<double>>& sample_cdfs,
+        const std::vector<Scalar>& sample_sort_vals,
+        const std::vector<QueryBounds>& workload) const {
+    size_t g = grid_dims_.size();
+    size_t sample_size = sample_sort_vals.size();
+    // Column of each sample point under this grid.
+    std::vector<size_t> sample_cols(g * sample_size);
+    for (size_t i = 0; i < g; i++) {
+        for (size_t s = 0; s < sample_size; s++) {
+            sample_cols[s * g + i] = std::min(columns[i] - 1, (size_t)(sample_cdfs[i][s] * columns[i]));
+        }
+    }
+    double scale = (double)data_size_ / sample_size;
+    double cost = 0;
+    std::vector<size_t> lo_col(g), hi_col(g);
+    for (const QueryBounds& qb : workload) {
+        double cells = 1;
+        for (size_t i = 0; i < g; i++) {
+            lo_col[i] = ColumnFor(i, qb.lo[i], columns[i]);
+            hi_col[i] = ColumnFor(i, qb.hi[i], columns[i]);
+            cells *= hi_col[i] - lo_col[i] + 1;
+        }
+        // A point is scanned if it lies in a visited cell and within the sort dimension range.
+        size_t scanned = 0;
+        for (size_t s = 0; s < sample_size; s++) {
+            bool visited = sample_sort_vals[s] >= qb.sort_lo && sample_sort_vals[s] <= qb.sort_hi;
+            for (size_t i = 0; i < g && visited; i++) {
+                size_t c = sample_cols[s * g + i];
+                visited = c >= lo_col[i] && c <= hi_col[i];
+            }
+            scanned += visited;
+        }
+        cost += scanned * scale + cells * CELL_COST;
+    }
+    return cost;
+}
+
+template <size_t D>
+void FloodIndex<D>::TuneColumns(PointIterator<D> start, const std::vector<size_t>& sample) {
+    size_t g = grid_dims_.size();
+    size_t max_cells = std::max<size_t>(1, data_size_ / MIN_POINTS_PER_CELL);
+    if (workload_file_.empty()) {
+        size_t target_cells = std::max<size_t>(1, data_size_ / DEFAULT_POINTS_PER_CELL);
+        size_t per_dim = std::max<size_t>(1, (size_t)std::pow((double)target_cells, 1.0 / g));
+        std::fill(columns_per_dim_.begin(), columns_per_dim_.end(), per_dim);
+        return;
+    }
+
+    std::vector<Query<D>> queries = load_query_file<D>(workload_file_);
+    std::vector<QueryBounds> workload;
+    size_t stride = std::max<size_t>(1, queries.size() / MAX_TUNING_QUERIES);
+    for (size_t q = 0; q < queries.size(); q += stride) {
+        QueryBounds qb;
+        if (GetBounds(queries[q], &qb)) {
+            workload.push_back(qb);
+        }
+    }
+    std::vector<std::vector<double>> sample_cdfs(g, std::vector<double>(sample.size()));
+    std::vector<Scalar> sample_sort_vals(sample.size());
+    for (size_t s = 0; s < sample.size(); s++) {
+        const Point<D>& p = *(start + sample[s]);
+        for (size_t i = 0; i < g; i++) {
+            sample_cdfs[i][s] = CDF(i, p[grid_dims_[i]]);
+        }
+        sample_sort_vals[s] = p[sort_dim_];
+    }
+
+    // Coordinate descent over powers of two, starting from a single cell.
+    std::vector<size_t> columns(g, 1);
+    double best = EstimateCost(columns, sample_cdfs, sample_sort_vals, workload);
+    bool improved = true;
+    while (improved) {
+        improved = false;
+        for (size_t i = 0; i < g; i++) {
+            size_t cells = 1;
+            for (size_t c : columns) {
+                cells *= c;
+            }
+            for (size_t candidate : {columns[i] * 2, columns[i] / 2}) {
+                if (candidate == 0 || cells / columns[i] * candidate > max_cells) {
+                    continue;
+                }
+                std::vector<size_t> next = columns;
+                next[i] = candidate;
+                double cost = EstimateCost(next, sample_cdfs, sample_sort_vals, workload);
+                if (cost < best) {
+                    best = cost;
+                    columns = next;
+                    improved = true;
+                    break;
+                }
+            }
+        }
+    }
+    columns_per_dim_ = columns;
+    std::cout << "FloodIndex tuned on " << workload.size() << " queries, estimated "
+        << best / std::max<size_t>(1, workload.size()) << " points scanned per query" << std::endl;
+}
+
+template <size_t D>
+void FloodIndex<D>::Init(PointIterator<D> start, PointIterator<D> end) {
+    data_size_ = std::distance(start, end);
+    size_t g = grid_dims_.size();
+    if (data_size_ == 0) {
+        cell_offsets_.assign(2, 0);
+        return;
+    }
+    std::vector<size_t> sample;
+    size_t sample_size = std::min(data_size_, SAMPLE_SIZE);
+    for (size_t s = 0; s < sample_size; s++) {
+        sample.push_back(s * data_size_ / sample_size);
+    }
+    FitCDFs(start, sample);
+    TuneColumns(start, sample);
+
+    size_t num_cells = 1;
+    std::cout << "Building FloodIndex with columns per grid dimension:";
+    for (size_t i = 0; i < g; i++) {
+        num_cells *= columns_per_dim_[i];
+        std::cout << " " << grid_dims_[i] << ":" << columns_per_dim_[i];
+    }
+    std::cout << ", sorted by " << sort_dim_ << std::endl;
+
+    // Cell ids are laid out with the last grid dimension varying fastest.
+    std::vector<size_t> cells(data_size_);
+    #pragma omp parallel for schedule(static)
+    for (size_t r = 0; r < data_size_; r++) {
+        const Point<D>& p = *(start + r);
+        size_t cell = 0;
+        for (size_t i = 0; i < g; i++) {
+            cell = cell * columns_per_dim_[i] + ColumnFor(i, p[grid_dims_[i]], columns_per_dim_[i]);
+        }
+        cells[r] = cell;
+    }
+    cell_offsets_.assign(num_cells + 1, 0);
+    for (size_t c : cells) {
+        cell_offsets_[c + 1]++;
+    }
+    for (size_t c = 0; c < num_cells; c++) {
+        cell_offsets_[c + 1] += cell_offsets_[c];
+    }
+    // Row that ends up at each position: rows grouped by cell, then sorted within each cell.
+    std::vector<size_t> order(data_size_);
+    std::vector<size_t> next(cell_offsets_.begin(), cell_offsets_.end() - 1);
+    for (size_t r = 0; r < data_size_; r++) {
+        order[next[cells[r]]++] = r;
+    }
+    std::vector<size_t>().swap(cells);
+    std::vector<size_t>().swap(next);
+
+    #pragma omp parallel
+    {
+        std::vector<std::pair<Scalar, size_t>> cell_rows;
+        #pragma omp for schedule(dynamic)
+        for (size_t c = 0; c < num_cells; c++) {
+            cell_rows.clear();
+            for (size_t i = cell_offsets_[c]; i < cell_offsets_[c + 1]; i++) {
+                cell_rows.emplace_back((*(start + order[i]))[sort_dim_], order[i]);
+            }
+            std::sort(cell_rows.begin(), cell_rows.end());
+            for (size_t i = 0; i < cell_rows.size(); i++) {
+                order[cell_offsets_[c] + i] = cell_rows[i].second;
+            }
+        }
+    }
+    PermutationUtils::ApplyParallel(start, order);
+
+    sort_fences_.clear();
+    for (size_t r = 0; r < data_size_; r += FENCE_SPACING) {
+        sort_fences_.push_back((*(start + r))[sort_dim_]);
+    }
+}
+
+template <size_t D>
+PhysicalIndexSet FloodIndex<D>::Ranges(Query<D>& query) {
+    QueryBounds qb;
+    if (!GetBounds(query, &qb)) {
+        return {{}, {}};
+    }
+    size_t g = grid_dims_.size();
+    std::vector<size_t> lo_col(g), hi_col(g);
+    for (size_t i = 0; i < g; i++) {
+        lo_col[i] = ColumnFor(i, qb.lo[i], columns_per_dim_[i]);
+        hi_col[i] = ColumnFor(i, qb.hi[i], columns_per_dim_[i]);
+    }
+
+    IndexRangeList ranges;
+    // Visit the cells in id order, so their row ranges come out sorted.
+    std::vector<size_t> col(lo_col);
+    while (true) {
+        size_t cell = 0;
+        for (size_t i = 0; i < g; i++) {
+            cell = cell * columns_per_dim_[i] + col[i];
+        }
+        size_t cell_start = cell_offsets_[cell];
+        size_t cell_end = cell_offsets_[cell + 1];
+        size_t row_start = cell_start;
+        size_t row_end = cell_end;
+        if (qb.sort_present && cell_start < cell_end) {
+            // The fences within the cell are sorted. Rows before the fence preceding the first
+            // fence >= sort_lo are all smaller than sort_lo, and rows from the first fence
+            // > sort_hi onwards are all larger than sort_hi.
+            auto first = sort_fences_.begin() + (cell_start + FENCE_SPACING - 1) / FENCE_SPACING;
+            auto last = sort_fences_.begin() + (cell_end + FENCE_SPACING - 1) / FENCE_SPACING;
+            auto lb = std::lower_bound(first, last, qb.sort_lo);
+            if (lb != first) {
+                row_start = std::max(cell_start, (size_t)(lb - sort_fences_.begin() - 1) * FENCE_SPACING);
+            }
+            auto ub = std::upper_bound(lb, last, qb.sort_hi);
+            if (ub != last) {
+                row_end = std::min(cell_end, (size_t)(ub - sort_fences_.begin()) * FENCE_SPACING);
+            }
+        }
+        if (row_start < row_end) {
+            if (!ranges.empty() && ranges.back().end == row_start) {
+                ranges.back().end = row_end;
+            } else {
+                ranges.push_back({row_start, row_end});
+            }
+        }
+        // Advance to the next cell in the query box, last dimension fastest.
+        size_t i = g;
+        while (i > 0 && col[i-1] == hi_col[i-1]) {
+            col[i-1] = lo_col[i-1];
+            i--;
+        }
+        if (i == 0) {
+            break;
+        }
+        col[i-1]++;
+    }
+    return {ranges, {}};
+}
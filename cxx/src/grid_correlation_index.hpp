@@ -0,0 +1,223 @@
+#include "grid_correlation_index.h"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+#include "merge_utils.h"
+#include "stash_utils.h"
+#include "utils.h"
+
+template <size_t D>
+GridCorrelationIndex<D>::GridCorrelationIndex(const std::vector<size_t>& mapped_columns,
+        size_t buckets_per_column, size_t target_bucket_size, float storage_factor)
+    : CorrelationIndexer<D>(), mapped_columns_(mapped_columns),
+      buckets_per_column_(buckets_per_column), target_bucket_size_(target_bucket_size),
+      storage_factor_(storage_factor), data_size_(0), bounds_(), num_buckets_(), strides_(),
+      cells_(), cell_offsets_(), cell_targets_(), outlier_offsets_(), outlier_rows_() {
+    AssertWithMessage(!mapped_columns_.empty(), "GridCorrelationIndex needs a mapped column");
+    for (size_t c : mapped_columns_) {
+        AssertWithMessage(c < D, "Mapped column out of range: " + std::to_string(c));
+    }
+    AssertWithMessage(buckets_per_column_ > 0, "Need at least one bucket per mapped column");
+    AssertWithMessage(target_bucket_size_ > 0, "Target buckets must hold at least one row");
+    this->column_ = mapped_columns_[0];
+}
+
+template <size_t D>
+size_t GridCorrelationIndex<D>::BucketOf(size_t c, Scalar v) const {
+    const std::vector<Scalar>& b = bounds_[c];
+    size_t key = std::upper_bound(b.begin() + 1, b.end(), v) - (b.begin() + 1);
+    return std::min<size_t>(key, num_buckets_[c] - 1);
+}
+
+template <size_t D>
+uint64_t GridCorrelationIndex<D>::CellOf(const Point<D>& p) const {
+    uint64_t cell = 0;
+    for (size_t c = 0; c < mapped_columns_.size(); c++) {
+        cell += BucketOf(c, p[mapped_columns_[c]]) * strides_[c];
+    }
+    return cell;
+}
+
+template <size_t D>
+void GridCorrelationIndex<D>::Init(ConstPointIterator<D> start, ConstPointIterator<D> end) {
+    data_size_ = std::distance(start, end);
+    AssertWithMessage(data_size_ > 0, "Can't build a grid correlation index on an empty dataset");
+    size_t k = mapped_columns_.size();
+    bounds_.assign(k, {});
+    num_buckets_.assign(k, 0);
+    strides_.assign(k, 0);
+    for (size_t c = 0; c < k; c++) {
+        bounds_[c] = StashUtils::EquiDepthBounds<D>(start, end, mapped_columns_[c],
+                buckets_per_column_);
+        num_buckets_[c] = bounds_[c].size() - 1;
+    }
+    uint64_t stride = 1;
+    for (size_t c = k; c-- > 0; ) {
+        strides_[c] = stride;
+        AssertWithMessage(stride <= std::numeric_limits<uint64_t>::max() / num_buckets_[c],
+                "Too many grid cells for GridCorrelationIndex");
+        stride *= num_buckets_[c];
+    }
+
+    std::vector<uint64_t> row_cells(data_size_);
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < data_size_; i++) {
+        row_cells[i] = CellOf(*(start + i));
+    }
+
+    // Every target bucket makes its stash decisions independently.
+    size_t num_targets = (data_size_ + target_bucket_size_ - 1) / target_bucket_size_;
+    AssertWithMessage(num_targets <= std::numeric_limits<uint32_t>::max(),
+            "Too many target buckets for GridCorrelationIndex");
+    std::vector<std::vector<uint64_t>> inlier_cells(num_targets);
+    std::vector<std::vector<std::pair<uint64_t, size_t>>> outliers(num_targets);
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t t = 0; t < num_targets; t++) {
+        size_t s = t * target_bucket_size_;
+        size_t e = std::min(s + target_bucket_size_, data_size_);
+        auto stash = StashUtils::StashTarget(row_cells.data() + s, e - s, storage_factor_);
+        for (size_t c = 0; c < stash.keys.size(); c++) {
+            if (stash.inlier[c]) {
+                inlier_cells[t].push_back(stash.keys[c]);
+            }
+        }
+        for (size_t i : stash.outliers) {
+            outliers[t].emplace_back(row_cells[s + i], s + i);
+        }
+    }
+
+    // Regroup by cell. Targets and rows are gathered in increasing order, and the stable sorts
+    // keep them that way within each cell.
+    std::vector<std::pair<uint64_t, uint32_t>> cell_targets;
+    std::vector<std::pair<uint64_t, size_t>> cell_rows;
+    for (size_t t = 0; t < num_targets; t++) {
+        for (uint64_t cell : inlier_cells[t]) {
+            cell_targets.emplace_back(cell, t);
+        }
+        cell_rows.insert(cell_rows.end(), outliers[t].begin(), outliers[t].end());
+    }
+    auto by_cell = [](const auto& a, const auto& b) { return a.first < b.first; };
+    std::stable_sort(cell_targets.begin(), cell_targets.end(), by_cell);
+    std::stable_sort(cell_rows.begin(), cell_rows.end(), by_cell);
+
+    cells_.clear();
+    cell_offsets_.assign(1, 0);
+    cell_targets_.clear();
+    outlier_offsets_.assign(1, 0);
+    outlier_rows_.clear();
+    size_t ti = 0, ri = 0;
+    while (ti < cell_targets.size() || ri < cell_rows.size()) {
+        uint64_t cell = std::numeric_limits<uint64_t>::max();
+        if (ti < cell_targets.size()) {
+            cell = cell_targets[ti].first;
+        }
+        if (ri < cell_rows.size()) {
+            cell = std::min(cell, cell_rows[ri].first);
+        }
+        for (; ti < cell_targets.size() && cell_targets[ti].first == cell; ti++) {
+            cell_targets_.push_back(cell_targets[ti].second);
+        }
+        for (; ri < cell_rows.size() && cell_rows[ri].first == cell; ri++) {
+            outlier_rows_.push_back(cell_rows[ri].second);
+        }
+        cells_.push_back(cell);
+        cell_offsets_.push_back(cell_targets_.size());
+        outlier_offsets_.push_back(outlier_rows_.size());
+    }
+    std::cout << "GridCorrelationIndex: " << k << " mapped columns, " << cells_.size()
+        << " non-empty cells, " << num_targets << " target buckets, " << cell_targets_.size()
+        << " inlier cells and " << outlier_rows_.size() << " outliers" << std::endl;
+}
+
+template <size_t D>
+bool GridCorrelationIndex<D>::BucketsMatching(size_t c, const Query<D>& q, size_t* lo,
+        size_t* hi) const {
+    const QueryFilter& qf = q.filters[mapped_columns_[c]];
+    if (!qf.present) {
+        *lo = 0;
+        *hi = num_buckets_[c] - 1;
+        return true;
+    }
+    Scalar qlo = std::numeric_limits<Scalar>::max(), qhi = std::numeric_limits<Scalar>::lowest();
+    if (qf.is_range) {
+        for (const ScalarRange& r : qf.ranges) {
+            qlo = std::min(qlo, r.first);
+            qhi = std::max(qhi, r.second);
+        }
+    } else {
+        for (Scalar v : qf.values) {
+            qlo = std::min(qlo, v);
+            qhi = std::max(qhi, v);
+        }
+    }
+    if (qlo > qhi || qhi < bounds_[c].front() || qlo >= bounds_[c].back()) {
+        return false;
+    }
+    *lo = BucketOf(c, qlo);
+    *hi = BucketOf(c, qhi);
+    return true;
+}
+
+template <size_t D>
+PhysicalIndexSet GridCorrelationIndex<D>::Ranges(const Query<D>& q) const {
+    size_t k = mapped_columns_.size();
+    bool filtered = false;
+    std::vector<size_t> lo(k), hi(k);
+    for (size_t c = 0; c < k; c++) {
+        filtered |= q.filters[mapped_columns_[c]].present;
+        if (!BucketsMatching(c, q, &lo[c], &hi[c])) {
+            return {};
+        }
+    }
+    if (!filtered) {
+        return {{{0, data_size_}}, {}};
+    }
+
+    // Walk the matching cells in increasing order: for every combination of buckets in the other
+    // columns, the buckets of the last column form a run of cell ids.
+    std::vector<uint32_t> targets;
+    IndexList rows;
+    std::vector<size_t> cur(lo);
+    auto pos = cells_.begin();
+    while (true) {
+        uint64_t base = 0;
+        for (size_t c = 0; c + 1 < k; c++) {
+            base += cur[c] * strides_[c];
+        }
+        pos = std::lower_bound(pos, cells_.end(), base + lo[k-1]);
+        for (; pos != cells_.end() && *pos <= base + hi[k-1]; pos++) {
+            size_t i = pos - cells_.begin();
+            targets.insert(targets.end(), cell_targets_.begin() + cell_offsets_[i],
+                    cell_targets_.begin() + cell_offsets_[i+1]);
+            rows.insert(rows.end(), outlier_rows_.begin() + outlier_offsets_[i],
+                    outlier_rows_.begin() + outlier_offsets_[i+1]);
+        }
+        // Move on to the next combination, with the second to last column varying fastest.
+        size_t c = k - 1;
+        while (c > 0 && cur[c-1] == hi[c-1]) {
+            cur[c-1] = lo[c-1];
+            c--;
+        }
+        if (c == 0) {
+            break;
+        }
+        cur[c-1]++;
+    }
+    std::sort(targets.begin(), targets.end());
+    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+    std::sort(rows.begin(), rows.end());
+
+    IndexRangeList ranges;
+    for (uint32_t t : targets) {
+        PhysicalIndexRange r(t * target_bucket_size_,
+                std::min((t + 1) * target_bucket_size_, data_size_));
+        if (!ranges.empty() && r.start == ranges.back().end) {
+            ranges.back().end = r.end;
+        } else {
+            ranges.push_back(r);
+        }
+    }
+    return MergeUtils::Union(ranges, rows);
+}
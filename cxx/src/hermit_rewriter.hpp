@@ -0,0 +1,83 @@
+#include "hermit_rewriter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+#include "merge_utils.h"
+#include "utils.h"
+
+template <size_t D>
+void HermitRewriter<D>::AddPair(size_t mapped, size_t target,
+        std::unique_ptr<SecondaryBTreeIndex<D>> outlier_index) {
+    AssertWithMessage(mapped < D && target < D, "HermitRewriter column out of range");
+    AssertWithMessage(mapped != target, "HermitRewriter can't map a column to itself");
+    AssertWithMessage(outlier_index != nullptr, "HermitRewriter needs an outlier index per pair");
+    AssertWithMessage(outlier_index->GetColumn() == mapped,
+            "Outlier index must be on the mapped column " + std::to_string(mapped));
+    for (const auto& p : pairs_) {
+        AssertWithMessage(p->GetMappedColumn() != mapped || p->GetTargetColumn() != target,
+                "Duplicate HermitRewriter pair " + std::to_string(mapped) + " -> "
+                + std::to_string(target));
+    }
+    auto pair = std::make_unique<TRSTreeRewriter<D>>(mapped, target);
+    pair->SetAuxiliaryIndex(std::move(outlier_index));
+    pairs_.push_back(std::move(pair));
+}
+
+template <size_t D>
+void HermitRewriter<D>::Init(ConstPointIterator<D> start, ConstPointIterator<D> end) {
+    AssertWithMessage(!pairs_.empty(), "HermitRewriter has no column pairs");
+    // Each tree is built with every thread, so they're built one after the other.
+    for (auto& p : pairs_) {
+        p->Init(start, end);
+    }
+}
+
+template <size_t D>
+IndexList HermitRewriter<D>::Rewrite(Query<D>& q) {
+    target_present_.fill(false);
+    // Everything is looked up against the original filters before any of them is rewritten, so
+    // that a target column that is also mapped doesn't see its own rewritten ranges.
+    IndexList outliers;
+    for (auto& p : pairs_) {
+        const QueryFilter& mapped = q.filters[p->GetMappedColumn()];
+        if (!mapped.present) {
+            continue;
+        }
+        assert (mapped.is_range);
+        const auto& ranges = p->TargetRanges(mapped.ranges);
+        size_t target = p->GetTargetColumn();
+        if (target_present_[target]) {
+            target_ranges_[target] = MergeUtils::Intersect(target_ranges_[target], ranges);
+        } else {
+            target_ranges_[target].assign(ranges.begin(), ranges.end());
+            target_present_[target] = true;
+        }
+        IndexList aux = p->Outliers(q);
+        if (outliers.empty()) {
+            outliers = std::move(aux);
+        } else {
+            outliers.insert(outliers.end(), aux.begin(), aux.end());
+        }
+    }
+
+    for (size_t target = 0; target < D; target++) {
+        if (!target_present_[target]) {
+            continue;
+        }
+        QueryFilter& target_qf = q.filters[target];
+        if (target_qf.present) {
+            assert (target_qf.is_range);
+            std::sort(target_qf.ranges.begin(), target_qf.ranges.end(), ScalarRangeStartComp{});
+            target_qf.ranges = MergeUtils::Intersect(target_ranges_[target], target_qf.ranges);
+        } else {
+            target_qf = {.present = true, .is_range = true};
+            target_qf.ranges.assign(target_ranges_[target].begin(), target_ranges_[target].end());
+        }
+    }
+    // A row can be an outlier of several pairs.
+    std::sort(outliers.begin(), outliers.end());
+    outliers.erase(std::unique(outliers.begin(), outliers.end()), outliers.end());
+    return outliers;
+}
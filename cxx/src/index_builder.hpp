@@ -23,24 +23,41 @@ std::unique_ptr<Indexer<D>> IndexBuilder<D>::Dispatch(std::ifstream& spec, bool
     } else if (next_index == "CombinedCorrelationIndex") {
         assert (!root);
         return BuildCombinedCorrelationIndex(spec);
+    } else if (next_index == "GridCorrelationIndex") {
+        return BuildGridCorrelationIndex(spec);
     } else if (next_index == "MappedCorrelationIndex") {
         assert (!root);
         return BuildMappedCorrelationIndex(spec);
     } else if (next_index == "SecondaryBTreeIndex") {
         assert (!root);
         return BuildSecondaryBTreeIndex(spec);
+    } else if (next_index == "PostingListSecondaryIndex") {
+        assert (!root);
+        return BuildPostingListSecondaryIndex(spec);
     } else if (next_index == "BinarySearchIndex") {
         return BuildBinarySearchIndex(spec);
     } else if (next_index == "PrimaryBTreeIndex") {
         return BuildPrimaryBTreeIndex(spec);
     } else if (next_index == "OctreeIndex") {
         return BuildOctreeIndex(spec);
+    } else if (next_index == "ZOrderIndex") {
+        return BuildZOrderIndex(spec);
+    } else if (next_index == "FloodIndex") {
+        return BuildFloodIndex(spec);
+    } else if (next_index == "CrackingIndex") {
+        return BuildCrackingIndex(spec);
     } else if (next_index == "BucketedSecondaryIndex") {
         return BuildBucketedSecondaryIndex(spec);
+    } else if (next_index == "SingleColumnRewriter") {
+        return BuildSingleColumnRewriter(spec);
     } else if (next_index == "LinearModelRewriter") {
         return BuildLinearModelRewriter(spec);
     } else if (next_index == "TRSTreeRewriter") {
         return BuildTRSTreeRewriter(spec);
+    } else if (next_index == "HermitRewriter") {
+        return BuildHermitRewriter(spec);
+    } else if (next_index == "PiecewiseLinearRewriter") {
+        return BuildPiecewiseLinearRewriter(spec);
     } else if (next_index == "MeasureBetaIndex") {
         return BuildMeasureBetaIndex(spec);
     } else if (next_index == "}") {
@@ -83,12 +100,31 @@ std::unique_ptr<SecondaryBTreeIndex<D>> IndexBuilder<D>::BuildSecondaryBTreeInde
     }
     spec >> paren2;
     AssertWithMessage(paren == "{" && paren2 == "}", "Incorrect spec for SecondaryBTreeIndex");
-    IndexList outlier_list = load_binary_file<size_t>(optional_list);
+    IndexList outlier_list = MappingArtifacts::LoadOutliers(optional_list);
     std::cout << "Building SecondaryBTreeIndex with dim " << dim << " and outlier list of size " << outlier_list.size() << std::endl;
     index->SetIndexList(outlier_list);
     return index;
 }
 
+template <size_t D>
+std::unique_ptr<PostingListSecondaryIndex<D>> IndexBuilder<D>::BuildPostingListSecondaryIndex(std::ifstream& spec) {
+    std::string paren, optional_list, paren2;
+    size_t dim;
+    spec >> paren >> dim >> optional_list;
+    auto index = std::make_unique<PostingListSecondaryIndex<D>>(dim);
+    if (optional_list == "}") {
+        AssertWithMessage(paren == "{", "Incorrect spec for PostingListSecondaryIndex");
+        std::cout << "Building PostingListSecondaryIndex with dim " << dim << std::endl;
+        return index;
+    }
+    spec >> paren2;
+    AssertWithMessage(paren == "{" && paren2 == "}", "Incorrect spec for PostingListSecondaryIndex");
+    IndexList outlier_list = MappingArtifacts::LoadOutliers(optional_list);
+    std::cout << "Building PostingListSecondaryIndex with dim " << dim << " and outlier list of size " << outlier_list.size() << std::endl;
+    index->SetIndexList(outlier_list);
+    return index;
+}
+
 template <size_t D>
 std::unique_ptr<BinarySearchIndex<D>> IndexBuilder<D>::BuildBinarySearchIndex(std::ifstream& spec) {
     std::pair<std::string, std::string> parens;
@@ -119,6 +155,34 @@ std::unique_ptr<MappedCorrelationIndex<D>> IndexBuilder<D>::BuildMappedCorrelati
     return std::make_unique<MappedCorrelationIndex<D>>(mapping_file, target_bucket_file);
 }
 
+template <size_t D>
+std::unique_ptr<GridCorrelationIndex<D>> IndexBuilder<D>::BuildGridCorrelationIndex(std::ifstream& spec) {
+    std::string token;
+    spec >> token;
+    AssertWithMessage(token == "{", "Incorrect spec for GridCorrelationIndex");
+    std::vector<std::string> params;
+    while (spec >> token) {
+        if (token == "}") {
+            break;
+        }
+        params.push_back(token);
+    }
+    AssertWithMessage(params.size() > 3, "GridCorrelationIndex requires buckets_per_column, "
+            "target_bucket_size, storage_factor and at least one mapped column");
+    size_t buckets_per_column = std::stoul(params[0]);
+    size_t target_bucket_size = std::stoul(params[1]);
+    float storage_factor = std::stof(params[2]);
+    std::vector<size_t> mapped_columns;
+    for (size_t i = 3; i < params.size(); i++) {
+        mapped_columns.push_back(std::stoi(params[i]));
+    }
+    std::cout << "Building GridCorrelationIndex on " << mapped_columns.size() << " columns with "
+        << buckets_per_column << " buckets each and target buckets of " << target_bucket_size
+        << " rows" << std::endl;
+    return std::make_unique<GridCorrelationIndex<D>>(mapped_columns, buckets_per_column,
+            target_bucket_size, storage_factor);
+}
+
 template <size_t D>
 std::unique_ptr<CombinedCorrelationIndex<D>> IndexBuilder<D>::BuildCombinedCorrelationIndex(std::ifstream& spec) {
     std::pair<std::string, std::string> parens;
@@ -184,10 +248,16 @@ std::unique_ptr<OctreeIndex<D>> IndexBuilder<D>::BuildOctreeIndex(std::ifstream&
     spec >> token;
     AssertWithMessage(token == "{", "Incorrect spec for OctreeIndex");
     std::vector<std::string> params;
+    // Optional trailing keyword to write out the sorted data after building.
+    bool dump_sorted_data = false;
     while (spec >> token) {
         if (token == "}") {
             break;
         }
+        if (token == "dump") {
+            dump_sorted_data = true;
+            continue;
+        }
         params.push_back(token);
     }
     AssertWithMessage(params.size() > 1, "Octree requires page_size and at least one indexed dimension");
@@ -198,7 +268,68 @@ std::unique_ptr<OctreeIndex<D>> IndexBuilder<D>::BuildOctreeIndex(std::ifstream&
     }
     std::cout << "Building Octree index with page size " << page_size << " and "
         << indexed_dims.size() << " columns" << std::endl;
-    return std::make_unique<OctreeIndex<D>>(indexed_dims, page_size);
+    auto index = std::make_unique<OctreeIndex<D>>(indexed_dims, page_size);
+    index->SetDumpSortedData(dump_sorted_data);
+    return index;
+}
+
+template <size_t D>
+std::unique_ptr<ZOrderIndex<D>> IndexBuilder<D>::BuildZOrderIndex(std::ifstream& spec) {
+    std::string token;
+    spec >> token;
+    AssertWithMessage(token == "{", "Incorrect spec for ZOrderIndex");
+    std::vector<std::string> params;
+    while (spec >> token) {
+        if (token == "}") {
+            break;
+        }
+        params.push_back(token);
+    }
+    AssertWithMessage(params.size() > 1, "ZOrderIndex requires page_size and at least one indexed dimension");
+    size_t page_size = std::stoi(params[0]);
+    std::vector<size_t> indexed_dims;
+    for (size_t i = 1; i < params.size(); i++) {
+        indexed_dims.push_back(std::stoi(params[i]));
+    }
+    std::cout << "Building ZOrder index with page size " << page_size << " and "
+        << indexed_dims.size() << " columns" << std::endl;
+    return std::make_unique<ZOrderIndex<D>>(indexed_dims, page_size);
+}
+
+template <size_t D>
+std::unique_ptr<FloodIndex<D>> IndexBuilder<D>::BuildFloodIndex(std::ifstream& spec) {
+    std::string token;
+    spec >> token;
+    AssertWithMessage(token == "{", "Incorrect spec for FloodIndex");
+    std::vector<std::string> params;
+    while (spec >> token) {
+        if (token == "}") {
+            break;
+        }
+        params.push_back(token);
+    }
+    // The workload file may be "none" to split the grid evenly without tuning.
+    AssertWithMessage(params.size() > 2,
+            "FloodIndex requires a workload file, the sort dimension and at least one grid dimension");
+    std::string workload_file = params[0] == "none" ? "" : params[0];
+    size_t sort_dim = std::stoi(params[1]);
+    std::vector<size_t> grid_dims;
+    for (size_t i = 2; i < params.size(); i++) {
+        grid_dims.push_back(std::stoi(params[i]));
+    }
+    std::cout << "Building Flood index sorted by " << sort_dim << " with "
+        << grid_dims.size() << " grid columns" << std::endl;
+    return std::make_unique<FloodIndex<D>>(grid_dims, sort_dim, workload_file);
+}
+
+template <size_t D>
+std::unique_ptr<CrackingIndex<D>> IndexBuilder<D>::BuildCrackingIndex(std::ifstream& spec) {
+    std::pair<std::string, std::string> parens;
+    size_t dim;
+    spec >> parens.first >> dim >> parens.second;
+    AssertWithMessage(parens.first == "{" && parens.second == "}", "Incorrect spec for CrackingIndex");
+    std::cout << "Building CrackingIndex on dim " << dim << std::endl;
+    return std::make_unique<CrackingIndex<D>>(dim);
 }
        
 template <size_t D>
@@ -215,7 +346,7 @@ std::unique_ptr<BucketedSecondaryIndex<D>> IndexBuilder<D>::BuildBucketedSeconda
     }
     spec >> paren2;
     AssertWithMessage(paren == "{" && paren2 == "}", "Incorrect spec for BucketedSecondaryIndex");
-    IndexList outlier_list = load_binary_file<size_t>(optional_list);
+    IndexList outlier_list = MappingArtifacts::LoadOutliers(optional_list);
     std::cout << "Building BucketedSecondaryIndex with dim " << dim << ", mapfile"
         << ", and outlier list of size " << outlier_list.size() << std::endl;
     auto idx = std::make_unique<BucketedSecondaryIndex<D>>(dim, outlier_list);
@@ -223,6 +354,18 @@ std::unique_ptr<BucketedSecondaryIndex<D>> IndexBuilder<D>::BuildBucketedSeconda
     return idx;
 }
 
+template <size_t D>
+std::unique_ptr<SingleColumnRewriter<D>> IndexBuilder<D>::BuildSingleColumnRewriter(std::ifstream& spec) {
+    std::string paren, mapfile;
+    spec >> paren >> mapfile;
+    AssertWithMessage(paren == "{", "Incorrect spec for SingleColumnRewriter");
+    auto rewriter = std::make_unique<SingleColumnRewriter<D>>(mapfile);
+    std::cout << "Building SingleColumnRewriter from " << mapfile << std::endl;
+    spec >> paren;
+    AssertWithMessage(paren == "}", "Incorrect spec: expected '}'");
+    return rewriter;
+}
+
 template <size_t D>
 std::unique_ptr<LinearModelRewriter<D>> IndexBuilder<D>::BuildLinearModelRewriter(std::ifstream& spec) {
     std::string paren, mapfile;
@@ -259,6 +402,56 @@ std::unique_ptr<TRSTreeRewriter<D>> IndexBuilder<D>::BuildTRSTreeRewriter(std::i
     return rewriter;
 }
 
+// Spec: HermitRewriter { <mapped> <target> <SecondaryBTreeIndex on mapped> ... }, with one
+// mapped/target pair and outlier index per correlated column.
+template <size_t D>
+std::unique_ptr<HermitRewriter<D>> IndexBuilder<D>::BuildHermitRewriter(std::ifstream& spec) {
+    std::string token;
+    spec >> token;
+    AssertWithMessage(token == "{", "Incorrect spec for HermitRewriter");
+    auto rewriter = std::make_unique<HermitRewriter<D>>();
+    while (spec >> token && token != "}") {
+        size_t mapped_dim = std::stoi(token);
+        size_t target_dim;
+        spec >> target_dim;
+        auto next_index = Dispatch(spec);
+        AssertWithMessage(next_index != nullptr, "Expected an outlier index for HermitRewriter");
+        AssertWithMessage(next_index->Type() == Secondary, "Expected Secondary Indexer for rewriter");
+        auto outlier_index = std::unique_ptr<SecondaryBTreeIndex<D>>(
+                dynamic_cast<SecondaryBTreeIndex<D>*>(next_index.release()));
+        AssertWithMessage(outlier_index != nullptr,
+                "HermitRewriter outlier indexes must be SecondaryBTreeIndex");
+        rewriter->AddPair(mapped_dim, target_dim, std::move(outlier_index));
+        std::cout << "Adding pair " << mapped_dim << " -> " << target_dim
+            << " to HermitRewriter" << std::endl;
+    }
+    AssertWithMessage(token == "}", "Incorrect spec: expected '}'");
+    AssertWithMessage(rewriter->NumPairs() > 0, "HermitRewriter needs at least one column pair");
+    return rewriter;
+}
+
+// Spec: PiecewiseLinearRewriter { <mapped> <target> <storage factor> <SecondaryBTreeIndex> }
+template <size_t D>
+std::unique_ptr<PiecewiseLinearRewriter<D>> IndexBuilder<D>::BuildPiecewiseLinearRewriter(
+        std::ifstream& spec) {
+    std::string paren;
+    size_t mapped_dim, target_dim;
+    double storage_factor;
+    spec >> paren >> mapped_dim >> target_dim >> storage_factor;
+    AssertWithMessage(paren == "{", "Incorrect spec for PiecewiseLinearRewriter");
+    auto rewriter = std::make_unique<PiecewiseLinearRewriter<D>>(mapped_dim, target_dim,
+            storage_factor);
+    auto next_index = Dispatch(spec);
+    AssertWithMessage(next_index != nullptr, "Expected an auxiliary index for rewriter");
+    AssertWithMessage(next_index->Type() == Secondary, "Expected Secondary Indexer for rewriter");
+    rewriter->SetAuxiliaryIndex(std::unique_ptr<SecondaryBTreeIndex<D>>(
+                        dynamic_cast<SecondaryBTreeIndex<D>*>(next_index.release())));
+    std::cout << "Setting secondary index for PiecewiseLinearRewriter" << std::endl;
+    spec >> paren;
+    AssertWithMessage(paren == "}", "Incorrect spec: expected '}'");
+    return rewriter;
+}
+
 template <size_t D>
 std::unique_ptr<MeasureBetaIndex<D>> IndexBuilder<D>::BuildMeasureBetaIndex(std::ifstream& spec) {
     std::string paren;
@@ -9,31 +9,23 @@
 
 #include "types.h"
 #include "utils.h"
+#include "radix_sort.h"
+#include "permutation_utils.h"
 
 template <size_t D>
 void JustSortIndex<D>::Init(PointIterator<D> start, PointIterator<D> end) {
     data_size_ = std::distance(start, end);
-    std::vector<std::pair<Scalar, size_t>> indices(data_size_);
-    size_t i = 0;
-    for (auto it = start; it != end; it++, i++) {
-        Scalar ix_val = (*it)[column_];
-        indices[i] = std::make_pair(ix_val, i);
+    std::vector<Scalar> keys(data_size_);
+    std::vector<size_t> order(data_size_);
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < data_size_; i++) {
+        keys[i] = (*(start + i))[column_];
+        order[i] = i;
     }
 
     // Sort by this array instead.
-    std::stable_sort(indices.begin(), indices.end(),
-        [](const std::pair<Scalar, size_t>& a, const std::pair<Scalar, size_t>& b) -> bool {
-            return a.first < b.first;
-        });
-
-    std::vector<Point<D>> data_cpy(data_size_);
-    const auto start_tmp = start;
-    std::transform(indices.begin(), indices.end(), data_cpy.begin(),
-            [start](const auto& ix_pair) -> Point<D> {
-                return *(start + ix_pair.second);
-                });
-
-    std::copy(data_cpy.cbegin(), data_cpy.cend(), start);
+    RadixSort::Sort(keys, order);
+    PermutationUtils::ApplyParallel(start, order);
 }
 
 
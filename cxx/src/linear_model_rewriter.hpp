@@ -88,7 +88,7 @@ IndexList LinearModelRewriter<D>::Rewrite(Query<D>& q) {
     
     q.filters[target_dim_] = {.present=true, .is_range=true, .ranges=ranges};
     if (outlier_index_) {
-        return outlier_index_->Matches(q);
+        return outlier_index_->Matches(q).ToList();
     }
     return {};
 }
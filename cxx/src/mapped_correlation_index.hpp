@@ -6,175 +6,120 @@
 #include <string>
 #include <sstream>
 
-#include "file_utils.h"
+#include "mapping_artifacts.h"
 #include "merge_utils.h"
 
 template <size_t D>
 MappedCorrelationIndex<D>::MappedCorrelationIndex(const std::string& mapping_filename,
         const std::string& target_buckets_filename) 
-    : mapping_(), mapping_lst_() {
+    : mapped_ends_(), tree_(), target_buckets_() {
     Load(mapping_filename, target_buckets_filename);
 }
 
 template <size_t D>
 void MappedCorrelationIndex<D>::Load(const std::string& mapping_filename, 
         const std::string& target_buckets_filename) {
-    std::ifstream file(mapping_filename);
-    AssertWithMessage(file.is_open(), "file not found: " + mapping_filename);
-    AssertWithMessage(FileUtils::NextLine(file) == "continuous-0", "Bad input file " + mapping_filename);
-    
-    auto header = FileUtils::NextArray<std::string>(file, 3);
-    AssertWithMessage(header[0] == "source", "Bad input file " + mapping_filename);
-    this->column_ = std::stoi(header[1]);
-    size_t s = std::stoi(header[2]);
-    // The last element is the rightmost bound on the data.
-    // Read everything as a double to be safe and then convert to scalar
-    
-    std::cout << "Reading " << s << " mapped buckets" << std::endl;
-    std::unordered_map<size_t, ScalarRange> mapped_buckets;
-    mapped_buckets.reserve(s); 
-    for (size_t i = 0; i < s; i++) {
-        auto arr = FileUtils::NextArray<double>(file, 3);
-        size_t mapix = (size_t)arr[0];
-        ScalarRange r = {(Scalar)arr[1], (Scalar)arr[2]};
-        mapped_buckets.emplace(mapix, r);
-    }
+    // Either file may be in the text or the binary artifact format.
+    MappingArtifact mapping_file(mapping_filename);
+    TargetBucketsArtifact target_file(target_buckets_filename);
+    const MappingView& mapping = mapping_file.View();
+    const TargetBucketsView& targets = target_file.View();
+    this->column_ = mapping.column;
+    std::cout << "Loaded " << mapping.num_buckets << " mapped buckets and "
+        << targets.num_buckets << " target buckets ("
+        << (mapping_file.IsBinary() ? "binary" : "text") << " mapping)" << std::endl;
 
-    header = FileUtils::NextArray<std::string>(file, 2);
-    std::cout << header[0] << std::endl;
-    AssertWithMessage(header[0] == "mapping", "Bad input file " + mapping_filename);
-    s = std::stoi(header[1]);
-    AssertWithMessage(s <= mapped_buckets.size(), "Bad input file " + mapping_filename);
-    std::unordered_map<size_t, std::vector<int32_t>> bucket_mapping;
-    bucket_mapping.reserve(s);
-    for (size_t i = 0; i < s; i++) {
-        auto arr = FileUtils::NextArray<size_t>(file);
-        bucket_mapping.emplace(arr[0], std::vector<int32_t>(arr.begin() + 1, arr.end()));
-    } 
-    std::cout << "Finished loading mapping-file" << std::endl;
-   
-    std::ifstream targetfile(target_buckets_filename); 
-    AssertWithMessage(targetfile.is_open(), "Couldn't find file: " + target_buckets_filename);
-    header = FileUtils::NextArray<std::string>(targetfile, 2);
-    AssertWithMessage(header[0] == "target_index_ranges", "bad input file " + target_buckets_filename);
-    s = std::stoi(header[1]);
-    std::map<int32_t, PhysicalIndexRange> targets;
-    size_t next_target_bucket = 0;
-    for (size_t i = 0; i < s; i++) {
-        auto arr = FileUtils::NextArray<size_t>(targetfile, 3);
-        AssertWithMessage(arr[0] >= next_target_bucket, "Target buckets not listed in sorted order!");
-        next_target_bucket = arr[0] + 1;
-        targets.emplace((int32_t)arr[0], PhysicalIndexRange(arr[1], arr[2]));
+    target_buckets_.resize(targets.num_buckets);
+    for (size_t i = 0; i < targets.num_buckets; i++) {
+        AssertWithMessage(i == 0 || targets.ids[i] > targets.ids[i-1],
+                "Target buckets not listed in sorted order!");
+        target_buckets_[i] = {(int32_t)targets.ids[i],
+            PhysicalIndexRange(targets.starts[i], targets.ends[i])};
     }
-    std::cout << "Finished loading target-buckets-file" << std::endl;
 
-    size_t total_num_ranges = 0;
-    for (auto mapit = mapped_buckets.cbegin(); mapit != mapped_buckets.cend(); mapit++) {
-        ScalarRange mb = mapit->second;
-        auto loc = bucket_mapping.find(mapit->first);
+    // Mapped buckets with the target buckets they map to, as positions in target_buckets_. Both
+    // the buckets and the mappings are sorted by id, so they are joined in a single pass.
+    std::vector<std::pair<ScalarRange, IndexList>> mapped_lists;
+    size_t m = 0;
+    for (size_t b = 0; b < mapping.num_buckets; b++) {
+        ScalarRange mb = {mapping.bucket_starts[b], mapping.bucket_ends[b]};
+        while (m < mapping.num_mappings && mapping.mapping_ids[m] < mapping.bucket_ids[b]) {
+            m++;
+        }
         // Can do something else here - we know that if a mapping is present, then there's at least
         // one point that lies in it, even if it's an outlier. If a mapping is not present, we know
         // there's nothing even in the outlier index.
-        if (loc == bucket_mapping.end()) {
+        if (m == mapping.num_mappings || mapping.mapping_ids[m] != mapping.bucket_ids[b]) {
             // Nothing to be done here.
             continue;
         }
-        std::vector<int32_t> tbs = loc->second;
-        AssertWithMessage(std::is_sorted(tbs.begin(), tbs.end()), "Ranges not sorted");
-        mapping_lst_.insert(std::make_pair(mb, tbs)); 
-        IndexRangeList tixs;
-        for (size_t j = 0; j < tbs.size(); j++) {
-            auto it = targets.find(tbs[j]);
+        const int32_t* tbs = mapping.targets + mapping.mapping_offsets[m];
+        size_t num_tbs = mapping.mapping_offsets[m+1] - mapping.mapping_offsets[m];
+        AssertWithMessage(std::is_sorted(tbs, tbs + num_tbs), "Ranges not sorted");
+        IndexList positions;
+        positions.reserve(num_tbs);
+        auto it = target_buckets_.begin();
+        for (size_t j = 0; j < num_tbs; j++) {
+            it = std::lower_bound(it, target_buckets_.end(), tbs[j],
+                    [](const auto& tb, int32_t id) { return tb.first < id; });
             // If the key isn't found, there's an inconsistency: it corresponds to an inlier bucket
             // but we missed it when writing out the target buckets.
-            AssertWithMessage(it != targets.end(), "Internal error: inconsistent");
-            PhysicalIndexRange r = it->second;
+            AssertWithMessage(it != target_buckets_.end() && it->first == tbs[j],
+                    "Internal error: inconsistent");
             // There must be points contained here, otherwise we shouldn't have written this bucket.
-            AssertWithMessage(r.end > r.start, "Internal error: inconsistent");
-            if (tixs.size() > 0 && r.start == tixs.back().end) {
-                // These ranges are consecutive, so merge them.
-                tixs.back().end = r.end;
-            } else {
-                tixs.push_back(r);
-            }
+            AssertWithMessage(it->second.end > it->second.start, "Internal error: inconsistent");
+            positions.push_back(it - target_buckets_.begin());
         }
-        tixs.shrink_to_fit();
-        total_num_ranges += tixs.size();
-        mapping_.insert(std::make_pair(mb, tixs));
+        mapped_lists.emplace_back(mb, std::move(positions));
     }
 
-    target_buckets_.assign(targets.begin(), targets.end());
-    std::cout << "Target_buckets_ has size " << target_buckets_.size() << std::endl;
-    std::cout << "Finished loading mapped correlation index on " << this->column_
-       << " with " << total_num_ranges << " total ranges and size " << Size() << std::endl;
-    size_t list_size = 0;
-    for (auto it = mapping_lst_.begin(); it != mapping_lst_.end(); it++) {
-        list_size += it->second.size() * sizeof(int32_t);
-        list_size += sizeof(ScalarRange);
+    // Order the mapped buckets by their end, which Ranges searches on. Buckets with the same end are
+    // merged into one leaf.
+    std::sort(mapped_lists.begin(), mapped_lists.end(),
+            [](const auto& a, const auto& b) { return a.first.second < b.first.second; });
+    std::vector<RoaringSet> leaves;
+    mapped_ends_.clear();
+    for (const auto& ml : mapped_lists) {
+        RoaringSet leaf = RoaringSet::FromList(ml.second);
+        if (!mapped_ends_.empty() && mapped_ends_.back() == ml.first.second) {
+            leaves.back() = RoaringSet::Union(leaves.back(), leaf);
+        } else {
+            mapped_ends_.push_back(ml.first.second);
+            leaves.push_back(std::move(leaf));
+        }
     }
-    // BTree overhead (5 bytes per entry)
-    list_size += mapping_lst_.size() * 10;
-    std::cout << "List mapping has size: " << list_size << std::endl;
+    BuildTree(std::move(leaves));
+
+    std::cout << "Finished loading mapped correlation index on " << this->column_
+       << " with " << mapped_lists.size() << " mapped buckets and size " << Size() << std::endl;
 };
 
 template <size_t D>
-PhysicalIndexSet MappedCorrelationIndex<D>::Ranges(const Query<D>& q) const {
-    size_t col = this->column_;
-    if (!q.filters[col].present) {
-        return {{{0, data_size_}}, {}};
+void MappedCorrelationIndex<D>::BuildTree(std::vector<RoaringSet>&& leaves) {
+    size_t n = leaves.size();
+    tree_.assign(2 * n, RoaringSet());
+    std::move(leaves.begin(), leaves.end(), tree_.begin() + n);
+    for (size_t i = n - 1; i >= 1 && i < n; i--) {
+        tree_[i] = RoaringSet::Union(tree_[2*i], tree_[2*i + 1]);
     }
-    assert (q.filters[col].is_range);
-    assert (q.filters[col].ranges.size() == 1);
-    ScalarRange sr = q.filters[col].ranges[0];
+}
 
-    // Bucket ends are exclusive, so we want to start at the first bucket whose end is larger than
-    // the start of the query range.
-    auto startit = mapping_lst_.upper_bound({sr.first, sr.first});
-    if (startit == mapping_lst_.end())  {
-        return {};
-    }
-    // Since we're treating query range ends as exclusive, the last range we scan is the one whose
-    // end is at least as large as the end of the query range.
-    auto endit = mapping_lst_.lower_bound({sr.second, sr.second});
-    if (endit != mapping_lst_.end()) {
-        endit++;
-    }
-    std::vector<int32_t> range_ixs;
-    for (auto it = startit; it != endit; it++) {
-        //range_ixs_tmp.clear();
-        //std::set_union(range_ixs.begin(), range_ixs.end(), it->second.begin(), it->second.end(),
-        //        std::back_inserter(range_ixs_tmp));
-        //range_ixs.swap(range_ixs_tmp);
-        range_ixs.insert(range_ixs.end(), it->second.begin(), it->second.end());
-    }
-    std::sort(range_ixs.begin(), range_ixs.end());
-    auto new_end = std::unique(range_ixs.begin(), range_ixs.end());
-    range_ixs.erase(new_end, range_ixs.end());
-    
-    /*std::cout << "Merged ranges (" << ranges.size() << "):" << std::endl;
-    for (auto r : ranges) {
-        std::cout << "\t" << r.start << " - " << r.end << std::endl;
-    }*/
-    std::cout << "Mapping query to " << range_ixs.size() << " ranges" << std::endl;
-    // Merge with bucket list.
-    std::vector<PhysicalIndexRange> ranges;
-    ranges.reserve(range_ixs.size());
-    int32_t prev_r = 0;
-    auto it = target_buckets_.begin();
-    for (int32_t r : range_ixs) {
-        while (it->first < r) { it++;}
-        if (ranges.size() > 0 && r == prev_r+1) {
-            ranges.back().end = it->second.end;
-        } else {
-            ranges.push_back(it->second);
+template <size_t D>
+RoaringSet MappedCorrelationIndex<D>::TargetsBetween(size_t first, size_t last) const {
+    size_t n = mapped_ends_.size();
+    RoaringSet targets;
+    for (size_t l = first + n, r = last + n; l < r; l /= 2, r /= 2) {
+        if (l & 1) {
+            targets = RoaringSet::Union(targets, tree_[l++]);
+        }
+        if (r & 1) {
+            targets = RoaringSet::Union(targets, tree_[--r]);
         }
-        prev_r = r;
-        it++;
     }
-    return PhysicalIndexSet(ranges, {});
+    return targets;
 }
 
-/*template <size_t D>
+template <size_t D>
 PhysicalIndexSet MappedCorrelationIndex<D>::Ranges(const Query<D>& q) const {
     size_t col = this->column_;
     if (!q.filters[col].present) {
@@ -184,37 +129,32 @@ PhysicalIndexSet MappedCorrelationIndex<D>::Ranges(const Query<D>& q) const {
     assert (q.filters[col].ranges.size() == 1);
     ScalarRange sr = q.filters[col].ranges[0];
 
-    
     // Bucket ends are exclusive, so we want to start at the first bucket whose end is larger than
     // the start of the query range.
-    auto startit = mapping_.upper_bound({sr.first, sr.first});
-    if (startit == mapping_.end())  {
-        return {};
-    }
+    size_t first = std::upper_bound(mapped_ends_.begin(), mapped_ends_.end(), sr.first)
+        - mapped_ends_.begin();
     // Since we're treating query range ends as exclusive, the last range we scan is the one whose
     // end is at least as large as the end of the query range.
-    auto endit = mapping_.lower_bound({sr.second, sr.second});
-    if (endit != mapping_.end()) {
-        endit++;
+    size_t last = std::lower_bound(mapped_ends_.begin(), mapped_ends_.end(), sr.second)
+        - mapped_ends_.begin();
+    last = std::min(last + 1, mapped_ends_.size());
+    if (first >= last) {
+        return {};
     }
-    IndexList ranges;
-    for (auto it = startit; it != endit; it++) {
-        //std::cout << "Matched map bucket " << it->first << " with "
-        //    << it->second.size() << " ranges:" << std::endl;
-        //for (auto r : it->second) {
-        //    std::cout << "\t" << r.start << " - " << r.end << std::endl;
-        //}
-        ranges = MergeUtils::Union(ranges, it->second);
+
+    // Target buckets come out of the tree in sorted order, so their physical ranges can be merged
+    // as they are emitted.
+    RoaringSet targets = TargetsBetween(first, last);
+    std::vector<PhysicalIndexRange> ranges;
+    for (PhysicalIndexRange run : targets.ToRanges()) {
+        for (size_t t = run.start; t < run.end; t++) {
+            PhysicalIndexRange r = target_buckets_[t].second;
+            if (ranges.size() > 0 && r.start == ranges.back().end) {
+                ranges.back().end = r.end;
+            } else {
+                ranges.push_back(r);
+            }
+        }
     }
-    //std::cout << "Merged ranges (" << ranges.size() << "):" << std::endl;
-    //for (auto r : ranges) {
-    //    std::cout << "\t" << r.start << " - " << r.end << std::endl;
-    //}
-    std::cout << "Mapping query to " << ranges.size() << " ranges" << std::endl;
-    // Merge with bucket list.
-    
     return PhysicalIndexSet(ranges, {});
-}*/
-
-
-
+}
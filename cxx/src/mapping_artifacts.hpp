@@ -0,0 +1,254 @@
+#include "mapping_artifacts.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file_utils.h"
+#include "utils.h"
+
+const char MappingArtifacts::MAGIC[8] = {'C', 'O', 'R', 'R', 'B', 'I', 'N', '\0'};
+
+void MappedFile::Open(const std::string& filename) {
+    AssertWithMessage(data_ == NULL, "File is already mapped");
+    int fd = open(filename.c_str(), O_RDONLY);
+    AssertWithMessage(fd >= 0, "Couldn't open file " + filename);
+    struct stat st;
+    AssertWithMessage(fstat(fd, &st) == 0, "Couldn't stat file " + filename);
+    size_ = st.st_size;
+    if (size_ > 0) {
+        void* addr = mmap(NULL, size_, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        AssertWithMessage(addr != MAP_FAILED, "Couldn't mmap file " + filename);
+        data_ = (const char*)addr;
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != NULL) {
+        munmap((void*)data_, size_);
+    }
+}
+
+bool MappingArtifacts::IsBinary(const std::string& filename) {
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    AssertWithMessage(file.is_open(), "Couldn't find file " + filename);
+    char magic[sizeof(MAGIC)];
+    file.read(magic, sizeof(magic));
+    return file.gcount() == sizeof(magic) && memcmp(magic, MAGIC, sizeof(magic)) == 0;
+}
+
+const char* MappingArtifacts::CheckHeader(const MappedFile& file, ArtifactKind kind,
+        const ArtifactHeader** header) {
+    AssertWithMessage(file.Size() >= sizeof(ArtifactHeader), "Truncated artifact header");
+    const ArtifactHeader* h = (const ArtifactHeader*)file.Data();
+    AssertWithMessage(memcmp(h->magic, MAGIC, sizeof(MAGIC)) == 0, "Not a binary artifact");
+    AssertWithMessage(h->version == VERSION, "Unsupported artifact version "
+            + std::to_string(h->version));
+    AssertWithMessage(h->kind == kind, "Expected artifact of kind " + std::to_string(kind)
+            + " but got " + std::to_string(h->kind));
+    *header = h;
+    return file.Data() + sizeof(ArtifactHeader);
+}
+
+template <typename T>
+void MappingArtifacts::WriteArray(std::ofstream& file, const T* data, size_t n) {
+    file.write((const char*)data, n * sizeof(T));
+    const char zeros[8] = {0};
+    file.write(zeros, PaddedBytes(n * sizeof(T)) - n * sizeof(T));
+}
+
+template <typename T>
+const T* MappingArtifacts::NextSection(const char** pos, size_t n) {
+    const T* section = (const T*)*pos;
+    *pos += PaddedBytes(n * sizeof(T));
+    return section;
+}
+
+void MappingArtifacts::WriteHeader(std::ofstream& file, ArtifactKind kind, uint64_t column,
+        uint64_t c0, uint64_t c1, uint64_t c2) {
+    ArtifactHeader header;
+    memcpy(header.magic, MAGIC, sizeof(header.magic));
+    header.version = VERSION;
+    header.kind = kind;
+    header.column = column;
+    header.counts[0] = c0;
+    header.counts[1] = c1;
+    header.counts[2] = c2;
+    file.write((const char*)&header, sizeof(header));
+}
+
+MappingArtifact::MappingArtifact(const std::string& filename) : file_() {
+    if (!MappingArtifacts::IsBinary(filename)) {
+        ParseText(filename);
+        return;
+    }
+    file_.Open(filename);
+    const ArtifactHeader* header;
+    const char* pos = MappingArtifacts::CheckHeader(file_, MAPPING, &header);
+    size_t nb = header->counts[0], nm = header->counts[1], nt = header->counts[2];
+    size_t want = sizeof(ArtifactHeader) + (3 * nb + 2 * nm + 1) * 8
+        + MappingArtifacts::PaddedBytes(nt * sizeof(int32_t));
+    AssertWithMessage(file_.Size() >= want, "Truncated mapping artifact " + filename);
+    view_.column = header->column;
+    view_.num_buckets = nb;
+    view_.bucket_ids = MappingArtifacts::NextSection<uint64_t>(&pos, nb);
+    view_.bucket_starts = MappingArtifacts::NextSection<Scalar>(&pos, nb);
+    view_.bucket_ends = MappingArtifacts::NextSection<Scalar>(&pos, nb);
+    view_.num_mappings = nm;
+    view_.mapping_ids = MappingArtifacts::NextSection<uint64_t>(&pos, nm);
+    view_.mapping_offsets = MappingArtifacts::NextSection<uint64_t>(&pos, nm + 1);
+    view_.targets = MappingArtifacts::NextSection<int32_t>(&pos, nt);
+    AssertWithMessage(view_.mapping_offsets[nm] == nt, "Inconsistent mapping artifact " + filename);
+}
+
+void MappingArtifact::ParseText(const std::string& filename) {
+    std::ifstream file(filename);
+    AssertWithMessage(file.is_open(), "file not found: " + filename);
+    AssertWithMessage(FileUtils::NextLine(file) == "continuous-0", "Bad input file " + filename);
+
+    auto header = FileUtils::NextArray<std::string>(file, 3);
+    AssertWithMessage(header[0] == "source", "Bad input file " + filename);
+    size_t column = std::stoi(header[1]);
+    size_t s = std::stoi(header[2]);
+    // Read everything as a double to be safe and then convert to scalar
+    std::vector<std::pair<uint64_t, ScalarRange>> buckets;
+    buckets.reserve(s);
+    for (size_t i = 0; i < s; i++) {
+        auto arr = FileUtils::NextArray<double>(file, 3);
+        buckets.emplace_back((uint64_t)arr[0], ScalarRange((Scalar)arr[1], (Scalar)arr[2]));
+    }
+    std::sort(buckets.begin(), buckets.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (const auto& b : buckets) {
+        bucket_ids_.push_back(b.first);
+        bucket_starts_.push_back(b.second.first);
+        bucket_ends_.push_back(b.second.second);
+    }
+
+    header = FileUtils::NextArray<std::string>(file, 2);
+    AssertWithMessage(header[0] == "mapping", "Bad input file " + filename);
+    s = std::stoi(header[1]);
+    AssertWithMessage(s <= buckets.size(), "Bad input file " + filename);
+    std::vector<std::vector<size_t>> lists(s);
+    for (size_t i = 0; i < s; i++) {
+        lists[i] = FileUtils::NextArray<size_t>(file);
+        AssertWithMessage(!lists[i].empty(), "Bad input file " + filename);
+    }
+    std::sort(lists.begin(), lists.end(),
+            [](const auto& a, const auto& b) { return a[0] < b[0]; });
+    mapping_offsets_.push_back(0);
+    for (const auto& l : lists) {
+        AssertWithMessage(std::is_sorted(l.begin() + 1, l.end()), "Ranges not sorted");
+        mapping_ids_.push_back(l[0]);
+        targets_.insert(targets_.end(), l.begin() + 1, l.end());
+        mapping_offsets_.push_back(targets_.size());
+    }
+
+    view_ = {
+        .column = column,
+        .num_buckets = bucket_ids_.size(),
+        .bucket_ids = bucket_ids_.data(),
+        .bucket_starts = bucket_starts_.data(),
+        .bucket_ends = bucket_ends_.data(),
+        .num_mappings = mapping_ids_.size(),
+        .mapping_ids = mapping_ids_.data(),
+        .mapping_offsets = mapping_offsets_.data(),
+        .targets = targets_.data(),
+    };
+}
+
+TargetBucketsArtifact::TargetBucketsArtifact(const std::string& filename) : file_() {
+    if (!MappingArtifacts::IsBinary(filename)) {
+        ParseText(filename);
+        return;
+    }
+    file_.Open(filename);
+    const ArtifactHeader* header;
+    const char* pos = MappingArtifacts::CheckHeader(file_, TARGET_BUCKETS, &header);
+    size_t n = header->counts[0];
+    AssertWithMessage(file_.Size() >= sizeof(ArtifactHeader) + 3 * n * 8,
+            "Truncated target bucket artifact " + filename);
+    view_.num_buckets = n;
+    view_.ids = MappingArtifacts::NextSection<uint64_t>(&pos, n);
+    view_.starts = MappingArtifacts::NextSection<uint64_t>(&pos, n);
+    view_.ends = MappingArtifacts::NextSection<uint64_t>(&pos, n);
+}
+
+void TargetBucketsArtifact::ParseText(const std::string& filename) {
+    std::ifstream file(filename);
+    AssertWithMessage(file.is_open(), "Couldn't find file: " + filename);
+    auto header = FileUtils::NextArray<std::string>(file, 2);
+    AssertWithMessage(header[0] == "target_index_ranges", "bad input file " + filename);
+    size_t s = std::stoi(header[1]);
+    ids_.reserve(s);
+    starts_.reserve(s);
+    ends_.reserve(s);
+    for (size_t i = 0; i < s; i++) {
+        auto arr = FileUtils::NextArray<size_t>(file, 3);
+        AssertWithMessage(ids_.empty() || arr[0] > ids_.back(),
+                "Target buckets not listed in sorted order!");
+        ids_.push_back(arr[0]);
+        starts_.push_back(arr[1]);
+        ends_.push_back(arr[2]);
+    }
+    view_ = {
+        .num_buckets = ids_.size(),
+        .ids = ids_.data(),
+        .starts = starts_.data(),
+        .ends = ends_.data(),
+    };
+}
+
+IndexList MappingArtifacts::LoadOutliers(const std::string& filename) {
+    if (!IsBinary(filename)) {
+        return load_binary_file<size_t>(filename);
+    }
+    MappedFile file(filename);
+    const ArtifactHeader* header;
+    const char* pos = CheckHeader(file, OUTLIERS, &header);
+    size_t n = header->counts[0];
+    AssertWithMessage(file.Size() >= sizeof(ArtifactHeader) + n * 8,
+            "Truncated outlier artifact " + filename);
+    const uint64_t* rows = NextSection<uint64_t>(&pos, n);
+    return IndexList(rows, rows + n);
+}
+
+void MappingArtifacts::WriteMapping(const MappingView& mapping, const std::string& filename) {
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    AssertWithMessage(file.is_open(), "Couldn't open file " + filename);
+    size_t nb = mapping.num_buckets, nm = mapping.num_mappings;
+    size_t nt = mapping.mapping_offsets[nm];
+    WriteHeader(file, MAPPING, mapping.column, nb, nm, nt);
+    WriteArray(file, mapping.bucket_ids, nb);
+    WriteArray(file, mapping.bucket_starts, nb);
+    WriteArray(file, mapping.bucket_ends, nb);
+    WriteArray(file, mapping.mapping_ids, nm);
+    WriteArray(file, mapping.mapping_offsets, nm + 1);
+    WriteArray(file, mapping.targets, nt);
+}
+
+void MappingArtifacts::WriteTargetBuckets(const TargetBucketsView& targets,
+        const std::string& filename) {
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    AssertWithMessage(file.is_open(), "Couldn't open file " + filename);
+    size_t n = targets.num_buckets;
+    WriteHeader(file, TARGET_BUCKETS, 0, n, 0, 0);
+    WriteArray(file, targets.ids, n);
+    WriteArray(file, targets.starts, n);
+    WriteArray(file, targets.ends, n);
+}
+
+void MappingArtifacts::WriteOutliers(const IndexList& rows, const std::string& filename) {
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    AssertWithMessage(file.is_open(), "Couldn't open file " + filename);
+    WriteHeader(file, OUTLIERS, 0, rows.size(), 0, 0);
+    WriteArray(file, rows.data(), rows.size());
+}
@@ -67,6 +67,9 @@ IndexRangeList MergeUtils::Intersect(const IndexRangeList& first, const IndexRan
 
 std::vector<ScalarRange> MergeUtils::Intersect(const std::vector<ScalarRange>& first, const std::vector<ScalarRange>& second) {
     // Assumes both ranges are already sorted.
+    if (first.empty() || second.empty()) {
+        return {};
+    }
     std::vector<ScalarRange> final_ranges;
     size_t i = 0, j = 0;
     size_t count = 0;
@@ -82,10 +85,9 @@ std::vector<ScalarRange> MergeUtils::Intersect(const std::vector<ScalarRange>& f
         if (j_start) { cur_second = second[j].first; }
         else { cur_second = second[j].second; }
         
-        // Here, we don't care about the case when they're equal.
-        // Since ranges in each input vector are not contiguous, if there's an equality here, it
-        // won't change the final answer.
-        if (cur_first < cur_second) {
+        // Scalar ranges are inclusive, so on a tie a start is popped before an end: ranges that
+        // only share an endpoint still intersect at it.
+        if (cur_first < cur_second || (cur_first == cur_second && i_start)) {
             popped = cur_first;
             if (i_start) {
                 count++;
@@ -123,31 +125,23 @@ std::vector<ScalarRange> MergeUtils::Intersect(const std::vector<ScalarRange>& f
     return final_ranges;
 }
 
-IndexList MergeUtils::Intersect(const IndexList& list1, const IndexList& list2) {
-    std::cout << "Intersecting two IndexLists with sizes " << list1.size() << ", " << list2.size() << std::endl;
-    IndexList output;
+template <typename Id1, typename Id2>
+std::vector<Id1> MergeUtils::Intersect(const std::vector<Id1>& list1, const std::vector<Id2>& list2) {
+    if (list1.empty() || list2.empty()) {
+        return {};
+    }
+    std::vector<Id1> output;
     output.reserve(std::min(list1.size(), list2.size()));
     std::set_intersection(list1.begin(), list1.end(), list2.begin(), list2.end(),
             std::back_inserter(output));
-    std::cout << "Intersect output = " << output.size() << std::endl;
     return output;
-    /*size_t i = 0, j = 0;
-    while (i < list1.size() && j < list2.size()) {
-        if (list1[i] < list2[j]) {
-            i++;
-        } else if (list1[i] > list2[j]) {
-            j++;
-        } else {
-            output.push_back(list1[i]);
-            i++;
-            j++;
-        }
-    }
-    return output;*/
 }
 
 PhysicalIndexSet MergeUtils::Intersect(const PhysicalIndexSet& set1, const PhysicalIndexSet& set2) {
     // Assumes both ranges are already sorted.
+    if ((set1.ranges.empty() && set1.list.empty()) || (set2.ranges.empty() && set2.list.empty())) {
+        return {};
+    }
     IndexRangeList final_ranges;
     IndexList final_list;
     final_list.reserve(set1.list.size() + set2.list.size());
@@ -192,10 +186,96 @@ PhysicalIndexSet MergeUtils::Intersect(const PhysicalIndexSet& set1, const Physi
     final_list.shrink_to_fit();
     return { MergeUtils::Intersect(set1.ranges, set2.ranges), final_list };
 }
-    
+
+MatchResult MergeUtils::Intersect(const MatchResult& first, const MatchResult& second) {
+    if (first.Empty() || second.IsUniverse()) {
+        return first;
+    }
+    if (second.Empty() || first.IsUniverse()) {
+        return second;
+    }
+    if (!first.IsList() && !second.IsList()) {
+        return MatchResult::FromRanges(Intersect(first.ranges, second.ranges));
+    }
+    MatchResult sorted_first, sorted_second;
+    const MatchResult* a = &first;
+    const MatchResult* b = &second;
+    if (first.kind == MatchResult::UNSORTED_LIST) {
+        sorted_first = first;
+        sorted_first.Sort();
+        a = &sorted_first;
+    }
+    if (second.kind == MatchResult::UNSORTED_LIST) {
+        sorted_second = second;
+        sorted_second.Sort();
+        b = &sorted_second;
+    }
+    if (a->IsList() && b->IsList()) {
+        // The output can't be wider than the narrower list.
+        if (b->list.IsNarrow() && !a->list.IsNarrow()) {
+            std::swap(a, b);
+        }
+        return a->list.Visit([b](const auto& l1) {
+            return b->list.Visit([&l1](const auto& l2) {
+                return MatchResult::FromSortedList(Intersect(l1, l2));
+            });
+        });
+    }
+    // One list and one set of ranges: only the list can survive.
+    if (!a->IsList()) {
+        std::swap(a, b);
+    }
+    return a->list.Visit([b](const auto& l) {
+        return MatchResult::FromSortedList(Merge(b->ranges, l));
+    });
+}
+
+PhysicalIndexSet MergeUtils::Intersect(const PhysicalIndexSet& set, const MatchResult& matches) {
+    if (matches.IsUniverse()) {
+        return set;
+    }
+    if (matches.Empty()) {
+        return {};
+    }
+    if (!matches.IsList()) {
+        return Intersect(set, matches.ToIndexSet());
+    }
+    MatchResult sorted;
+    const MatchResult* m = &matches;
+    if (matches.kind == MatchResult::UNSORTED_LIST) {
+        sorted = matches;
+        sorted.Sort();
+        m = &sorted;
+    }
+    // Walk the match list against both parts of the set. Ids are widened only as they're output.
+    return m->list.Visit([&set](const auto& ids) {
+        IndexList final_list;
+        auto range_it = set.ranges.cbegin();
+        auto list_it = set.list.cbegin();
+        for (PhysicalIndex id : ids) {
+            while (range_it != set.ranges.cend() && id >= range_it->end) {
+                range_it++;
+            }
+            while (list_it != set.list.cend() && *list_it < id) {
+                list_it++;
+            }
+            bool in_range = range_it != set.ranges.cend() && id >= range_it->start;
+            bool in_list = list_it != set.list.cend() && *list_it == id;
+            if (in_range || in_list) {
+                final_list.push_back(id);
+            } else if (range_it == set.ranges.cend() && list_it == set.list.cend()) {
+                break;
+            }
+        }
+        return PhysicalIndexSet({}, std::move(final_list));
+    });
+}
 
 IndexRangeList MergeUtils::Union(const IndexRangeList& first, const IndexRangeList& second) {
     // Assumes both ranges are already sorted.
+    if (first.empty() || second.empty()) {
+        return first.empty() ? second : first;
+    }
     IndexRangeList final_ranges;
     size_t i = 0, j = 0;
     size_t count = 0;
@@ -286,18 +366,19 @@ PhysicalIndexSet MergeUtils::Union(const IndexRangeList& ranges, const IndexList
 }
 
 
-IndexList MergeUtils::Merge(const IndexRangeList& ranges, const IndexList& idxs) {
+template <typename Id>
+std::vector<Id> MergeUtils::Merge(const IndexRangeList& ranges, const std::vector<Id>& idxs) {
     if (ranges.empty() || idxs.empty()) {
         return {};
     }
     size_t cur_range_ix = 0;
-    IndexList output;
+    std::vector<Id> output;
     output.reserve(idxs.size());
-    for (size_t ix : idxs) {
-       while (ix >= ranges[cur_range_ix].end) {
+    for (Id ix : idxs) {
+       while (cur_range_ix < ranges.size() && ix >= ranges[cur_range_ix].end) {
            cur_range_ix++;
        }
-       if (cur_range_ix > ranges.size()) {
+       if (cur_range_ix == ranges.size()) {
            break;
        }
        if (ix < ranges[cur_range_ix].start) {
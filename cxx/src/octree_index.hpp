@@ -19,16 +19,12 @@ OctreeIndex<D>::OctreeIndex(std::vector<size_t>& index_dims, size_t page_size) :
         mins_(index_dims.size()),
         maxs_(index_dims.size()),
         next_id_(0),
-        sorted_data_points_(),
-        sorted_data_buckets_(),
-        num_partitions_(1U << index_dims.size()) {
-            sorted_data_points_.open("octree_sorted_data.bin", std::ios::binary);
-            sorted_data_buckets_.open("octree_sorted_buckets.dat");
-        }
+        dump_sorted_data_(false),
+        num_partitions_(1U << index_dims.size()) {}
 
 
 template <size_t D>
-int OctreeIndex<D>::get_octant_containing_point(Point<D>& point, std::vector<Scalar>& center) const {
+int OctreeIndex<D>::get_octant_containing_point(const Point<D>& point, const std::vector<Scalar>& center) const {
     int oct = 0;
     for (size_t i = 0; i < index_dims_.size(); i++) {
         if(point[index_dims_[i]] > center[i]) {
@@ -59,6 +55,30 @@ bool OctreeIndex<D>::should_keep_dividing(std::shared_ptr<Node> node, int depth)
     return !single_point;
 }
 
+template <size_t D>
+void OctreeIndex<D>::partition_by_octant(PointIterator<D> data_start, PointIterator<D> data_end,
+        const std::vector<Scalar>& center, std::vector<size_t>& next) const {
+    // In-place multiway partition (American flag sort): each octant has a write cursor, and every
+    // misplaced point is swapped directly into the next free slot of its octant, so each point
+    // moves at most once.
+    std::vector<size_t> bucket_end(num_partitions_);
+    for (size_t i = 0; i + 1 < num_partitions_; i++) {
+        bucket_end[i] = next[i+1];
+    }
+    bucket_end[num_partitions_ - 1] = std::distance(data_start, data_end);
+    for (size_t b = 0; b < num_partitions_; b++) {
+        while (next[b] < bucket_end[b]) {
+            size_t oct = get_octant_containing_point(*(data_start + next[b]), center);
+            if (oct == b) {
+                next[b]++;
+            } else {
+                std::iter_swap(data_start + next[b], data_start + next[oct]);
+                next[oct]++;
+            }
+        }
+    }
+}
+
 template <size_t D>
 bool OctreeIndex<D>::divide_node(std::shared_ptr<Node> node, PointIterator<D> data_start, PointIterator<D> data_end, int depth) {
     if (!should_keep_dividing(node, depth)) {
@@ -68,10 +88,6 @@ bool OctreeIndex<D>::divide_node(std::shared_ptr<Node> node, PointIterator<D> da
                           return a[sort_dim_] < b[sort_dim_];
                       });
         }
-        sorted_data_buckets_ << node->start_offset << ", " << node->end_offset << std::endl;
-        size_t write_size = sizeof(Point<D>) * (node->end_offset - node->start_offset);
-        sorted_data_points_.write((char *)&*(data_start + node->start_offset), write_size);
-        sorted_data_points_.flush();
         return sort_leaf_;
     }
 
@@ -79,21 +95,7 @@ bool OctreeIndex<D>::divide_node(std::shared_ptr<Node> node, PointIterator<D> da
     for (size_t i = 0; i < index_dims_.size(); i++) {
         center[i] = (node->mins[i] + node->maxs[i]) / 2;
     }
-    /*if (depth < 2) {
-        std::cout << "Node at depth " << depth << ", center: {";
-        for (Scalar c : center) {
-            std::cout << " " << c;
-        }
-        std::cout << "}" << std::endl;
-    }*/
 
-//    std::cout << "divide depth " << depth << " npoints " << node->end_offset - node->start_offset << " center ";
-//    for (size_t i = 0; i < index_dims_.size(); i++) {
-//        std::cout << center[i] << " ";
-//    }
-//    std::cout << std::endl;
-
-    std::vector<std::vector<Point<D>>> child_data(num_partitions_);
     node->children = std::vector<std::shared_ptr<Node>>(num_partitions_);
     for (size_t i = 0; i < num_partitions_; i++) {
         std::vector<Scalar> child_mins(index_dims_.size());
@@ -108,65 +110,97 @@ bool OctreeIndex<D>::divide_node(std::shared_ptr<Node> node, PointIterator<D> da
             }
         }
         node->children[i] = std::make_shared<Node>();
-        node->children[i]->id = next_id_++;
         node->children[i]->mins = child_mins;
         node->children[i]->maxs = child_maxs;
     }
-    /*if (depth == 0) {
-        for (size_t i = 0; i < num_partitions_; i++) {
-            std::cout << "Child " << i << ": mins = {";
-            for (Scalar m : node->children[i]->mins) {
-                std::cout << " " << m;
-            }
-            std::cout << "}, maxs = {";
-            for (Scalar m : node->children[i]->maxs) {
-                std::cout << " " << m;
-            }
-            std::cout << "}";
-        }
-    }*/
     
-    // Data is unmodified at this level if the points are already sorted by octant.
+    // Count the points in each octant. Data is unmodified at this level if the points are already
+    // sorted by octant.
+    std::vector<size_t> counts(num_partitions_, 0);
     bool data_modified = false;
     size_t prev_oct = 0;
     for (size_t i = node->start_offset; i < node->end_offset; i++) {
-        auto pt = *(data_start + i);
-        size_t oct = get_octant_containing_point(pt, center);
-        child_data[oct].push_back(pt);
-        /*if (oct < prev_oct) {
-            std::cout << "Got bucket " << oct << " after " << prev_oct << ", depth " << depth << std::endl;
-        }*/
+        size_t oct = get_octant_containing_point(*(data_start + i), center);
+        counts[oct]++;
         data_modified |= (oct < prev_oct);
         prev_oct = oct;
     }
 
+    // Offsets of each octant relative to the start of this node.
+    std::vector<size_t> next(num_partitions_);
     size_t cur = node->start_offset;
     for (size_t i = 0; i < num_partitions_; i++) {
         node->children[i]->start_offset = cur;
-        node->children[i]->end_offset = cur + child_data[i].size();
-        if (data_modified) {
-            for (size_t j = 0; j < child_data[i].size(); j++) {
-                *(data_start + cur) = child_data[i][j];
-                cur++;
-            }
-        } else {
-            cur += child_data[i].size();
-        }
-        // Free the unnecessary memory
-        std::vector<Point<D>>().swap(child_data[i]);
+        next[i] = cur - node->start_offset;
+        cur += counts[i];
+        node->children[i]->end_offset = cur;
+    }
+    if (data_modified) {
+        partition_by_octant(data_start + node->start_offset, data_start + node->end_offset,
+                center, next);
     }
 
+    // Children own disjoint slices of the data, so large ones are built concurrently.
+    std::vector<char> child_modified(num_partitions_, 0);
     for (size_t i = 0; i < num_partitions_; i++) {
-        if (node->children[i]->start_offset == node->children[i]->end_offset) {
+        std::shared_ptr<Node> child = node->children[i];
+        size_t npoints = child->end_offset - child->start_offset;
+        if (npoints == 0) {
             node->children[i] = nullptr;
+        } else if (npoints >= MIN_POINTS_PER_TASK) {
+            #pragma omp task default(shared) firstprivate(child, i)
+            child_modified[i] = divide_node(child, data_start, data_end, depth + 1);
         } else {
-            bool mod = divide_node(node->children[i], data_start, data_end, depth + 1);
-            data_modified |= mod;
+            child_modified[i] = divide_node(child, data_start, data_end, depth + 1);
         }
     }
+    #pragma omp taskwait
+    for (char mod : child_modified) {
+        data_modified |= mod;
+    }
     return data_modified;
 }
 
+template <size_t D>
+void OctreeIndex<D>::assign_ids(Node* node) {
+    for (const auto& child : node->children) {
+        if (child) {
+            child->id = next_id_++;
+        }
+    }
+    for (const auto& child : node->children) {
+        if (child) {
+            assign_ids(child.get());
+        }
+    }
+}
+
+template <size_t D>
+void OctreeIndex<D>::write_sorted_data(PointIterator<D> data_start) const {
+    // Leaves are contiguous and appear in offset order in a depth-first traversal, so the sorted
+    // data is just the reordered dataset, written in one go.
+    std::ofstream sorted_data_points("octree_sorted_data.bin", std::ios::binary);
+    std::ofstream sorted_data_buckets("octree_sorted_buckets.dat");
+    std::stack<Node*> node_stack;
+    node_stack.push(root_node.get());
+    while (!node_stack.empty()) {
+        Node* cur = node_stack.top();
+        node_stack.pop();
+        if (cur->children.empty()) {
+            sorted_data_buckets << cur->start_offset << ", " << cur->end_offset << "\n";
+            continue;
+        }
+        for (auto it = cur->children.rbegin(); it != cur->children.rend(); it++) {
+            if (*it) {
+                node_stack.push((*it).get());
+            }
+        }
+    }
+    sorted_data_points.write((char *)&*data_start, sizeof(Point<D>) * data_size_);
+    sorted_data_points.close();
+    sorted_data_buckets.close();
+}
+
 // Modifies data in place to sort it via this indexing method.
 template <size_t D>
 void OctreeIndex<D>::Init(PointIterator<D> data_start, PointIterator<D> data_end) {
@@ -189,21 +223,27 @@ void OctreeIndex<D>::Init(PointIterator<D> data_start, PointIterator<D> data_end
     std::cout << std::endl;
     data_size_ = std::distance(data_start, data_end);
     root_node = std::make_shared<Node>();
-    root_node->id = next_id_++;
     root_node->mins = mins_;
     root_node->maxs = maxs_;
     root_node->start_offset = 0;
     root_node->end_offset = std::distance(data_start, data_end);
-    bool modified = divide_node(root_node, data_start, data_end, 0);
+    bool modified = false;
+    #pragma omp parallel
+    #pragma omp single
+    modified = divide_node(root_node, data_start, data_end, 0);
+    next_id_ = 0;
+    root_node->id = next_id_++;
+    assign_ids(root_node.get());
     std::cout << "Data was " << (modified ? "" : "not ") << "modified" << std::endl;
-    sorted_data_points_.close();
-    sorted_data_buckets_.close();
+    if (dump_sorted_data_) {
+        write_sorted_data(data_start);
+    }
 }
 
 template <size_t D>
-bool OctreeIndex<D>::is_relevant_node(std::shared_ptr<Node> node, const Query<D>& query) const {
+bool OctreeIndex<D>::is_relevant_node(const Node* node, const Query<D>& query) const {
     for (size_t i = 0; i < index_dims_.size(); i++) {
-        QueryFilter qf = query.filters[index_dims_[i]];
+        const QueryFilter& qf = query.filters[index_dims_[i]];
         if (!qf.present) {
             continue;
         }
@@ -219,6 +259,21 @@ bool OctreeIndex<D>::is_relevant_node(std::shared_ptr<Node> node, const Query<D>
     return true;
 }
 
+template <size_t D>
+bool OctreeIndex<D>::is_contained_node(const Node* node, const Query<D>& query) const {
+    for (size_t i = 0; i < index_dims_.size(); i++) {
+        const QueryFilter& qf = query.filters[index_dims_[i]];
+        if (!qf.present) {
+            continue;
+        }
+        if (qf.ranges.empty() || qf.ranges[0].first > node->mins[i]
+                || qf.ranges[0].second < node->maxs[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
 
 template <size_t D>
 PhysicalIndexSet OctreeIndex<D>::Ranges(Query<D> &query) {
@@ -230,26 +285,30 @@ PhysicalIndexSet OctreeIndex<D>::Ranges(Query<D> &query) {
     if (!index_relevant) {
         return {{{0, data_size_}}, {}};
     }
-    std::stack<std::shared_ptr<Node>> node_stack;
-    node_stack.push(root_node);
+    std::stack<const Node*> node_stack;
+    node_stack.push(root_node.get());
     size_t indexes_scanned = 0;
     while (!node_stack.empty()) {
-        std::shared_ptr<Node> cur = node_stack.top();
+        const Node* cur = node_stack.top();
         node_stack.pop();
         if (!is_relevant_node(cur, query)) {
             continue;
         }
-        if (cur->children.empty()) {
-            // this node is a leaf
-            // TODO: add code here if we're sorting.
+        if (cur->children.empty() || is_contained_node(cur, query)) {
+            // Either a leaf or a node entirely inside the query: scan all of it.
+            // Nodes are visited in offset order, so physically adjacent ranges are merged here.
             if (cur->end_offset > cur->start_offset) {
-                ranges.emplace_back(cur->start_offset, cur->end_offset);
+                if (!ranges.empty() && ranges.back().end == cur->start_offset) {
+                    ranges.back().end = cur->end_offset;
+                } else {
+                    ranges.emplace_back(cur->start_offset, cur->end_offset);
+                }
             }
             indexes_scanned += cur->end_offset - cur->start_offset;
         } else {
             for (auto it = cur->children.rbegin(); it != cur->children.rend(); it++) {
                 if (*it != nullptr) {
-                    node_stack.push(*it);
+                    node_stack.push(it->get());
                 }
             }
         }
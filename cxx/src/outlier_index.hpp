@@ -8,6 +8,7 @@
 #include <iostream>
 
 #include "types.h"
+#include "utils.h"
 
 template <size_t D>
 OutlierIndex<D>::OutlierIndex(const std::vector<size_t>& outlier_list)
@@ -59,16 +60,28 @@ PhysicalIndexSet OutlierIndex<D>::Ranges(Query<D>& q) {
 template <size_t D>
 void OutlierIndex<D>::Init(PointIterator<D> start, PointIterator<D> end) {
     std::sort(outlier_list_.begin(), outlier_list_.end());
-    // Move all the outliers to the end of the list.
-    auto next_outlier = end-1;
-    for (auto oit = outlier_list_.rbegin(); oit != outlier_list_.rend(); oit++) {
-        size_t oix = *oit;
-        if (start + oix != next_outlier) {
-            std::iter_swap(start + oix, next_outlier);
-        }
-        next_outlier--;
+    size_t n = std::distance(start, end);
+    AssertWithMessage(std::adjacent_find(outlier_list_.begin(), outlier_list_.end())
+            == outlier_list_.end(), "Outlier list has duplicate rows");
+    AssertWithMessage(outlier_list_.empty() || outlier_list_.back() < n,
+            "Outlier list has rows past the end of the data");
+    // Move all the outliers to the end of the list, keeping the inliers and the outliers in their
+    // existing order. The outliers are set aside, and each run of inliers between two of them
+    // shifts down by the number of outliers before it.
+    std::vector<Point<D>> outliers;
+    outliers.reserve(outlier_list_.size());
+    size_t write = 0;
+    size_t run_start = 0;
+    for (size_t o : outlier_list_) {
+        std::move(start + run_start, start + o, start + write);
+        write += o - run_start;
+        outliers.push_back(std::move(*(start + o)));
+        run_start = o + 1;
     }
-    auto outlier_start = next_outlier + 1;
+    std::move(start + run_start, end, start + write);
+    std::move(outliers.begin(), outliers.end(), end - outliers.size());
+    std::vector<Point<D>>().swap(outliers);
+    auto outlier_start = end - outlier_list_.size();
     
     assert (main_indexer_);
     main_indexer_->Init(start, outlier_start);
@@ -0,0 +1,115 @@
+#include "permutation_utils.h"
+
+#include <cassert>
+#include <iterator>
+#include <omp.h>
+
+template <typename RandomIt>
+void PermutationUtils::Apply(RandomIt data, const std::vector<size_t>& order) {
+    typedef typename std::iterator_traits<RandomIt>::value_type T;
+    size_t n = order.size();
+    std::vector<bool> visited(n, false);
+    for (size_t i = 0; i < n; i++) {
+        if (visited[i]) {
+            continue;
+        }
+        visited[i] = true;
+        if (order[i] == i) {
+            continue;
+        }
+        T tmp = std::move(data[i]);
+        size_t j = i;
+        while (order[j] != i) {
+            size_t k = order[j];
+            assert (!visited[k]);
+            data[j] = std::move(data[k]);
+            visited[k] = true;
+            j = k;
+        }
+        data[j] = std::move(tmp);
+    }
+}
+
+template <typename RandomIt>
+void PermutationUtils::ApplyParallel(RandomIt data, const std::vector<size_t>& order) {
+    typedef typename std::iterator_traits<RandomIt>::value_type T;
+    size_t n = order.size();
+    if (n < MIN_PARALLEL_SIZE || omp_get_max_threads() == 1) {
+        Apply(data, order);
+        return;
+    }
+
+    // Consecutive positions along a long cycle. The block moves its elements one step along the
+    // cycle, and its last position takes the first element of the next block.
+    struct Block {
+        size_t start;
+        size_t length;
+        size_t next;
+    };
+    std::vector<Block> blocks;
+    // Cycles of at most BLOCK_SIZE elements are moved whole, by the thread that owns the leader.
+    std::vector<bool> is_leader(n, false);
+    std::vector<bool> visited(n, false);
+    // Finding the cycles only reads the permutation, which is cheap next to moving the data.
+    for (size_t i = 0; i < n; i++) {
+        if (visited[i]) {
+            continue;
+        }
+        size_t length = 0;
+        size_t j = i;
+        do {
+            visited[j] = true;
+            length++;
+            j = order[j];
+        } while (j != i);
+        if (length == 1) {
+            continue;
+        }
+        if (length <= BLOCK_SIZE) {
+            is_leader[i] = true;
+            continue;
+        }
+        size_t first_block = blocks.size();
+        for (size_t done = 0; done < length; done += BLOCK_SIZE) {
+            blocks.push_back({j, std::min(BLOCK_SIZE, length - done), blocks.size() + 1});
+            for (size_t s = 0; s < blocks.back().length; s++) {
+                j = order[j];
+            }
+        }
+        blocks.back().next = first_block;
+    }
+    std::vector<bool>().swap(visited);
+
+    std::vector<T> saved(blocks.size());
+    #pragma omp parallel
+    {
+        #pragma omp for schedule(static)
+        for (size_t b = 0; b < blocks.size(); b++) {
+            saved[b] = data[blocks[b].start];
+        }
+        // Implicit barrier: every block's first element is saved before any block moves.
+        #pragma omp for schedule(dynamic, 1) nowait
+        for (size_t b = 0; b < blocks.size(); b++) {
+            size_t pos = blocks[b].start;
+            for (size_t s = 1; s < blocks[b].length; s++) {
+                size_t next = order[pos];
+                data[pos] = std::move(data[next]);
+                pos = next;
+            }
+            data[pos] = std::move(saved[blocks[b].next]);
+        }
+        #pragma omp for schedule(dynamic, BLOCK_SIZE)
+        for (size_t i = 0; i < n; i++) {
+            if (!is_leader[i]) {
+                continue;
+            }
+            T tmp = std::move(data[i]);
+            size_t j = i;
+            while (order[j] != i) {
+                data[j] = std::move(data[order[j]]);
+                j = order[j];
+            }
+            data[j] = std::move(tmp);
+        }
+    }
+}
@@ -0,0 +1,189 @@
+#include "piecewise_linear_model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <omp.h>
+
+#include "utils.h"
+
+void PiecewiseLinearModel::Region::Reset(Scalar x0, double lo, double hi, double max_slope) {
+    x0_ = x0;
+    poly_ = {{-max_slope, lo}, {max_slope, lo}, {max_slope, hi}, {-max_slope, hi}};
+}
+
+void PiecewiseLinearModel::Region::Clip(const std::vector<std::pair<double, double>>& poly,
+        double dx, double c, double sign, std::vector<std::pair<double, double>>* out) {
+    out->clear();
+    // Integer targets with eps = 0 or a full-width group pin lines to a single value, which
+    // flattens the region onto a segment. Rounding (and FMA contraction) then puts its vertices
+    // on either side of the line, so anything within tol of it counts as on it.
+    double tol = CLIP_TOLERANCE * (fabs(c) + 1);
+    for (size_t i = 0; i < poly.size(); i++) {
+        const auto& p = poly[i];
+        const auto& q = poly[(i + 1) % poly.size()];
+        double fp = sign * (p.first * dx + p.second - c);
+        double fq = sign * (q.first * dx + q.second - c);
+        if (fp >= -tol) {
+            out->push_back(p);
+        }
+        // Only cross strictly: a vertex on the line is already kept, and cutting at it again
+        // would pile up duplicate vertices.
+        if ((fp > tol && fq < -tol) || (fp < -tol && fq > tol)) {
+            double t = fp / (fp - fq);
+            out->emplace_back(p.first + t * (q.first - p.first), p.second + t * (q.second - p.second));
+        }
+    }
+}
+
+bool PiecewiseLinearModel::Region::Add(Scalar x, double lo, double hi) {
+    double dx = double(x - x0_);
+    Clip(poly_, dx, lo, 1, &clipped_lo_);
+    if (clipped_lo_.empty()) {
+        return false;
+    }
+    Clip(clipped_lo_, dx, hi, -1, &clipped_);
+    if (clipped_.empty()) {
+        return false;
+    }
+    poly_.swap(clipped_);
+    return true;
+}
+
+std::pair<double, double> PiecewiseLinearModel::Region::Line(Scalar x) const {
+    // The polygon is convex, so the mean of its vertices is inside it.
+    double a = 0, b = 0;
+    for (const auto& v : poly_) {
+        a += v.first;
+        b += v.second;
+    }
+    a /= poly_.size();
+    b /= poly_.size();
+    return {a, b + a * double(x - x0_)};
+}
+
+PiecewiseLinearModel::Group PiecewiseLinearModel::NextGroup(const std::vector<Scalar>& xs,
+        const std::vector<Scalar>& ys, size_t start, size_t index_end, double eps) {
+    size_t end = start + 1;
+    Scalar ymin = ys[start], ymax = ys[start];
+    for (; end < index_end && xs[end] == xs[start]; end++) {
+        ymin = std::min(ymin, ys[end]);
+        ymax = std::max(ymax, ys[end]);
+    }
+    if (ymax - ymin > 2 * eps) {
+        // Keep the window of width 2 * eps holding the most points.
+        std::vector<Scalar> sorted(ys.begin() + start, ys.begin() + end);
+        std::sort(sorted.begin(), sorted.end());
+        size_t best = 0, best_count = 0;
+        for (size_t a = 0, b = 0; a < sorted.size(); a++) {
+            while (b < sorted.size() && sorted[b] - sorted[a] <= 2 * eps) {
+                b++;
+            }
+            if (b - a > best_count) {
+                best = a;
+                best_count = b - a;
+            }
+        }
+        ymin = sorted[best];
+        ymax = sorted[best + best_count - 1];
+    }
+    return {start, end, xs[start], ymax - eps, ymin + eps};
+}
+
+bool PiecewiseLinearModel::IsSpike(const Group& g, const Group& next, const Group& after,
+        double max_slope) {
+    Region region;
+    region.Reset(g.x, g.lo, g.hi, max_slope);
+    if (region.Add(next.x, next.lo, next.hi) && region.Add(after.x, after.lo, after.hi)) {
+        return false;
+    }
+    region.Reset(next.x, next.lo, next.hi, max_slope);
+    return region.Add(after.x, after.lo, after.hi);
+}
+
+void PiecewiseLinearModel::Fit(const std::vector<Scalar>& xs, const std::vector<Scalar>& ys,
+        size_t index_start, size_t index_end, double eps, std::vector<PLASegment>* segments) {
+    if (index_start >= index_end) {
+        return;
+    }
+    // x values are distinct integers between groups, so no line through two of them needs a
+    // steeper slope than the whole span of y.
+    auto minmax = std::minmax_element(ys.begin() + index_start, ys.begin() + index_end);
+    double max_slope = double(*minmax.second - *minmax.first) + 2 * eps + 1;
+
+    // The two groups after g, if there are that many.
+    auto lookahead = [&](const Group& g, Group* next, Group* after) {
+        if (g.end >= index_end) {
+            return false;
+        }
+        *next = NextGroup(xs, ys, g.end, index_end, eps);
+        if (next->end >= index_end) {
+            return false;
+        }
+        *after = NextGroup(xs, ys, next->end, index_end, eps);
+        return true;
+    };
+
+    Region region, trial;
+    Group g = NextGroup(xs, ys, index_start, index_end, eps), next, after;
+    Scalar first_x, last_x;
+    // Starts a segment at g, or right after it if g is a spike. Returns the last group added.
+    auto start_segment = [&]() {
+        first_x = g.x;
+        if (lookahead(g, &next, &after) && IsSpike(g, next, after, max_slope)) {
+            g = next;
+        }
+        region.Reset(g.x, g.lo, g.hi, max_slope);
+        last_x = g.x;
+        return g;
+    };
+    Group last = start_segment();
+    while (last.end < index_end) {
+        g = NextGroup(xs, ys, last.end, index_end, eps);
+        if (region.Add(g.x, g.lo, g.hi)) {
+            last_x = g.x;
+            last = g;
+            continue;
+        }
+        // A spike is left to the outliers when the segment goes on past it.
+        if (lookahead(g, &next, &after) && IsSpike(g, next, after, max_slope)) {
+            trial = region;
+            if (trial.Add(next.x, next.lo, next.hi)) {
+                std::swap(region, trial);
+                last_x = next.x;
+                last = next;
+                continue;
+            }
+        }
+        auto line = region.Line(first_x);
+        segments->push_back({first_x, last_x, line.first, line.second});
+        last = start_segment();
+    }
+    auto line = region.Line(first_x);
+    segments->push_back({first_x, last_x, line.first, line.second});
+}
+
+std::vector<PLASegment> PiecewiseLinearModel::ParallelFit(const std::vector<Scalar>& xs,
+        const std::vector<Scalar>& ys, double eps) {
+    size_t n = xs.size();
+    size_t nslices = n < MIN_PARALLEL_SIZE ? 1 : omp_get_max_threads();
+    // Slices start on a new x value, so points sharing one stay in the same slice.
+    std::vector<size_t> bounds(nslices + 1, n);
+    bounds[0] = 0;
+    for (size_t s = 1; s < nslices; s++) {
+        size_t b = std::max(bounds[s-1], s * n / nslices);
+        while (b > 0 && b < n && xs[b] == xs[b-1]) {
+            b++;
+        }
+        bounds[s] = b;
+    }
+    std::vector<std::vector<PLASegment>> parts(nslices);
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t s = 0; s < nslices; s++) {
+        Fit(xs, ys, bounds[s], bounds[s+1], eps, &parts[s]);
+    }
+    std::vector<PLASegment> segments;
+    for (const auto& p : parts) {
+        segments.insert(segments.end(), p.begin(), p.end());
+    }
+    return segments;
+}
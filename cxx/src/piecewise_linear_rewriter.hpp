@@ -0,0 +1,175 @@
+#include "piecewise_linear_rewriter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <omp.h>
+
+#include "merge_utils.h"
+#include "radix_sort.h"
+#include "utils.h"
+
+template <size_t D>
+PiecewiseLinearRewriter<D>::PiecewiseLinearRewriter(size_t mapped, size_t target,
+        double storage_factor)
+    : mapped_dim_(mapped), target_dim_(target), storage_factor_(storage_factor), eps_(0),
+      fixed_eps_(false), segments_(), segment_ends_(), bands_(), outlier_index_() {
+    AssertWithMessage(mapped != target, "PiecewiseLinearRewriter can't map a column to itself");
+}
+
+template <size_t D>
+IndexList PiecewiseLinearRewriter<D>::Uncovered(const std::vector<PLASegment>& segments,
+        double eps, const std::vector<Scalar>& xs, const std::vector<Scalar>& ys) {
+    size_t n = xs.size();
+    size_t nblocks = n < PiecewiseLinearModel::MIN_PARALLEL_SIZE ? 1 : omp_get_max_threads();
+    std::vector<IndexList> uncovered(nblocks);
+    #pragma omp parallel for schedule(static)
+    for (size_t b = 0; b < nblocks; b++) {
+        size_t lo = b * n / nblocks, hi = (b + 1) * n / nblocks;
+        if (lo == hi) {
+            continue;
+        }
+        // Segments cover every x in the data, so each block walks forward from the segment
+        // holding its first point.
+        size_t s = std::upper_bound(segments.begin(), segments.end(), xs[lo],
+                [](Scalar x, const PLASegment& seg) { return x < seg.x_start; })
+            - segments.begin() - 1;
+        for (size_t i = lo; i < hi; i++) {
+            while (xs[i] > segments[s].x_end) {
+                s++;
+            }
+            if (!PiecewiseLinearModel::Covers(segments[s], eps, xs[i], ys[i])) {
+                uncovered[b].push_back(i);
+            }
+        }
+    }
+    IndexList all;
+    for (const auto& u : uncovered) {
+        all.insert(all.end(), u.begin(), u.end());
+    }
+    return all;
+}
+
+template <size_t D>
+double PiecewiseLinearRewriter<D>::ChooseErrorBound(const std::vector<Scalar>& xs,
+        const std::vector<Scalar>& ys) const {
+    // An evenly spaced sample keeps the shape of the sorted data.
+    size_t step = (xs.size() + SAMPLE_SIZE - 1) / SAMPLE_SIZE;
+    std::vector<Scalar> sample_xs, sample_ys;
+    for (size_t i = 0; i < xs.size(); i += step) {
+        sample_xs.push_back(xs[i]);
+        sample_ys.push_back(ys[i]);
+    }
+    auto minmax = std::minmax_element(sample_ys.begin(), sample_ys.end());
+    double y_span = double(*minmax.second - *minmax.first) + 1;
+    // Outliers would stretch the span, so the density comes from the middle 98% of the values.
+    std::vector<Scalar> sorted_ys(sample_ys);
+    size_t lo = sorted_ys.size() / 100, hi = sorted_ys.size() - 1 - lo;
+    std::nth_element(sorted_ys.begin(), sorted_ys.begin() + lo, sorted_ys.end());
+    Scalar y_lo = sorted_ys[lo];
+    std::nth_element(sorted_ys.begin(), sorted_ys.begin() + hi, sorted_ys.end());
+    double rows_per_value = (hi - lo + 1) / (double(sorted_ys[hi] - y_lo) + 1);
+
+    std::vector<double> bounds;
+    for (double eps = 1; eps <= y_span; eps *= 2) {
+        bounds.push_back(eps);
+    }
+    std::vector<double> costs(bounds.size());
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t c = 0; c < bounds.size(); c++) {
+        std::vector<PLASegment> segments;
+        PiecewiseLinearModel::Fit(sample_xs, sample_ys, 0, sample_xs.size(), bounds[c],
+                &segments);
+        double scanned = 0;
+        for (const auto& s : segments) {
+            scanned += fabs(s.slope) * double(s.x_end - s.x_start) + 2 * bounds[c];
+        }
+        size_t outliers = Uncovered(segments, bounds[c], sample_xs, sample_ys).size();
+        costs[c] = rows_per_value * scanned + storage_factor_ * outliers;
+    }
+    return bounds[std::min_element(costs.begin(), costs.end()) - costs.begin()];
+}
+
+template <size_t D>
+void PiecewiseLinearRewriter<D>::Init(ConstPointIterator<D> start, ConstPointIterator<D> end) {
+    size_t data_size = std::distance(start, end);
+    AssertWithMessage(data_size > 0, "Can't build a PiecewiseLinearRewriter on an empty dataset");
+    AssertWithMessage(outlier_index_ != nullptr, "PiecewiseLinearRewriter needs an outlier index");
+    std::vector<Scalar> xs(data_size);
+    std::vector<size_t> sort_indices(data_size);
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < data_size; i++) {
+        xs[i] = (*(start + i))[mapped_dim_];
+        sort_indices[i] = i;
+    }
+    RadixSort::Sort(xs, sort_indices);
+    std::vector<Scalar> ys(data_size);
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < data_size; i++) {
+        ys[i] = (*(start + sort_indices[i]))[target_dim_];
+    }
+
+    if (!fixed_eps_) {
+        eps_ = ChooseErrorBound(xs, ys);
+    }
+    segments_ = PiecewiseLinearModel::ParallelFit(xs, ys, eps_);
+    segment_ends_.resize(segments_.size());
+    for (size_t s = 0; s < segments_.size(); s++) {
+        segment_ends_[s] = segments_[s].x_end;
+    }
+    IndexList outliers = Uncovered(segments_, eps_, xs, ys);
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < outliers.size(); i++) {
+        outliers[i] = sort_indices[outliers[i]];
+    }
+    std::cout << "Built piecewise linear model " << mapped_dim_ << " -> " << target_dim_
+        << " with " << segments_.size() << " segments, eps = " << eps_ << " and "
+        << outliers.size() << " outliers" << std::endl;
+    outlier_index_->SetIndexList(outliers);
+    outlier_index_->Init(start, end);
+}
+
+template <size_t D>
+IndexList PiecewiseLinearRewriter<D>::Rewrite(Query<D>& q) {
+    const QueryFilter& mapped = q.filters[mapped_dim_];
+    if (!mapped.present) {
+        return {};
+    }
+    assert (mapped.is_range);
+    // Union of the bands of every segment the filter reaches, clipped to the filter.
+    bands_.clear();
+    for (ScalarRange r : mapped.ranges) {
+        size_t s = std::lower_bound(segment_ends_.begin(), segment_ends_.end(), r.first)
+            - segment_ends_.begin();
+        for (; s < segments_.size() && segments_[s].x_start <= r.second; s++) {
+            const PLASegment& seg = segments_[s];
+            double y1 = seg.At(std::max(r.first, seg.x_start));
+            double y2 = seg.At(std::min(r.second, seg.x_end));
+            bands_.emplace_back((Scalar)floor(std::min(y1, y2) - eps_),
+                    (Scalar)ceil(std::max(y1, y2) + eps_));
+        }
+    }
+    std::sort(bands_.begin(), bands_.end(), ScalarRangeStartComp{});
+    // Bands are inclusive, so adjacent ones merge too.
+    size_t out = 0;
+    for (size_t i = 0; i < bands_.size(); i++) {
+        if (out > 0 && bands_[i].first <= bands_[out-1].second + 1) {
+            bands_[out-1].second = std::max(bands_[out-1].second, bands_[i].second);
+        } else {
+            bands_[out++] = bands_[i];
+        }
+    }
+    bands_.resize(out);
+
+    QueryFilter& target_qf = q.filters[target_dim_];
+    if (target_qf.present) {
+        assert (target_qf.is_range);
+        std::sort(target_qf.ranges.begin(), target_qf.ranges.end(), ScalarRangeStartComp{});
+        target_qf.ranges = MergeUtils::Intersect(bands_, target_qf.ranges);
+    } else {
+        target_qf = {.present = true, .is_range = true};
+        target_qf.ranges.assign(bands_.begin(), bands_.end());
+    }
+    return outlier_index_->Matches(q).ToList();
+}
@@ -0,0 +1,279 @@
+#include "posting_list_secondary_index.h"
+
+#include <algorithm>
+#include <numeric>
+#include <queue>
+#include <iostream>
+#include <limits>
+
+#include "radix_sort.h"
+
+template <size_t D>
+PostingListSecondaryIndex<D>::PostingListSecondaryIndex(size_t dim)
+    : SecondaryIndexer<D>(dim), data_size_(0), use_index_subset_(false), index_subset_(),
+      stream_size_(0) {}
+
+template <size_t D>
+void PostingListSecondaryIndex<D>::Init(ConstPointIterator<D> start, ConstPointIterator<D> end) {
+    data_size_ = std::distance(start, end);
+    std::vector<Scalar> keys;
+    std::vector<PhysicalIndex> rows;
+    if (!use_index_subset_) {
+        rows.resize(data_size_);
+        std::iota(rows.begin(), rows.end(), 0);
+    } else {
+        rows = std::move(index_subset_);
+        index_subset_.clear();
+        std::sort(rows.begin(), rows.end());
+    }
+    keys.resize(rows.size());
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < rows.size(); i++) {
+        keys[i] = (*(start + rows[i]))[this->column_];
+    }
+    // The sort is stable and the rows start out in order, so each posting list comes out sorted.
+    RadixSort::Sort(keys, rows);
+
+    // Split off the single rows into the directory, and compact the lists into the front of rows,
+    // which becomes the stream.
+    keys_.clear();
+    std::vector<PhysicalIndex> refs, offsets;
+    size_t stream_size = 0;
+    size_t i = 0;
+    while (i < keys.size()) {
+        size_t j = i;
+        while (j < keys.size() && keys[j] == keys[i]) {
+            j++;
+        }
+        keys_.push_back(keys[i]);
+        if (j - i == 1) {
+            refs.push_back(rows[i]);
+        } else {
+            refs.push_back(data_size_ + offsets.size());
+            offsets.push_back(stream_size);
+            for (size_t t = i; t < j; t++) {
+                rows[stream_size++] = rows[t];
+            }
+        }
+        i = j;
+    }
+    offsets.push_back(stream_size);
+    stream_size_ = stream_size;
+    key_refs_.Reset(data_size_ + offsets.size());
+    key_refs_.Visit([&](auto& r) { r.assign(refs.begin(), refs.end()); });
+    list_offsets_.Reset(stream_size_ + 1);
+    list_offsets_.Visit([&](auto& o) { o.assign(offsets.begin(), offsets.end()); });
+
+    std::vector<PhysicalIndex> firsts;
+    block_offsets_.clear();
+    block_bits_.clear();
+    packed_.clear();
+    // Difference of row from prev, wrapped around the number of rows.
+    auto step = [this](PhysicalIndex prev, PhysicalIndex row) -> uint64_t {
+        return row >= prev ? row - prev : row + data_size_ - prev;
+    };
+    for (size_t bstart = 0; bstart < stream_size_; bstart += BLOCK_SIZE) {
+        size_t bend = std::min(stream_size_, bstart + BLOCK_SIZE);
+        uint64_t max_step = 0;
+        for (size_t t = bstart + 1; t < bend; t++) {
+            max_step = std::max(max_step, step(rows[t-1], rows[t]));
+        }
+        size_t bits = max_step == 0 ? 0 : 64 - __builtin_clzll(max_step);
+        size_t base = packed_.size();
+        AssertWithMessage(base <= std::numeric_limits<uint32_t>::max(),
+                "PostingListSecondaryIndex stream is too large for 32-bit block offsets");
+        firsts.push_back(rows[bstart]);
+        block_offsets_.push_back(base);
+        block_bits_.push_back(bits);
+        packed_.resize(base + ((bend - bstart - 1) * bits + 63) / 64, 0);
+        for (size_t t = bstart + 1; t < bend; t++) {
+            uint64_t v = step(rows[t-1], rows[t]);
+            size_t offset = (t - bstart - 1) * bits;
+            size_t w = base + offset / 64;
+            size_t shift = offset % 64;
+            packed_[w] |= v << shift;
+            if (shift + bits > 64) {
+                packed_[w+1] |= v >> (64 - shift);
+            }
+        }
+    }
+    block_first_.Reset(data_size_);
+    block_first_.Visit([&](auto& f) { f.assign(firsts.begin(), firsts.end()); });
+    std::cout << "PostingListSecondaryIndex on " << this->column_ << " loaded " << keys.size()
+        << " points with " << keys_.size() << " keys, " << offsets.size() - 1
+        << " lists and total size " << Size() << std::endl;
+}
+
+template <size_t D>
+void PostingListSecondaryIndex<D>::DecodeBlock(size_t b, PhysicalIndex* out) const {
+    size_t count = std::min(BLOCK_SIZE, stream_size_ - b * BLOCK_SIZE);
+    out[0] = block_first_[b];
+    size_t bits = block_bits_[b];
+    if (bits == 0) {
+        std::fill(out + 1, out + count, out[0]);
+        return;
+    }
+    const uint64_t* words = packed_.data() + block_offsets_[b];
+    uint64_t mask = bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+    for (size_t t = 1; t < count; t++) {
+        size_t offset = (t - 1) * bits;
+        size_t w = offset / 64;
+        size_t shift = offset % 64;
+        uint64_t v = words[w] >> shift;
+        if (shift + bits > 64) {
+            v |= words[w+1] << (64 - shift);
+        }
+        PhysicalIndex row = out[t-1] + (v & mask);
+        out[t] = row >= data_size_ ? row - data_size_ : row;
+    }
+}
+
+template <size_t D>
+template <typename Id>
+void PostingListSecondaryIndex<D>::DecodeSlice(size_t begin, size_t end, Id* out) const {
+    PhysicalIndex block[BLOCK_SIZE];
+    for (size_t b = begin / BLOCK_SIZE; b * BLOCK_SIZE < end; b++) {
+        size_t bstart = b * BLOCK_SIZE;
+        DecodeBlock(b, block);
+        size_t lo = std::max(begin, bstart), hi = std::min(end, bstart + BLOCK_SIZE);
+        std::copy(block + (lo - bstart), block + (hi - bstart), out);
+        out += hi - lo;
+    }
+}
+
+template <size_t D>
+template <typename Id>
+void PostingListSecondaryIndex<D>::DecodeList(size_t k, std::vector<Id>* out) const {
+    PhysicalIndex ref = key_refs_[k];
+    if (ref < data_size_) {
+        out->push_back(ref);
+        return;
+    }
+    size_t begin = list_offsets_[ref - data_size_], end = list_offsets_[ref - data_size_ + 1];
+    size_t pos = out->size();
+    out->resize(pos + end - begin);
+    DecodeSlice(begin, end, out->data() + pos);
+}
+
+template <size_t D>
+template <typename Id>
+void PostingListSecondaryIndex<D>::MergeLists(const std::vector<size_t>& key_ixs, size_t total,
+        std::vector<Id>* out) const {
+    if (key_ixs.size() == 1) {
+        DecodeList(key_ixs[0], out);
+        return;
+    }
+    if (key_ixs.size() <= MAX_HEAP_MERGE_LISTS) {
+        // Decode one block of each list at a time and merge with a heap on the next row of each.
+        struct Cursor {
+            // Next stream position to decode and the end of the list.
+            size_t next;
+            size_t end;
+            size_t pos;
+            size_t count;
+            PhysicalIndex rows[BLOCK_SIZE];
+        };
+        // Decodes the rest of the cursor's current block, up to the end of its list.
+        auto refill = [this](Cursor& cur) {
+            size_t stop = std::min(cur.end, (cur.next / BLOCK_SIZE + 1) * BLOCK_SIZE);
+            DecodeSlice(cur.next, stop, cur.rows);
+            cur.pos = 0;
+            cur.count = stop - cur.next;
+            cur.next = stop;
+        };
+        std::vector<Cursor> cursors(key_ixs.size());
+        typedef std::pair<PhysicalIndex, size_t> HeapEntry;
+        std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>> heap;
+        for (size_t c = 0; c < key_ixs.size(); c++) {
+            Cursor& cur = cursors[c];
+            PhysicalIndex ref = key_refs_[key_ixs[c]];
+            if (ref < data_size_) {
+                cur.next = cur.end = 0;
+                cur.pos = 0;
+                cur.count = 1;
+                cur.rows[0] = ref;
+            } else {
+                cur.next = list_offsets_[ref - data_size_];
+                cur.end = list_offsets_[ref - data_size_ + 1];
+                refill(cur);
+            }
+            heap.emplace(cur.rows[0], c);
+        }
+        while (!heap.empty()) {
+            size_t c = heap.top().second;
+            out->push_back(heap.top().first);
+            heap.pop();
+            Cursor& cur = cursors[c];
+            if (++cur.pos == cur.count) {
+                if (cur.next == cur.end) {
+                    continue;
+                }
+                refill(cur);
+            }
+            heap.emplace(cur.rows[cur.pos], c);
+        }
+        return;
+    }
+    size_t pos = out->size();
+    for (size_t k : key_ixs) {
+        DecodeList(k, out);
+    }
+    if (total * 64 < data_size_) {
+        std::sort(out->begin() + pos, out->end());
+        return;
+    }
+    // Dense result: mark the rows in a bitmap and read them back in order.
+    std::vector<uint64_t> bitmap((data_size_ + 63) / 64, 0);
+    for (size_t i = pos; i < out->size(); i++) {
+        bitmap[(*out)[i] / 64] |= 1ULL << ((*out)[i] % 64);
+    }
+    out->resize(pos);
+    for (size_t w = 0; w < bitmap.size(); w++) {
+        uint64_t word = bitmap[w];
+        while (word) {
+            out->push_back(w * 64 + __builtin_ctzll(word));
+            word &= word - 1;
+        }
+    }
+}
+
+template <size_t D>
+MatchResult PostingListSecondaryIndex<D>::Matches(const Query<D>& q) const {
+    auto filter = q.filters[this->column_];
+    if (!filter.present) {
+        return MatchResult::Universe(data_size_);
+    }
+    std::vector<size_t> key_ixs;
+    if (filter.is_range) {
+        for (ScalarRange r : filter.ranges) {
+            size_t lo = std::lower_bound(keys_.begin(), keys_.end(), r.first) - keys_.begin();
+            size_t hi = std::upper_bound(keys_.begin(), keys_.end(), r.second) - keys_.begin();
+            for (size_t k = lo; k < hi; k++) {
+                key_ixs.push_back(k);
+            }
+        }
+    } else {
+        for (Scalar val : filter.values) {
+            auto it = std::lower_bound(keys_.begin(), keys_.end(), val);
+            if (it != keys_.end() && *it == val) {
+                key_ixs.push_back(it - keys_.begin());
+            }
+        }
+    }
+    // Overlapping ranges or repeated values shouldn't produce the same rows twice.
+    std::sort(key_ixs.begin(), key_ixs.end());
+    key_ixs.erase(std::unique(key_ixs.begin(), key_ixs.end()), key_ixs.end());
+    size_t total = 0;
+    for (size_t k : key_ixs) {
+        total += ListSize(k);
+    }
+    RowIds idxs;
+    idxs.Reset(data_size_);
+    return idxs.Visit([&](auto& ids) {
+        if (!key_ixs.empty()) {
+            ids.reserve(total);
+            MergeLists(key_ixs, total, &ids);
+        }
+        return MatchResult::FromSortedList(std::move(ids));
+    });
+}
@@ -9,6 +9,8 @@
 
 #include "types.h"
 #include "utils.h"
+#include "radix_sort.h"
+#include "permutation_utils.h"
 
 template <size_t D>
 PrimaryBTreeIndex<D>::PrimaryBTreeIndex(size_t dim, size_t ps)
@@ -92,22 +94,16 @@ template <size_t D>
 void PrimaryBTreeIndex<D>::Init(PointIterator<D> start, PointIterator<D> end) {
     size_t s = std::distance(start, end);
     data_size_ = s;
-    std::vector<std::pair<Scalar, size_t>> indices(s);
-    size_t i = 0;
-    for (auto it = start; it != end; it++, i++) {
-        indices[i] = std::make_pair((*it)[column_], i);
+    std::vector<Scalar> keys(s);
+    std::vector<size_t> order(s);
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < s; i++) {
+        keys[i] = (*(start + i))[column_];
+        order[i] = i;
     }
 
     // Sort by this array instead.
-    std::stable_sort(indices.begin(), indices.end(),
-        [](const std::pair<Scalar, size_t>& a, const std::pair<Scalar, size_t>& b) -> bool {
-            return a.first < b.first;
-        });
-    std::vector<Point<D>> data_cpy(s);
-    std::transform(indices.begin(), indices.end(), data_cpy.begin(),
-            [start](const auto& ix_pair) -> Point<D> {
-                return *(start + ix_pair.second);
-                });
+    RadixSort::Sort(keys, order);
 
     // Run through sorted data to build the index
     bool first = true;
@@ -115,16 +111,16 @@ void PrimaryBTreeIndex<D>::Init(PointIterator<D> start, PointIterator<D> end) {
     size_t cur_min_ix = 0;
     size_t cur_max_ix = 0;
     Page page;
-    for (const auto item : indices) {
+    for (const Scalar key : keys) {
         if (first) {
-            page.value_range.first = item.first;
-            cur_ix_val = item.first;
+            page.value_range.first = key;
+            cur_ix_val = key;
             first = false;
         }
-        if (cur_ix_val < item.first) {
+        if (cur_ix_val < key) {
             ExtendOrTruncPage(&page, cur_ix_val, cur_min_ix, cur_max_ix);
             cur_min_ix = cur_max_ix;
-            cur_ix_val = item.first;
+            cur_ix_val = key;
         }
         cur_max_ix++;
     }
@@ -136,7 +132,7 @@ void PrimaryBTreeIndex<D>::Init(PointIterator<D> start, PointIterator<D> end) {
     }
 
     std::cout << "Index has " << pages_.size() << " buckets" << std::endl;
-    std::copy(data_cpy.begin(), data_cpy.end(), start);
+    PermutationUtils::ApplyParallel(start, order);
     ready_ = true;
 }
 
@@ -18,7 +18,8 @@ QueryEngine<D>::QueryEngine(
       range_scan_time_(0),
       indexing_time_(0),
       list_scan_time_(0),
-      num_queries_(0) {}
+      num_queries_(0),
+      bitmap_scan_(false) {}
 
 template <size_t D>
 void QueryEngine<D>::Execute(Query<D>& q, Visitor<D>& visitor) {
@@ -38,6 +39,12 @@ void QueryEngine<D>::Execute(Query<D>& q, Visitor<D>& visitor) {
             }
         }
     }
+    if (bitmap_scan_) {
+        range_scan_time_ += ExecuteBitmap(q, visitor, categorical_query_dimensions, value_sets,
+                range_query_dimensions);
+        num_queries_ += 1;
+        return;
+    }
     auto preindex = std::chrono::high_resolution_clock::now();
     PhysicalIndexSet indexes_to_scan = indexer_->Ranges(q);
     auto start = std::chrono::high_resolution_clock::now();
@@ -47,15 +54,8 @@ void QueryEngine<D>::Execute(Query<D>& q, Visitor<D>& visitor) {
             size_t true_end = std::min(range.end, p + 64UL);
             // A way to get the last true_end - p bits set to 1.
             uint64_t valids = 1ULL + (((1ULL << (true_end - p - 1)) - 1ULL) << 1);
-            for (size_t i = 0; i < categorical_query_dimensions.size(); i++) {
-                valids &= dataset_->GetCoordInSet(p, true_end,
-                        categorical_query_dimensions[i], value_sets[i]);
-            }
-            for (size_t d : range_query_dimensions) {
-                auto r = q.filters[d].ranges[0];
-                valids &= dataset_->GetCoordInRange(p, true_end,
-                        d, r.first, r.second);
-            }
+            valids = FilterWord(q, p, true_end, valids, categorical_query_dimensions, value_sets,
+                    range_query_dimensions);
             visitor.visitRange(dataset_.get(), p, true_end, valids); 
         }
     }
@@ -89,3 +89,42 @@ void QueryEngine<D>::Execute(Query<D>& q, Visitor<D>& visitor) {
     indexing_time_ += index_t;
 }
 
+
+template <size_t D>
+long QueryEngine<D>::ExecuteBitmap(Query<D>& q, Visitor<D>& visitor,
+        const std::vector<size_t>& categorical_dims,
+        const std::vector<std::unordered_set<Scalar>>& value_sets,
+        const std::vector<size_t>& range_dims) {
+    auto preindex = std::chrono::high_resolution_clock::now();
+    RoaringSet indexes_to_scan = indexer_->RangesBitmap(q);
+    auto start = std::chrono::high_resolution_clock::now();
+    size_t data_size = dataset_->Size();
+    indexes_to_scan.ForEachWord([&](PhysicalIndex p, uint64_t word) {
+        size_t true_end = std::min(data_size, p + 64UL);
+        // Bitmap words are MSB-first over 64 rows, while valids only has true_end - p bits.
+        uint64_t valids = word >> (64 - (true_end - p));
+        scanned_range_points_ += __builtin_popcountll(valids);
+        valids = FilterWord(q, p, true_end, valids, categorical_dims, value_sets, range_dims);
+        visitor.visitRange(dataset_.get(), p, true_end, valids);
+    });
+    auto end = std::chrono::high_resolution_clock::now();
+    auto scan_t = std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count();
+    indexing_time_ += std::chrono::duration_cast<std::chrono::nanoseconds>(start-preindex).count();
+    std::cout << "Scan time (us): bitmap = " << scan_t / 1e3 << std::endl;
+    return scan_t;
+}
+
+template <size_t D>
+uint64_t QueryEngine<D>::FilterWord(Query<D>& q, size_t start, size_t end, uint64_t valids,
+        const std::vector<size_t>& categorical_dims,
+        const std::vector<std::unordered_set<Scalar>>& value_sets,
+        const std::vector<size_t>& range_dims) const {
+    for (size_t i = 0; i < categorical_dims.size(); i++) {
+        valids &= dataset_->GetCoordInSet(start, end, categorical_dims[i], value_sets[i]);
+    }
+    for (size_t d : range_dims) {
+        auto r = q.filters[d].ranges[0];
+        valids &= dataset_->GetCoordInRange(start, end, d, r.first, r.second);
+    }
+    return valids;
+}
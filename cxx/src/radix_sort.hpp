@@ -0,0 +1,80 @@
+#include "radix_sort.h"
+
+#include <algorithm>
+#include <cassert>
+#include <omp.h>
+
+template <typename K, typename P>
+void RadixSort::Sort(std::vector<K>& keys, std::vector<P>& payload) {
+    size_t n = keys.size();
+    assert (payload.size() == n);
+    if (n < 2) {
+        return;
+    }
+    int nthreads = n < MIN_PARALLEL_SIZE ? 1 : omp_get_max_threads();
+
+    // Histograms of every digit, collected in a single read of the keys. These don't depend on the
+    // order of the keys, so they also tell us up front which passes can be skipped.
+    std::vector<size_t> digit_counts(NUM_PASSES * NUM_BUCKETS, 0);
+    #pragma omp parallel num_threads(nthreads)
+    {
+        std::vector<size_t> local_counts(NUM_PASSES * NUM_BUCKETS, 0);
+        #pragma omp for schedule(static)
+        for (size_t i = 0; i < n; i++) {
+            uint64_t key = KeyBits(keys[i]);
+            for (size_t p = 0; p < NUM_PASSES; p++) {
+                local_counts[p * NUM_BUCKETS + ((key >> (p * RADIX_BITS)) & (NUM_BUCKETS - 1))]++;
+            }
+        }
+        #pragma omp critical
+        for (size_t i = 0; i < digit_counts.size(); i++) {
+            digit_counts[i] += local_counts[i];
+        }
+    }
+
+    std::vector<K> keys_tmp(n);
+    std::vector<P> payload_tmp(n);
+    // Per-thread write offsets for each bucket, laid out as offsets[thread * NUM_BUCKETS + bucket].
+    std::vector<size_t> offsets(nthreads * NUM_BUCKETS);
+    for (size_t p = 0; p < NUM_PASSES; p++) {
+        const size_t* counts = &digit_counts[p * NUM_BUCKETS];
+        if (std::find(counts, counts + NUM_BUCKETS, n) != counts + NUM_BUCKETS) {
+            // Every key has the same digit here, so this pass wouldn't move anything.
+            continue;
+        }
+        size_t shift = p * RADIX_BITS;
+        #pragma omp parallel num_threads(nthreads)
+        {
+            size_t t = omp_get_thread_num();
+            size_t nt = omp_get_num_threads();
+            // Each thread owns a contiguous chunk, and chunks are scattered in thread order, which
+            // keeps the sort stable.
+            size_t begin = n * t / nt;
+            size_t end = n * (t + 1) / nt;
+            size_t* hist = &offsets[t * NUM_BUCKETS];
+            std::fill(hist, hist + NUM_BUCKETS, 0);
+            for (size_t i = begin; i < end; i++) {
+                hist[(KeyBits(keys[i]) >> shift) & (NUM_BUCKETS - 1)]++;
+            }
+            #pragma omp barrier
+            #pragma omp single
+            {
+                size_t sum = 0;
+                for (size_t b = 0; b < NUM_BUCKETS; b++) {
+                    for (size_t tt = 0; tt < nt; tt++) {
+                        size_t c = offsets[tt * NUM_BUCKETS + b];
+                        offsets[tt * NUM_BUCKETS + b] = sum;
+                        sum += c;
+                    }
+                }
+            }
+            for (size_t i = begin; i < end; i++) {
+                size_t pos = hist[(KeyBits(keys[i]) >> shift) & (NUM_BUCKETS - 1)]++;
+                keys_tmp[pos] = keys[i];
+                payload_tmp[pos] = payload[i];
+            }
+        }
+        keys.swap(keys_tmp);
+        payload.swap(payload_tmp);
+    }
+}
@@ -0,0 +1,431 @@
+#include "roaring_set.h"
+
+#include <algorithm>
+#include <cassert>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+RoaringSet RoaringSet::FromRanges(const IndexRangeList& ranges) {
+    RoaringSet set;
+    for (const auto& r : ranges) {
+        PhysicalIndex start = r.start;
+        while (start < r.end) {
+            uint64_t key = start >> CHUNK_BITS;
+            PhysicalIndex chunk_end = std::min<PhysicalIndex>(r.end, (key + 1) << CHUNK_BITS);
+            Run run = {(uint16_t)(start & (CHUNK_SIZE - 1)),
+                (uint16_t)((chunk_end - 1) & (CHUNK_SIZE - 1))};
+            if (set.keys_.empty() || set.keys_.back() != key) {
+                assert (set.keys_.empty() || set.keys_.back() < key);
+                set.keys_.push_back(key);
+                set.containers_.emplace_back(RUN, 0);
+            }
+            Container& c = set.containers_.back();
+            if (!c.runs.empty() && (uint32_t)c.runs.back().last + 1 == run.start) {
+                // Touching ranges are merged into a single run.
+                c.runs.back().last = run.last;
+            } else {
+                c.runs.push_back(run);
+            }
+            c.cardinality += chunk_end - start;
+            start = chunk_end;
+        }
+    }
+    return set;
+}
+
+template <typename Id>
+RoaringSet RoaringSet::FromList(const std::vector<Id>& list) {
+    const std::vector<Id>* sorted = &list;
+    std::vector<Id> copy;
+    if (!std::is_sorted(list.begin(), list.end())) {
+        copy = list;
+        std::sort(copy.begin(), copy.end());
+        sorted = &copy;
+    }
+    RoaringSet set;
+    size_t i = 0;
+    while (i < sorted->size()) {
+        uint64_t key = (*sorted)[i] >> CHUNK_BITS;
+        std::vector<uint16_t> values;
+        for (; i < sorted->size() && ((*sorted)[i] >> CHUNK_BITS) == key; i++) {
+            uint16_t offset = (*sorted)[i] & (CHUNK_SIZE - 1);
+            if (values.empty() || values.back() != offset) {
+                values.push_back(offset);
+            }
+        }
+        set.keys_.push_back(key);
+        set.containers_.push_back(Normalize(ArrayContainer(std::move(values))));
+    }
+    return set;
+}
+
+RoaringSet RoaringSet::FromIndexSet(const PhysicalIndexSet& set) {
+    if (set.list.empty()) {
+        return FromRanges(set.ranges);
+    }
+    if (set.ranges.empty()) {
+        return FromList(set.list);
+    }
+    return Union(FromRanges(set.ranges), FromList(set.list));
+}
+
+RoaringSet RoaringSet::Intersect(const RoaringSet& first, const RoaringSet& second) {
+    RoaringSet result;
+    size_t i = 0, j = 0;
+    while (i < first.keys_.size() && j < second.keys_.size()) {
+        if (first.keys_[i] < second.keys_[j]) {
+            i++;
+        } else if (first.keys_[i] > second.keys_[j]) {
+            j++;
+        } else {
+            Container c = IntersectContainers(first.containers_[i], second.containers_[j]);
+            if (c.cardinality > 0) {
+                result.keys_.push_back(first.keys_[i]);
+                result.containers_.push_back(std::move(c));
+            }
+            i++;
+            j++;
+        }
+    }
+    return result;
+}
+
+RoaringSet RoaringSet::Union(const RoaringSet& first, const RoaringSet& second) {
+    RoaringSet result;
+    size_t i = 0, j = 0;
+    while (i < first.keys_.size() || j < second.keys_.size()) {
+        if (j == second.keys_.size() || (i < first.keys_.size() && first.keys_[i] < second.keys_[j])) {
+            result.keys_.push_back(first.keys_[i]);
+            result.containers_.push_back(first.containers_[i]);
+            i++;
+        } else if (i == first.keys_.size() || second.keys_[j] < first.keys_[i]) {
+            result.keys_.push_back(second.keys_[j]);
+            result.containers_.push_back(second.containers_[j]);
+            j++;
+        } else {
+            result.keys_.push_back(first.keys_[i]);
+            result.containers_.push_back(UnionContainers(first.containers_[i], second.containers_[j]));
+            i++;
+            j++;
+        }
+    }
+    return result;
+}
+
+size_t RoaringSet::Cardinality() const {
+    size_t total = 0;
+    for (const auto& c : containers_) {
+        total += c.cardinality;
+    }
+    return total;
+}
+
+bool RoaringSet::Contains(PhysicalIndex ix) const {
+    auto it = std::lower_bound(keys_.begin(), keys_.end(), ix >> CHUNK_BITS);
+    if (it == keys_.end() || *it != (ix >> CHUNK_BITS)) {
+        return false;
+    }
+    return ContainsOffset(containers_[it - keys_.begin()], ix & (CHUNK_SIZE - 1));
+}
+
+template <typename F>
+void RoaringSet::ForEachWord(F f) const {
+    for (size_t i = 0; i < keys_.size(); i++) {
+        const Container& c = containers_[i];
+        PhysicalIndex base = keys_[i] << CHUNK_BITS;
+        if (c.type == BITMAP) {
+            for (size_t w = 0; w < BITMAP_WORDS; w++) {
+                if (c.bitmap[w]) {
+                    f(base + 64 * w, c.bitmap[w]);
+                }
+            }
+            continue;
+        }
+        // Arrays and runs can put several entries in the same word, so accumulate the word until
+        // we move past it.
+        size_t cur = BITMAP_WORDS;
+        uint64_t mask = 0;
+        auto add = [&](size_t w, uint64_t bits) {
+            if (w != cur) {
+                if (mask) {
+                    f(base + 64 * cur, mask);
+                }
+                cur = w;
+                mask = 0;
+            }
+            mask |= bits;
+        };
+        if (c.type == ARRAY) {
+            for (uint16_t v : c.array) {
+                add(v / 64, 1ULL << (63 - v % 64));
+            }
+        } else {
+            for (const Run& r : c.runs) {
+                for (size_t w = r.start / 64; w <= r.last / 64u; w++) {
+                    size_t first = std::max<size_t>(r.start, 64 * w) - 64 * w;
+                    size_t last = std::min<size_t>(r.last, 64 * w + 63) - 64 * w;
+                    add(w, WordMask(first, last));
+                }
+            }
+        }
+        if (mask) {
+            f(base + 64 * cur, mask);
+        }
+    }
+}
+
+IndexList RoaringSet::ToList() const {
+    IndexList list;
+    list.reserve(Cardinality());
+    ForEachWord([&list](PhysicalIndex start, uint64_t word) {
+        while (word) {
+            size_t lz = __builtin_clzll(word);
+            list.push_back(start + lz);
+            word &= ~(1ULL << (63 - lz));
+        }
+    });
+    return list;
+}
+
+IndexRangeList RoaringSet::ToRanges() const {
+    IndexRangeList ranges;
+    auto add = [&ranges](PhysicalIndex start, PhysicalIndex end) {
+        if (!ranges.empty() && ranges.back().end == start) {
+            ranges.back().end = end;
+        } else {
+            ranges.emplace_back(start, end);
+        }
+    };
+    for (size_t i = 0; i < keys_.size(); i++) {
+        const Container& c = containers_[i];
+        PhysicalIndex base = keys_[i] << CHUNK_BITS;
+        if (c.type == RUN) {
+            for (const Run& r : c.runs) {
+                add(base + r.start, base + r.last + 1);
+            }
+        } else if (c.type == ARRAY) {
+            for (uint16_t v : c.array) {
+                add(base + v, base + v + 1);
+            }
+        } else {
+            for (size_t w = 0; w < BITMAP_WORDS; w++) {
+                uint64_t word = c.bitmap[w];
+                PhysicalIndex word_start = base + 64 * w;
+                // Peel off one run of consecutive set bits at a time.
+                while (word) {
+                    size_t first = __builtin_clzll(word);
+                    uint64_t rest = ~word & (~0ULL >> first);
+                    size_t last = rest ? __builtin_clzll(rest) : 64;
+                    add(word_start + first, word_start + last);
+                    word &= last == 64 ? 0 : (~0ULL >> last);
+                }
+            }
+        }
+    }
+    return ranges;
+}
+
+size_t RoaringSet::Size() const {
+    size_t size = keys_.size() * (sizeof(uint64_t) + sizeof(Container));
+    for (const auto& c : containers_) {
+        size += c.array.size() * sizeof(uint16_t) + c.bitmap.size() * sizeof(uint64_t)
+            + c.runs.size() * sizeof(Run);
+    }
+    return size;
+}
+
+RoaringSet::Container RoaringSet::ArrayContainer(std::vector<uint16_t>&& values) {
+    Container c(ARRAY, values.size());
+    c.array = std::move(values);
+    return c;
+}
+
+RoaringSet::Container RoaringSet::BitmapContainer(std::vector<uint64_t>&& words, uint32_t cardinality) {
+    Container c(BITMAP, cardinality);
+    c.bitmap = std::move(words);
+    return c;
+}
+
+RoaringSet::Container RoaringSet::Normalize(Container c) {
+    if (c.type == ARRAY && c.cardinality > ARRAY_MAX) {
+        return BitmapContainer(ToWords(c), c.cardinality);
+    }
+    if (c.type == BITMAP && c.cardinality <= ARRAY_MAX) {
+        std::vector<uint16_t> values;
+        values.reserve(c.cardinality);
+        for (size_t w = 0; w < BITMAP_WORDS; w++) {
+            uint64_t word = c.bitmap[w];
+            while (word) {
+                size_t lz = __builtin_clzll(word);
+                values.push_back(64 * w + lz);
+                word &= ~(1ULL << (63 - lz));
+            }
+        }
+        return ArrayContainer(std::move(values));
+    }
+    return c;
+}
+
+std::vector<uint64_t> RoaringSet::ToWords(const Container& c) {
+    if (c.type == BITMAP) {
+        return c.bitmap;
+    }
+    std::vector<uint64_t> words(BITMAP_WORDS, 0);
+    if (c.type == ARRAY) {
+        for (uint16_t v : c.array) {
+            words[v / 64] |= 1ULL << (63 - v % 64);
+        }
+    } else {
+        for (const Run& r : c.runs) {
+            size_t first_word = r.start / 64, last_word = r.last / 64;
+            if (first_word == last_word) {
+                words[first_word] |= WordMask(r.start % 64, r.last % 64);
+                continue;
+            }
+            words[first_word] |= WordMask(r.start % 64, 63);
+            std::fill(words.begin() + first_word + 1, words.begin() + last_word, ~0ULL);
+            words[last_word] |= WordMask(0, r.last % 64);
+        }
+    }
+    return words;
+}
+
+bool RoaringSet::ContainsOffset(const Container& c, uint16_t offset) {
+    if (c.type == BITMAP) {
+        return c.bitmap[offset / 64] & (1ULL << (63 - offset % 64));
+    } else if (c.type == ARRAY) {
+        return std::binary_search(c.array.begin(), c.array.end(), offset);
+    }
+    auto it = std::upper_bound(c.runs.begin(), c.runs.end(), offset,
+            [](uint16_t v, const Run& r) { return v < r.start; });
+    return it != c.runs.begin() && offset <= (it - 1)->last;
+}
+
+RoaringSet::Container RoaringSet::IntersectContainers(const Container& a, const Container& b) {
+    if (a.type == RUN && b.type == RUN) {
+        Container c(RUN, 0);
+        size_t i = 0, j = 0;
+        while (i < a.runs.size() && j < b.runs.size()) {
+            uint16_t start = std::max(a.runs[i].start, b.runs[j].start);
+            uint16_t last = std::min(a.runs[i].last, b.runs[j].last);
+            if (start <= last) {
+                c.runs.push_back({start, last});
+                c.cardinality += last - start + 1;
+            }
+            if (a.runs[i].last < b.runs[j].last) {
+                i++;
+            } else {
+                j++;
+            }
+        }
+        return c;
+    }
+    if (a.type == ARRAY || b.type == ARRAY) {
+        const Container& arr = a.type == ARRAY ? a : b;
+        const Container& other = a.type == ARRAY ? b : a;
+        std::vector<uint16_t> values;
+        values.reserve(std::min(arr.cardinality, other.cardinality));
+        if (other.type == ARRAY) {
+            std::set_intersection(arr.array.begin(), arr.array.end(),
+                    other.array.begin(), other.array.end(), std::back_inserter(values));
+        } else {
+            for (uint16_t v : arr.array) {
+                if (ContainsOffset(other, v)) {
+                    values.push_back(v);
+                }
+            }
+        }
+        return ArrayContainer(std::move(values));
+    }
+    std::vector<uint64_t> words(BITMAP_WORDS);
+    uint32_t card;
+    if (a.type == BITMAP && b.type == BITMAP) {
+        card = AndWords(a.bitmap.data(), b.bitmap.data(), words.data());
+    } else {
+        card = AndWords(ToWords(a).data(), ToWords(b).data(), words.data());
+    }
+    return Normalize(BitmapContainer(std::move(words), card));
+}
+
+RoaringSet::Container RoaringSet::UnionContainers(const Container& a, const Container& b) {
+    if (a.type == RUN && b.type == RUN) {
+        Container c(RUN, 0);
+        size_t i = 0, j = 0;
+        while (i < a.runs.size() || j < b.runs.size()) {
+            Run next;
+            if (j == b.runs.size() || (i < a.runs.size() && a.runs[i].start < b.runs[j].start)) {
+                next = a.runs[i++];
+            } else {
+                next = b.runs[j++];
+            }
+            if (!c.runs.empty() && next.start <= (uint32_t)c.runs.back().last + 1) {
+                c.runs.back().last = std::max(c.runs.back().last, next.last);
+            } else {
+                c.runs.push_back(next);
+            }
+        }
+        for (const Run& r : c.runs) {
+            c.cardinality += r.last - r.start + 1;
+        }
+        return c;
+    }
+    if (a.cardinality == CHUNK_SIZE || b.cardinality == CHUNK_SIZE) {
+        return a.cardinality == CHUNK_SIZE ? a : b;
+    }
+    if (a.type == ARRAY && b.type == ARRAY) {
+        std::vector<uint16_t> values;
+        values.reserve(a.cardinality + b.cardinality);
+        std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                std::back_inserter(values));
+        return Normalize(ArrayContainer(std::move(values)));
+    }
+    std::vector<uint64_t> words(BITMAP_WORDS);
+    uint32_t card;
+    if (a.type == BITMAP && b.type == BITMAP) {
+        card = OrWords(a.bitmap.data(), b.bitmap.data(), words.data());
+    } else {
+        card = OrWords(ToWords(a).data(), ToWords(b).data(), words.data());
+    }
+    return Normalize(BitmapContainer(std::move(words), card));
+}
+
+uint32_t RoaringSet::AndWords(const uint64_t* a, const uint64_t* b, uint64_t* out) {
+    size_t w = 0;
+#ifdef __AVX2__
+    for (; w < BITMAP_WORDS; w += 4) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + w));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + w));
+        _mm256_storeu_si256((__m256i*)(out + w), _mm256_and_si256(va, vb));
+    }
+#else
+    for (; w < BITMAP_WORDS; w++) {
+        out[w] = a[w] & b[w];
+    }
+#endif
+    uint32_t card = 0;
+    for (w = 0; w < BITMAP_WORDS; w++) {
+        card += __builtin_popcountll(out[w]);
+    }
+    return card;
+}
+
+uint32_t RoaringSet::OrWords(const uint64_t* a, const uint64_t* b, uint64_t* out) {
+    size_t w = 0;
+#ifdef __AVX2__
+    for (; w < BITMAP_WORDS; w += 4) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + w));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + w));
+        _mm256_storeu_si256((__m256i*)(out + w), _mm256_or_si256(va, vb));
+    }
+#else
+    for (; w < BITMAP_WORDS; w++) {
+        out[w] = a[w] | b[w];
+    }
+#endif
+    uint32_t card = 0;
+    for (w = 0; w < BITMAP_WORDS; w++) {
+        card += __builtin_popcountll(out[w]);
+    }
+    return card;
+}
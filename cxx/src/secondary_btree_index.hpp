@@ -1,58 +1,76 @@
 #include "secondary_btree_index.h"
 
+#include <algorithm>
+#include <numeric>
 #include <iostream>
 
+#include "radix_sort.h"
+
 template <size_t D>
 SecondaryBTreeIndex<D>::SecondaryBTreeIndex(size_t dim)
-    : SecondaryIndexer<D>(dim), use_index_subset_(false), btree_() {}
+    : SecondaryIndexer<D>(dim), use_index_subset_(false), keys_(), rows_(), unique_keys_(0) {}
 
 template <size_t D>
-std::vector<size_t> SecondaryBTreeIndex<D>::Matches(const Query<D>& q) const {
-    std::vector<size_t> idxs;
+MatchResult SecondaryBTreeIndex<D>::Matches(const Query<D>& q) const {
     auto filter = q.filters[this->column_];
     if (!filter.present) {
-        std::vector<size_t> idxs(data_size_);
-        std::iota(idxs.begin(), idxs.end(), 0);
-        return idxs;
+        return MatchResult::Universe(data_size_);
     }
-    if (filter.is_range) {
-        for (ScalarRange r : filter.ranges) {
-            auto startit = btree_.lower_bound(r.first);
-            auto endit = btree_.upper_bound(r.second);
-            for (auto it = startit; it != endit; it++) {
-                idxs.push_back(it->second);
+    // The matches are copied out at the width the rows are stored in.
+    return rows_.Visit([&](const auto& rows) {
+        std::decay_t<decltype(rows)> idxs;
+        auto add_matches = [&](Scalar low, Scalar high) {
+            auto startit = std::lower_bound(keys_.begin(), keys_.end(), low);
+            auto endit = std::upper_bound(startit, keys_.end(), high);
+            idxs.insert(idxs.end(), rows.begin() + (startit - keys_.begin()),
+                    rows.begin() + (endit - keys_.begin()));
+        };
+        if (filter.is_range) {
+            for (ScalarRange r : filter.ranges) {
+                add_matches(r.first, r.second);
             }
         }
-    }
-    else {
-        for (Scalar val : filter.values) {
-            auto startit = btree_.lower_bound(val);
-            auto endit = btree_.upper_bound(val);
-            for (auto it = startit; it != endit; it++) {
-                idxs.push_back(it->second);
+        else {
+            for (Scalar val : filter.values) {
+                add_matches(val, val);
             }
         }
-    }
-    // Leave these unsorted for now. Anyone using them can sort if necessary.
-    return idxs;
+        // Leave these unsorted for now. Anyone using them can sort if necessary.
+        return MatchResult::FromList(std::move(idxs));
+    });
 }
 
 template <size_t D>
 void SecondaryBTreeIndex<D>::Init(ConstPointIterator<D> start, ConstPointIterator<D> end) {
     data_size_ = std::distance(start, end);
-    if (!use_index_subset_) {
-        size_t i = 0;
-        for (auto it = start; it != end; it++, i++) {
-            btree_.insert(std::make_pair((*it)[this->column_], i));
-        }
-    } else {
-        std::cout << "Using provided index list to load B+ tree" << std::endl;
-        for (size_t ix : index_subset_) {
-            btree_.insert(std::make_pair((*(start+ix))[this->column_], ix));
+    rows_.Reset(data_size_);
+    rows_.Visit([&](auto& rows) {
+        if (!use_index_subset_) {
+            keys_.resize(data_size_);
+            rows.resize(data_size_);
+            #pragma omp parallel for schedule(static)
+            for (size_t i = 0; i < data_size_; i++) {
+                keys_[i] = (*(start + i))[this->column_];
+                rows[i] = i;
+            }
+        } else {
+            std::cout << "Using provided index list to load B+ tree" << std::endl;
+            keys_.resize(index_subset_.size());
+            rows.assign(index_subset_.begin(), index_subset_.end());
+            #pragma omp parallel for schedule(static)
+            for (size_t i = 0; i < rows.size(); i++) {
+                keys_[i] = (*(start + rows[i]))[this->column_];
+            }
+            index_subset_.clear();
+            index_subset_.shrink_to_fit();
         }
-        index_subset_.clear();
+        RadixSort::Sort(keys_, rows);
+    });
+    unique_keys_ = keys_.empty() ? 0 : 1;
+    for (size_t i = 1; i < keys_.size(); i++) {
+        unique_keys_ += keys_[i] != keys_[i-1];
     }
-    std::cout << "SecondaryBTreeIndex on " << this->column_ << " loaded " << btree_.size() << " points"
-        << " and total size " << Size() << std::endl;
+    std::cout << "SecondaryBTreeIndex on " << this->column_ << " loaded " << keys_.size() << " points"
+        << " (" << unique_keys_ << " unique), " << (rows_.IsNarrow() ? 32 : 64)
+        << "-bit row ids and total size " << Size() << std::endl;
 }
-
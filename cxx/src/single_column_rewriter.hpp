@@ -5,13 +5,14 @@
 #include <string>
 #include <sstream>
 #include <algorithm>
-#include <set>
+#include <limits>
 
 #include "utils.h"
 
 template <size_t D>
 SingleColumnRewriter<D>::SingleColumnRewriter(const std::string& filename) 
-    : cmap_continuous_(), cmap_categorical_(), mapped_dim_(), target_dim_() {
+    : bucket_ends_(), range_offsets_(1, 0), ranges_(), node_offsets_(), node_ranges_(),
+      values_(), value_offsets_(1, 0), value_targets_(), mapped_dim_(), target_dim_() {
     Load(filename);
 }
 
@@ -89,10 +90,81 @@ void SingleColumnRewriter<D>::LoadContinuous(std::istream& file) {
             }
         }
         prev_bucket_end = bucket_end;
-        assert(cmap_continuous_.upper_bound(bucket_end) == cmap_continuous_.end());
-        cmap_continuous_[bucket_end] = ranges;
+        bucket_ends_.push_back(bucket_end);
+        ranges_.insert(ranges_.end(), ranges.begin(), ranges.end());
+        range_offsets_.push_back(ranges_.size());
+    }
+    BuildTree();
+    std::cout << "Rewriter has " << bucket_ends_.size() << " mapping entries" << std::endl;
+}
+
+template <size_t D>
+std::pair<const ScalarRange*, const ScalarRange*> SingleColumnRewriter<D>::Node(size_t k) const {
+    size_t n = bucket_ends_.size();
+    if (k >= n) {
+        return {ranges_.data() + range_offsets_[k - n], ranges_.data() + range_offsets_[k - n + 1]};
+    }
+    return {node_ranges_.data() + node_offsets_[k], node_ranges_.data() + node_offsets_[k + 1]};
+}
+
+template <size_t D>
+void SingleColumnRewriter<D>::BuildTree() {
+    size_t n = bucket_ends_.size();
+    // Children have higher numbers than their parent, so nodes are filled from n - 1 down and
+    // flattened once they're all known.
+    std::vector<std::vector<ScalarRange>> nodes(n);
+    auto node = [&](size_t k) {
+        if (k >= n) {
+            auto span = Node(k);
+            return std::vector<ScalarRange>(span.first, span.second);
+        }
+        return nodes[k];
+    };
+    for (size_t k = n - 1; k >= 1 && k < n; k--) {
+        nodes[k] = UnionSortedRanges(node(2 * k), node(2 * k + 1));
+    }
+    node_offsets_.assign(n + 1, 0);
+    node_ranges_.clear();
+    for (size_t k = 0; k < n; k++) {
+        node_ranges_.insert(node_ranges_.end(), nodes[k].begin(), nodes[k].end());
+        node_offsets_[k + 1] = node_ranges_.size();
+    }
+}
+
+template <size_t D>
+void SingleColumnRewriter<D>::BucketRanges(size_t lo, size_t hi,
+        std::vector<ScalarRange>* out) const {
+    out->clear();
+    // The nodes covering [lo, hi], at most two per level.
+    size_t n = bucket_ends_.size();
+    std::vector<std::pair<const ScalarRange*, const ScalarRange*>> lists;
+    for (size_t l = lo + n, r = hi + 1 + n; l < r; l >>= 1, r >>= 1) {
+        if (l & 1) {
+            lists.push_back(Node(l++));
+        }
+        if (r & 1) {
+            lists.push_back(Node(--r));
+        }
+    }
+    // Merge them by start with a heap, coalescing as ranges come out.
+    auto later = [](const auto& a, const auto& b) { return a.first->first > b.first->first; };
+    lists.erase(std::remove_if(lists.begin(), lists.end(),
+                [](const auto& l) { return l.first == l.second; }), lists.end());
+    std::make_heap(lists.begin(), lists.end(), later);
+    while (!lists.empty()) {
+        std::pop_heap(lists.begin(), lists.end(), later);
+        ScalarRange r = *lists.back().first++;
+        if (lists.back().first == lists.back().second) {
+            lists.pop_back();
+        } else {
+            std::push_heap(lists.begin(), lists.end(), later);
+        }
+        if (!out->empty() && r.first <= out->back().second) {
+            out->back().second = std::max(out->back().second, r.second);
+        } else {
+            out->push_back(r);
+        }
     }
-    std::cout << "Rewriter has " << cmap_continuous_.size() << " mapping entries" << std::endl;
 }
 
 /**
@@ -105,7 +177,6 @@ void SingleColumnRewriter<D>::LoadContinuous(std::istream& file) {
  */
 template <size_t D>
 void SingleColumnRewriter<D>::LoadCategorical(std::istream& file) {
-    size_t num_entries = 0;
     // These getlines make sure we discard the newline after each line when parsing.
     std::string line;
     std::getline(file, line);
@@ -115,6 +186,7 @@ void SingleColumnRewriter<D>::LoadCategorical(std::istream& file) {
     assert (mapped_dim_ != target_dim_
            && mapped_dim_ < D && target_dim_ < D);
     
+    std::vector<std::pair<Scalar, std::vector<Scalar>>> entries;
     while (!file.eof()) {
         std::getline(file, line);
         if (line.empty()) {
@@ -133,11 +205,20 @@ void SingleColumnRewriter<D>::LoadCategorical(std::istream& file) {
         while (liness >> target_val) {
             targets.push_back(target_val);
         }
-        assert (cmap_categorical_.find(mapped_val) == cmap_categorical_.end());
         assert (targets.size() == num_targets);
-        cmap_categorical_[mapped_val] = targets;
+        std::sort(targets.begin(), targets.end());
+        targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+        entries.emplace_back(mapped_val, std::move(targets));
+    }
+    std::sort(entries.begin(), entries.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (auto& e : entries) {
+        assert (values_.empty() || e.first > values_.back());
+        values_.push_back(e.first);
+        value_targets_.insert(value_targets_.end(), e.second.begin(), e.second.end());
+        value_offsets_.push_back(value_targets_.size());
     }
-    std::cout << "Rewriter has " << cmap_categorical_.size() << " mapping entries" << std::endl;
+    std::cout << "Rewriter has " << values_.size() << " mapping entries" << std::endl;
 }
 
 template <size_t D>
@@ -147,7 +228,6 @@ std::vector<ScalarRange> SingleColumnRewriter<D>::UnionSortedRanges(const std::v
     std::vector<ScalarRange> final_ranges;
     size_t i = 0, j = 0;
     size_t count = 0;
-    Scalar cur_first = first[0].first, cur_second = second[0].first;
     bool i_start = true, j_start = true;
     bool in_range = false;
     ScalarRange cur_range;
@@ -212,7 +292,6 @@ std::vector<ScalarRange> SingleColumnRewriter<D>::IntersectSortedRanges(const st
     std::vector<ScalarRange> final_ranges;
     size_t i = 0, j = 0;
     size_t count = 0;
-    Scalar cur_first = first[0].first, cur_second = second[0].first;
     bool i_start = true, j_start = true;
     bool in_range = false;
     ScalarRange cur_range;
@@ -274,14 +353,16 @@ QueryFilter SingleColumnRewriter<D>::RewriteRangeFilter(const QueryFilter& qf_ma
         abort();
     }
     ScalarRange qrange = qf_mapped.ranges[0];
-    auto start = cmap_continuous_.lower_bound(qrange.first);
-    auto end = cmap_continuous_.lower_bound(qrange.second);
-    end++;
-    // For each mapped column, we union the ranges, then intersect it with any existing range in the
-    // target dimension's filter.
+    // Every bucket from the first one ending at or after the start of the query, up to and
+    // including the first one ending at or after its end.
+    size_t lo = std::lower_bound(bucket_ends_.begin(), bucket_ends_.end(), qrange.first)
+        - bucket_ends_.begin();
+    size_t hi = std::lower_bound(bucket_ends_.begin(), bucket_ends_.end(), qrange.second)
+        - bucket_ends_.begin();
+    hi = std::min(hi, bucket_ends_.size() - 1);
     std::vector<ScalarRange> ranges;
-    for (auto it = start; it != end; it++) {
-        ranges = UnionSortedRanges(ranges, it->second);     
+    if (lo <= hi && lo < bucket_ends_.size()) {
+        BucketRanges(lo, hi, &ranges);
     }
     if (qf_target.present) {
         // We don't currently handle mapping from continuous to categorical.
@@ -295,13 +376,17 @@ QueryFilter SingleColumnRewriter<D>::RewriteRangeFilter(const QueryFilter& qf_ma
 template <size_t D>
 QueryFilter SingleColumnRewriter<D>::RewriteValueFilter(const QueryFilter& qf_mapped,
         const QueryFilter& qf_target) const {
-    std::set<Scalar> targets;
+    std::vector<Scalar> targets;
     for (Scalar mval : qf_mapped.values) {
-        auto loc = cmap_categorical_.find(mval);
-        if (loc != cmap_categorical_.end()) {
-            targets.insert(loc->second.begin(), loc->second.end());
+        auto loc = std::lower_bound(values_.begin(), values_.end(), mval);
+        if (loc != values_.end() && *loc == mval) {
+            size_t i = loc - values_.begin();
+            targets.insert(targets.end(), value_targets_.begin() + value_offsets_[i],
+                    value_targets_.begin() + value_offsets_[i + 1]);
         }
     }
+    std::sort(targets.begin(), targets.end());
+    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
     std::vector<Scalar> merged;
     if (!qf_target.present) {
         merged.insert(merged.end(), targets.begin(), targets.end());
@@ -350,7 +435,7 @@ IndexList SingleColumnRewriter<D>::Rewrite(Query<D>& q) {
                     q.filters[mapped_dim_], q.filters[target_dim_]);
         }
     }
-    AssertWithMessage(false, "SingleColumnRewriter does not support auxiliary indexes");
+    // There's no auxiliary index: every row is covered by the mapping.
     return {};
 }
 
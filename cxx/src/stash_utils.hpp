@@ -0,0 +1,69 @@
+#include "stash_utils.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "target_bucket.h"
+#include "utils.h"
+
+template <size_t D>
+std::vector<Scalar> StashUtils::EquiDepthBounds(ConstPointIterator<D> start,
+        ConstPointIterator<D> end, size_t col, size_t num_buckets) {
+    size_t n = std::distance(start, end);
+    std::vector<Scalar> values(n);
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < n; i++) {
+        values[i] = (*(start + i))[col];
+    }
+    std::sort(values.begin(), values.end());
+    std::vector<Scalar> bounds;
+    for (size_t b = 0; b < num_buckets; b++) {
+        Scalar v = values[b * n / num_buckets];
+        // Skip redundant bounds when many points share a value.
+        if (bounds.empty() || v > bounds.back()) {
+            bounds.push_back(v);
+        }
+    }
+    bounds.push_back(values.back() + 1);
+    return bounds;
+}
+
+template <typename K>
+StashUtils::StashResult<K> StashUtils::StashTarget(const K* row_keys, size_t n,
+        float storage_factor) {
+    AssertWithMessage(n <= (size_t)std::numeric_limits<int32_t>::max(),
+            "Target bucket too large for TargetBucket");
+    std::vector<K> sorted_keys(row_keys, row_keys + n);
+    std::sort(sorted_keys.begin(), sorted_keys.end());
+
+    // One TargetBucket entry per mapped bucket, identified by its position in result.keys.
+    StashResult<K> result;
+    std::vector<std::pair<int32_t, int32_t>> counts;
+    for (size_t i = 0; i < n; ) {
+        size_t j = i;
+        while (j < n && sorted_keys[j] == sorted_keys[i]) {
+            j++;
+        }
+        counts.emplace_back(result.keys.size(), j - i);
+        result.keys.push_back(sorted_keys[i]);
+        i = j;
+    }
+    TargetBucket tb(storage_factor);
+    tb.AddPointsBatch(counts);
+    result.inlier.resize(counts.size());
+    bool has_outliers = false;
+    for (size_t c = 0; c < counts.size(); c++) {
+        result.inlier[c] = !tb.buckets_[tb.Find(c)].is_outlier;
+        has_outliers |= !result.inlier[c];
+    }
+    if (has_outliers) {
+        for (size_t i = 0; i < n; i++) {
+            size_t c = std::lower_bound(result.keys.begin(), result.keys.end(), row_keys[i])
+                - result.keys.begin();
+            if (!result.inlier[c]) {
+                result.outliers.push_back(i);
+            }
+        }
+    }
+    return result;
+}
@@ -1,4 +1,4 @@
-#include "linear_model_rewriter.h"
+#include "trs_tree_rewriter.h"
 
 #include <iostream>
 #include <fstream>
@@ -9,6 +9,7 @@
 #include "types.h"
 #include "file_utils.h"
 #include "utils.h"
+#include "radix_sort.h"
 
 const std::string HERMIT_OUTLIER_FILEBASE = "hermit_outliers";
 
@@ -16,48 +17,43 @@ const std::string HERMIT_OUTLIER_FILEBASE = "hermit_outliers";
 template <size_t D>
 TRSTreeRewriter<D>::TRSTreeRewriter(size_t mapped, size_t target)
     : mapped_dim_(mapped), target_dim_(target),
-      trs_root_(std::make_unique<TRSNode>(2, 0.1, 8, 0, 10)) {
+      trs_root_(std::make_unique<TRSNode>(2, 0.1, 8, 0, 10)), flat_trs_(), trs_ranges_(),
+      lookup_ranges_() {
 }
 
 template <size_t D>
 void TRSTreeRewriter<D>::Init(ConstPointIterator<D> start, ConstPointIterator<D> end) {
     // Get the list of x and y.
     data_size_ = std::distance(start, end);
-    std::vector<std::pair<int32_t, std::pair<Scalar, Scalar>>> corr(data_size_);
+    std::vector<Scalar> xs(data_size_);
+    std::vector<size_t> sort_indices(data_size_);
+    #pragma omp parallel for schedule(static)
     for (size_t i = 0; i < data_size_; i++) {
-        const Point<D> pt = *(start + i);
-        corr[i] = std::make_pair(i, std::make_pair(pt[mapped_dim_], pt[target_dim_]));
+        xs[i] = (*(start + i))[mapped_dim_];
+        sort_indices[i] = i;
     }
     // Sort by mapped dimension.
-    std::sort(corr.begin(), corr.end(), [] (const auto& lhs, const auto& rhs) {
-            return lhs.second.first < rhs.second.first;
-            });
-
-    std::vector<int32_t> sort_indices(data_size_);
-    std::transform(corr.begin(), corr.end(), sort_indices.begin(), [] (const auto& item) {
-            return item.first;
-            });
-    std::vector<Scalar> xs(data_size_);
+    RadixSort::Sort(xs, sort_indices);
     std::vector<Scalar> ys(data_size_);
-    std::transform(corr.begin(), corr.end(), xs.begin(), [] (const auto& pair) {
-            return pair.second.first;
-            });
-    std::transform(corr.begin(), corr.end(), ys.begin(), [] (const auto& pair) {
-            return pair.second.second;
-            });
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < data_size_; i++) {
+        ys[i] = (*(start + sort_indices[i]))[target_dim_];
+    }
     
     // Normalizes error bound.
     //trs_root_->err_bound = 2. *  sqrt(data_size_ / 4208260.);
     std::cout << "Building TRS Tree from dim " << mapped_dim_ << " to " << target_dim_ << std::endl;
     IndexList trs_outliers = trs_root_->Build(xs, ys, 0, data_size_);
     IndexList outliers(trs_outliers.size());
-    std::transform(trs_outliers.begin(), trs_outliers.end(), outliers.begin(), [&sort_indices] (const auto& ix) {
-            return sort_indices[ix];
-            });
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < trs_outliers.size(); i++) {
+        outliers[i] = sort_indices[trs_outliers[i]];
+    }
     WriteOutliers(outliers);
+    flat_trs_.Compile(*trs_root_);
     auto nodes = trs_root_->Nodes();
     std::cout << "Built TRS Tree with " << nodes.first << " nodes (" << nodes.second
-        << " leaves) and size " << trs_root_->Size() << std::endl;
+        << " leaves) and size " << flat_trs_.Size() << std::endl;
     outlier_index_->SetIndexList(outliers); 
     outlier_index_->Init(start, end);
 }
@@ -73,30 +69,52 @@ void TRSTreeRewriter<D>::WriteOutliers(const IndexList& outliers) {
     output.close();
 }
 
+template <size_t D>
+const std::vector<ScalarRange>& TRSTreeRewriter<D>::TargetRanges(
+        const std::vector<ScalarRange>& mapped_ranges) {
+    if (mapped_ranges.size() == 1) {
+        flat_trs_.Lookup(mapped_ranges[0], &trs_ranges_);
+        return trs_ranges_;
+    }
+    std::vector<ScalarRange> all;
+    for (ScalarRange r : mapped_ranges) {
+        flat_trs_.Lookup(r, &lookup_ranges_);
+        all.insert(all.end(), lookup_ranges_.begin(), lookup_ranges_.end());
+    }
+    trs_ranges_.clear();
+    if (!all.empty()) {
+        std::sort(all.begin(), all.end(), ScalarRangeStartComp{});
+        trs_ranges_ = MergeUtils::Coalesce(all.begin(), all.end());
+    }
+    return trs_ranges_;
+}
+
+template <size_t D>
+IndexList TRSTreeRewriter<D>::Outliers(const Query<D>& q) const {
+    if (outlier_index_) {
+        return outlier_index_->Matches(q).ToList();
+    }
+    return {};
+}
+
 template <size_t D>
 IndexList TRSTreeRewriter<D>::Rewrite(Query<D>& q) {
     if (!q.filters[mapped_dim_].present) {
         return {};
     }
     assert (q.filters[mapped_dim_].is_range);
-    Scalar start = q.filters[mapped_dim_].ranges[0].first;
-    Scalar end = q.filters[mapped_dim_].ranges[0].second;
-    
-    std::vector<ScalarRange> trs_ranges;
-    trs_root_->Lookup(ScalarRange{start, end}, &trs_ranges);
+    TargetRanges(q.filters[mapped_dim_].ranges);
     // Intersect this with the existing ranges in the filter.
     QueryFilter target_qf = q.filters[target_dim_];
     if (target_qf.present) {
         assert (target_qf.is_range && target_qf.ranges.size() == 1);
         std::vector<ScalarRange> existing = {target_qf.ranges[0]};
-        trs_ranges = MergeUtils::Intersect(trs_ranges, existing);
+        q.filters[target_dim_].ranges = MergeUtils::Intersect(trs_ranges_, existing);
+    } else {
+        q.filters[target_dim_] = {.present = true, .is_range = true};
+        q.filters[target_dim_].ranges.assign(trs_ranges_.begin(), trs_ranges_.end());
     }
-    q.filters[target_dim_] = {.present = true, .is_range=true,
-        .ranges = trs_ranges};
 
-    if (outlier_index_) {
-        return outlier_index_->Matches(q);
-    }
-    return {};
+    return Outliers(q);
 }
 
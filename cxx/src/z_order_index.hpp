@@ -0,0 +1,242 @@
+#include "z_order_index.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stack>
+#include <iostream>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+#include "radix_sort.h"
+#include "permutation_utils.h"
+
+template <size_t D>
+ZOrderIndex<D>::ZOrderIndex(std::vector<size_t>& index_dims, size_t page_size) :
+        index_dims_(index_dims),
+        page_size_(page_size),
+        data_size_(0),
+        bits_per_dim_(std::min<size_t>(63, 64 / index_dims.size())),
+        mins_(index_dims.size()),
+        maxs_(index_dims.size()),
+        shifts_(index_dims.size()),
+        dim_masks_(index_dims.size(), 0),
+        page_keys_() {
+    AssertWithMessage(!index_dims.empty() && index_dims.size() <= 64,
+            "ZOrderIndex needs between 1 and 64 indexed dimensions");
+    assert (page_size > 0);
+    size_t k = index_dims_.size();
+    for (size_t i = 0; i < k; i++) {
+        for (size_t j = 0; j < bits_per_dim_; j++) {
+            dim_masks_[i] |= 1ULL << (j * k + (k - 1 - i));
+        }
+    }
+}
+
+template <size_t D>
+uint64_t ZOrderIndex<D>::Encode(const std::vector<uint64_t>& cell) const {
+    uint64_t z = 0;
+    for (size_t i = 0; i < index_dims_.size(); i++) {
+#ifdef __BMI2__
+        z |= _pdep_u64(cell[i], dim_masks_[i]);
+#else
+        uint64_t mask = dim_masks_[i];
+        uint64_t c = cell[i];
+        while (mask && c) {
+            uint64_t lowest = mask & -mask;
+            if (c & 1) {
+                z |= lowest;
+            }
+            c >>= 1;
+            mask ^= lowest;
+        }
+#endif
+    }
+    return z;
+}
+
+template <size_t D>
+uint64_t ZOrderIndex<D>::CellFor(size_t i, Scalar val) const {
+    val = std::max(mins_[i], std::min(maxs_[i], val));
+    return ((uint64_t)val - (uint64_t)mins_[i]) >> shifts_[i];
+}
+
+template <size_t D>
+void ZOrderIndex<D>::Init(PointIterator<D> start, PointIterator<D> end) {
+    size_t k = index_dims_.size();
+    data_size_ = std::distance(start, end);
+    for (size_t i = 0; i < k; i++) {
+        mins_[i] = std::numeric_limits<Scalar>::max();
+        maxs_[i] = std::numeric_limits<Scalar>::lowest();
+    }
+    for (auto it = start; it != end; it++) {
+        for (size_t i = 0; i < k; i++) {
+            mins_[i] = std::min(mins_[i], (*it)[index_dims_[i]]);
+            maxs_[i] = std::max(maxs_[i], (*it)[index_dims_[i]]);
+        }
+    }
+    // Use the smallest shift that fits each dimension's value range in bits_per_dim_ bits.
+    for (size_t i = 0; i < k && data_size_ > 0; i++) {
+        uint64_t range = (uint64_t)maxs_[i] - (uint64_t)mins_[i];
+        shifts_[i] = 0;
+        while (shifts_[i] < 64 && (range >> shifts_[i]) >= (1ULL << bits_per_dim_)) {
+            shifts_[i]++;
+        }
+    }
+    std::cout << "Building ZOrderIndex with page size " << page_size_
+        << " and " << bits_per_dim_ << " bits per dimension on dimensions: ";
+    for (size_t i : index_dims_) {
+        std::cout << i << " ";
+    }
+    std::cout << std::endl;
+
+    std::vector<uint64_t> keys(data_size_);
+    std::vector<size_t> order(data_size_);
+    #pragma omp parallel
+    {
+        std::vector<uint64_t> cell(k);
+        #pragma omp for schedule(static)
+        for (size_t r = 0; r < data_size_; r++) {
+            const Point<D>& p = *(start + r);
+            for (size_t i = 0; i < k; i++) {
+                cell[i] = CellFor(i, p[index_dims_[i]]);
+            }
+            keys[r] = Encode(cell);
+            order[r] = r;
+        }
+    }
+    RadixSort::Sort(keys, order);
+
+    page_keys_.clear();
+    for (size_t r = 0; r < data_size_; r += page_size_) {
+        page_keys_.push_back(keys[r]);
+    }
+    if (data_size_ > 0) {
+        page_keys_.push_back(keys.back());
+    }
+    std::vector<uint64_t>().swap(keys);
+
+    PermutationUtils::ApplyParallel(start, order);
+    std::cout << "ZOrderIndex has " << (page_keys_.empty() ? 0 : page_keys_.size() - 1)
+        << " pages" << std::endl;
+}
+
+template <size_t D>
+bool ZOrderIndex<D>::QueryBox(const Query<D>& query, CellBox* box) const {
+    size_t k = index_dims_.size();
+    box->lo.resize(k);
+    box->hi.resize(k);
+    for (size_t i = 0; i < k; i++) {
+        const QueryFilter& qf = query.filters[index_dims_[i]];
+        Scalar low = mins_[i];
+        Scalar high = maxs_[i];
+        if (qf.present) {
+            if (qf.is_range) {
+                if (qf.ranges.empty()) {
+                    return false;
+                }
+                // Multiple ranges are covered by their hull.
+                low = qf.ranges[0].first;
+                high = qf.ranges[0].second;
+                for (const ScalarRange& r : qf.ranges) {
+                    low = std::min(low, r.first);
+                    high = std::max(high, r.second);
+                }
+            } else {
+                if (qf.values.empty()) {
+                    return false;
+                }
+                low = qf.values.front();
+                high = qf.values.back();
+            }
+        }
+        if (low > high || high < mins_[i] || low > maxs_[i]) {
+            return false;
+        }
+        box->lo[i] = CellFor(i, low);
+        box->hi[i] = CellFor(i, high);
+    }
+    return true;
+}
+
+template <size_t D>
+bool ZOrderIndex<D>::IsContiguous(const CellBox& box, uint64_t zlo, uint64_t zhi) const {
+    unsigned __int128 volume = 1;
+    for (size_t i = 0; i < index_dims_.size(); i++) {
+        volume *= (unsigned __int128)(box.hi[i] - box.lo[i]) + 1;
+    }
+    return (unsigned __int128)(zhi - zlo) + 1 == volume;
+}
+
+template <size_t D>
+PhysicalIndexRange ZOrderIndex<D>::RowsFor(uint64_t zlo, uint64_t zhi) const {
+    if (page_keys_.empty() || zlo > page_keys_.back() || zhi < page_keys_.front()) {
+        return {0, 0};
+    }
+    auto first = page_keys_.begin();
+    auto last = page_keys_.end() - 1;
+    // The page before the first one starting at or after zlo may still end with zlo.
+    size_t start_page = std::lower_bound(first, last, zlo) - first;
+    if (start_page > 0) {
+        start_page--;
+    }
+    // No key <= zhi is stored at or after the first page starting after zhi.
+    size_t end_page = std::upper_bound(first, last, zhi) - first;
+    return {start_page * page_size_, std::min(end_page * page_size_, data_size_)};
+}
+
+template <size_t D>
+PhysicalIndexSet ZOrderIndex<D>::Ranges(Query<D>& query) {
+    bool index_relevant = false;
+    for (size_t dim : index_dims_) {
+        index_relevant |= query.filters[dim].present;
+    }
+    if (!index_relevant) {
+        return {{{0, data_size_}}, {}};
+    }
+    CellBox box;
+    if (!QueryBox(query, &box)) {
+        return {{}, {}};
+    }
+    size_t k = index_dims_.size();
+    IndexRangeList ranges;
+    size_t num_intervals = 0;
+    std::stack<CellBox> boxes;
+    boxes.push(box);
+    while (!boxes.empty()) {
+        CellBox cur = boxes.top();
+        boxes.pop();
+        uint64_t zlo = Encode(cur.lo);
+        uint64_t zhi = Encode(cur.hi);
+        PhysicalIndexRange rows = RowsFor(zlo, zhi);
+        if (rows.end <= rows.start) {
+            continue;
+        }
+        // Stop splitting once the interval fits in one page, is entirely inside the box, or the
+        // interval budget is spent.
+        if (rows.end - rows.start <= page_size_ || IsContiguous(cur, zlo, zhi)
+                || num_intervals + boxes.size() >= MAX_INTERVALS) {
+            num_intervals++;
+            // Intervals come out in increasing Z order, so the rows only need merging with the
+            // last range.
+            if (!ranges.empty() && rows.start <= ranges.back().end) {
+                ranges.back().end = std::max(ranges.back().end, rows.end);
+            } else {
+                ranges.push_back(rows);
+            }
+            continue;
+        }
+        // Split at the most significant bit where the corners differ. The lower half ends at
+        // LITMAX and the upper half starts at BIGMIN.
+        size_t pos = 63 - __builtin_clzll(zlo ^ zhi);
+        size_t i = k - 1 - pos % k;
+        size_t level = pos / k;
+        uint64_t split = (cur.hi[i] >> level) << level;
+        CellBox upper = cur;
+        upper.lo[i] = split;
+        cur.hi[i] = split - 1;
+        boxes.push(upper);
+        boxes.push(cur);
+    }
+    return {ranges, {}};
+}
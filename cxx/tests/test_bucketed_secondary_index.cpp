@@ -0,0 +1,98 @@
+#include "gtest/gtest.h"
+#include "bucketed_secondary_index.h"
+#include <random>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+namespace test {
+
+    const size_t TESTD = 2;
+    class BucketedSecondaryIndexTest : public ::testing::Test {
+        public:
+        vector<Point<TESTD>> RandomPoints(size_t n, Scalar maxval) {
+            std::default_random_engine gen(1);
+            std::uniform_int_distribution<Scalar> dist(0, maxval);
+            vector<Point<TESTD>> pts(n);
+            for (size_t i = 0; i < n; i++) {
+                pts[i] = {dist(gen), 0};
+            }
+            return pts;
+        }
+
+        std::vector<size_t> BruteForce(const vector<Point<TESTD>>& pts,
+                const std::vector<ScalarRange>& ranges, size_t step = 1) {
+            std::vector<size_t> want;
+            for (size_t i = 0; i < pts.size(); i += step) {
+                for (auto r : ranges) {
+                    if (pts[i][0] >= r.first && pts[i][0] <= r.second) {
+                        want.push_back(i);
+                        break;
+                    }
+                }
+            }
+            return want;
+        }
+
+        MatchResult Match(const BucketedSecondaryIndex<TESTD>& index,
+                const std::vector<ScalarRange>& ranges) {
+            Query<TESTD> q;
+            q.filters[0] = {.present = true, .is_range = true, .ranges = ranges};
+            q.filters[1] = {.present = false};
+            return index.Matches(q);
+        }
+    };
+
+    TEST_F(BucketedSecondaryIndexTest, TestWithoutFilter) {
+        auto pts = RandomPoints(1000, 100);
+        BucketedSecondaryIndex<TESTD> index(0);
+        index.SetBucketWidth(10);
+        index.Init(pts.begin(), pts.end());
+        Query<TESTD> q;
+        q.filters[0] = {.present = false};
+        q.filters[1] = {.present = true, .is_range = true, .ranges = {{0, 0}}};
+        EXPECT_TRUE(index.Matches(q).IsUniverse());
+    }
+
+    TEST_F(BucketedSecondaryIndexTest, TestMatchesAreExactAndSorted) {
+        // Wide buckets give dense blocks, narrow ones give sparse blocks merged row by row.
+        auto pts = RandomPoints(300000, 100000);
+        for (Scalar width : {20000, 100}) {
+            BucketedSecondaryIndex<TESTD> index(0);
+            index.SetBucketWidth(width);
+            index.Init(pts.begin(), pts.end());
+            std::vector<std::vector<ScalarRange>> queries = {
+                {{0, 19999}},
+                {{5, 7}},
+                {{150, 60123}},
+                {{-100, 200000}},
+                {{1000, 1500}, {1400, 2600}, {90000, 90001}},
+                {{200001, 300000}},
+            };
+            for (const auto& ranges : queries) {
+                MatchResult got = Match(index, ranges);
+                EXPECT_EQ(got.kind, MatchResult::SORTED_LIST);
+                EXPECT_EQ(got.ToList(), BruteForce(pts, ranges)) << "width " << width;
+            }
+        }
+    }
+
+    TEST_F(BucketedSecondaryIndexTest, TestIndexSubset) {
+        auto pts = RandomPoints(50000, 1000);
+        IndexList subset;
+        for (size_t i = 0; i < pts.size(); i += 7) {
+            subset.push_back(i);
+        }
+        BucketedSecondaryIndex<TESTD> index(0, subset);
+        index.SetBucketWidth(64);
+        index.Init(pts.begin(), pts.end());
+        std::vector<ScalarRange> ranges = {{10, 500}};
+        EXPECT_EQ(Match(index, ranges).ToList(), BruteForce(pts, ranges, 7));
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
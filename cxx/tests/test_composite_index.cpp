@@ -3,7 +3,12 @@
 
 #include "secondary_btree_index.h"
 #include "primary_btree_index.h"
+#include "grid_correlation_index.h"
+#include "piecewise_linear_rewriter.h"
+#include <random>
 #include <vector>
+#include <fstream>
+#include <cstdio>
 
 using namespace std;
 
@@ -36,6 +41,65 @@ namespace test {
         }
     };
 
+    const size_t MIXD = 4;
+    // Column 0 is sorted by the primary index. Column 1 follows it loosely, column 2 is
+    // independent of it and column 3 is a noisy line over it.
+    class MixedCompositeIndexTest : public ::testing::Test {
+        public:
+        void SetUp() override {
+            std::default_random_engine gen(17);
+            std::uniform_int_distribution<Scalar> noise(0, 4);
+            std::uniform_int_distribution<Scalar> independent(0, 999);
+            for (Scalar i = 0; i < 100000; i++) {
+                Scalar a = (i * 7919) % 100000;
+                pts_.push_back({a, a / 10 + noise(gen), independent(gen), 2 * a + noise(gen)});
+            }
+        }
+
+        static bool Contains(const PhysicalIndexSet& s, size_t i) {
+            for (const auto& r : s.ranges) {
+                if (i >= r.start && i < r.end) {
+                    return true;
+                }
+            }
+            return std::binary_search(s.list.begin(), s.list.end(), i);
+        }
+
+        static size_t Count(const PhysicalIndexSet& s) {
+            size_t n = s.list.size();
+            for (const auto& r : s.ranges) {
+                n += r.end - r.start;
+            }
+            return n;
+        }
+
+        // Every row matching the original query is in the result, and the result is no larger
+        // than max_rows.
+        void ExpectCovers(const PhysicalIndexSet& s, const Query<MIXD>& q, size_t max_rows) {
+            for (size_t i = 0; i < pts_.size(); i++) {
+                bool match = true;
+                for (size_t c = 0; c < MIXD; c++) {
+                    const QueryFilter& qf = q.filters[c];
+                    if (!qf.present) {
+                        continue;
+                    }
+                    if (qf.is_range) {
+                        match &= pts_[i][c] >= qf.ranges[0].first && pts_[i][c] <= qf.ranges[0].second;
+                    } else {
+                        match &= std::find(qf.values.begin(), qf.values.end(), pts_[i][c])
+                            != qf.values.end();
+                    }
+                }
+                if (match) {
+                    ASSERT_TRUE(Contains(s, i)) << "row " << i;
+                }
+            }
+            EXPECT_LE(Count(s), max_rows);
+        }
+
+        vector<Point<MIXD>> pts_;
+    };
+
     TEST_F(CompositeIndexTest, TestInitWithPrimary) {
         auto pts = ValuesToPoints({10, 6, 6, 7, 8, 2, 3, 5, 1, 2, 9, 4});
         auto pindex = std::make_unique<PrimaryBTreeIndex<TESTD>>(0, 1);
@@ -90,9 +154,18 @@ namespace test {
         Query<TESTD> q;
         q.filters[0] = {.present = false};
         q.filters[1] = {.present = true, .is_range = false, .ranges = {}, .values = {1, 2}};
+        // On 12 rows, scanning the 3 secondary matches at random costs more than scanning
+        // everything, so the plan leaves the filter to the scan unless it's forced.
         std::vector<PhysicalIndexRange> ranges = index.Ranges(q).ranges;
-        std::vector<PhysicalIndexRange> want = {{5, 6}, {8, 10}};
+        std::vector<PhysicalIndexRange> want = {{0, 12}};
+        EXPECT_TRUE(ArrayEqual(ranges, want));
+        EXPECT_EQ(index.LastPlan(), "primary");
+
+        index.ForcePlan({"secondary_1"});
+        ranges = index.Ranges(q).ranges;
+        want = {{5, 6}, {8, 10}};
         EXPECT_TRUE(ArrayEqual(ranges, want));
+        EXPECT_EQ(index.LastPlan(), "primary+secondary_1");
     }
     
     TEST_F(CompositeIndexTest, TestRangesWithPrimaryIndexButSecondaryFilter) {
@@ -108,9 +181,11 @@ namespace test {
         Query<TESTD> q;
         q.filters[0] = {.present = false};
         q.filters[1] = {.present = true, .is_range = false, .ranges = {}, .values = {1, 2}};
+        index.ForcePlan({"secondary_1"});
         std::vector<PhysicalIndexRange> ranges = index.Ranges(q).ranges;
         std::vector<PhysicalIndexRange> want = {{0, 3}};
         EXPECT_TRUE(ArrayEqual(ranges, want));
+        EXPECT_EQ(index.LastPlan(), "primary+secondary_1");
     }
     
     TEST_F(CompositeIndexTest, TestRangesRelevantPrimaryFilter) {
@@ -144,9 +219,11 @@ namespace test {
         Query<TESTD> q;
         q.filters[0] = {.present = true, .is_range = false, .ranges = {}, .values = {2, 3, 4, 5}};
         q.filters[1] = {.present = true, .is_range = false, .ranges = {}, .values = {1, 2, 5}};
+        index.ForcePlan({"secondary_1"});
         std::vector<PhysicalIndexRange> ranges = index.Ranges(q).ranges;
         std::vector<PhysicalIndexRange> want = {{1, 3}, {5, 6}};
         EXPECT_TRUE(ArrayEqual(ranges, want));
+        EXPECT_EQ(index.LastPlan(), "primary+secondary_1");
     }
     
     TEST_F(CompositeIndexTest, TestRangesWithLargerGapThreshold) {
@@ -162,6 +239,7 @@ namespace test {
         Query<TESTD> q;
         q.filters[0] = {.present = true, .is_range = false, .ranges = {}, .values = {2, 3, 4, 5}};
         q.filters[1] = {.present = true, .is_range = false, .ranges = {}, .values = {1, 2, 3, 5}};
+        index.ForcePlan({"secondary_1"});
         std::vector<PhysicalIndexRange> ranges = index.Ranges(q).ranges;
         std::vector<PhysicalIndexRange> want = {{1, 4}, {5, 6}};
         EXPECT_TRUE(ArrayEqual(ranges, want));
@@ -172,12 +250,244 @@ namespace test {
         gapIndex.SetPrimaryIndex(std::move(pindex));
         gapIndex.AddSecondaryIndex(std::move(sindex));
         gapIndex.Init(pts.begin(), pts.end());
+        gapIndex.ForcePlan({"secondary_1"});
          
         ranges = gapIndex.Ranges(q).ranges;
         // Even though 4 isn't included in the final output.
         want = {{1, 6}};
         EXPECT_TRUE(ArrayEqual(ranges, want));
     }
+
+    TEST_F(CompositeIndexTest, TestInitBuildsSubIndexesConcurrently) {
+        std::vector<Point<TESTD>> pts;
+        for (Scalar i = 0; i < 100000; i++) {
+            pts.push_back({(i * 7919) % 1000, (i * 104729) % 997});
+        }
+        CompositeIndex<TESTD> index(0);
+        index.SetPrimaryIndex(std::make_unique<PrimaryBTreeIndex<TESTD>>(0, 1));
+        index.AddSecondaryIndex(std::make_unique<SecondaryBTreeIndex<TESTD>>(1));
+        index.AddSecondaryIndex(std::make_unique<SecondaryBTreeIndex<TESTD>>(0));
+        index.Init(pts.begin(), pts.end());
+
+        Query<TESTD> q;
+        q.filters[0] = {.present = false};
+        q.filters[1] = {.present = true, .is_range = false, .ranges = {}, .values = {3, 500}};
+        IndexList got = index.Ranges(q).list;
+        std::sort(got.begin(), got.end());
+        IndexList want;
+        for (size_t i = 0; i < pts.size(); i++) {
+            if (pts[i][1] == 3 || pts[i][1] == 500) {
+                want.push_back(i);
+            }
+        }
+        EXPECT_TRUE(ArrayEqual(got, want));
+
+        std::string statsname = "composite_index_test_stats.out";
+        std::ofstream statsfile(statsname);
+        index.WriteStats(statsfile);
+        statsfile.close();
+        std::ifstream stats(statsname);
+        std::string contents((std::istreambuf_iterator<char>(stats)), std::istreambuf_iterator<char>());
+        std::remove(statsname.c_str());
+        EXPECT_NE(contents.find("primary_build_time_ns: "), std::string::npos);
+        EXPECT_NE(contents.find("build_time_ns_secondary_1: "), std::string::npos);
+        EXPECT_NE(contents.find("build_time_ns_secondary_0: "), std::string::npos);
+    }
+
+    TEST_F(CompositeIndexTest, TestPlanSkipsUnselectiveSecondary) {
+        std::vector<Point<TESTD>> pts;
+        for (Scalar i = 0; i < 100000; i++) {
+            pts.push_back({(i * 7919) % 1000, (i * 104729) % 10});
+        }
+        CompositeIndex<TESTD> index(0);
+        index.AddSecondaryIndex(std::make_unique<SecondaryBTreeIndex<TESTD>>(1));
+        index.Init(pts.begin(), pts.end());
+
+        // Matches 60% of the table, so scanning everything is cheaper.
+        Query<TESTD> q = {};
+        q.filters[1] = {.present = true, .is_range = true, .ranges = {{0, 5}}, .values = {}};
+        PhysicalIndexSet got = index.Ranges(q);
+        EXPECT_EQ(index.LastPlan(), "primary");
+        std::vector<PhysicalIndexRange> want = {{0, pts.size()}};
+        EXPECT_TRUE(ArrayEqual(got.ranges, want));
+
+        q.filters[1] = {.present = true, .is_range = false, .ranges = {}, .values = {3}};
+        got = index.Ranges(q);
+        EXPECT_EQ(index.LastPlan(), "primary+secondary_1");
+        EXPECT_EQ(got.list.size(), pts.size() / 10);
+    }
+
+    TEST_F(CompositeIndexTest, TestPlanAppliesMostSelectiveFirst) {
+        std::vector<Point<TESTD>> pts;
+        for (Scalar i = 0; i < 100000; i++) {
+            pts.push_back({(i * 7919) % 1000, (i * 104729) % 10});
+        }
+        CompositeIndex<TESTD> index(0);
+        index.AddSecondaryIndex(std::make_unique<SecondaryBTreeIndex<TESTD>>(1));
+        index.AddSecondaryIndex(std::make_unique<SecondaryBTreeIndex<TESTD>>(0));
+        index.Init(pts.begin(), pts.end());
+
+        // Column 0 matches 0.2% of the rows, so the index on column 1 isn't worth its lookup.
+        Query<TESTD> q = {};
+        q.filters[0] = {.present = true, .is_range = false, .ranges = {}, .values = {17, 400}};
+        q.filters[1] = {.present = true, .is_range = false, .ranges = {}, .values = {3, 4}};
+        IndexList got = index.Ranges(q).list;
+        EXPECT_EQ(index.LastPlan(), "primary+secondary_0");
+        std::sort(got.begin(), got.end());
+        IndexList want;
+        for (size_t i = 0; i < pts.size(); i++) {
+            if (pts[i][0] == 17 || pts[i][0] == 400) {
+                want.push_back(i);
+            }
+        }
+        EXPECT_TRUE(ArrayEqual(got, want));
+
+        std::string statsname = "composite_index_plan_stats.out";
+        std::ofstream statsfile(statsname);
+        index.WriteStats(statsfile);
+        statsfile.close();
+        std::ifstream stats(statsname);
+        std::string contents((std::istreambuf_iterator<char>(stats)), std::istreambuf_iterator<char>());
+        std::remove(statsname.c_str());
+        EXPECT_NE(contents.find("plan_primary+secondary_0: 1"), std::string::npos);
+    }
+
+    TEST_F(CompositeIndexTest, TestChoosePlan) {
+        using Candidate = CompositeIndex<TESTD>::Candidate;
+        CompositeIndex<TESTD> index(1);
+        // Scanning a quarter of 12 rows at random costs more than scanning all 12 in order.
+        Candidate list = {.name = "s", .selectivity = 0.25, .lookup_cost = 3, .is_list = true};
+        EXPECT_TRUE(index.ChoosePlan(12, false, {list}).empty());
+        // A list of 1% of 100000 rows pays off.
+        list = {.name = "s", .selectivity = 0.01, .lookup_cost = 1000, .is_list = true};
+        EXPECT_EQ(index.ChoosePlan(100000, false, {list}), std::vector<size_t>({0}));
+
+        // Most selective first, and a candidate that no longer lowers the cost is dropped.
+        std::vector<Candidate> candidates = {
+            {.name = "a", .selectivity = 0.1, .lookup_cost = 500, .is_list = false},
+            {.name = "b", .selectivity = 0.01, .lookup_cost = 50, .is_list = false},
+            {.name = "c", .selectivity = 0.5, .lookup_cost = 2500, .is_list = true},
+        };
+        EXPECT_EQ(index.ChoosePlan(100000, false, candidates), std::vector<size_t>({1, 0}));
+
+        // A result that's already a list is scanned at random anyway, so a list that only rules
+        // out 70% of it is worth intersecting.
+        list = {.name = "s", .selectivity = 0.3, .lookup_cost = 300, .is_list = true};
+        EXPECT_TRUE(index.ChoosePlan(1000, false, {list}).empty());
+        EXPECT_EQ(index.ChoosePlan(1000, true, {list}), std::vector<size_t>({0}));
+    }
+
+    TEST_F(MixedCompositeIndexTest, TestCorrelationAndSecondary) {
+        CompositeIndex<MIXD> index(1);
+        index.SetPrimaryIndex(std::make_unique<PrimaryBTreeIndex<MIXD>>(0, 64));
+        index.AddCorrelationIndex(std::make_unique<GridCorrelationIndex<MIXD>>(
+                    std::vector<size_t>({1}), 256, 256, 10.0));
+        index.AddSecondaryIndex(std::make_unique<SecondaryBTreeIndex<MIXD>>(2));
+        index.Init(pts_.begin(), pts_.end());
+
+        Query<MIXD> q = {};
+        q.filters[1] = {.present = true, .is_range = true, .ranges = {{3000, 3500}}, .values = {}};
+        q.filters[2] = {.present = true, .is_range = false, .ranges = {}, .values = {5, 6}};
+        Query<MIXD> orig = q;
+        PhysicalIndexSet got = index.Ranges(q);
+        EXPECT_EQ(index.LastPlan(), "primary+secondary_2+correlation_1");
+        ExpectCovers(got, orig, 100);
+
+        // The secondary index isn't worth it for half of column 2.
+        q.filters[2] = {.present = true, .is_range = true, .ranges = {{0, 499}}, .values = {}};
+        orig = q;
+        got = index.Ranges(q);
+        EXPECT_EQ(index.LastPlan(), "primary+correlation_1");
+        ExpectCovers(got, orig, 10000);
+    }
+
+    TEST_F(MixedCompositeIndexTest, TestRewriterWithSecondaryAndCorrelation) {
+        CompositeIndex<MIXD> index(1);
+        index.SetPrimaryIndex(std::make_unique<PrimaryBTreeIndex<MIXD>>(0, 64));
+        auto rw = std::make_unique<PiecewiseLinearRewriter<MIXD>>(3, 0, 4);
+        rw->SetAuxiliaryIndex(std::make_unique<SecondaryBTreeIndex<MIXD>>(3));
+        index.AddRewriter(std::move(rw));
+        index.AddCorrelationIndex(std::make_unique<GridCorrelationIndex<MIXD>>(
+                    std::vector<size_t>({1}), 256, 256, 10.0));
+        index.AddSecondaryIndex(std::make_unique<SecondaryBTreeIndex<MIXD>>(2));
+        index.Init(pts_.begin(), pts_.end());
+
+        Query<MIXD> q = {};
+        q.filters[3] = {.present = true, .is_range = true, .ranges = {{40000, 60000}}, .values = {}};
+        q.filters[2] = {.present = true, .is_range = false, .ranges = {}, .values = {7}};
+        Query<MIXD> orig = q;
+        PhysicalIndexSet got = index.Ranges(q);
+        EXPECT_EQ(index.LastPlan(), "rewriter+primary+secondary_2");
+        ExpectCovers(got, orig, 100);
+
+        // All three kinds of sub-index in one query.
+        q = {};
+        q.filters[3] = {.present = true, .is_range = true, .ranges = {{40000, 160000}}, .values = {}};
+        q.filters[1] = {.present = true, .is_range = true, .ranges = {{3000, 3500}}, .values = {}};
+        q.filters[2] = {.present = true, .is_range = false, .ranges = {}, .values = {7, 8}};
+        orig = q;
+        got = index.Ranges(q);
+        EXPECT_NE(index.LastPlan().find("rewriter+primary"), std::string::npos);
+        ExpectCovers(got, orig, 1000);
+    }
+
+    TEST_F(MixedCompositeIndexTest, TestRewriterOutliersWithSecondaryOnTarget) {
+        // Rows far off the line between columns 3 and 0, with a column 3 value inside the query
+        // below and a column 0 value inside its original filter but outside the rewritten one.
+        for (auto& p : pts_) {
+            if (p[0] >= 40900 && p[0] < 41000 && p[0] % 10 == 0) {
+                p[3] = 82100;
+            }
+        }
+        CompositeIndex<MIXD> index(1);
+        index.SetPrimaryIndex(std::make_unique<PrimaryBTreeIndex<MIXD>>(0, 64));
+        auto rw = std::make_unique<PiecewiseLinearRewriter<MIXD>>(3, 0, 4);
+        rw->SetAuxiliaryIndex(std::make_unique<SecondaryBTreeIndex<MIXD>>(3));
+        index.AddRewriter(std::move(rw));
+        index.AddSecondaryIndex(std::make_unique<SecondaryBTreeIndex<MIXD>>(0));
+        index.Init(pts_.begin(), pts_.end());
+
+        Query<MIXD> q = {};
+        q.filters[3] = {.present = true, .is_range = true, .ranges = {{82000, 82200}}, .values = {}};
+        q.filters[0] = {.present = true, .is_range = true, .ranges = {{40900, 41120}}, .values = {}};
+        Query<MIXD> orig = q;
+        PhysicalIndexSet got = index.Ranges(q);
+        // The secondary index looks up the original filter on column 0, so it keeps the outliers
+        // the rewriter returned.
+        EXPECT_EQ(index.LastPlan(), "rewriter+primary+secondary_0");
+        ExpectCovers(got, orig, 1000);
+        size_t outliers = 0;
+        for (size_t i = 0; i < pts_.size(); i++) {
+            if (pts_[i][3] == 82100 && pts_[i][0] < 41000) {
+                EXPECT_TRUE(Contains(got, i)) << "row " << i;
+                outliers++;
+            }
+        }
+        EXPECT_EQ(outliers, 10);
+    }
+
+    TEST_F(MixedCompositeIndexTest, TestBitmapFollowsPlan) {
+        CompositeIndex<MIXD> index(1);
+        index.SetPrimaryIndex(std::make_unique<PrimaryBTreeIndex<MIXD>>(0, 64));
+        index.AddCorrelationIndex(std::make_unique<GridCorrelationIndex<MIXD>>(
+                    std::vector<size_t>({1}), 256, 256, 10.0));
+        index.AddSecondaryIndex(std::make_unique<SecondaryBTreeIndex<MIXD>>(2));
+        index.Init(pts_.begin(), pts_.end());
+
+        Query<MIXD> q = {};
+        q.filters[1] = {.present = true, .is_range = true, .ranges = {{3000, 3500}}, .values = {}};
+        q.filters[2] = {.present = true, .is_range = true, .ranges = {{0, 499}}, .values = {}};
+        Query<MIXD> orig = q;
+        PhysicalIndexSet want = index.Ranges(q);
+        std::string plan = index.LastPlan();
+        q = orig;
+        RoaringSet got = index.RangesBitmap(q);
+        EXPECT_EQ(index.LastPlan(), plan);
+        EXPECT_EQ(got.Cardinality(), Count(want));
+        for (size_t i : got.ToList()) {
+            ASSERT_TRUE(Contains(want, i)) << "row " << i;
+        }
+    }
 }
 
 int main(int argc, char **argv) {
@@ -0,0 +1,142 @@
+#include "gtest/gtest.h"
+#include "correlation_map_builder.h"
+#include "mapped_correlation_index.h"
+
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace std;
+
+namespace test {
+
+    const size_t TESTD = 2;
+    class CorrelationMapBuilderTest : public ::testing::Test {
+        public:
+        // Column 1 is the sorted target column and column 0 follows it with some noise. Target
+        // bucket t holds rows [1000t, 1000t + 1000) and has id 2t. A handful of rows in target
+        // bucket 3 lie far away on the mapped column.
+        void SetUp() override {
+            std::default_random_engine gen(5);
+            std::uniform_int_distribution<Scalar> noise(-300, 300);
+            for (size_t i = 0; i < 20000; i++) {
+                Scalar y = i;
+                pts_.push_back({y + noise(gen), y});
+            }
+            for (size_t i = 3100; i < 3105; i++) {
+                pts_[i][0] = 1000000;
+            }
+            for (size_t t = 0; t < 20; t++) {
+                ids_.push_back(2*t);
+                starts_.push_back(1000*t);
+                ends_.push_back(1000*t + 1000);
+            }
+            targets_ = {.num_buckets = ids_.size(), .ids = ids_.data(), .starts = starts_.data(),
+                .ends = ends_.data()};
+        }
+
+        // Mapped bucket containing row i.
+        size_t BucketOf(const MappingView& m, size_t i) {
+            Scalar v = pts_[i][0];
+            for (size_t b = 0; b < m.num_buckets; b++) {
+                if (v >= m.bucket_starts[b] && v < m.bucket_ends[b]) {
+                    return m.bucket_ids[b];
+                }
+            }
+            return m.num_buckets;
+        }
+
+        std::set<int32_t> TargetsOf(const MappingView& m, size_t bucket) {
+            for (size_t j = 0; j < m.num_mappings; j++) {
+                if (m.mapping_ids[j] == bucket) {
+                    return std::set<int32_t>(m.targets + m.mapping_offsets[j],
+                            m.targets + m.mapping_offsets[j+1]);
+                }
+            }
+            return {};
+        }
+
+        // Every row is either an outlier or covered by the mapping, and never both.
+        void ExpectCovered(const CorrelationMapBuilder<TESTD>& builder) {
+            MappingView m = builder.Mapping();
+            std::set<size_t> outliers(builder.Outliers().begin(), builder.Outliers().end());
+            EXPECT_TRUE(std::is_sorted(builder.Outliers().begin(), builder.Outliers().end()));
+            for (size_t i = 0; i < pts_.size(); i++) {
+                size_t b = BucketOf(m, i);
+                ASSERT_LT(b, m.num_buckets) << "row " << i;
+                bool mapped = TargetsOf(m, b).count(2 * (i / 1000)) > 0;
+                EXPECT_NE(mapped, outliers.count(i) > 0) << "row " << i;
+            }
+        }
+
+        vector<Point<TESTD>> pts_;
+        std::vector<uint64_t> ids_, starts_, ends_;
+        TargetBucketsView targets_;
+    };
+
+    TEST_F(CorrelationMapBuilderTest, TestConstantWidth) {
+        CorrelationMapBuilder<TESTD> builder(0, 100.0);
+        builder.SetBucketWidth(100);
+        builder.Build(pts_.cbegin(), pts_.cend(), targets_);
+        MappingView m = builder.Mapping();
+        EXPECT_EQ(m.column, 0);
+        for (size_t b = 0; b < m.num_buckets; b++) {
+            EXPECT_EQ(m.bucket_ends[b] - m.bucket_starts[b], 100);
+            EXPECT_EQ(m.bucket_starts[b] % 100, 0);
+        }
+        ExpectCovered(builder);
+        // The far away rows are stashed rather than making target bucket 3 match their bucket.
+        for (size_t i = 3100; i < 3105; i++) {
+            EXPECT_TRUE(std::binary_search(builder.Outliers().begin(), builder.Outliers().end(), i));
+        }
+        EXPECT_LT(builder.Outliers().size(), pts_.size() / 10);
+        TargetBucketsView t = builder.TargetBuckets();
+        EXPECT_EQ(t.num_buckets, 20);
+    }
+
+    TEST_F(CorrelationMapBuilderTest, TestEquiDepth) {
+        CorrelationMapBuilder<TESTD> builder(0, 100.0);
+        builder.SetNumBuckets(50);
+        builder.Build(pts_.cbegin(), pts_.cend(), targets_);
+        MappingView m = builder.Mapping();
+        EXPECT_LE(m.num_buckets, 50);
+        for (size_t b = 1; b < m.num_buckets; b++) {
+            EXPECT_LE(m.bucket_ends[b-1], m.bucket_starts[b]);
+        }
+        ExpectCovered(builder);
+    }
+
+    TEST_F(CorrelationMapBuilderTest, TestArtifactsLoad) {
+        CorrelationMapBuilder<TESTD> builder(0, 100.0);
+        builder.SetBucketWidth(250);
+        builder.Build(pts_.cbegin(), pts_.cend(), targets_);
+        builder.Write("testing_builder");
+        EXPECT_EQ(MappingArtifacts::LoadOutliers("testing_builder.outliers"), builder.Outliers());
+
+        MappedCorrelationIndex<TESTD> index("testing_builder.mapping", "testing_builder.targets");
+        index.Init(pts_.cbegin(), pts_.cend());
+        std::set<size_t> outliers(builder.Outliers().begin(), builder.Outliers().end());
+        for (Scalar lo : {-500, 0, 777, 5000, 19000}) {
+            Query<TESTD> q;
+            q.filters[0] = {.present = true, .is_range = true, .ranges = {{lo, lo + 400}}};
+            q.filters[1] = {.present = false};
+            PhysicalIndexSet got = index.Ranges(q);
+            // Every matching inlier is in one of the returned ranges.
+            for (size_t i = 0; i < pts_.size(); i++) {
+                if (pts_[i][0] < lo || pts_[i][0] > lo + 400 || outliers.count(i) > 0) {
+                    continue;
+                }
+                bool found = false;
+                for (auto r : got.ranges) {
+                    found |= (i >= r.start && i < r.end);
+                }
+                EXPECT_TRUE(found) << "row " << i << " for query at " << lo;
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,151 @@
+#include "gtest/gtest.h"
+#include "cracking_index.h"
+
+#include <random>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+namespace test {
+
+    const size_t TESTD = 3;
+    class CrackingIndexTest : public ::testing::Test {
+        public:
+        vector<Point<TESTD>> RandomPoints(size_t n, Scalar maxval) {
+            std::default_random_engine gen(1);
+            std::uniform_int_distribution<Scalar> dist(0, maxval);
+            vector<Point<TESTD>> pts(n);
+            for (size_t i = 0; i < n; i++) {
+                pts[i] = {dist(gen), dist(gen), (Scalar)i};
+            }
+            return pts;
+        }
+
+        Query<TESTD> RangeQuery(size_t dim, ScalarRange r) {
+            Query<TESTD> q;
+            for (size_t d = 0; d < TESTD; d++) {
+                q.filters[d] = {.present = false};
+            }
+            q.filters[dim] = {.present = true, .is_range = true, .ranges = {r}};
+            return q;
+        }
+
+        // The ids (last coordinate) of the points matching r on dim, sorted.
+        std::vector<Scalar> Expected(const vector<Point<TESTD>>& pts, size_t dim, ScalarRange r) {
+            std::vector<Scalar> ids;
+            for (const auto& p : pts) {
+                if (p[dim] >= r.first && p[dim] <= r.second) {
+                    ids.push_back(p[TESTD-1]);
+                }
+            }
+            std::sort(ids.begin(), ids.end());
+            return ids;
+        }
+
+        // The ids of the points in the given ranges, which all have to match r on dim.
+        std::vector<Scalar> Scan(const vector<Point<TESTD>>& pts, const IndexRangeList& ranges,
+                size_t dim, ScalarRange r) {
+            std::vector<Scalar> ids;
+            for (const auto& range : ranges) {
+                for (size_t i = range.start; i < range.end; i++) {
+                    EXPECT_TRUE(pts[i][dim] >= r.first && pts[i][dim] <= r.second);
+                    ids.push_back(pts[i][TESTD-1]);
+                }
+            }
+            std::sort(ids.begin(), ids.end());
+            return ids;
+        }
+    };
+
+    TEST_F(CrackingIndexTest, TestInitLeavesDataInPlace) {
+        auto pts = RandomPoints(10000, 1000);
+        auto orig = pts;
+        CrackingIndex<TESTD> index(0);
+        index.Init(pts.begin(), pts.end());
+        EXPECT_EQ(pts, orig);
+        EXPECT_EQ(index.NumPieces(), 1);
+    }
+
+    TEST_F(CrackingIndexTest, TestRangesReturnExactPieces) {
+        auto pts = RandomPoints(100000, 1 << 20);
+        CrackingIndex<TESTD> index(0);
+        index.Init(pts.begin(), pts.end());
+        std::default_random_engine gen(2);
+        std::uniform_int_distribution<Scalar> dist(0, 1 << 20);
+        for (size_t i = 0; i < 50; i++) {
+            Scalar a = dist(gen), b = dist(gen);
+            ScalarRange r(std::min(a, b), std::min(a, b) + (std::max(a, b) - std::min(a, b)) / 10);
+            auto q = RangeQuery(0, r);
+            auto result = index.Ranges(q);
+            // The matching rows are cracked into one piece.
+            EXPECT_TRUE(result.list.empty());
+            EXPECT_LE(result.ranges.size(), 1);
+            EXPECT_EQ(Scan(pts, result.ranges, 0, r), Expected(pts, 0, r));
+        }
+        EXPECT_GT(index.NumPieces(), 50);
+        // A column that isn't indexed is a full scan.
+        auto q = RangeQuery(1, {0, 10});
+        auto ranges = index.Ranges(q).ranges;
+        ASSERT_EQ(ranges.size(), 1);
+        EXPECT_EQ(ranges[0], PhysicalIndexRange(0, pts.size()));
+    }
+
+    TEST_F(CrackingIndexTest, TestRepeatedQueriesConverge) {
+        auto pts = RandomPoints(100000, 1 << 20);
+        CrackingIndex<TESTD> index(0);
+        index.Init(pts.begin(), pts.end());
+        ScalarRange r(1000, 50000);
+        auto q = RangeQuery(0, r);
+        auto first = index.Ranges(q);
+        size_t pieces = index.NumPieces();
+        auto cracked = pts;
+        for (size_t i = 0; i < 10; i++) {
+            auto again = RangeQuery(0, r);
+            auto result = index.Ranges(again);
+            EXPECT_TRUE(result.list.empty());
+            ASSERT_EQ(result.ranges, first.ranges);
+        }
+        // Once cracked, the same query neither cracks nor moves anything.
+        EXPECT_EQ(index.NumPieces(), pieces);
+        EXPECT_EQ(pts, cracked);
+        EXPECT_EQ(Scan(pts, first.ranges, 0, r), Expected(pts, 0, r));
+    }
+
+    TEST_F(CrackingIndexTest, TestSequentialQueriesOnDuplicates) {
+        // Few distinct values and queries walking the domain in order.
+        auto pts = RandomPoints(100000, 20);
+        CrackingIndex<TESTD> index(0);
+        index.Init(pts.begin(), pts.end());
+        for (Scalar v = -1; v <= 21; v++) {
+            auto q = RangeQuery(0, {v, v});
+            auto result = index.Ranges(q);
+            EXPECT_TRUE(result.list.empty());
+            EXPECT_EQ(Scan(pts, result.ranges, 0, {v, v}), Expected(pts, 0, {v, v}));
+        }
+        // Values are cracked one piece each and come back merged.
+        Query<TESTD> q;
+        for (size_t d = 0; d < TESTD; d++) {
+            q.filters[d] = {.present = false};
+        }
+        q.filters[0] = {.present = true, .is_range = false, .values = {3, 4, 5, 9}};
+        auto ranges = index.Ranges(q).ranges;
+        EXPECT_EQ(ranges.size(), 2);
+        auto ids = Scan(pts, ranges, 0, {3, 9});
+        auto expected = Expected(pts, 0, {3, 5});
+        auto nines = Expected(pts, 0, {9, 9});
+        expected.insert(expected.end(), nines.begin(), nines.end());
+        std::sort(expected.begin(), expected.end());
+        EXPECT_EQ(ids, expected);
+
+        auto all = RangeQuery(0, {std::numeric_limits<Scalar>::lowest(), std::numeric_limits<Scalar>::max()});
+        ranges = index.Ranges(all).ranges;
+        ASSERT_EQ(ranges.size(), 1);
+        EXPECT_EQ(ranges[0], PhysicalIndexRange(0, pts.size()));
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,147 @@
+#include "gtest/gtest.h"
+#include "flood_index.h"
+
+#include <random>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+
+using namespace std;
+
+namespace test {
+
+    const size_t TESTD = 4;
+    class FloodIndexTest : public ::testing::Test {
+        public:
+        // Columns 0 and 1 are grid dimensions (column 1 is skewed), 2 is the sort dimension and 3
+        // holds the original position of each point.
+        vector<Point<TESTD>> RandomPoints(size_t n) {
+            std::default_random_engine gen(1);
+            std::uniform_int_distribution<Scalar> dist(0, 1 << 20);
+            std::exponential_distribution<double> skewed(1e-4);
+            vector<Point<TESTD>> pts(n);
+            for (size_t i = 0; i < n; i++) {
+                pts[i] = {dist(gen), (Scalar)skewed(gen), dist(gen), (Scalar)i};
+            }
+            return pts;
+        }
+
+        Query<TESTD> BoxQuery(ScalarRange r0, ScalarRange r1, ScalarRange r2) {
+            Query<TESTD> q;
+            q.filters[0] = {.present = true, .is_range = true, .ranges = {r0}};
+            q.filters[1] = {.present = true, .is_range = true, .ranges = {r1}};
+            q.filters[2] = {.present = true, .is_range = true, .ranges = {r2}};
+            q.filters[3] = {.present = false};
+            return q;
+        }
+
+        bool Matches(const Point<TESTD>& p, ScalarRange r0, ScalarRange r1, ScalarRange r2) {
+            return p[0] >= r0.first && p[0] <= r0.second && p[1] >= r1.first && p[1] <= r1.second
+                && p[2] >= r2.first && p[2] <= r2.second;
+        }
+
+        // Returns the number of points scanned, or -1 if a matching point isn't covered.
+        long ScannedIfCovering(const vector<Point<TESTD>>& pts, const IndexRangeList& ranges,
+                ScalarRange r0, ScalarRange r1, ScalarRange r2) {
+            std::vector<bool> covered(pts.size(), false);
+            long scanned = 0;
+            for (auto r : ranges) {
+                scanned += r.end - r.start;
+                for (size_t i = r.start; i < r.end; i++) {
+                    covered[i] = true;
+                }
+            }
+            for (size_t i = 0; i < pts.size(); i++) {
+                if (Matches(pts[i], r0, r1, r2) && !covered[i]) {
+                    std::cout << "Point " << i << " matches but is not covered" << std::endl;
+                    return -1;
+                }
+            }
+            return scanned;
+        }
+
+        // Writes queries that are narrow in column 0 and unfiltered elsewhere.
+        std::string WriteWorkload() {
+            std::string filename = "flood_test_workload.dat";
+            std::ofstream f(filename);
+            std::default_random_engine gen(3);
+            std::uniform_int_distribution<Scalar> dist(0, 1 << 20);
+            for (size_t i = 0; i < 100; i++) {
+                Scalar s = dist(gen);
+                f << "=" << std::endl << "ranges " << s << " " << s + 1000 << std::endl
+                    << "none" << std::endl << "none" << std::endl << "none" << std::endl;
+            }
+            return filename;
+        }
+    };
+
+    TEST_F(FloodIndexTest, TestInitIsPermutation) {
+        auto pts = RandomPoints(100000);
+        auto orig = pts;
+        std::vector<size_t> dims = {0, 1};
+        FloodIndex<TESTD> index(dims, 2, "");
+        index.Init(pts.begin(), pts.end());
+        std::vector<Scalar> ids;
+        for (size_t i = 0; i < pts.size(); i++) {
+            ASSERT_EQ(pts[i], orig[pts[i][3]]);
+            ids.push_back(pts[i][3]);
+        }
+        std::sort(ids.begin(), ids.end());
+        for (size_t i = 0; i < ids.size(); i++) {
+            ASSERT_EQ(ids[i], (Scalar)i);
+        }
+    }
+
+    TEST_F(FloodIndexTest, TestRangesCoverMatches) {
+        auto pts = RandomPoints(100000);
+        std::vector<size_t> dims = {0, 1};
+        FloodIndex<TESTD> index(dims, 2, "");
+        index.Init(pts.begin(), pts.end());
+        std::default_random_engine gen(2);
+        std::uniform_int_distribution<Scalar> dist(0, 1 << 20);
+        std::uniform_int_distribution<Scalar> skewed(0, 30000);
+        for (size_t i = 0; i < 30; i++) {
+            Scalar a = dist(gen), b = dist(gen), c = skewed(gen), d = skewed(gen), e = dist(gen), f = dist(gen);
+            ScalarRange r0(std::min(a, b), std::max(a, b));
+            ScalarRange r1(std::min(c, d), std::max(c, d));
+            ScalarRange r2(std::min(e, f), std::max(e, f));
+            auto q = BoxQuery(r0, r1, r2);
+            auto ranges = index.Ranges(q).ranges;
+            EXPECT_GE(ScannedIfCovering(pts, ranges, r0, r1, r2), 0);
+            for (size_t j = 1; j < ranges.size(); j++) {
+                EXPECT_LT(ranges[j-1].end, ranges[j].start);
+            }
+        }
+        auto empty = BoxQuery({10, 5}, {0, 100}, {0, 100});
+        EXPECT_TRUE(index.Ranges(empty).ranges.empty());
+    }
+
+    TEST_F(FloodIndexTest, TestTunedToWorkload) {
+        auto pts = RandomPoints(100000);
+        std::vector<size_t> dims = {0, 1};
+        std::string workload_file = WriteWorkload();
+        FloodIndex<TESTD> index(dims, 2, workload_file);
+        index.Init(pts.begin(), pts.end());
+        std::remove(workload_file.c_str());
+        // The workload only filters column 0, so only column 0 should be split.
+        auto cols = index.ColumnsPerDim();
+        EXPECT_GT(cols[0], 1);
+        EXPECT_EQ(cols[1], 1);
+
+        ScalarRange full(std::numeric_limits<Scalar>::lowest(), std::numeric_limits<Scalar>::max());
+        Query<TESTD> q;
+        q.filters[0] = {.present = true, .is_range = true, .ranges = {{500000, 501000}}};
+        q.filters[1] = {.present = false};
+        q.filters[2] = {.present = false};
+        q.filters[3] = {.present = false};
+        long scanned = ScannedIfCovering(pts, index.Ranges(q).ranges, {500000, 501000}, full, full);
+        EXPECT_GE(scanned, 0);
+        EXPECT_LT(scanned, (long)pts.size() / 50);
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,132 @@
+#include "gtest/gtest.h"
+#include "grid_correlation_index.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+namespace test {
+
+    const size_t TESTD = 3;
+    class GridCorrelationIndexTest : public ::testing::Test {
+        public:
+        // Column 2 is the sorted target column and is determined by columns 0 and 1 together,
+        // up to some noise: c = 10 * (24a + b) + noise. A handful of rows with a = 50, b = 7 have
+        // a target value far away from the others.
+        void SetUp() override {
+            std::default_random_engine gen(3);
+            std::uniform_int_distribution<Scalar> a_dist(0, 99);
+            std::uniform_int_distribution<Scalar> b_dist(0, 23);
+            std::uniform_int_distribution<Scalar> noise(0, 9);
+            for (size_t i = 0; i < 50000; i++) {
+                Scalar a = a_dist(gen), b = b_dist(gen);
+                pts_.push_back({a, b, 10 * (24 * a + b) + noise(gen)});
+            }
+            for (size_t i = 0; i < 5; i++) {
+                pts_.push_back({50, 7, (Scalar)(1000 * i)});
+            }
+            std::sort(pts_.begin(), pts_.end(),
+                    [](const auto& p1, const auto& p2) { return p1[2] < p2[2]; });
+        }
+
+        static bool Contains(const PhysicalIndexSet& s, size_t i) {
+            for (const auto& r : s.ranges) {
+                if (i >= r.start && i < r.end) {
+                    return true;
+                }
+            }
+            return std::binary_search(s.list.begin(), s.list.end(), i);
+        }
+
+        static size_t Count(const PhysicalIndexSet& s) {
+            size_t n = s.list.size();
+            for (const auto& r : s.ranges) {
+                n += r.end - r.start;
+            }
+            return n;
+        }
+
+        static Query<TESTD> RangeQuery(Scalar a_lo, Scalar a_hi, Scalar b_lo, Scalar b_hi) {
+            Query<TESTD> q = {};
+            q.filters[0] = {.present = true, .is_range = true, .ranges = {{a_lo, a_hi}}};
+            q.filters[1] = {.present = true, .is_range = true, .ranges = {{b_lo, b_hi}}};
+            return q;
+        }
+
+        // Every row matching the query is in the result.
+        void ExpectCovers(const PhysicalIndexSet& s, const Query<TESTD>& q) {
+            for (size_t i = 0; i < pts_.size(); i++) {
+                bool match = true;
+                for (size_t c = 0; c < 2; c++) {
+                    if (q.filters[c].present) {
+                        match &= pts_[i][c] >= q.filters[c].ranges[0].first
+                            && pts_[i][c] <= q.filters[c].ranges[0].second;
+                    }
+                }
+                if (match) {
+                    ASSERT_TRUE(Contains(s, i)) << "row " << i;
+                }
+            }
+        }
+
+        vector<Point<TESTD>> pts_;
+    };
+
+    TEST_F(GridCorrelationIndexTest, TestJointQueries) {
+        GridCorrelationIndex<TESTD> index({0, 1}, 32, 50, 10.0);
+        index.Init(pts_.cbegin(), pts_.cend());
+
+        std::default_random_engine gen(11);
+        std::uniform_int_distribution<Scalar> a_dist(0, 95);
+        std::uniform_int_distribution<Scalar> b_dist(0, 20);
+        for (int i = 0; i < 50; i++) {
+            Scalar a = a_dist(gen), b = b_dist(gen);
+            Query<TESTD> q = RangeQuery(a, a + 3, b, b + 2);
+            PhysicalIndexSet s = index.Ranges(q);
+            ExpectCovers(s, q);
+            // Filtering only on a gives a much larger set.
+            Query<TESTD> loose = q;
+            loose.filters[1].present = false;
+            PhysicalIndexSet l = index.Ranges(loose);
+            ExpectCovers(l, loose);
+            EXPECT_LT(2 * Count(s), Count(l));
+        }
+    }
+
+    TEST_F(GridCorrelationIndexTest, TestOutliers) {
+        GridCorrelationIndex<TESTD> index({0, 1}, 32, 50, 10.0);
+        index.Init(pts_.cbegin(), pts_.cend());
+        EXPECT_GE(index.NumOutliers(), 5);
+
+        Query<TESTD> q = RangeQuery(50, 50, 7, 7);
+        PhysicalIndexSet s = index.Ranges(q);
+        ExpectCovers(s, q);
+        // The far away rows come back as a list rather than as whole target buckets.
+        EXPECT_LT(Count(s), 1000);
+    }
+
+    TEST_F(GridCorrelationIndexTest, TestUnfilteredAndEmpty) {
+        GridCorrelationIndex<TESTD> index({0, 1}, 32, 50, 10.0);
+        index.Init(pts_.cbegin(), pts_.cend());
+
+        Query<TESTD> q = {};
+        q.filters[2] = {.present = true, .is_range = true, .ranges = {{0, 100}}};
+        PhysicalIndexSet s = index.Ranges(q);
+        ASSERT_EQ(s.ranges.size(), 1);
+        EXPECT_EQ(s.ranges[0].start, 0);
+        EXPECT_EQ(s.ranges[0].end, pts_.size());
+
+        q = RangeQuery(200, 300, 0, 10);
+        EXPECT_EQ(Count(index.Ranges(q)), 0);
+
+        // A single filtered column still narrows the result down.
+        q = {};
+        q.filters[1] = {.present = true, .is_range = true, .ranges = {{3, 3}}};
+        s = index.Ranges(q);
+        ExpectCovers(s, q);
+        EXPECT_LT(2 * Count(s), pts_.size());
+        EXPECT_TRUE(index.Filters(q));
+    }
+}
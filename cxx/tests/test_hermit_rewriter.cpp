@@ -0,0 +1,148 @@
+#include "gtest/gtest.h"
+#include "hermit_rewriter.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "types.h"
+#include "utils.h"
+
+using namespace std;
+
+namespace test {
+    const size_t TESTD = 3;
+
+    class HermitRewriterTest : public ::testing::Test {
+        public:
+        // Column 0 is the host column. Columns 1 and 2 are noisy linear functions of it with a
+        // few planted outliers.
+        void SetUp() override {
+            std::default_random_engine gen(3);
+            std::uniform_int_distribution<Scalar> noise(-30, 30);
+            data.resize(20000);
+            for (size_t i = 0; i < data.size(); i++) {
+                Scalar t = 5 * i;
+                data[i] = {t, 2 * t + noise(gen), 100000 - t + noise(gen)};
+                if (i % 501 == 0) {
+                    data[i][1] += 40000;
+                }
+                if (i % 733 == 0) {
+                    data[i][2] -= 30000;
+                }
+            }
+        }
+
+        std::unique_ptr<HermitRewriter<TESTD>> Build(std::vector<size_t> mapped) {
+            auto rw = std::make_unique<HermitRewriter<TESTD>>();
+            for (size_t m : mapped) {
+                rw->AddPair(m, 0, std::make_unique<SecondaryBTreeIndex<TESTD>>(m));
+            }
+            rw->Init(data.cbegin(), data.cend());
+            return rw;
+        }
+
+        static bool InRanges(Scalar v, const std::vector<ScalarRange>& ranges) {
+            for (const auto& r : ranges) {
+                if (v >= r.first && v <= r.second) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        static Scalar Width(const std::vector<ScalarRange>& ranges) {
+            Scalar w = 0;
+            for (const auto& r : ranges) {
+                w += r.second - r.first;
+            }
+            return w;
+        }
+
+        // Every row matching the original filters has to be reachable through the rewritten
+        // target ranges or the returned outliers.
+        void ExpectCovers(const Query<TESTD>& orig, const Query<TESTD>& rewritten,
+                const IndexList& outliers) {
+            EXPECT_TRUE(std::is_sorted(outliers.begin(), outliers.end()));
+            for (size_t i = 0; i < data.size(); i++) {
+                bool match = true;
+                for (size_t d = 0; d < TESTD; d++) {
+                    if (orig.filters[d].present) {
+                        match &= InRanges(data[i][d], orig.filters[d].ranges);
+                    }
+                }
+                if (match && !InRanges(data[i][0], rewritten.filters[0].ranges)) {
+                    EXPECT_TRUE(std::binary_search(outliers.begin(), outliers.end(), i))
+                        << "Row " << i << " is missing";
+                }
+            }
+        }
+
+        std::vector<Point<TESTD>> data;
+    };
+
+    TEST_F(HermitRewriterTest, TestSinglePair) {
+        auto rw = Build({1});
+        Query<TESTD> q = {};
+        q.filters[1] = {.present = true, .is_range = true, .ranges = {{20000, 30000}}};
+        Query<TESTD> orig = q;
+        IndexList outliers = rw->Rewrite(q);
+        ASSERT_TRUE(q.filters[0].present);
+        EXPECT_FALSE(q.filters[0].ranges.empty());
+        // The host range stays close to [10000, 15000].
+        EXPECT_LT(Width(q.filters[0].ranges), 6000);
+        ExpectCovers(orig, q, outliers);
+    }
+
+    TEST_F(HermitRewriterTest, TestIntersectsPairs) {
+        auto both = Build({1, 2});
+        auto only_a = Build({1});
+        auto only_b = Build({2});
+        EXPECT_EQ(both->NumPairs(), 2);
+
+        std::default_random_engine gen(8);
+        std::uniform_int_distribution<Scalar> dist(0, 100000);
+        for (size_t i = 0; i < 50; i++) {
+            Scalar a = dist(gen), b = dist(gen);
+            Query<TESTD> q = {};
+            q.filters[1] = {.present = true, .is_range = true,
+                .ranges = {{2 * a, 2 * a + 40000}}};
+            q.filters[2] = {.present = true, .is_range = true,
+                .ranges = {{100000 - b - 20000, 100000 - b}}};
+            Query<TESTD> orig = q, qa = q, qb = q;
+            IndexList outliers = both->Rewrite(q);
+            ExpectCovers(orig, q, outliers);
+
+            // One target range, no wider than either pair gives on its own.
+            only_a->Rewrite(qa);
+            only_b->Rewrite(qb);
+            EXPECT_LE(Width(q.filters[0].ranges), Width(qa.filters[0].ranges));
+            EXPECT_LE(Width(q.filters[0].ranges), Width(qb.filters[0].ranges));
+        }
+    }
+
+    TEST_F(HermitRewriterTest, TestExistingTargetFilter) {
+        auto rw = Build({1, 2});
+        Query<TESTD> q = {};
+        q.filters[0] = {.present = true, .is_range = true, .ranges = {{12000, 13000}}};
+        q.filters[1] = {.present = true, .is_range = true, .ranges = {{20000, 30000}}};
+        Query<TESTD> orig = q;
+        IndexList outliers = rw->Rewrite(q);
+        for (const auto& r : q.filters[0].ranges) {
+            EXPECT_GE(r.first, 12000);
+            EXPECT_LE(r.second, 13000);
+        }
+        ExpectCovers(orig, q, outliers);
+    }
+
+    TEST_F(HermitRewriterTest, TestNoMappedFilter) {
+        auto rw = Build({1, 2});
+        Query<TESTD> q = {};
+        q.filters[0] = {.present = true, .is_range = true, .ranges = {{100, 200}}};
+        IndexList outliers = rw->Rewrite(q);
+        EXPECT_TRUE(outliers.empty());
+        EXPECT_EQ(q.filters[0].ranges, std::vector<ScalarRange>({{100, 200}}));
+        EXPECT_FALSE(q.filters[1].present);
+        EXPECT_FALSE(q.filters[2].present);
+    }
+}
@@ -0,0 +1,168 @@
+#include "gtest/gtest.h"
+#include "mapped_correlation_index.h"
+
+#include <fstream>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace std;
+
+namespace test {
+
+    const size_t TESTD = 2;
+    class MappedCorrelationIndexTest : public ::testing::Test {
+        public:
+        // Mapped bucket i covers [10i, 10i + 10) and maps to a random set of target buckets. Every
+        // 7th mapped bucket has no mapping. Target bucket ids are even, and their physical ranges
+        // are contiguous except for a gap before every 5th one.
+        void WriteFiles(size_t num_mapped, size_t num_targets) {
+            std::default_random_engine gen(7);
+            std::uniform_int_distribution<size_t> count(1, 12);
+            std::uniform_int_distribution<size_t> target(0, num_targets - 1);
+
+            std::ofstream targetfile(TargetFile(), std::ios::trunc | std::ios::out);
+            targetfile << "target_index_ranges " << num_targets << std::endl;
+            targets_.clear();
+            size_t start = 0;
+            for (size_t t = 0; t < num_targets; t++) {
+                if (t % 5 == 0) {
+                    start += 3;
+                }
+                PhysicalIndexRange r(start, start + 1 + t % 4);
+                targetfile << 2*t << " " << r.start << " " << r.end << std::endl;
+                targets_.push_back(r);
+                start = r.end;
+            }
+            targetfile.close();
+
+            std::ofstream mapfile(MappingFile(), std::ios::trunc | std::ios::out);
+            mapfile << "continuous-0" << std::endl;
+            mapfile << "source 0 " << num_mapped << std::endl;
+            for (size_t i = 0; i < num_mapped; i++) {
+                mapfile << i << " " << 10*i << " " << 10*i + 10 << std::endl;
+            }
+            mapping_.assign(num_mapped, {});
+            size_t num_mappings = 0;
+            for (size_t i = 0; i < num_mapped; i++) {
+                if (i % 7 != 3) {
+                    size_t c = count(gen);
+                    for (size_t j = 0; j < c; j++) {
+                        mapping_[i].insert(target(gen));
+                    }
+                    num_mappings++;
+                }
+            }
+            mapfile << "mapping " << num_mappings << std::endl;
+            for (size_t i = 0; i < num_mapped; i++) {
+                if (mapping_[i].empty()) {
+                    continue;
+                }
+                mapfile << i;
+                for (size_t t : mapping_[i]) {
+                    mapfile << " " << 2*t;
+                }
+                mapfile << std::endl;
+            }
+            mapfile.close();
+        }
+
+        std::string MappingFile() { return "testing_mapping.tmp"; }
+        std::string TargetFile() { return "testing_targets.tmp"; }
+
+        // Unions the target buckets of the mapped buckets that end after lo, up to and including
+        // the first one that ends at or after hi, and merges physically adjacent ranges.
+        IndexRangeList BruteForce(Scalar lo, Scalar hi) {
+            std::set<size_t> ts;
+            for (size_t i = 0; i < mapping_.size(); i++) {
+                Scalar end = 10*i + 10;
+                if (mapping_[i].empty()) {
+                    continue;
+                }
+                if (end > lo) {
+                    ts.insert(mapping_[i].begin(), mapping_[i].end());
+                }
+                if (end >= hi) {
+                    break;
+                }
+            }
+            IndexRangeList ranges;
+            for (size_t t : ts) {
+                if (!ranges.empty() && ranges.back().end == targets_[t].start) {
+                    ranges.back().end = targets_[t].end;
+                } else {
+                    ranges.push_back(targets_[t]);
+                }
+            }
+            return ranges;
+        }
+
+        Query<TESTD> RangeQuery(Scalar lo, Scalar hi) {
+            Query<TESTD> q;
+            q.filters[0] = {.present = true, .is_range = true, .ranges = {{lo, hi}}};
+            q.filters[1] = {.present = false};
+            return q;
+        }
+
+        std::vector<std::set<size_t>> mapping_;
+        IndexRangeList targets_;
+    };
+
+    TEST_F(MappedCorrelationIndexTest, TestWithoutFilter) {
+        WriteFiles(20, 30);
+        MappedCorrelationIndex<TESTD> index(MappingFile(), TargetFile());
+        vector<Point<TESTD>> pts(100);
+        index.Init(pts.begin(), pts.end());
+        Query<TESTD> q;
+        q.filters[0] = {.present = false};
+        q.filters[1] = {.present = true, .is_range = true, .ranges = {{0, 5}}};
+        IndexRangeList want = {{0, 100}};
+        EXPECT_EQ(index.Ranges(q).ranges, want);
+    }
+
+    TEST_F(MappedCorrelationIndexTest, TestRangesMatchBruteForce) {
+        WriteFiles(300, 200);
+        MappedCorrelationIndex<TESTD> index(MappingFile(), TargetFile());
+        vector<Point<TESTD>> pts(100);
+        index.Init(pts.begin(), pts.end());
+        std::vector<ScalarRange> queries = {
+            {0, 9}, {0, 10}, {5, 5}, {10, 10}, {35, 36}, {-100, 5000}, {123, 1877},
+            {2990, 3000}, {3000, 4000}, {-10, -1}, {1000, 1001},
+        };
+        std::default_random_engine gen(3);
+        std::uniform_int_distribution<Scalar> dist(-20, 3020);
+        for (size_t i = 0; i < 100; i++) {
+            Scalar a = dist(gen), b = dist(gen);
+            queries.emplace_back(std::min(a, b), std::max(a, b));
+        }
+        for (ScalarRange sr : queries) {
+            PhysicalIndexSet got = index.Ranges(RangeQuery(sr.first, sr.second));
+            EXPECT_EQ(got.ranges, BruteForce(sr.first, sr.second))
+                << "query " << sr.first << " - " << sr.second;
+            EXPECT_TRUE(got.list.empty());
+        }
+    }
+
+    TEST_F(MappedCorrelationIndexTest, TestBinaryArtifacts) {
+        WriteFiles(100, 80);
+        MappedCorrelationIndex<TESTD> text_index(MappingFile(), TargetFile());
+        MappingArtifacts::WriteMapping(MappingArtifact(MappingFile()).View(), "testing_mapping.bin");
+        MappingArtifacts::WriteTargetBuckets(TargetBucketsArtifact(TargetFile()).View(),
+                "testing_targets.bin");
+        MappedCorrelationIndex<TESTD> binary_index("testing_mapping.bin", "testing_targets.bin");
+        vector<Point<TESTD>> pts(100);
+        text_index.Init(pts.begin(), pts.end());
+        binary_index.Init(pts.begin(), pts.end());
+        EXPECT_EQ(binary_index.GetMappedColumn(), 0);
+        for (Scalar lo = -5; lo < 1010; lo += 37) {
+            Query<TESTD> q = RangeQuery(lo, lo + 95);
+            EXPECT_EQ(binary_index.Ranges(q).ranges, text_index.Ranges(q).ranges);
+            EXPECT_EQ(binary_index.Ranges(q).ranges, BruteForce(lo, lo + 95));
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
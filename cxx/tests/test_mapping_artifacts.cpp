@@ -0,0 +1,109 @@
+#include "gtest/gtest.h"
+#include "mapping_artifacts.h"
+
+#include <fstream>
+#include <vector>
+
+using namespace std;
+
+namespace test {
+
+    class MappingArtifactsTest : public ::testing::Test {
+        public:
+        // Buckets and mappings are deliberately listed out of order.
+        std::string MappingTextFile() {
+            std::string fname = "testing_mapping.tmp";
+            std::ofstream file(fname, std::ios::trunc | std::ios::out);
+            file << "continuous-0" << std::endl
+                << "source 1 4" << std::endl
+                << "2 20 30" << std::endl
+                << "0 -5.0 10" << std::endl
+                << "3 30 45" << std::endl
+                << "1 10 20" << std::endl
+                << "mapping 3" << std::endl
+                << "3 4" << std::endl
+                << "0 1 4 7" << std::endl
+                << "1 2" << std::endl;
+            file.close();
+            return fname;
+        }
+
+        std::string TargetTextFile() {
+            std::string fname = "testing_targets.tmp";
+            std::ofstream file(fname, std::ios::trunc | std::ios::out);
+            file << "target_index_ranges 4" << std::endl
+                << "1 0 10" << std::endl
+                << "2 10 12" << std::endl
+                << "4 20 25" << std::endl
+                << "7 25 40" << std::endl;
+            file.close();
+            return fname;
+        }
+
+        void ExpectMapping(const MappingView& v) {
+            EXPECT_EQ(v.column, 1);
+            ASSERT_EQ(v.num_buckets, 4);
+            EXPECT_EQ(vector<uint64_t>(v.bucket_ids, v.bucket_ids + 4),
+                    vector<uint64_t>({0, 1, 2, 3}));
+            EXPECT_EQ(vector<Scalar>(v.bucket_starts, v.bucket_starts + 4),
+                    vector<Scalar>({-5, 10, 20, 30}));
+            EXPECT_EQ(vector<Scalar>(v.bucket_ends, v.bucket_ends + 4),
+                    vector<Scalar>({10, 20, 30, 45}));
+            ASSERT_EQ(v.num_mappings, 3);
+            EXPECT_EQ(vector<uint64_t>(v.mapping_ids, v.mapping_ids + 3),
+                    vector<uint64_t>({0, 1, 3}));
+            EXPECT_EQ(vector<uint64_t>(v.mapping_offsets, v.mapping_offsets + 4),
+                    vector<uint64_t>({0, 3, 4, 5}));
+            EXPECT_EQ(vector<int32_t>(v.targets, v.targets + 5),
+                    vector<int32_t>({1, 4, 7, 2, 4}));
+        }
+    };
+
+    TEST_F(MappingArtifactsTest, TestMappingRoundTrip) {
+        MappingArtifact text(MappingTextFile());
+        EXPECT_FALSE(text.IsBinary());
+        ExpectMapping(text.View());
+
+        MappingArtifacts::WriteMapping(text.View(), "testing_mapping.bin");
+        EXPECT_TRUE(MappingArtifacts::IsBinary("testing_mapping.bin"));
+        MappingArtifact binary("testing_mapping.bin");
+        EXPECT_TRUE(binary.IsBinary());
+        ExpectMapping(binary.View());
+    }
+
+    TEST_F(MappingArtifactsTest, TestTargetBucketsRoundTrip) {
+        TargetBucketsArtifact text(TargetTextFile());
+        MappingArtifacts::WriteTargetBuckets(text.View(), "testing_targets.bin");
+        TargetBucketsArtifact binary("testing_targets.bin");
+        EXPECT_TRUE(binary.IsBinary());
+        for (const TargetBucketsArtifact* a : {&text, &binary}) {
+            const TargetBucketsView& v = a->View();
+            ASSERT_EQ(v.num_buckets, 4);
+            EXPECT_EQ(vector<uint64_t>(v.ids, v.ids + 4), vector<uint64_t>({1, 2, 4, 7}));
+            EXPECT_EQ(vector<uint64_t>(v.starts, v.starts + 4), vector<uint64_t>({0, 10, 20, 25}));
+            EXPECT_EQ(vector<uint64_t>(v.ends, v.ends + 4), vector<uint64_t>({10, 12, 25, 40}));
+        }
+    }
+
+    TEST_F(MappingArtifactsTest, TestOutliers) {
+        // Outlier lists were written as raw arrays of size_t, which are still accepted.
+        IndexList rows = {3, 17, 1 << 20, 5};
+        std::ofstream raw("testing_outliers.tmp", std::ios::binary | std::ios::trunc);
+        raw.write((const char*)rows.data(), rows.size() * sizeof(size_t));
+        raw.close();
+        EXPECT_FALSE(MappingArtifacts::IsBinary("testing_outliers.tmp"));
+        EXPECT_EQ(MappingArtifacts::LoadOutliers("testing_outliers.tmp"), rows);
+
+        MappingArtifacts::WriteOutliers(rows, "testing_outliers.bin");
+        EXPECT_TRUE(MappingArtifacts::IsBinary("testing_outliers.bin"));
+        EXPECT_EQ(MappingArtifacts::LoadOutliers("testing_outliers.bin"), rows);
+
+        MappingArtifacts::WriteOutliers({}, "testing_outliers.bin");
+        EXPECT_TRUE(MappingArtifacts::LoadOutliers("testing_outliers.bin").empty());
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
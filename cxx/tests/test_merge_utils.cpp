@@ -62,6 +62,15 @@ namespace test {
         EXPECT_TRUE(ArrayEqual(got32, want23));
     }
 
+    TEST_F(MergeUtilsTest, TestIntersectScalarRangesSharedEndpoint) {
+        // Scalar ranges are inclusive, so touching ranges intersect at a single value.
+        std::vector<ScalarRange> r1 = {{0, 10}, {20, 30}};
+        std::vector<ScalarRange> r2 = {{10, 20}};
+        std::vector<ScalarRange> want = {{10, 10}, {20, 20}};
+        EXPECT_EQ(MergeUtils::Intersect(r1, r2), want);
+        EXPECT_EQ(MergeUtils::Intersect(r2, r1), want);
+    }
+
     TEST_F(MergeUtilsTest, TestIntersectPhysicalIndexSets) {
         IndexRangeList r1 = {{5, 10}, {15, 20}, {50, 60}};
         IndexList l1 = {2, 25, 26, 31, 36, 42};
@@ -76,6 +85,59 @@ namespace test {
         EXPECT_TRUE(ArrayEqual(got_set.list, want_list));
     }
 
+    TEST_F(MergeUtilsTest, TestIntersectMatchResults) {
+        MatchResult universe = MatchResult::Universe(100);
+        MatchResult empty = MatchResult::FromSortedList({});
+        MatchResult unsorted = MatchResult::FromList({42, 7, 90, 3});
+        MatchResult ranges = MatchResult::FromRanges({{0, 10}, {40, 50}});
+
+        // Universe and empty results pass through untouched.
+        auto got = MergeUtils::Intersect(universe, unsorted);
+        EXPECT_EQ(got.kind, MatchResult::UNSORTED_LIST);
+        EXPECT_TRUE(ArrayEqual(got.ToList(), unsorted.ToList()));
+        EXPECT_TRUE(MergeUtils::Intersect(ranges, universe).kind == MatchResult::RANGES);
+        EXPECT_TRUE(MergeUtils::Intersect(universe, universe).IsUniverse());
+        EXPECT_TRUE(MergeUtils::Intersect(unsorted, empty).Empty());
+        EXPECT_TRUE(MergeUtils::Intersect(empty, universe).Empty());
+
+        got = MergeUtils::Intersect(unsorted, ranges);
+        EXPECT_EQ(got.kind, MatchResult::SORTED_LIST);
+        EXPECT_TRUE(ArrayEqual(got.ToList(), {3, 7, 42}));
+        got = MergeUtils::Intersect(ranges, MatchResult::FromRanges({{5, 45}}));
+        EXPECT_EQ(got.kind, MatchResult::RANGES);
+        EXPECT_TRUE(ArrayEqual(got.ranges, {{5, 10}, {40, 45}}));
+        got = MergeUtils::Intersect(unsorted, MatchResult::FromSortedList({3, 4, 42}));
+        EXPECT_TRUE(ArrayEqual(got.ToList(), {3, 42}));
+
+        PhysicalIndexSet set({{0, 50}}, {});
+        EXPECT_TRUE(ArrayEqual(MergeUtils::Intersect(set, universe).ranges, set.ranges));
+        EXPECT_TRUE(ArrayEqual(MergeUtils::Intersect(set, unsorted).list, {3, 7, 42}));
+        EXPECT_TRUE(MergeUtils::Intersect(set, empty).ranges.empty());
+        EXPECT_TRUE(ArrayEqual(universe.ToList(), MatchResult::FromRanges({{0, 100}}).ToList()));
+    }
+
+    TEST_F(MergeUtilsTest, TestIntersectKeepsNarrowLists) {
+        MatchResult narrow = MatchResult::FromList(std::vector<uint32_t>{42, 7, 90, 3});
+        MatchResult narrow_sorted = MatchResult::FromSortedList(std::vector<uint32_t>{3, 4, 42, 90});
+        MatchResult wide = MatchResult::FromSortedList(IndexList{3, 7, 90});
+        MatchResult ranges = MatchResult::FromRanges({{0, 10}, {40, 50}});
+
+        auto got = MergeUtils::Intersect(narrow, narrow_sorted);
+        EXPECT_TRUE(got.list.IsNarrow());
+        EXPECT_TRUE(ArrayEqual(got.ToList(), {3, 42, 90}));
+        // Mixed widths come out at the narrower one.
+        got = MergeUtils::Intersect(wide, narrow);
+        EXPECT_TRUE(got.list.IsNarrow());
+        EXPECT_TRUE(ArrayEqual(got.ToList(), {3, 7, 90}));
+        got = MergeUtils::Intersect(ranges, narrow);
+        EXPECT_TRUE(got.list.IsNarrow());
+        EXPECT_TRUE(ArrayEqual(got.ToList(), {3, 7, 42}));
+        EXPECT_FALSE(MergeUtils::Intersect(wide, ranges).list.IsNarrow());
+
+        PhysicalIndexSet set({{40, 100}}, {3, 5});
+        EXPECT_TRUE(ArrayEqual(MergeUtils::Intersect(set, narrow).list, {3, 42, 90}));
+    }
+
     TEST_F(MergeUtilsTest, TestUnionHeap) {
         IndexList l1 = {1, 3, 5, 7};
         IndexList l2 = {4, 6, 9, 19, 20};
@@ -0,0 +1,128 @@
+#include "gtest/gtest.h"
+#include "octree_index.h"
+
+#include <random>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+namespace test {
+
+    const size_t TESTD = 3;
+    class OctreeIndexTest : public ::testing::Test {
+        public:
+        vector<Point<TESTD>> RandomPoints(size_t n, Scalar maxval) {
+            std::default_random_engine gen(1);
+            std::uniform_int_distribution<Scalar> dist(0, maxval);
+            vector<Point<TESTD>> pts(n);
+            for (size_t i = 0; i < n; i++) {
+                pts[i] = {dist(gen), dist(gen), (Scalar)i};
+            }
+            return pts;
+        }
+
+        Query<TESTD> BoxQuery(ScalarRange r0, ScalarRange r1) {
+            Query<TESTD> q;
+            q.filters[0] = {.present = true, .is_range = true, .ranges = {r0}};
+            q.filters[1] = {.present = true, .is_range = true, .ranges = {r1}};
+            q.filters[2] = {.present = false};
+            return q;
+        }
+
+        // Checks that every point inside the query box is covered by one of the ranges.
+        bool CoversMatches(const vector<Point<TESTD>>& pts, const IndexRangeList& ranges,
+                ScalarRange r0, ScalarRange r1) {
+            std::vector<bool> covered(pts.size(), false);
+            for (auto r : ranges) {
+                for (size_t i = r.start; i < r.end; i++) {
+                    covered[i] = true;
+                }
+            }
+            for (size_t i = 0; i < pts.size(); i++) {
+                bool match = pts[i][0] >= r0.first && pts[i][0] <= r0.second
+                    && pts[i][1] >= r1.first && pts[i][1] <= r1.second;
+                if (match && !covered[i]) {
+                    std::cout << "Point " << i << " matches but is not covered" << std::endl;
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    TEST_F(OctreeIndexTest, TestInitIsPermutation) {
+        auto pts = RandomPoints(200000, 1 << 20);
+        std::vector<size_t> dims = {0, 1};
+        OctreeIndex<TESTD> index(dims, 1000);
+        index.Init(pts.begin(), pts.end());
+        // The last column holds the original position of each point.
+        std::vector<Scalar> ids;
+        for (const auto& p : pts) {
+            ids.push_back(p[2]);
+        }
+        std::sort(ids.begin(), ids.end());
+        for (size_t i = 0; i < ids.size(); i++) {
+            ASSERT_EQ(ids[i], (Scalar)i);
+        }
+    }
+
+    TEST_F(OctreeIndexTest, TestRangesCoverMatches) {
+        auto pts = RandomPoints(200000, 1 << 20);
+        std::vector<size_t> dims = {0, 1};
+        OctreeIndex<TESTD> index(dims, 1000);
+        index.Init(pts.begin(), pts.end());
+        std::vector<std::pair<ScalarRange, ScalarRange>> boxes = {
+            {{0, 1 << 20}, {0, 1 << 20}},
+            {{1000, 50000}, {300000, 900000}},
+            {{524288, 524288}, {0, 1 << 19}},
+            {{1 << 21, 1 << 22}, {0, 10}},
+        };
+        for (auto box : boxes) {
+            auto q = BoxQuery(box.first, box.second);
+            auto ranges = index.Ranges(q).ranges;
+            EXPECT_TRUE(CoversMatches(pts, ranges, box.first, box.second));
+        }
+    }
+
+    TEST_F(OctreeIndexTest, TestRangesContainedQueryIsSingleRange) {
+        auto pts = RandomPoints(200000, 1 << 20);
+        std::vector<size_t> dims = {0, 1};
+        OctreeIndex<TESTD> index(dims, 1000);
+        index.Init(pts.begin(), pts.end());
+        // The query covers the whole bounding box, so the root node is returned directly.
+        auto q = BoxQuery({-1, 1 << 21}, {-1, 1 << 21});
+        auto ranges = index.Ranges(q).ranges;
+        ASSERT_EQ(ranges.size(), 1);
+        EXPECT_EQ(ranges[0], PhysicalIndexRange(0, pts.size()));
+    }
+
+    TEST_F(OctreeIndexTest, TestRangesAreCoalesced) {
+        auto pts = RandomPoints(200000, 1 << 20);
+        std::vector<size_t> dims = {0, 1};
+        OctreeIndex<TESTD> index(dims, 1000);
+        index.Init(pts.begin(), pts.end());
+        auto q = BoxQuery({1000, 700000}, {20000, 900000});
+        auto ranges = index.Ranges(q).ranges;
+        EXPECT_TRUE(CoversMatches(pts, ranges, {1000, 700000}, {20000, 900000}));
+        for (size_t i = 1; i < ranges.size(); i++) {
+            EXPECT_LT(ranges[i-1].end, ranges[i].start);
+        }
+    }
+
+    TEST_F(OctreeIndexTest, TestSortedInputUnmodified) {
+        // A single point per quadrant, already listed in octant order.
+        vector<Point<TESTD>> pts = {{0, 0, 0}, {0, 10, 1}, {10, 0, 2}, {10, 10, 3}};
+        std::vector<size_t> dims = {0, 1};
+        OctreeIndex<TESTD> index(dims, 1);
+        index.Init(pts.begin(), pts.end());
+        for (size_t i = 0; i < pts.size(); i++) {
+            EXPECT_EQ(pts[i][2], (Scalar)i);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
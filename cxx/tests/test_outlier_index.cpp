@@ -103,6 +103,20 @@ namespace test {
         }
     }
     
+    TEST_F(OutlierIndexTest, TestInitKeepsOutlierOrder) {
+        auto pts = ValuesToPoints({10, 6, 16, 7, 8, 2, 3, 5, 1, 12, 9, 4});
+        // Unsorted, and including the first and last rows.
+        std::vector<size_t> outlier_list = {9, 0, 5, 11, 6};
+        OutlierIndex<TESTD> index(outlier_list);
+        index.SetIndexer(std::make_unique<PrimaryBTreeIndex<TESTD>>(0, 1));
+
+        index.Init(pts.begin(), pts.end());
+        vector<Scalar> want = {1, 5, 6, 7, 8, 9, 16, 10, 2, 3, 12, 4};
+        for (size_t i = 0; i < want.size(); i++) {
+            EXPECT_EQ(pts[i][0], want[i]);
+        }
+    }
+
     TEST_F(OutlierIndexTest, TestRangesWithOutlierIndexAndInlierMatch) {
         auto pts = ValuesToPoints({10, 6, 6, 7, 8, 2, 3, 5, 1, 2, 9, 4});
         std::vector<size_t> outlier_list = {3, 5, 6, 7, 9};
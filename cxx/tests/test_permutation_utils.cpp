@@ -0,0 +1,83 @@
+#include "gtest/gtest.h"
+#include "permutation_utils.h"
+
+#include <random>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+namespace test {
+
+    class PermutationUtilsTest : public ::testing::Test {
+        public:
+        vector<size_t> RandomPermutation(size_t n) {
+            vector<size_t> order(n);
+            for (size_t i = 0; i < n; i++) {
+                order[i] = i;
+            }
+            std::default_random_engine gen(1);
+            std::shuffle(order.begin(), order.end(), gen);
+            return order;
+        }
+
+        // Data whose first coordinate is its original position.
+        vector<Point<2>> Identity(size_t n) {
+            vector<Point<2>> data(n);
+            for (size_t i = 0; i < n; i++) {
+                data[i] = {(Scalar)i, (Scalar)(n - i)};
+            }
+            return data;
+        }
+
+        void CheckApplied(const vector<Point<2>>& data, const vector<size_t>& order) {
+            ASSERT_EQ(data.size(), order.size());
+            for (size_t i = 0; i < data.size(); i++) {
+                ASSERT_EQ(data[i][0], (Scalar)order[i]);
+                ASSERT_EQ(data[i][1], (Scalar)(order.size() - order[i]));
+            }
+        }
+    };
+
+    TEST_F(PermutationUtilsTest, TestApply) {
+        vector<size_t> order = {2, 0, 1, 3, 5, 4};
+        auto data = Identity(order.size());
+        PermutationUtils::Apply(data.begin(), order);
+        CheckApplied(data, order);
+
+        order = RandomPermutation(10000);
+        data = Identity(order.size());
+        PermutationUtils::Apply(data.begin(), order);
+        CheckApplied(data, order);
+    }
+
+    TEST_F(PermutationUtilsTest, TestApplyParallelRandom) {
+        auto order = RandomPermutation(500000);
+        auto data = Identity(order.size());
+        PermutationUtils::ApplyParallel(data.begin(), order);
+        CheckApplied(data, order);
+    }
+
+    TEST_F(PermutationUtilsTest, TestApplyParallelLongAndShortCycles) {
+        size_t n = 300000;
+        vector<size_t> order(n);
+        // One rotation over the first half, swaps of neighbours in the second half.
+        for (size_t i = 0; i < n / 2; i++) {
+            order[i] = (i + 1) % (n / 2);
+        }
+        for (size_t i = n / 2; i < n; i += 2) {
+            order[i] = i + 1;
+            order[i + 1] = i;
+        }
+        order[n - 1] = n - 1;
+        order[n - 2] = n - 2;
+        auto data = Identity(n);
+        PermutationUtils::ApplyParallel(data.begin(), order);
+        CheckApplied(data, order);
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
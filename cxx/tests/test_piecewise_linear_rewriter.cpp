@@ -0,0 +1,156 @@
+#include "gtest/gtest.h"
+#include "piecewise_linear_rewriter.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "types.h"
+#include "utils.h"
+
+using namespace std;
+
+namespace test {
+    const size_t TESTD = 2;
+
+    class PiecewiseLinearRewriterTest : public ::testing::Test {
+        public:
+        static bool InRanges(Scalar v, const std::vector<ScalarRange>& ranges) {
+            for (const auto& r : ranges) {
+                if (v >= r.first && v <= r.second) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Every row matching the original filter has to be reachable through the rewritten
+        // target ranges or the returned outliers.
+        void ExpectCovers(const std::vector<Point<TESTD>>& data, const Query<TESTD>& orig,
+                const Query<TESTD>& rewritten, IndexList outliers) {
+            std::sort(outliers.begin(), outliers.end());
+            for (size_t i = 0; i < data.size(); i++) {
+                bool match = true;
+                for (size_t d = 0; d < TESTD; d++) {
+                    if (orig.filters[d].present) {
+                        match &= InRanges(data[i][d], orig.filters[d].ranges);
+                    }
+                }
+                if (match && !InRanges(data[i][1], rewritten.filters[1].ranges)) {
+                    EXPECT_TRUE(std::binary_search(outliers.begin(), outliers.end(), i))
+                        << "Row " << i << " is missing";
+                }
+            }
+        }
+    };
+
+    TEST_F(PiecewiseLinearRewriterTest, TestFitExactPieces) {
+        // Three lines, with several points per x value.
+        std::vector<Scalar> xs, ys;
+        for (Scalar x = 0; x < 3000; x++) {
+            Scalar y = x < 1000 ? 3 * x : (x < 2000 ? 3000 - x : 2000 + 5 * (x - 2000));
+            for (int k = 0; k < 3; k++) {
+                xs.push_back(x);
+                ys.push_back(y + k - 1);
+            }
+        }
+        std::vector<PLASegment> segments;
+        PiecewiseLinearModel::Fit(xs, ys, 0, xs.size(), 1, &segments);
+        EXPECT_LE(segments.size(), 3);
+        for (size_t i = 0; i < xs.size(); i++) {
+            auto s = std::upper_bound(segments.begin(), segments.end(), xs[i],
+                    [](Scalar x, const PLASegment& seg) { return x < seg.x_start; }) - 1;
+            ASSERT_LE(xs[i], s->x_end);
+            EXPECT_TRUE(PiecewiseLinearModel::Covers(*s, 1, xs[i], ys[i])) << i;
+        }
+    }
+
+    TEST_F(PiecewiseLinearRewriterTest, TestParallelFitCoversEverything) {
+        std::default_random_engine gen(1);
+        std::uniform_int_distribution<Scalar> noise(-10, 10);
+        std::vector<Scalar> xs(1 << 18), ys(1 << 18);
+        for (size_t i = 0; i < xs.size(); i++) {
+            xs[i] = i / 2;
+            ys[i] = (Scalar)(sqrt(i) * 100) + noise(gen);
+        }
+        auto segments = PiecewiseLinearModel::ParallelFit(xs, ys, 10);
+        ASSERT_FALSE(segments.empty());
+        EXPECT_EQ(segments.front().x_start, xs.front());
+        EXPECT_EQ(segments.back().x_end, xs.back());
+        for (size_t s = 1; s < segments.size(); s++) {
+            EXPECT_GT(segments[s].x_start, segments[s-1].x_end);
+        }
+    }
+
+    TEST_F(PiecewiseLinearRewriterTest, TestRewriteNonLinear) {
+        // A curved relation with noise and a few planted outliers, in shuffled order.
+        std::default_random_engine gen(4);
+        std::uniform_int_distribution<Scalar> noise(-5, 5);
+        std::vector<Point<TESTD>> data(30000);
+        for (size_t i = 0; i < data.size(); i++) {
+            Scalar x = i;
+            data[i] = {x, x * x / 1000 + noise(gen)};
+            if (i % 1009 == 0) {
+                data[i][1] -= 10000000;
+            }
+        }
+        std::shuffle(data.begin(), data.end(), gen);
+
+        PiecewiseLinearRewriter<TESTD> rw(0, 1, 4);
+        rw.SetAuxiliaryIndex(std::make_unique<SecondaryBTreeIndex<TESTD>>(0));
+        rw.Init(data.cbegin(), data.cend());
+        EXPECT_GT(rw.Segments().size(), 1);
+        // The noise is within 5, so a tight bound wins.
+        EXPECT_LE(rw.ErrorBound(), 64);
+
+        std::uniform_int_distribution<Scalar> dist(-100, 30100);
+        for (size_t i = 0; i < 50; i++) {
+            Scalar a = dist(gen), b = dist(gen);
+            Query<TESTD> q = {};
+            q.filters[0] = {.present = true, .is_range = true,
+                .ranges = {{std::min(a, b), std::max(a, b)}}};
+            Query<TESTD> orig = q;
+            IndexList outliers = rw.Rewrite(q);
+            ASSERT_TRUE(q.filters[1].present);
+            ExpectCovers(data, orig, q, outliers);
+            // The planted outliers in range come back from the outlier index.
+            size_t planted = 0;
+            for (size_t r : outliers) {
+                planted += data[r][1] < -1000000;
+            }
+            size_t want = 0;
+            for (const auto& p : data) {
+                want += p[1] < -1000000 && p[0] >= std::min(a, b) && p[0] <= std::max(a, b);
+            }
+            EXPECT_EQ(planted, want);
+        }
+    }
+
+    TEST_F(PiecewiseLinearRewriterTest, TestExistingTargetFilter) {
+        std::vector<Point<TESTD>> data(5000);
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = {(Scalar)i, 2 * (Scalar)i + (Scalar)(i % 3)};
+        }
+        PiecewiseLinearRewriter<TESTD> rw(0, 1, 4);
+        rw.SetAuxiliaryIndex(std::make_unique<SecondaryBTreeIndex<TESTD>>(0));
+        rw.SetErrorBound(2);
+        rw.Init(data.cbegin(), data.cend());
+        EXPECT_EQ(rw.ErrorBound(), 2);
+        EXPECT_EQ(rw.Segments().size(), 1);
+
+        Query<TESTD> q = {};
+        q.filters[0] = {.present = true, .is_range = true, .ranges = {{1000, 2000}}};
+        q.filters[1] = {.present = true, .is_range = true, .ranges = {{2500, 3100}}};
+        Query<TESTD> orig = q;
+        IndexList outliers = rw.Rewrite(q);
+        EXPECT_TRUE(outliers.empty());
+        ASSERT_EQ(q.filters[1].ranges.size(), 1);
+        EXPECT_EQ(q.filters[1].ranges[0], ScalarRange(2500, 3100));
+        ExpectCovers(data, orig, q, outliers);
+
+        // Nothing to rewrite without a filter on the mapped column.
+        Query<TESTD> none = {};
+        EXPECT_TRUE(rw.Rewrite(none).empty());
+        EXPECT_FALSE(none.filters[1].present);
+    }
+}
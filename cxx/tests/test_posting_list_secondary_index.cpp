@@ -0,0 +1,221 @@
+#include "gtest/gtest.h"
+#include "posting_list_secondary_index.h"
+#include "secondary_btree_index.h"
+#include <random>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+namespace test {
+
+    const size_t TESTD = 2;
+    class PostingListSecondaryIndexTest : public ::testing::Test {
+        public:
+        vector<Point<TESTD>> ValuesToPoints(const std::vector<Scalar>& vals) {
+            vector<Point<TESTD>> pts;
+            for (Scalar s : vals) {
+                pts.push_back({s, 0});
+            }
+            return pts;
+        }
+
+        vector<Point<TESTD>> RandomPoints(size_t n, Scalar maxval) {
+            std::default_random_engine gen(1);
+            std::uniform_int_distribution<Scalar> dist(0, maxval);
+            vector<Point<TESTD>> pts(n);
+            for (size_t i = 0; i < n; i++) {
+                pts[i] = {dist(gen), 0};
+            }
+            return pts;
+        }
+
+        // Rows whose first column matches the filter, in increasing order.
+        std::vector<size_t> BruteForce(const vector<Point<TESTD>>& pts, const QueryFilter& filter) {
+            std::vector<size_t> want;
+            for (size_t i = 0; i < pts.size(); i++) {
+                bool match = false;
+                if (filter.is_range) {
+                    for (auto r : filter.ranges) {
+                        match |= pts[i][0] >= r.first && pts[i][0] <= r.second;
+                    }
+                } else {
+                    match = std::find(filter.values.begin(), filter.values.end(), pts[i][0])
+                        != filter.values.end();
+                }
+                if (match) {
+                    want.push_back(i);
+                }
+            }
+            return want;
+        }
+    };
+
+    TEST_F(PostingListSecondaryIndexTest, TestRangesWithoutFilter) {
+        auto pts = ValuesToPoints({10, 6, 6, 7, 8, 2, 3, 5, 1, 2, 9, 4});
+        PostingListSecondaryIndex<TESTD> index(0);
+        index.Init(pts.begin(), pts.end());
+        Query<TESTD> q;
+        q.filters[0] = {.present = false};
+        q.filters[1] = {.present = true, .is_range = false, .ranges = {}, .values = {1}};
+        MatchResult got = index.Matches(q);
+        EXPECT_TRUE(got.IsUniverse());
+        std::vector<size_t> want = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+        EXPECT_EQ(got.ToList(), want);
+    }
+
+    TEST_F(PostingListSecondaryIndexTest, TestValuesAreSorted) {
+        auto pts = ValuesToPoints({10, 6, 6, 7, 8, 2, 3, 5, 1, 2, 9, 4});
+        PostingListSecondaryIndex<TESTD> index(0);
+        index.Init(pts.begin(), pts.end());
+        Query<TESTD> q;
+        q.filters[1] = {.present = false};
+        q.filters[0] = {.present = true, .is_range = false, .ranges = {}, .values = {4, 2, 2, 11}};
+        MatchResult got = index.Matches(q);
+        std::vector<size_t> want = {5, 9, 11};
+        EXPECT_EQ(got.kind, MatchResult::SORTED_LIST);
+        EXPECT_EQ(got.ToList(), want);
+    }
+
+    TEST_F(PostingListSecondaryIndexTest, TestMatchesBruteForce) {
+        auto pts = RandomPoints(300000, 5000);
+        PostingListSecondaryIndex<TESTD> index(0);
+        index.Init(pts.begin(), pts.end());
+        // Covers a single list, heap merges of a few lists, and the sort and bitmap paths for
+        // many lists.
+        std::vector<QueryFilter> filters = {
+            {.present = true, .is_range = false, .ranges = {}, .values = {17}},
+            {.present = true, .is_range = false, .ranges = {}, .values = {3, 4000, 12, -1}},
+            {.present = true, .is_range = true, .ranges = {{100, 110}}},
+            {.present = true, .is_range = true, .ranges = {{100, 130}, {120, 140}}},
+            {.present = true, .is_range = true, .ranges = {{-50, 4000}}},
+            {.present = true, .is_range = true, .ranges = {{6000, 7000}}},
+        };
+        for (const auto& filter : filters) {
+            Query<TESTD> q;
+            q.filters[0] = filter;
+            q.filters[1] = {.present = false};
+            std::vector<size_t> got = index.Matches(q).ToList();
+            EXPECT_EQ(got, BruteForce(pts, filter));
+        }
+    }
+
+    TEST_F(PostingListSecondaryIndexTest, TestLargeGaps) {
+        // Rare values leave gaps of thousands of rows, which need wide bit-packing.
+        vector<Point<TESTD>> pts;
+        for (Scalar i = 0; i < 500000; i++) {
+            pts.push_back({i % 9973 == 0 ? 1 : (i % 50000 == 7 ? 2 : 0), 0});
+        }
+        PostingListSecondaryIndex<TESTD> index(0);
+        index.Init(pts.begin(), pts.end());
+        for (Scalar v : {0, 1, 2}) {
+            QueryFilter filter = {.present = true, .is_range = false, .ranges = {}, .values = {v}};
+            Query<TESTD> q;
+            q.filters[0] = filter;
+            q.filters[1] = {.present = false};
+            EXPECT_EQ(index.Matches(q).ToList(), BruteForce(pts, filter));
+        }
+    }
+
+    TEST_F(PostingListSecondaryIndexTest, TestIndexSubset) {
+        auto pts = RandomPoints(10000, 100);
+        std::vector<size_t> subset;
+        for (size_t i = 0; i < pts.size(); i += 3) {
+            subset.push_back(i);
+        }
+        std::reverse(subset.begin(), subset.end());
+        PostingListSecondaryIndex<TESTD> index(0);
+        index.SetIndexList(subset);
+        index.Init(pts.begin(), pts.end());
+        QueryFilter filter = {.present = true, .is_range = true, .ranges = {{10, 20}}};
+        Query<TESTD> q;
+        q.filters[0] = filter;
+        q.filters[1] = {.present = false};
+        std::vector<size_t> want;
+        for (size_t i : BruteForce(pts, filter)) {
+            if (i % 3 == 0) {
+                want.push_back(i);
+            }
+        }
+        EXPECT_EQ(index.Matches(q).ToList(), want);
+    }
+
+    TEST_F(PostingListSecondaryIndexTest, TestCompressedSize) {
+        auto pts = RandomPoints(1000000, 1000);
+        PostingListSecondaryIndex<TESTD> index(0);
+        index.Init(pts.begin(), pts.end());
+        SecondaryBTreeIndex<TESTD> btree(0);
+        btree.Init(pts.begin(), pts.end());
+        // Gaps average about 1000 rows, so they pack into well under a 32-bit row id each.
+        EXPECT_LT(index.Size(), btree.Size() / 4);
+    }
+
+    TEST_F(PostingListSecondaryIndexTest, TestUniqueKeySize) {
+        // Every key has a single row, so the rows sit inline in the key directory.
+        vector<Point<TESTD>> pts(1000000);
+        for (size_t i = 0; i < pts.size(); i++) {
+            pts[i] = {(Scalar)((i * 7919) % pts.size()), 0};
+        }
+        PostingListSecondaryIndex<TESTD> index(0);
+        index.Init(pts.begin(), pts.end());
+        SecondaryBTreeIndex<TESTD> btree(0);
+        btree.Init(pts.begin(), pts.end());
+        std::cout << "Unique keys: posting lists " << index.Size() << " B, b-tree arrays "
+            << btree.Size() << " B" << std::endl;
+        // Both store a key and a 32-bit row per row; only the end of the empty list stream is extra.
+        EXPECT_LE(index.Size(), btree.Size() + sizeof(uint64_t));
+        // Small lists share blocks instead of starting one each.
+        auto few = RandomPoints(1000000, 250000);
+        PostingListSecondaryIndex<TESTD> few_index(0);
+        few_index.Init(few.begin(), few.end());
+        SecondaryBTreeIndex<TESTD> few_btree(0);
+        few_btree.Init(few.begin(), few.end());
+        std::cout << "About 4 rows per key: posting lists " << few_index.Size()
+            << " B, b-tree arrays " << few_btree.Size() << " B" << std::endl;
+        EXPECT_LT(few_index.Size(), few_btree.Size());
+
+        std::vector<QueryFilter> filters = {
+            {.present = true, .is_range = false, .ranges = {}, .values = {17, 99999, 500000}},
+            {.present = true, .is_range = true, .ranges = {{1000, 1100}}},
+            {.present = true, .is_range = true, .ranges = {{0, 200000}}},
+        };
+        for (const auto& filter : filters) {
+            Query<TESTD> q;
+            q.filters[0] = filter;
+            q.filters[1] = {.present = false};
+            EXPECT_EQ(index.Matches(q).ToList(), BruteForce(pts, filter));
+            EXPECT_EQ(few_index.Matches(q).ToList(), BruteForce(few, filter));
+        }
+    }
+
+    TEST_F(PostingListSecondaryIndexTest, TestMixedSingletonsAndLists) {
+        // Single rows and lists of every length, so lists start anywhere within a block.
+        vector<Point<TESTD>> pts;
+        std::default_random_engine gen(3);
+        for (Scalar k = 0; k < 2000; k++) {
+            size_t n = k % 7 == 0 ? 1 : k % 301;
+            for (size_t t = 0; t < n; t++) {
+                pts.push_back({k, 0});
+            }
+        }
+        std::shuffle(pts.begin(), pts.end(), gen);
+        PostingListSecondaryIndex<TESTD> index(0);
+        index.Init(pts.begin(), pts.end());
+        std::uniform_int_distribution<Scalar> dist(-10, 2010);
+        for (size_t i = 0; i < 100; i++) {
+            QueryFilter filter = {.present = true, .is_range = false, .ranges = {}, .values = {}};
+            for (size_t v = 0; v < i % 20 + 1; v++) {
+                filter.values.push_back(dist(gen));
+            }
+            Query<TESTD> q;
+            q.filters[0] = filter;
+            q.filters[1] = {.present = false};
+            EXPECT_EQ(index.Matches(q).ToList(), BruteForce(pts, filter));
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,101 @@
+#include "gtest/gtest.h"
+#include "radix_sort.h"
+
+#include <random>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+namespace test {
+
+    class RadixSortTest : public ::testing::Test {
+        public:
+        // Checks the keys are sorted and that equal keys keep their original order.
+        void CheckSortedStable(const vector<uint64_t>& orig, const vector<uint64_t>& keys,
+                const vector<size_t>& payload) {
+            ASSERT_EQ(keys.size(), orig.size());
+            for (size_t i = 0; i < keys.size(); i++) {
+                ASSERT_EQ(keys[i], orig[payload[i]]);
+                if (i > 0) {
+                    ASSERT_LE(keys[i-1], keys[i]);
+                    if (keys[i-1] == keys[i]) {
+                        ASSERT_LT(payload[i-1], payload[i]);
+                    }
+                }
+            }
+        }
+
+        vector<size_t> Identity(size_t n) {
+            vector<size_t> ids(n);
+            for (size_t i = 0; i < n; i++) {
+                ids[i] = i;
+            }
+            return ids;
+        }
+    };
+
+    TEST_F(RadixSortTest, TestSortsFullWidthKeys) {
+        std::default_random_engine gen(1);
+        std::uniform_int_distribution<uint64_t> dist;
+        vector<uint64_t> keys(300000);
+        for (auto& k : keys) {
+            k = dist(gen);
+        }
+        auto orig = keys;
+        auto payload = Identity(keys.size());
+        RadixSort::Sort(keys, payload);
+        CheckSortedStable(orig, keys, payload);
+    }
+
+    TEST_F(RadixSortTest, TestStableWithDuplicates) {
+        std::default_random_engine gen(1);
+        std::uniform_int_distribution<uint64_t> dist(0, 100);
+        vector<uint64_t> keys(300000);
+        for (auto& k : keys) {
+            // Only a couple of the digits vary, so most passes are skipped.
+            k = (dist(gen) << 40) | 7;
+        }
+        auto orig = keys;
+        auto payload = Identity(keys.size());
+        RadixSort::Sort(keys, payload);
+        CheckSortedStable(orig, keys, payload);
+    }
+
+    TEST_F(RadixSortTest, TestSignedKeys) {
+        std::default_random_engine gen(1);
+        std::uniform_int_distribution<Scalar> dist(std::numeric_limits<Scalar>::lowest(),
+                std::numeric_limits<Scalar>::max());
+        vector<Scalar> keys(300000);
+        for (auto& k : keys) {
+            k = dist(gen);
+        }
+        keys[5] = std::numeric_limits<Scalar>::lowest();
+        keys[6] = -1;
+        keys[7] = 0;
+        auto orig = keys;
+        auto payload = Identity(keys.size());
+        RadixSort::Sort(keys, payload);
+        ASSERT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+        for (size_t i = 0; i < keys.size(); i++) {
+            ASSERT_EQ(keys[i], orig[payload[i]]);
+        }
+    }
+
+    TEST_F(RadixSortTest, TestSmallInputs) {
+        vector<uint64_t> keys = {5, 3, 5, 0, 1ULL << 63, 3};
+        auto orig = keys;
+        auto payload = Identity(keys.size());
+        RadixSort::Sort(keys, payload);
+        CheckSortedStable(orig, keys, payload);
+        vector<uint64_t> empty;
+        vector<size_t> empty_payload;
+        RadixSort::Sort(empty, empty_payload);
+        EXPECT_TRUE(empty.empty());
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
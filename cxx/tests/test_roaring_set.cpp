@@ -0,0 +1,165 @@
+#include "gtest/gtest.h"
+#include "roaring_set.h"
+
+#include <random>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+namespace test {
+
+    class RoaringSetTest : public ::testing::Test {
+        public:
+        // Sorted, distinct indexes below maxval, each present with probability p.
+        IndexList RandomList(size_t maxval, double p, int seed) {
+            std::default_random_engine gen(seed);
+            std::bernoulli_distribution dist(p);
+            IndexList list;
+            for (size_t i = 0; i < maxval; i++) {
+                if (dist(gen)) {
+                    list.push_back(i);
+                }
+            }
+            return list;
+        }
+
+        IndexList RangesToList(const IndexRangeList& ranges) {
+            IndexList list;
+            for (auto r : ranges) {
+                for (size_t i = r.start; i < r.end; i++) {
+                    list.push_back(i);
+                }
+            }
+            return list;
+        }
+
+        // A mix of sparse, dense and contiguous chunks, so every pair of container types meets.
+        std::vector<IndexList> MixedLists() {
+            IndexList sparse = RandomList(1 << 20, 0.01, 1);
+            IndexList dense = RandomList(1 << 20, 0.5, 2);
+            IndexList ranges = RangesToList({{10, 5000}, {70000, 200000}, {300001, 300002},
+                    {500000, 800000}, {1000000, 1048000}});
+            IndexList mixed;
+            for (size_t i : RandomList(1 << 18, 0.02, 3)) {
+                mixed.push_back(i);
+            }
+            for (size_t i : RandomList(1 << 19, 0.7, 4)) {
+                if (i >= (1 << 18)) {
+                    mixed.push_back(i);
+                }
+            }
+            return {sparse, dense, ranges, mixed, {}};
+        }
+
+        RoaringSet Build(const IndexList& list, bool as_ranges) {
+            if (!as_ranges) {
+                return RoaringSet::FromList(list);
+            }
+            IndexRangeList ranges;
+            for (size_t i : list) {
+                if (!ranges.empty() && ranges.back().end == i) {
+                    ranges.back().end++;
+                } else {
+                    ranges.emplace_back(i, i + 1);
+                }
+            }
+            return RoaringSet::FromRanges(ranges);
+        }
+    };
+
+    TEST_F(RoaringSetTest, TestListRoundTrip) {
+        for (const auto& list : MixedLists()) {
+            RoaringSet set = RoaringSet::FromList(list);
+            EXPECT_EQ(set.Cardinality(), list.size());
+            EXPECT_EQ(set.ToList(), list);
+            EXPECT_EQ(RangesToList(set.ToRanges()), list);
+        }
+    }
+
+    TEST_F(RoaringSetTest, TestUnsortedList) {
+        IndexList list = {70000, 3, 65536, 3, 9, 1 << 20};
+        RoaringSet set = RoaringSet::FromList(list);
+        IndexList want = {3, 9, 65536, 70000, 1 << 20};
+        EXPECT_EQ(set.ToList(), want);
+        EXPECT_TRUE(set.Contains(65536));
+        EXPECT_FALSE(set.Contains(65537));
+    }
+
+    TEST_F(RoaringSetTest, TestRangesAreRuns) {
+        IndexRangeList ranges = {{0, 10}, {10, 20}, {65530, 65600}, {1 << 20, (1 << 20) + 1}};
+        RoaringSet set = RoaringSet::FromRanges(ranges);
+        IndexRangeList want = {{0, 20}, {65530, 65600}, {1 << 20, (1 << 20) + 1}};
+        EXPECT_EQ(set.ToRanges(), want);
+        EXPECT_EQ(set.Cardinality(), 91);
+        EXPECT_TRUE(set.Contains(65535));
+        EXPECT_FALSE(set.Contains(20));
+        // Runs are much smaller than the rows they cover.
+        RoaringSet big = RoaringSet::FromRanges({{0, 1 << 24}});
+        EXPECT_LT(big.Size(), 1 << 15);
+    }
+
+    TEST_F(RoaringSetTest, TestIntersectAndUnion) {
+        auto lists = MixedLists();
+        for (size_t i = 0; i < lists.size(); i++) {
+            for (size_t j = 0; j < lists.size(); j++) {
+                IndexList want_and, want_or;
+                std::set_intersection(lists[i].begin(), lists[i].end(), lists[j].begin(),
+                        lists[j].end(), std::back_inserter(want_and));
+                std::set_union(lists[i].begin(), lists[i].end(), lists[j].begin(),
+                        lists[j].end(), std::back_inserter(want_or));
+                for (bool ranges_i : {false, true}) {
+                    for (bool ranges_j : {false, true}) {
+                        RoaringSet a = Build(lists[i], ranges_i);
+                        RoaringSet b = Build(lists[j], ranges_j);
+                        RoaringSet got_and = RoaringSet::Intersect(a, b);
+                        RoaringSet got_or = RoaringSet::Union(a, b);
+                        EXPECT_EQ(got_and.ToList(), want_and) << i << " & " << j;
+                        EXPECT_EQ(got_and.Cardinality(), want_and.size());
+                        EXPECT_EQ(got_or.ToList(), want_or) << i << " | " << j;
+                        EXPECT_EQ(got_or.Cardinality(), want_or.size());
+                    }
+                }
+            }
+        }
+    }
+
+    TEST_F(RoaringSetTest, TestFromIndexSet) {
+        PhysicalIndexSet pis;
+        pis.ranges = {{100, 200}, {70000, 70010}};
+        pis.list = {5, 150, 250, 70005};
+        RoaringSet set = RoaringSet::FromIndexSet(pis);
+        IndexRangeList want = {{5, 6}, {100, 200}, {250, 251}, {70000, 70010}};
+        EXPECT_EQ(set.ToRanges(), want);
+    }
+
+    TEST_F(RoaringSetTest, TestWordsAreMsbFirst) {
+        IndexList list = {0, 63, 64, 130, 65536 + 1};
+        RoaringSet set = RoaringSet::FromList(list);
+        std::vector<std::pair<PhysicalIndex, uint64_t>> words;
+        set.ForEachWord([&words](PhysicalIndex start, uint64_t word) {
+            words.emplace_back(start, word);
+        });
+        std::vector<std::pair<PhysicalIndex, uint64_t>> want = {
+            {0, (1ULL << 63) | 1ULL},
+            {64, 1ULL << 63},
+            {128, 1ULL << 61},
+            {65536, 1ULL << 62},
+        };
+        EXPECT_EQ(words, want);
+
+        // Runs spanning several words fill them completely.
+        RoaringSet run = RoaringSet::FromRanges({{60, 200}});
+        words.clear();
+        run.ForEachWord([&words](PhysicalIndex start, uint64_t word) {
+            words.emplace_back(start, word);
+        });
+        want = {{0, 0xFULL}, {64, ~0ULL}, {128, ~0ULL}, {192, 0xFFULL << 56}};
+        EXPECT_EQ(words, want);
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
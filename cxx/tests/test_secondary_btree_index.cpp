@@ -1,6 +1,8 @@
 #include "gtest/gtest.h"
 #include "secondary_btree_index.h"
 #include <vector>
+#include <algorithm>
+#include <type_traits>
 
 using namespace std;
 
@@ -27,6 +29,28 @@ namespace test {
             // No change to underlying data.
             EXPECT_EQ(pts[i][0], want[i][0]);
         }
+        EXPECT_TRUE(index.HasNarrowRowIds());
+    }
+
+    TEST_F(SecondaryBTreeIndexTest, TestRowIdWidth) {
+        RowIds ids;
+        ids.Reset((size_t)1 << 32);
+        EXPECT_TRUE(ids.IsNarrow());
+        ids.Visit([](auto& rows) { rows.push_back(((size_t)1 << 32) - 1); });
+        EXPECT_EQ(ids[0], ((size_t)1 << 32) - 1);
+        EXPECT_EQ(ids.Bytes(), sizeof(uint32_t));
+
+        ids.Reset(((size_t)1 << 32) + 1);
+        EXPECT_FALSE(ids.IsNarrow());
+        ids.Visit([](auto& rows) {
+            // Only the wide instantiation runs here, but both have to compile.
+            if constexpr (sizeof(typename std::decay_t<decltype(rows)>::value_type) == 8) {
+                rows.push_back((size_t)1 << 32);
+            }
+        });
+        EXPECT_EQ(ids.size(), 1);
+        EXPECT_EQ(ids[0], (size_t)1 << 32);
+        EXPECT_EQ(ids.Bytes(), sizeof(uint64_t));
     }
 
     TEST_F(SecondaryBTreeIndexTest, TestRangesWithoutFilter) {
@@ -36,7 +60,10 @@ namespace test {
         Query<TESTD> q;
         q.filters[0] = {.present = false};
         q.filters[1] = {.present = true, .is_range = false, .ranges = {}, .values = {1}};
-        std::vector<size_t> ranges = index.Matches(q);
+        MatchResult matches = index.Matches(q);
+        // Without a filter on the column, no list is materialized.
+        EXPECT_TRUE(matches.IsUniverse());
+        std::vector<size_t> ranges = matches.ToList();
         std::vector<size_t> want = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
         EXPECT_EQ(ranges.size(), want.size());
         for (size_t i = 0; i < want.size(); i++) {
@@ -51,7 +78,7 @@ namespace test {
         Query<TESTD> q;
         q.filters[1] = {.present = false};
         q.filters[0] = {.present = true, .is_range = false, .ranges = {}, .values = {2,4}};
-        std::vector<size_t> ranges = index.Matches(q);
+        std::vector<size_t> ranges = index.Matches(q).ToList();
         std::sort(ranges.begin(), ranges.end());
         std::vector<size_t> want = {5, 9, 11};
         EXPECT_EQ(ranges.size(), want.size());
@@ -59,6 +86,42 @@ namespace test {
             EXPECT_EQ(ranges[i], want[i]);
         }
     }
+
+    TEST_F(SecondaryBTreeIndexTest, TestBulkLoad) {
+        vector<Point<TESTD>> pts;
+        for (Scalar i = 0; i < 200000; i++) {
+            pts.push_back({(i * 7919) % 5003 - 2500, 0});
+        }
+        SecondaryBTreeIndex<TESTD> index(0);
+        index.Init(pts.begin(), pts.end());
+        EXPECT_EQ(index.NumUniqueKeys(), 5003);
+        Query<TESTD> q;
+        q.filters[1] = {.present = false};
+        q.filters[0] = {.present = true, .is_range = true, .ranges = {{-10, 3}, {2000, 2600}}};
+        std::vector<size_t> got = index.Matches(q).ToList();
+        std::sort(got.begin(), got.end());
+        std::vector<size_t> want;
+        for (size_t i = 0; i < pts.size(); i++) {
+            if ((pts[i][0] >= -10 && pts[i][0] <= 3) || pts[i][0] >= 2000) {
+                want.push_back(i);
+            }
+        }
+        EXPECT_EQ(got, want);
+    }
+
+    TEST_F(SecondaryBTreeIndexTest, TestIndexSubset) {
+        auto pts = ValuesToPoints({10, 6, 6, 7, 8, 2, 3, 5, 1, 2, 9, 4});
+        SecondaryBTreeIndex<TESTD> index(0);
+        index.SetIndexList({1, 5, 9, 11});
+        index.Init(pts.begin(), pts.end());
+        EXPECT_EQ(index.NumUniqueKeys(), 3);
+        Query<TESTD> q;
+        q.filters[1] = {.present = false};
+        q.filters[0] = {.present = true, .is_range = false, .ranges = {}, .values = {2, 6}};
+        std::vector<size_t> got = index.Matches(q).ToList();
+        std::sort(got.begin(), got.end());
+        EXPECT_EQ(got, std::vector<size_t>({1, 5, 9}));
+    }
 }
 
 int main(int argc, char **argv) {
@@ -188,4 +188,59 @@ namespace test {
         EXPECT_TRUE(QueryFiltersEqual(q.filters[1], want));
         EXPECT_TRUE(QueryFiltersEqual(q.filters[0], q.filters[0]));        
     }
+
+    TEST_F(SingleColumnRewriterTest, TestRewriteContinuousManyBuckets) {
+        // Random mapping with more buckets than a query usually covers, checked against unioning
+        // the buckets one at a time.
+        std::srand(7);
+        std::vector<std::pair<ScalarRange, std::vector<ScalarRange>>> spec;
+        for (Scalar b = 0; b < 300; b++) {
+            std::vector<ScalarRange> ranges;
+            Scalar start = std::rand() % 50;
+            for (int r = std::rand() % 4; r >= 0; r--) {
+                Scalar end = start + 1 + std::rand() % 20;
+                ranges.push_back({start, end});
+                start = end + 1 + std::rand() % 30;
+            }
+            spec.push_back({{b * 10, b * 10 + 10}, ranges});
+        }
+        SingleColumnRewriter<TESTD> rewriter(ContinuousFile(spec));
+
+        for (int i = 0; i < 200; i++) {
+            Scalar lo = std::rand() % 3100 - 50;
+            Scalar hi = lo + std::rand() % 1000;
+            std::vector<ScalarRange> want;
+            for (const auto& mapping : spec) {
+                // The buckets overlapping [lo, hi]. Queries below the first bucket still map through it.
+                if (mapping.first.second >= lo
+                        && (mapping.first.first < hi || &mapping == &spec.front())) {
+                    want = rewriter.UnionSortedRanges(want, mapping.second);
+                }
+            }
+            Query<TESTD> q = {};
+            q.filters[0] = {.present = true, .is_range = true, .ranges = {{lo, hi}}, .values = {}};
+            rewriter.Rewrite(q);
+            EXPECT_TRUE(ArrayEqual(q.filters[1].ranges, want));
+        }
+    }
+
+    TEST_F(SingleColumnRewriterTest, TestRewriteContinuousOutOfRange) {
+        std::vector<std::pair<ScalarRange, std::vector<ScalarRange>>> spec =
+            {{{0, 5}, {{0, 3}, {6, 10}}},
+             {{5, 10}, {{0, 5}, {7, 11}}}};
+
+        SingleColumnRewriter<TESTD> rewriter(ContinuousFile(spec));
+        Query<TESTD> q = {};
+        q.filters[0] = {.present = true, .is_range = true, .ranges = {{20, 30}}, .values = {}};
+        rewriter.Rewrite(q);
+        QueryFilter want = {.present = true, .is_range = true, .ranges = {}};
+        EXPECT_TRUE(QueryFiltersEqual(q.filters[1], want));
+
+        // Past the last bucket, the query still includes it.
+        q = {};
+        q.filters[0] = {.present = true, .is_range = true, .ranges = {{8, 30}}, .values = {}};
+        rewriter.Rewrite(q);
+        want = {.present = true, .is_range = true, .ranges = {{0, 5}, {7, 11}}};
+        EXPECT_TRUE(QueryFiltersEqual(q.filters[1], want));
+    }
 }
@@ -0,0 +1,62 @@
+#include "gtest/gtest.h"
+#include "stash_utils.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace test {
+
+    const size_t TESTD = 2;
+    class StashUtilsTest : public ::testing::Test {
+        public:
+        vector<Point<TESTD>> ValuesToPoints(const vector<Scalar>& vals) {
+            vector<Point<TESTD>> pts;
+            for (Scalar s : vals) {
+                pts.push_back({0, s});
+            }
+            return pts;
+        }
+    };
+
+    TEST_F(StashUtilsTest, TestEquiDepthBounds) {
+        vector<Scalar> vals;
+        for (Scalar v = 99; v >= 0; v--) {
+            vals.push_back(v);
+        }
+        auto pts = ValuesToPoints(vals);
+        auto bounds = StashUtils::EquiDepthBounds<TESTD>(pts.begin(), pts.end(), 1, 4);
+        EXPECT_EQ(bounds, vector<Scalar>({0, 25, 50, 75, 100}));
+    }
+
+    TEST_F(StashUtilsTest, TestEquiDepthBoundsSkipsRepeatedValues) {
+        vector<Scalar> vals(90, 0);
+        for (Scalar v = 1; v <= 10; v++) {
+            vals.push_back(v);
+        }
+        auto pts = ValuesToPoints(vals);
+        auto bounds = StashUtils::EquiDepthBounds<TESTD>(pts.begin(), pts.end(), 1, 4);
+        EXPECT_EQ(bounds, vector<Scalar>({0, 11}));
+    }
+
+    TEST_F(StashUtilsTest, TestStashTarget) {
+        // A single row in its own mapped bucket costs more to scan for than to stash.
+        vector<uint64_t> keys(100, 7);
+        keys[37] = 3;
+        auto result = StashUtils::StashTarget(keys.data(), keys.size(), 1.0);
+        EXPECT_EQ(result.keys, vector<uint64_t>({3, 7}));
+        EXPECT_EQ(result.inlier, vector<bool>({false, true}));
+        EXPECT_EQ(result.outliers, IndexList({37}));
+
+        vector<uint64_t> same(50, 2);
+        result = StashUtils::StashTarget(same.data(), same.size(), 1.0);
+        EXPECT_EQ(result.keys, vector<uint64_t>({2}));
+        EXPECT_EQ(result.inlier, vector<bool>({true}));
+        EXPECT_TRUE(result.outliers.empty());
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -1,5 +1,6 @@
 #include "gtest/gtest.h"
 #include "trs_node.h"
+#include "flat_trs_tree.h"
 
 #include <random>
 #include <chrono>
@@ -163,4 +164,144 @@ namespace test {
         EXPECT_TRUE(fabs(ranges[1].first - 44) < 1e-7);
         EXPECT_TRUE(fabs(ranges[1].second - 50) < 1e-7); 
     }
+
+    TEST_F(TRSNodeTest, TestParallelBuild) {
+        // Large enough that subtrees and outlier scans become tasks.
+        std::default_random_engine gen(5);
+        std::uniform_int_distribution<Scalar> noise(-20, 20);
+        size_t n = 1 << 20, nulls = 100;
+        std::vector<Scalar> xs(n), ys(n);
+        for (size_t i = 0; i < n; i++) {
+            xs[i] = i < nulls ? NINF - 1 : 1000000000LL + 2 * i;
+            ys[i] = (i % (n / 8)) * ((i / (n / 8)) % 2 ? 3 : -1) + noise(gen);
+            if (i % 997 == 0) {
+                ys[i] += 100000;
+            }
+        }
+        auto tn = TRSNode(2, 0.1, 8, 0, 3);
+        auto outliers = tn.Build(xs, ys, 0, n);
+        ASSERT_GT(tn.children.size(), 1);
+
+        // Outliers come out leaf by leaf, followed by the NULLs, and are exactly the points that
+        // fall outside their leaf's band.
+        std::vector<TRSNode*> leaves;
+        tn.CollectLeaves(&leaves);
+        std::vector<size_t> want;
+        size_t leaf = 0;
+        for (size_t i = nulls; i < n; i++) {
+            while (xs[i] > leaves[leaf]->bounds.second) {
+                leaf++;
+            }
+            ASSERT_GE(xs[i], leaves[leaf]->bounds.first);
+            if (leaves[leaf]->IsOutlier(xs[i], ys[i])) {
+                want.push_back(i);
+            }
+        }
+        for (size_t i = 0; i < nulls; i++) {
+            want.push_back(i);
+        }
+        EXPECT_EQ(outliers, want);
+        // Every planted outlier is caught.
+        for (size_t i = nulls; i < n; i += 997 * 100) {
+            EXPECT_TRUE(std::binary_search(want.begin(), want.end() - nulls, i));
+        }
+    }
+
+    TEST_F(TRSNodeTest, TestBuildInEnclosingParallelRegion) {
+        // Several trees built as tasks of one parallel region, as CompositeIndex builds its
+        // sub-indexes, come out the same as trees built on their own.
+        std::default_random_engine gen(7);
+        std::uniform_int_distribution<Scalar> noise(-20, 20);
+        size_t n = 1 << 19;
+        std::vector<Scalar> xs(n), ys(n);
+        for (size_t i = 0; i < n; i++) {
+            xs[i] = 3 * i;
+            ys[i] = (i % (n / 4)) * ((i / (n / 4)) % 2 ? 2 : -1) + noise(gen);
+            if (i % 1009 == 0) {
+                ys[i] += 100000;
+            }
+        }
+        auto want_tn = TRSNode(2, 0.1, 8, 0, 3);
+        auto want = want_tn.Build(xs, ys, 0, n);
+        std::vector<TRSNode*> want_leaves;
+        want_tn.CollectLeaves(&want_leaves);
+        ASSERT_GT(want_leaves.size(), 1);
+
+        const size_t ntrees = 3;
+        std::vector<std::unique_ptr<TRSNode>> trees;
+        for (size_t t = 0; t < ntrees; t++) {
+            trees.push_back(std::make_unique<TRSNode>(2, 0.1, 8, 0, 3));
+        }
+        std::vector<std::vector<size_t>> outliers(ntrees);
+        #pragma omp parallel
+        #pragma omp single
+        for (size_t t = 0; t < ntrees; t++) {
+            #pragma omp task firstprivate(t)
+            outliers[t] = trees[t]->Build(xs, ys, 0, n);
+        }
+        for (size_t t = 0; t < ntrees; t++) {
+            EXPECT_EQ(outliers[t], want);
+            std::vector<TRSNode*> leaves;
+            trees[t]->CollectLeaves(&leaves);
+            ASSERT_EQ(leaves.size(), want_leaves.size());
+            for (size_t i = 0; i < leaves.size(); i++) {
+                EXPECT_EQ(leaves[i]->bounds, want_leaves[i]->bounds);
+                EXPECT_DOUBLE_EQ(leaves[i]->slope, want_leaves[i]->slope);
+            }
+        }
+    }
+
+    TEST_F(TRSNodeTest, TestFlatLookupMatchesTree) {
+        // A noisy piecewise linear relation, so the tree splits over several levels.
+        std::default_random_engine gen(11);
+        std::uniform_int_distribution<Scalar> noise(-50, 50);
+        std::vector<Scalar> xs(20000), ys(20000);
+        for (size_t i = 0; i < xs.size(); i++) {
+            xs[i] = 3 * i;
+            ys[i] = (i % 5000) * (i < 10000 ? 2 : -3) + noise(gen);
+        }
+        auto tn = TRSNode(2, 0.1, 4, 0, 4);
+        tn.Build(xs, ys, 0, xs.size());
+        ASSERT_GT(tn.Nodes().second, 1);
+        FlatTRSTree flat(tn);
+        EXPECT_EQ(flat.NumLeaves(), tn.Nodes().second);
+
+        std::uniform_int_distribution<Scalar> dist(-1000, 61000);
+        std::vector<ScalarRange> want, got;
+        for (size_t i = 0; i < 500; i++) {
+            Scalar a = dist(gen), b = dist(gen);
+            ScalarRange q(std::min(a, b), std::max(a, b));
+            want.clear();
+            tn.Lookup(q, &want);
+            flat.Lookup(q, &got);
+            if (q.second < 0 || q.first > xs.back()) {
+                EXPECT_TRUE(got.empty());
+            } else {
+                EXPECT_EQ(got, want) << q.first << " - " << q.second;
+            }
+        }
+    }
+
+    TEST_F(TRSNodeTest, TestFlatLookupReusesBuffer) {
+        std::vector<Scalar> xs(50, 0);
+        std::iota(xs.begin(), xs.end(), 0);
+        std::vector<Scalar> ys;
+        for (size_t i = 0; i < 25; i++) {
+            ys.push_back(50 - xs[i]);
+        }
+        for (size_t i = 25; i < xs.size(); i++) {
+            ys.push_back(75 - xs[i]);
+        }
+        auto tn = TRSNode(2, 0.1, 2, 0, 1);
+        tn.Build(xs, ys, 0, xs.size());
+        FlatTRSTree flat(tn);
+
+        // The leaves' ranges come out in decreasing order and are sorted before coalescing.
+        std::vector<ScalarRange> ranges = {{-5, -1}, {-3, 0}, {7, 9}};
+        flat.Lookup({20, 30}, &ranges);
+        std::vector<ScalarRange> want = {{25, 31}, {44, 51}};
+        EXPECT_EQ(ranges, want);
+        flat.Lookup({100, 200}, &ranges);
+        EXPECT_TRUE(ranges.empty());
+    }
 };
@@ -0,0 +1,145 @@
+#include "gtest/gtest.h"
+#include "z_order_index.h"
+
+#include <random>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+namespace test {
+
+    const size_t TESTD = 3;
+    class ZOrderIndexTest : public ::testing::Test {
+        public:
+        vector<Point<TESTD>> RandomPoints(size_t n, Scalar maxval) {
+            std::default_random_engine gen(1);
+            std::uniform_int_distribution<Scalar> dist(0, maxval);
+            vector<Point<TESTD>> pts(n);
+            for (size_t i = 0; i < n; i++) {
+                pts[i] = {dist(gen), dist(gen), (Scalar)i};
+            }
+            return pts;
+        }
+
+        Query<TESTD> BoxQuery(ScalarRange r0, ScalarRange r1) {
+            Query<TESTD> q;
+            q.filters[0] = {.present = true, .is_range = true, .ranges = {r0}};
+            q.filters[1] = {.present = true, .is_range = true, .ranges = {r1}};
+            q.filters[2] = {.present = false};
+            return q;
+        }
+
+        // Checks that every point inside the query box is covered by one of the ranges.
+        bool CoversMatches(const vector<Point<TESTD>>& pts, const IndexRangeList& ranges,
+                ScalarRange r0, ScalarRange r1) {
+            std::vector<bool> covered(pts.size(), false);
+            for (auto r : ranges) {
+                for (size_t i = r.start; i < r.end; i++) {
+                    covered[i] = true;
+                }
+            }
+            for (size_t i = 0; i < pts.size(); i++) {
+                bool match = pts[i][0] >= r0.first && pts[i][0] <= r0.second
+                    && pts[i][1] >= r1.first && pts[i][1] <= r1.second;
+                if (match && !covered[i]) {
+                    std::cout << "Point " << i << " matches but is not covered" << std::endl;
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    TEST_F(ZOrderIndexTest, TestEncodeInterleaves) {
+        std::vector<size_t> dims = {0, 1};
+        ZOrderIndex<TESTD> index(dims, 10);
+        // The first dimension takes the more significant bit of each pair.
+        EXPECT_EQ(index.Encode({1, 0}), 2);
+        EXPECT_EQ(index.Encode({0, 1}), 1);
+        EXPECT_EQ(index.Encode({3, 0}), 10);
+        EXPECT_EQ(index.Encode({5, 6}), 0b110110);
+    }
+
+    TEST_F(ZOrderIndexTest, TestInitSortsByKey) {
+        auto pts = RandomPoints(200000, 1 << 20);
+        auto orig = pts;
+        std::vector<size_t> dims = {0, 1};
+        ZOrderIndex<TESTD> index(dims, 1000);
+        index.Init(pts.begin(), pts.end());
+        std::vector<Scalar> ids;
+        for (size_t i = 0; i < pts.size(); i++) {
+            // Points are unmodified, only reordered.
+            ASSERT_EQ(pts[i], orig[pts[i][2]]);
+            ids.push_back(pts[i][2]);
+        }
+        std::sort(ids.begin(), ids.end());
+        for (size_t i = 0; i < ids.size(); i++) {
+            ASSERT_EQ(ids[i], (Scalar)i);
+        }
+    }
+
+    TEST_F(ZOrderIndexTest, TestRangesCoverMatches) {
+        auto pts = RandomPoints(200000, 1 << 20);
+        std::vector<size_t> dims = {0, 1};
+        ZOrderIndex<TESTD> index(dims, 1000);
+        index.Init(pts.begin(), pts.end());
+        std::vector<std::pair<ScalarRange, ScalarRange>> boxes = {
+            {{0, 1 << 20}, {0, 1 << 20}},
+            {{1000, 50000}, {300000, 900000}},
+            {{524288, 524288}, {0, 1 << 19}},
+            {{-50, 100}, {777, 1 << 21}},
+        };
+        std::default_random_engine gen(2);
+        std::uniform_int_distribution<Scalar> dist(0, 1 << 20);
+        for (size_t i = 0; i < 20; i++) {
+            Scalar a = dist(gen), b = dist(gen), c = dist(gen), d = dist(gen);
+            boxes.push_back({{std::min(a, b), std::max(a, b)}, {std::min(c, d), std::max(c, d)}});
+        }
+        for (auto box : boxes) {
+            auto q = BoxQuery(box.first, box.second);
+            auto ranges = index.Ranges(q).ranges;
+            EXPECT_TRUE(CoversMatches(pts, ranges, box.first, box.second));
+            for (size_t i = 1; i < ranges.size(); i++) {
+                EXPECT_LT(ranges[i-1].end, ranges[i].start);
+            }
+        }
+    }
+
+    TEST_F(ZOrderIndexTest, TestRangesAreSelective) {
+        auto pts = RandomPoints(200000, 1 << 20);
+        std::vector<size_t> dims = {0, 1};
+        ZOrderIndex<TESTD> index(dims, 1000);
+        index.Init(pts.begin(), pts.end());
+        // A box covering about 1% of the space shouldn't scan much more than a few percent of rows.
+        auto q = BoxQuery({100000, 200000}, {600000, 700000});
+        auto ranges = index.Ranges(q).ranges;
+        size_t scanned = 0;
+        for (auto r : ranges) {
+            scanned += r.end - r.start;
+        }
+        EXPECT_LT(scanned, pts.size() / 20);
+        EXPECT_TRUE(CoversMatches(pts, ranges, {100000, 200000}, {600000, 700000}));
+    }
+
+    TEST_F(ZOrderIndexTest, TestEmptyQuery) {
+        auto pts = RandomPoints(10000, 1 << 20);
+        std::vector<size_t> dims = {0, 1};
+        ZOrderIndex<TESTD> index(dims, 100);
+        index.Init(pts.begin(), pts.end());
+        auto q = BoxQuery({1 << 21, 1 << 22}, {0, 10});
+        EXPECT_TRUE(index.Ranges(q).ranges.empty());
+        Query<TESTD> unfiltered;
+        unfiltered.filters[0] = {.present = false};
+        unfiltered.filters[1] = {.present = false};
+        unfiltered.filters[2] = {.present = true, .is_range = true, .ranges = {{0, 10}}};
+        auto ranges = index.Ranges(unfiltered).ranges;
+        ASSERT_EQ(ranges.size(), 1);
+        EXPECT_EQ(ranges[0], PhysicalIndexRange(0, pts.size()));
+    }
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}